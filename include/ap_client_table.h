@@ -0,0 +1,314 @@
+#ifndef AP_CLIENT_TABLE_H
+#define AP_CLIENT_TABLE_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_wifi.h>
+#include <tcpip_adapter.h>
+#include "common_structures.h"
+
+// Количество клиентов, которые помнит таблица (подключенные и недавно отключенные).
+// Драйвер ESP32 допускает не более 10 одновременных станций
+#define AP_CLIENT_TABLE_CAPACITY 16
+// Размер хеш-индекса по MAC (степень двойки, вдвое больше емкости)
+#define AP_CLIENT_INDEX_SIZE 32
+
+// Структура для хранения информации о клиенте AP
+struct APClient {
+  IPAddress ip;
+  uint8_t mac[6];
+  uint16_t aid;             // Association ID для esp_wifi_deauth_sta, 0 - неизвестен
+  bool connected;
+  bool blocked;
+  String lastPacket;
+  unsigned long lastSeen;
+  unsigned long connectedAt;
+};
+
+// Таблица клиентов точки доступа.
+//
+// Заполняется по событиям STACONNECTED/STADISCONNECTED/STAIPASSIGNED (задача
+// событий Arduino), а читается задачами интерфейса и сети и обработчиками
+// веб-сервера, поэтому
+// все операции выполняются под мьютексом, а наружу выдаются копии записей.
+// Записи не удаляются и не перемещаются: индекс клиента стабилен, пока его
+// слот не переиспользован под новый MAC (вытесняется самый давно отключенный),
+// а счетчики сохраняются между переподключениями.
+class APClientTable {
+private:
+  APClient clients[AP_CLIENT_TABLE_CAPACITY];
+  size_t count;
+  int8_t index[AP_CLIENT_INDEX_SIZE];  // Открытая адресация, -1 - пусто
+  SemaphoreHandle_t mutex;
+
+  static uint32_t hashKey(uint64_t key) {
+    // Младшие байты MAC у разных устройств различаются сильнее всего
+    uint32_t h = (uint32_t)key ^ (uint32_t)(key >> 24);
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h;
+  }
+
+  int findLocked(uint64_t key) const {
+    uint32_t pos = hashKey(key) & (AP_CLIENT_INDEX_SIZE - 1);
+    for (int probe = 0; probe < AP_CLIENT_INDEX_SIZE; probe++) {
+      int8_t slot = index[pos];
+      if (slot < 0) {
+        return -1;
+      }
+      if (macToKey(clients[slot].mac) == key) {
+        return slot;
+      }
+      pos = (pos + 1) & (AP_CLIENT_INDEX_SIZE - 1);
+    }
+    return -1;
+  }
+
+  void insertIndex(uint64_t key, int slot) {
+    uint32_t pos = hashKey(key) & (AP_CLIENT_INDEX_SIZE - 1);
+    while (index[pos] >= 0) {
+      pos = (pos + 1) & (AP_CLIENT_INDEX_SIZE - 1);
+    }
+    index[pos] = slot;
+  }
+
+  void rebuildIndex() {
+    memset(index, -1, sizeof(index));
+    for (size_t i = 0; i < count; i++) {
+      insertIndex(macToKey(clients[i].mac), i);
+    }
+  }
+
+  // Слот под новый MAC: свободный или самый давно отключенный
+  int allocateLocked() {
+    if (count < AP_CLIENT_TABLE_CAPACITY) {
+      return count++;
+    }
+
+    int oldest = -1;
+    for (size_t i = 0; i < count; i++) {
+      if (!clients[i].connected && (oldest < 0 || clients[i].lastSeen < clients[oldest].lastSeen)) {
+        oldest = i;
+      }
+    }
+    return oldest;
+  }
+
+  void lock() const { xSemaphoreTake(mutex, portMAX_DELAY); }
+  void unlock() const { xSemaphoreGive(mutex); }
+
+public:
+  APClientTable() : count(0) {
+    memset(index, -1, sizeof(index));
+    mutex = xSemaphoreCreateMutex();
+  }
+
+  // Подключение станции. Возвращает индекс клиента или -1, если таблица заполнена
+  int onConnected(const uint8_t* mac, uint16_t aid, bool blocked) {
+    uint64_t key = macToKey(mac);
+
+    lock();
+    int slot = findLocked(key);
+    if (slot < 0) {
+      slot = allocateLocked();
+      if (slot < 0) {
+        unlock();
+        return -1;
+      }
+
+      APClient& client = clients[slot];
+      client.ip = IPAddress((uint32_t)0);
+      memcpy(client.mac, mac, 6);
+      client.lastPacket = "";
+      rebuildIndex();
+    }
+
+    APClient& client = clients[slot];
+    client.aid = aid;
+    client.connected = true;
+    client.blocked = blocked;
+    client.connectedAt = millis();
+    client.lastSeen = client.connectedAt;
+    unlock();
+    return slot;
+  }
+
+  // Отключение станции (запись и счетчики сохраняются)
+  void onDisconnected(const uint8_t* mac) {
+    lock();
+    int slot = findLocked(macToKey(mac));
+    if (slot >= 0) {
+      clients[slot].connected = false;
+      clients[slot].lastSeen = millis();
+    }
+    unlock();
+  }
+
+  // Назначение IP станции DHCP-сервером
+  void setIP(const uint8_t* mac, const IPAddress& ip) {
+    lock();
+    int slot = findLocked(macToKey(mac));
+    if (slot >= 0) {
+      clients[slot].ip = ip;
+      clients[slot].lastSeen = millis();
+    }
+    unlock();
+  }
+
+  // Назначение IP по событию STAIPASSIGNED: в IDF 4.x событие не содержит MAC,
+  // поэтому соответствие берется из таблицы DHCP-сервера
+  void onIPAssigned(const IPAddress& ip) {
+    wifi_sta_list_t stationList;
+    tcpip_adapter_sta_list_t adapterList;
+    if (esp_wifi_ap_get_sta_list(&stationList) != ESP_OK ||
+        tcpip_adapter_get_sta_list(&stationList, &adapterList) != ESP_OK) {
+      return;
+    }
+
+    for (int i = 0; i < adapterList.num; i++) {
+      if (adapterList.sta[i].ip.addr == (uint32_t)ip) {
+        setIP(adapterList.sta[i].mac, ip);
+        return;
+      }
+    }
+  }
+
+  // Сверка с драйвером на случай пропущенных событий (например, станции,
+  // подключенные до регистрации обработчиков)
+  template <typename BlockedFn>
+  void sync(BlockedFn isBlocked) {
+    wifi_sta_list_t stationList;
+    tcpip_adapter_sta_list_t adapterList;
+    if (esp_wifi_ap_get_sta_list(&stationList) != ESP_OK) {
+      return;
+    }
+    bool haveIPs = tcpip_adapter_get_sta_list(&stationList, &adapterList) == ESP_OK;
+
+    lock();
+    for (size_t i = 0; i < count; i++) {
+      bool present = false;
+      for (int j = 0; j < stationList.num; j++) {
+        if (memcmp(stationList.sta[j].mac, clients[i].mac, 6) == 0) {
+          present = true;
+          break;
+        }
+      }
+      if (clients[i].connected && !present) {
+        clients[i].connected = false;
+        clients[i].lastSeen = millis();
+      }
+    }
+    unlock();
+
+    for (int j = 0; j < stationList.num; j++) {
+      const uint8_t* mac = stationList.sta[j].mac;
+      lock();
+      int slot = findLocked(macToKey(mac));
+      bool known = slot >= 0 && clients[slot].connected;
+      unlock();
+
+      // В списке станций AID нет - для новых спрашиваем драйвер отдельно
+      if (!known) {
+        onConnected(mac, stationAID(mac), isBlocked(mac));
+      }
+      if (haveIPs && j < adapterList.num && adapterList.sta[j].ip.addr != 0) {
+        setIP(adapterList.sta[j].mac, IPAddress(adapterList.sta[j].ip.addr));
+      }
+    }
+  }
+
+  // AID подключенной станции по MAC или 0, если драйвер ее не знает
+  static uint16_t stationAID(const uint8_t* mac) {
+    uint16_t aid = 0;
+    if (esp_wifi_ap_get_sta_aid(mac, &aid) != ESP_OK) {
+      return 0;
+    }
+    return aid;
+  }
+
+  // Поиск клиента по MAC (O(1))
+  int find(const uint8_t* mac) const {
+    lock();
+    int slot = findLocked(macToKey(mac));
+    unlock();
+    return slot;
+  }
+
+  // Поиск подключенного клиента по IP
+  int findByIP(const IPAddress& ip) const {
+    if ((uint32_t)ip == 0) {
+      return -1;
+    }
+
+    int found = -1;
+    lock();
+    for (size_t i = 0; i < count; i++) {
+      if (clients[i].connected && clients[i].ip == ip) {
+        found = i;
+        break;
+      }
+    }
+    unlock();
+    return found;
+  }
+
+  // Копия записи клиента
+  bool get(int slot, APClient& out) const {
+    if (slot < 0) {
+      return false;
+    }
+
+    lock();
+    bool valid = (size_t)slot < count;
+    if (valid) {
+      out = clients[slot];
+    }
+    unlock();
+    return valid;
+  }
+
+  void setBlocked(int slot, bool blocked) {
+    lock();
+    if (slot >= 0 && (size_t)slot < count) {
+      clients[slot].blocked = blocked;
+    }
+    unlock();
+  }
+
+  void setLastPacket(int slot, const String& text) {
+    lock();
+    if (slot >= 0 && (size_t)slot < count) {
+      clients[slot].lastPacket = text;
+    }
+    unlock();
+  }
+
+  // Количество записей (включая отключенных клиентов)
+  size_t size() const {
+    lock();
+    size_t n = count;
+    unlock();
+    return n;
+  }
+
+  size_t connectedCount() const {
+    size_t n = 0;
+    lock();
+    for (size_t i = 0; i < count; i++) {
+      if (clients[i].connected) n++;
+    }
+    unlock();
+    return n;
+  }
+
+  // Очистка таблицы (при выключении точки доступа)
+  void clear() {
+    lock();
+    count = 0;
+    memset(index, -1, sizeof(index));
+    unlock();
+  }
+};
+
+#endif // AP_CLIENT_TABLE_H
@@ -0,0 +1,121 @@
+#ifndef AP_NETIF_HOOK_H
+#define AP_NETIF_HOOK_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_netif.h>
+#include <lwip/netif.h>
+#include <lwip/pbuf.h>
+#include <lwip/tcpip.h>
+#include "blocklist.h"
+#include "repeater_path.h"
+#include "ap_traffic_meter.h"
+
+#define ETH_HEADER_LEN 14
+#define ETH_TYPE_IPV4 0x0800
+
+// Перехват входящих кадров интерфейса точки доступа.
+//
+// Драйвер WiFi передает кадры AP в lwIP через netif->input; обработчик
+// подменяет этот указатель и отбрасывает кадры с заблокированным MAC или
+// IPv4-адресом источника до разбора стеком. Так блокировка действует и на
+// трафик к самому устройству, и на пересылаемый через NAT. Тем же путем
+// (и через linkoutput в обратную сторону) идут учет трафика клиентов и
+// счетчики ретранслятора.
+class APNetifHook {
+private:
+  static netif_input_fn originalInput;
+  static netif_linkoutput_fn originalLinkOutput;
+  static struct netif* hookedNetif;
+  static const Blocklist* blocklist;
+  static std::atomic<uint32_t> droppedByMAC;
+  static std::atomic<uint32_t> droppedByIP;
+
+  static err_t filterInput(struct pbuf* p, struct netif* inp) {
+    if (blocklist && p && p->len >= ETH_HEADER_LEN) {
+      const uint8_t* frame = (const uint8_t*)p->payload;
+
+      // MAC источника - байты 6..11 заголовка Ethernet
+      if (blocklist->macCount() > 0 && blocklist->isMACBlocked(frame + 6)) {
+        droppedByMAC.fetch_add(1);
+        RepeaterPath::onDrop(frame + 6);
+        pbuf_free(p);
+        return ERR_OK;
+      }
+
+      // IP источника - смещение 12 в заголовке IPv4
+      uint16_t etherType = ((uint16_t)frame[12] << 8) | frame[13];
+      if (etherType == ETH_TYPE_IPV4 && blocklist->ipCount() > 0 &&
+          p->len >= ETH_HEADER_LEN + 20) {
+        uint32_t srcIP;
+        memcpy(&srcIP, frame + ETH_HEADER_LEN + 12, sizeof(srcIP));
+        if (blocklist->isIPBlocked(srcIP)) {
+          droppedByIP.fetch_add(1);
+          RepeaterPath::onDrop(frame + 6);
+          pbuf_free(p);
+          return ERR_OK;
+        }
+      }
+    }
+    if (p && p->len >= ETH_HEADER_LEN) {
+      APTrafficMeter::onReceive((const uint8_t*)p->payload, p->tot_len);
+      RepeaterPath::onInput((uint8_t*)p->payload, p->len);
+    }
+    return originalInput(p, inp);
+  }
+
+  static err_t filterOutput(struct netif* nif, struct pbuf* p) {
+    err_t result = originalLinkOutput(nif, p);
+    if (p->len >= ETH_HEADER_LEN) {
+      APTrafficMeter::onTransmit((const uint8_t*)p->payload, p->tot_len, result == ERR_OK);
+      RepeaterPath::onOutput((const uint8_t*)p->payload, p->len, result == ERR_OK);
+    }
+    return result;
+  }
+
+  // Замена указателя выполняется в задаче lwIP
+  static void installCallback(void* ctx) {
+    struct netif* nif = (struct netif*)ctx;
+    if (nif->input == filterInput) {
+      return;
+    }
+    originalInput = nif->input;
+    originalLinkOutput = nif->linkoutput;
+    hookedNetif = nif;
+    nif->input = filterInput;
+    nif->linkoutput = filterOutput;
+  }
+
+public:
+  // Установка фильтра на интерфейс AP (повторный вызов безопасен).
+  // Вызывать после запуска точки доступа: при перезапуске netif создается заново
+  static bool install(const Blocklist& list) {
+    blocklist = &list;
+
+    esp_netif_t* handle = esp_netif_get_handle_from_ifkey("WIFI_AP_DEF");
+    if (!handle) {
+      return false;
+    }
+    struct netif* nif = (struct netif*)esp_netif_get_netif_impl(handle);
+    if (!nif) {
+      return false;
+    }
+    return tcpip_callback(installCallback, nif) == ERR_OK;
+  }
+
+  static bool isInstalled() {
+    return hookedNetif != nullptr && hookedNetif->input == filterInput;
+  }
+
+  static uint32_t getDroppedByMAC() { return droppedByMAC.load(); }
+  static uint32_t getDroppedByIP() { return droppedByIP.load(); }
+};
+
+netif_input_fn APNetifHook::originalInput = nullptr;
+netif_linkoutput_fn APNetifHook::originalLinkOutput = nullptr;
+struct netif* APNetifHook::hookedNetif = nullptr;
+const Blocklist* APNetifHook::blocklist = nullptr;
+std::atomic<uint32_t> APNetifHook::droppedByMAC(0);
+std::atomic<uint32_t> APNetifHook::droppedByIP(0);
+
+#endif // AP_NETIF_HOOK_H
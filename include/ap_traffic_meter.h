@@ -0,0 +1,154 @@
+#ifndef AP_TRAFFIC_METER_H
+#define AP_TRAFFIC_METER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include "common_structures.h"
+
+// Станций, для которых ведется учет (подключенные и недавно отключенные)
+#define AP_TRAFFIC_SLOTS 16
+#define AP_TRAFFIC_RATE_ALPHA 0.3f   // Сглаживание скорости (1 - без сглаживания)
+
+// Трафик одной станции. rx - от станции к AP, tx - от AP к станции
+struct APTrafficSample {
+  uint32_t rxPackets;
+  uint32_t rxBytes;
+  uint32_t txPackets;
+  uint32_t txBytes;
+  uint32_t txErrors;       // Кадры, не принятые драйвером
+  float rxRate;            // Байт/с
+  float txRate;
+};
+
+// Постоянный учет трафика клиентов точки доступа.
+//
+// Кадры считаются на интерфейсе AP в lwIP (APNetifHook: input в задаче
+// драйвера WiFi, linkoutput в задаче lwIP), так что учет не требует
+// promiscuous-режима и охватывает всех клиентов сразу. На кадр - поиск по
+// MAC в маленькой таблице и пара сложений в критической секции.
+// Скорость пересчитывается раз в секунду сетевой задачей (tick()).
+class APTrafficMeter {
+private:
+  struct Slot {
+    uint64_t key;            // macToKey, 0 - пусто
+    APTrafficSample sample;
+    uint32_t lastRxBytes;    // На момент прошлого tick()
+    uint32_t lastTxBytes;
+    uint32_t lastActive;     // millis() последнего кадра
+  };
+
+  static Slot slots[AP_TRAFFIC_SLOTS];
+  static portMUX_TYPE mux;
+  static uint32_t lastTick;
+
+  // Слот станции; вызывать под mux. Новая станция вытесняет самую давнюю
+  static Slot* slotFor(uint64_t key) {
+    Slot* oldest = &slots[0];
+    for (auto& slot : slots) {
+      if (slot.key == key) {
+        return &slot;
+      }
+      if (slot.key == 0) {
+        oldest = &slot;
+        break;
+      }
+      if ((int32_t)(slot.lastActive - oldest->lastActive) < 0) {
+        oldest = &slot;
+      }
+    }
+    memset(oldest, 0, sizeof(*oldest));
+    oldest->key = key;
+    return oldest;
+  }
+
+public:
+  // Кадр от станции (MAC источника - байты 6..11)
+  static void onReceive(const uint8_t* frame, uint16_t len) {
+    if (len < 14) return;
+    uint64_t key = macToKey(frame + 6);
+    portENTER_CRITICAL(&mux);
+    Slot* slot = slotFor(key);
+    slot->sample.rxPackets++;
+    slot->sample.rxBytes += len;
+    slot->lastActive = millis();
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // Кадр станции (MAC назначения - байты 0..5), групповые не учитываются
+  static void onTransmit(const uint8_t* frame, uint16_t len, bool sent) {
+    if (len < 14 || (frame[0] & 0x01)) return;
+    uint64_t key = macToKey(frame);
+    portENTER_CRITICAL(&mux);
+    Slot* slot = slotFor(key);
+    if (sent) {
+      slot->sample.txPackets++;
+      slot->sample.txBytes += len;
+    } else {
+      slot->sample.txErrors++;
+    }
+    slot->lastActive = millis();
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // Пересчет скоростей (из сетевой задачи раз в секунду)
+  static void tick() {
+    uint32_t now = millis();
+    uint32_t elapsed = now - lastTick;
+    lastTick = now;
+    if (elapsed == 0) return;
+
+    portENTER_CRITICAL(&mux);
+    for (auto& slot : slots) {
+      if (slot.key == 0) continue;
+      float rx = (slot.sample.rxBytes - slot.lastRxBytes) * 1000.0f / elapsed;
+      float tx = (slot.sample.txBytes - slot.lastTxBytes) * 1000.0f / elapsed;
+      slot.sample.rxRate += AP_TRAFFIC_RATE_ALPHA * (rx - slot.sample.rxRate);
+      slot.sample.txRate += AP_TRAFFIC_RATE_ALPHA * (tx - slot.sample.txRate);
+      slot.lastRxBytes = slot.sample.rxBytes;
+      slot.lastTxBytes = slot.sample.txBytes;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // Снимок счетчиков станции. false - кадров от нее еще не было
+  static bool get(const uint8_t* mac, APTrafficSample& out) {
+    uint64_t key = macToKey(mac);
+    bool found = false;
+    portENTER_CRITICAL(&mux);
+    for (const auto& slot : slots) {
+      if (slot.key == key) {
+        out = slot.sample;
+        found = true;
+        break;
+      }
+    }
+    portEXIT_CRITICAL(&mux);
+    if (!found) {
+      memset(&out, 0, sizeof(out));
+    }
+    return found;
+  }
+
+  // Сумма по всем станциям в таблице
+  static void totals(APTrafficSample& out) {
+    memset(&out, 0, sizeof(out));
+    portENTER_CRITICAL(&mux);
+    for (const auto& slot : slots) {
+      if (slot.key == 0) continue;
+      out.rxPackets += slot.sample.rxPackets;
+      out.rxBytes += slot.sample.rxBytes;
+      out.txPackets += slot.sample.txPackets;
+      out.txBytes += slot.sample.txBytes;
+      out.txErrors += slot.sample.txErrors;
+      out.rxRate += slot.sample.rxRate;
+      out.txRate += slot.sample.txRate;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+};
+
+APTrafficMeter::Slot APTrafficMeter::slots[AP_TRAFFIC_SLOTS];
+portMUX_TYPE APTrafficMeter::mux = portMUX_INITIALIZER_UNLOCKED;
+uint32_t APTrafficMeter::lastTick = 0;
+
+#endif // AP_TRAFFIC_METER_H
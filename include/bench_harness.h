@@ -0,0 +1,88 @@
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+#include <Arduino.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <esp_timer.h>
+
+// Повторов на замер по умолчанию и прогревочных запусков перед ним
+#define BENCH_DEFAULT_ITERATIONS 200
+#define BENCH_WARMUP_ITERATIONS 5
+
+// Префикс строк с результатами в Serial (по нему их выбирает tools/bench_report.py)
+#define BENCH_LINE_PREFIX "BENCH "
+
+// Приемник сериализации, который только считает байты:
+// замеряется построение JSON, а не вывод в сеть
+class BenchNullPrint : public Print {
+public:
+  size_t bytes = 0;
+  size_t write(uint8_t) override { bytes++; return 1; }
+  size_t write(const uint8_t*, size_t size) override { bytes += size; return size; }
+};
+
+// Микробенчмарки на устройстве.
+//
+// Каждый замер выполняется iterations раз после прогрева; время каждого
+// запуска берется по esp_timer в микросекундах, в вывод идут минимум,
+// медиана, 95-й перцентиль, максимум и среднее. Одна строка JSON на замер:
+//   BENCH {"name":"sniffer_match","n":1,"iters":200,"min":3,...}
+// n - размер входа (станций, записей), чтобы сравнивать масштабирование.
+class BenchRunner {
+private:
+  std::vector<uint32_t> samples;
+  uint16_t count;
+
+public:
+  BenchRunner() : count(0) {}
+
+  // Заголовок прогона: по нему отчеты разных прошивок сопоставляются
+  void begin(const char* build) {
+    count = 0;
+    Serial.printf(BENCH_LINE_PREFIX "{\"event\":\"start\",\"build\":\"%s\",\"cpuMhz\":%u,"
+                  "\"sdk\":\"%s\",\"freeHeap\":%u}\n",
+                  build, (unsigned)getCpuFrequencyMhz(), ESP.getSdkVersion(),
+                  (unsigned)ESP.getFreeHeap());
+  }
+
+  // Замер fn. setup вызывается перед каждым запуском и в замер не входит
+  void run(const char* name, uint32_t n, std::function<void()> fn,
+           uint16_t iterations = BENCH_DEFAULT_ITERATIONS,
+           std::function<void()> setup = nullptr) {
+    for (uint16_t i = 0; i < BENCH_WARMUP_ITERATIONS; i++) {
+      if (setup) setup();
+      fn();
+    }
+
+    samples.assign(iterations, 0);
+    uint64_t total = 0;
+    for (uint16_t i = 0; i < iterations; i++) {
+      if (setup) setup();
+      int64_t start = esp_timer_get_time();
+      fn();
+      uint32_t us = esp_timer_get_time() - start;
+      samples[i] = us;
+      total += us;
+      // Длинные замеры не должны будить сторожевой таймер задачи
+      if ((i & 15) == 15) yield();
+    }
+
+    std::sort(samples.begin(), samples.end());
+    Serial.printf(BENCH_LINE_PREFIX "{\"name\":\"%s\",\"n\":%u,\"iters\":%u,\"min\":%u,\"p50\":%u,"
+                  "\"p95\":%u,\"max\":%u,\"mean\":%u,\"unit\":\"us\"}\n",
+                  name, (unsigned)n, (unsigned)iterations, (unsigned)samples.front(),
+                  (unsigned)samples[iterations / 2], (unsigned)samples[(iterations * 95) / 100],
+                  (unsigned)samples.back(), (unsigned)(total / iterations));
+    count++;
+  }
+
+  void end() {
+    Serial.printf(BENCH_LINE_PREFIX "{\"event\":\"done\",\"benchmarks\":%u,\"freeHeap\":%u,"
+                  "\"minFreeHeap\":%u}\n",
+                  (unsigned)count, (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMinFreeHeap());
+  }
+};
+
+#endif // BENCH_HARNESS_H
@@ -0,0 +1,434 @@
+#ifndef BLOCKLIST_H
+#define BLOCKLIST_H
+
+#include <Arduino.h>
+#include <vector>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include <rom/crc.h>
+#include "common_structures.h"
+
+#define BLOCKLIST_FILE "/blocklist.bin"
+#define BLOCKLIST_LEGACY_FILE "/blocked_macs.json"
+#define BLOCKLIST_MAGIC 0x314B4C42  // "BLK1"
+#define BLOCKLIST_VERSION 1
+#define BLOCKLIST_MAX_ENTRIES 4096
+
+// Множество целочисленных ключей с открытой адресацией (линейное пробирование).
+//
+// Ключ 0 означает пустой слот, а ~0 - удаленный; оба значения не могут быть
+// корректным MAC (00:00:... и широковещательный) или IP (0.0.0.0 и
+// 255.255.255.255). Поиск выполняется под спин-блокировкой и не выделяет
+// память, поэтому безопасен в задаче lwIP. Таблица перестраивается в новом
+// массиве вне спин-блокировки; изменения сериализуются отдельным мьютексом.
+template <typename Key>
+class HashSet {
+private:
+  static constexpr Key EMPTY = 0;
+  static constexpr Key DELETED = (Key)~(Key)0;
+
+  Key* slots;
+  size_t capacity;   // Степень двойки
+  size_t count;
+  size_t tombstones;
+  mutable portMUX_TYPE mux;
+  SemaphoreHandle_t writer;
+
+  static size_t hashKey(Key key) {
+    uint64_t h = (uint64_t)key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (size_t)h;
+  }
+
+  static bool insertInto(Key* table, size_t cap, Key key) {
+    size_t pos = hashKey(key) & (cap - 1);
+    for (size_t probe = 0; probe < cap; probe++) {
+      Key current = table[pos];
+      if (current == key) {
+        return false;
+      }
+      if (current == EMPTY || current == DELETED) {
+        table[pos] = key;
+        return true;
+      }
+      pos = (pos + 1) & (cap - 1);
+    }
+    return false;
+  }
+
+  // Позиция ключа или -1 (вызывать под блокировкой)
+  long locate(Key key) const {
+    if (!slots) return -1;
+    size_t pos = hashKey(key) & (capacity - 1);
+    for (size_t probe = 0; probe < capacity; probe++) {
+      Key current = slots[pos];
+      if (current == EMPTY) {
+        return -1;
+      }
+      if (current == key) {
+        return pos;
+      }
+      pos = (pos + 1) & (capacity - 1);
+    }
+    return -1;
+  }
+
+  // Перестройка с новой емкостью (под writer). Старую таблицу меняет
+  // только писатель, поэтому она читается без спин-блокировки; под ней -
+  // лишь подмена указателя
+  bool rehash(size_t newCapacity) {
+    Key* table = (Key*)calloc(newCapacity, sizeof(Key));
+    if (!table) {
+      return false;
+    }
+
+    for (size_t i = 0; i < capacity; i++) {
+      if (slots[i] != EMPTY && slots[i] != DELETED) {
+        insertInto(table, newCapacity, slots[i]);
+      }
+    }
+
+    portENTER_CRITICAL(&mux);
+    Key* old = slots;
+    slots = table;
+    capacity = newCapacity;
+    tombstones = 0;
+    portEXIT_CRITICAL(&mux);
+
+    free(old);
+    return true;
+  }
+
+public:
+  HashSet() : slots(nullptr), capacity(0), count(0), tombstones(0) {
+    portMUX_TYPE init = portMUX_INITIALIZER_UNLOCKED;
+    mux = init;
+    writer = xSemaphoreCreateMutex();
+  }
+
+  ~HashSet() {
+    free(slots);
+  }
+
+  static bool isValidKey(Key key) {
+    return key != EMPTY && key != DELETED;
+  }
+
+  // Добавление ключа. false - ключ уже есть, некорректен или нет памяти
+  bool insert(Key key) {
+    if (!isValidKey(key)) {
+      return false;
+    }
+
+    xSemaphoreTake(writer, portMAX_DELAY);
+    if (count >= BLOCKLIST_MAX_ENTRIES) {
+      xSemaphoreGive(writer);
+      return false;
+    }
+
+    // Заполненность (вместе с удаленными слотами) не выше 1/2
+    if (!slots || (count + tombstones + 1) * 2 > capacity) {
+      size_t newCapacity = capacity ? capacity : 16;
+      while ((count + 1) * 2 > newCapacity) {
+        newCapacity *= 2;
+      }
+      if (!rehash(newCapacity)) {
+        xSemaphoreGive(writer);
+        return false;
+      }
+    }
+
+    portENTER_CRITICAL(&mux);
+    bool added = locate(key) < 0;
+    if (added) {
+      // Переиспользуем удаленный слот, если он встретится раньше пустого
+      size_t pos = hashKey(key) & (capacity - 1);
+      while (slots[pos] != EMPTY && slots[pos] != DELETED) {
+        pos = (pos + 1) & (capacity - 1);
+      }
+      if (slots[pos] == DELETED) {
+        tombstones--;
+      }
+      slots[pos] = key;
+      count++;
+    }
+    portEXIT_CRITICAL(&mux);
+    xSemaphoreGive(writer);
+    return added;
+  }
+
+  // Удаление ключа
+  bool erase(Key key) {
+    if (!isValidKey(key)) {
+      return false;
+    }
+
+    xSemaphoreTake(writer, portMAX_DELAY);
+    portENTER_CRITICAL(&mux);
+    long pos = locate(key);
+    if (pos >= 0) {
+      slots[pos] = DELETED;
+      count--;
+      tombstones++;
+    }
+    portEXIT_CRITICAL(&mux);
+    xSemaphoreGive(writer);
+    return pos >= 0;
+  }
+
+  // Проверка наличия ключа (O(1), без выделения памяти)
+  bool contains(Key key) const {
+    if (count == 0 || !isValidKey(key)) {
+      return false;
+    }
+
+    portENTER_CRITICAL(&mux);
+    bool found = locate(key) >= 0;
+    portEXIT_CRITICAL(&mux);
+    return found;
+  }
+
+  // Копирование ключей (не более max). Возвращает количество скопированных
+  size_t copyTo(Key* out, size_t max) const {
+    size_t copied = 0;
+    portENTER_CRITICAL(&mux);
+    for (size_t i = 0; i < capacity && copied < max; i++) {
+      if (isValidKey(slots[i])) {
+        out[copied++] = slots[i];
+      }
+    }
+    portEXIT_CRITICAL(&mux);
+    return copied;
+  }
+
+  void clear() {
+    xSemaphoreTake(writer, portMAX_DELAY);
+    portENTER_CRITICAL(&mux);
+    if (slots) {
+      memset(slots, 0, capacity * sizeof(Key));
+    }
+    count = 0;
+    tombstones = 0;
+    portEXIT_CRITICAL(&mux);
+    xSemaphoreGive(writer);
+  }
+
+  size_t size() const {
+    return count;
+  }
+};
+
+// Заголовок бинарного файла списка блокировки.
+// За ним следуют macCount MAC по 6 байт, ipCount IPv4 по 4 байта
+// (в сетевом порядке) и CRC32 всех предшествующих байт
+struct __attribute__((packed)) BlocklistFileHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t reserved;
+  uint32_t macCount;
+  uint32_t ipCount;
+};
+
+// Списки блокировки MAC и IP
+class Blocklist {
+private:
+  HashSet<uint64_t> macs;
+  HashSet<uint32_t> ips;
+  SemaphoreHandle_t saveLock;
+
+  // Чтение одного файла. При ошибке списки остаются пустыми
+  bool readFile(const char* path) {
+    macs.clear();
+    ips.clear();
+
+    if (!LittleFS.exists(path)) {
+      return false;
+    }
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+      return false;
+    }
+
+    BlocklistFileHeader header;
+    if (file.read((uint8_t*)&header, sizeof(header)) != sizeof(header) ||
+        header.magic != BLOCKLIST_MAGIC || header.version != BLOCKLIST_VERSION ||
+        header.macCount > BLOCKLIST_MAX_ENTRIES || header.ipCount > BLOCKLIST_MAX_ENTRIES) {
+      file.close();
+      Serial.println("Blocklist: invalid file header");
+      return false;
+    }
+
+    uint32_t crc = crc32_le(0, (const uint8_t*)&header, sizeof(header));
+    bool ok = true;
+
+    for (uint32_t i = 0; ok && i < header.macCount; i++) {
+      uint8_t mac[6];
+      ok = file.read(mac, sizeof(mac)) == sizeof(mac);
+      if (ok) {
+        crc = crc32_le(crc, mac, sizeof(mac));
+        blockMAC(mac);
+      }
+    }
+    for (uint32_t i = 0; ok && i < header.ipCount; i++) {
+      uint32_t ip;
+      ok = file.read((uint8_t*)&ip, sizeof(ip)) == sizeof(ip);
+      if (ok) {
+        crc = crc32_le(crc, (const uint8_t*)&ip, sizeof(ip));
+        blockIP(ip);
+      }
+    }
+
+    uint32_t storedCrc = 0;
+    ok = ok && file.read((uint8_t*)&storedCrc, sizeof(storedCrc)) == sizeof(storedCrc);
+    file.close();
+
+    if (!ok || storedCrc != crc) {
+      Serial.println("Blocklist: file corrupted, ignoring");
+      macs.clear();
+      ips.clear();
+      return false;
+    }
+    return true;
+  }
+
+  // Запись списков во временный файл и подмена основного
+  bool writeFile() const {
+    std::vector<uint64_t> macList = getMACs();
+    std::vector<uint32_t> ipList = getIPs();
+
+    BlocklistFileHeader header;
+    header.magic = BLOCKLIST_MAGIC;
+    header.version = BLOCKLIST_VERSION;
+    header.reserved = 0;
+    header.macCount = macList.size();
+    header.ipCount = ipList.size();
+
+    File file = LittleFS.open(BLOCKLIST_FILE ".tmp", "w");
+    if (!file) {
+      Serial.println("Failed to open blocklist for writing");
+      return false;
+    }
+
+    uint32_t crc = crc32_le(0, (const uint8_t*)&header, sizeof(header));
+    bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+
+    for (uint64_t key : macList) {
+      uint8_t mac[6];
+      keyToMAC(key, mac);
+      crc = crc32_le(crc, mac, sizeof(mac));
+      ok = ok && file.write(mac, sizeof(mac)) == sizeof(mac);
+    }
+    for (uint32_t ip : ipList) {
+      crc = crc32_le(crc, (const uint8_t*)&ip, sizeof(ip));
+      ok = ok && file.write((const uint8_t*)&ip, sizeof(ip)) == sizeof(ip);
+    }
+    ok = ok && file.write((const uint8_t*)&crc, sizeof(crc)) == sizeof(crc);
+    file.close();
+
+    if (!ok) {
+      LittleFS.remove(BLOCKLIST_FILE ".tmp");
+      return false;
+    }
+
+    // rename в LittleFS атомарно заменяет существующий файл
+    if (!LittleFS.rename(BLOCKLIST_FILE ".tmp", BLOCKLIST_FILE)) {
+      LittleFS.remove(BLOCKLIST_FILE ".tmp");
+      return false;
+    }
+    return true;
+  }
+
+  // Миграция со старого формата /blocked_macs.json
+  bool loadLegacy() {
+    if (!LittleFS.exists(BLOCKLIST_LEGACY_FILE)) {
+      return false;
+    }
+
+    File file = LittleFS.open(BLOCKLIST_LEGACY_FILE, "r");
+    if (!file) {
+      return false;
+    }
+
+    DynamicJsonDocument doc(2048);
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+    if (error) {
+      return false;
+    }
+
+    JsonArray blockedArray = doc["blocked"];
+    for (JsonVariant v : blockedArray) {
+      uint8_t mac[6];
+      if (parseMAC(v.as<String>(), mac)) {
+        blockMAC(mac);
+      }
+    }
+
+    Serial.printf("Blocklist: migrated %u MACs from JSON\n", (unsigned)macs.size());
+    if (save()) {
+      LittleFS.remove(BLOCKLIST_LEGACY_FILE);
+    }
+    return true;
+  }
+
+public:
+  Blocklist() {
+    saveLock = xSemaphoreCreateMutex();
+  }
+
+  bool blockMAC(const uint8_t* mac) { return macs.insert(macToKey(mac)); }
+  bool unblockMAC(const uint8_t* mac) { return macs.erase(macToKey(mac)); }
+  bool isMACBlocked(const uint8_t* mac) const { return macs.contains(macToKey(mac)); }
+
+  // IP - в сетевом порядке байт, как в IPAddress и ip4_addr_t
+  bool blockIP(uint32_t ip) { return ips.insert(ip); }
+  bool unblockIP(uint32_t ip) { return ips.erase(ip); }
+  bool isIPBlocked(uint32_t ip) const { return ips.contains(ip); }
+
+  size_t macCount() const { return macs.size(); }
+  size_t ipCount() const { return ips.size(); }
+
+  // Копии списков для выдачи через API
+  std::vector<uint64_t> getMACs() const {
+    std::vector<uint64_t> out(macs.size());
+    out.resize(macs.copyTo(out.data(), out.size()));
+    return out;
+  }
+
+  std::vector<uint32_t> getIPs() const {
+    std::vector<uint32_t> out(ips.size());
+    out.resize(ips.copyTo(out.data(), out.size()));
+    return out;
+  }
+
+  // Сохранение в бинарный файл через временный файл и переименование.
+  // Сохраняют и веб-обработчики, и задача интерфейса: общий временный файл
+  // пишется под мьютексом, снимок списков берется внутри него
+  bool save() const {
+    xSemaphoreTake(saveLock, portMAX_DELAY);
+    bool ok = writeFile();
+    xSemaphoreGive(saveLock);
+    return ok;
+  }
+
+  // Загрузка бинарного файла (или миграция из JSON)
+  bool load() {
+    if (readFile(BLOCKLIST_FILE)) {
+      return true;
+    }
+    // Питание пропало между записью нового файла и подменой
+    if (readFile(BLOCKLIST_FILE ".tmp")) {
+      Serial.println("Blocklist: recovered from pending save");
+      LittleFS.rename(BLOCKLIST_FILE ".tmp", BLOCKLIST_FILE);
+      return true;
+    }
+    if (!LittleFS.exists(BLOCKLIST_FILE)) {
+      return loadLegacy();
+    }
+    return false;
+  }
+};
+
+#endif // BLOCKLIST_H
@@ -0,0 +1,46 @@
+#ifndef BOOT_PROFILE_H
+#define BOOT_PROFILE_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#define BOOT_PROFILE_MAX_PHASES 12
+
+// Отметки фаз загрузки: время от старта, чтобы сравнивать
+// время до готовности между версиями прошивки
+class BootProfile {
+public:
+  struct Phase {
+    const char* name;     // Строковый литерал
+    uint32_t atMs;        // От запуска esp_timer (включения питания)
+  };
+
+private:
+  Phase phases[BOOT_PROFILE_MAX_PHASES];
+  uint8_t count;
+  uint32_t usableMs;
+
+public:
+  BootProfile() : count(0), usableMs(0) {}
+
+  void mark(const char* name) {
+    uint32_t at = esp_timer_get_time() / 1000;
+    if (count < BOOT_PROFILE_MAX_PHASES) {
+      phases[count++] = {name, at};
+    }
+    Serial.printf("Boot: %s at %u ms\n", name, (unsigned)at);
+  }
+
+  // Меню на экране и кнопки отвечают
+  void markUsable() {
+    usableMs = esp_timer_get_time() / 1000;
+    mark("usable");
+  }
+
+  uint8_t size() const { return count; }
+  const Phase& at(uint8_t i) const { return phases[i]; }
+  uint32_t getUsableMs() const { return usableMs; }
+  uint32_t getTotalMs() const { return count > 0 ? phases[count - 1].atMs : 0; }
+};
+
+#endif // BOOT_PROFILE_H
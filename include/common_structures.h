@@ -46,6 +46,9 @@ struct APConfig {
   String password;
   bool hidden;
   int channel;
+  uint16_t naptEntries;     // Записей NAPT ретранслятора (применяется после перезагрузки)
+  uint16_t mssClamp;        // MSS пересылаемых SYN, 0 - без изменений
+  uint8_t maxClients;       // Клиентов AP ретранслятора
 };
 
 // Структура для пинов
@@ -71,6 +74,48 @@ struct WiFiResult {
   int32_t channel;
 };
 
+// Форматирование MAC-адреса в виде AA:BB:CC:DD:EE:FF (буфер не менее 18 байт)
+inline void formatMAC(const uint8_t* mac, char* out) {
+  sprintf(out, "%02X:%02X:%02X:%02X:%02X:%02X",
+          mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+// Форматирование IPv4-адреса без выделения памяти (буфер не менее 16 байт)
+inline void formatIP(const IPAddress& ip, char* out) {
+  sprintf(out, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+}
+
+// 48-битный MAC-адрес в виде целого числа (ключ таблиц и списков блокировки)
+inline uint64_t macToKey(const uint8_t* mac) {
+  return ((uint64_t)mac[0] << 40) | ((uint64_t)mac[1] << 32) | ((uint64_t)mac[2] << 24) |
+         ((uint64_t)mac[3] << 16) | ((uint64_t)mac[4] << 8) | (uint64_t)mac[5];
+}
+
+inline void keyToMAC(uint64_t key, uint8_t* mac) {
+  for (int i = 5; i >= 0; i--) {
+    mac[i] = key & 0xFF;
+    key >>= 8;
+  }
+}
+
+// Разбор MAC-адреса вида AA:BB:CC:DD:EE:FF (допускается и '-')
+inline bool parseMAC(const String& text, uint8_t* mac) {
+  unsigned int bytes[6];
+  char sep[5];
+  if (sscanf(text.c_str(), "%2x%c%2x%c%2x%c%2x%c%2x%c%2x",
+             &bytes[0], &sep[0], &bytes[1], &sep[1], &bytes[2], &sep[2],
+             &bytes[3], &sep[3], &bytes[4], &sep[4], &bytes[5]) != 11) {
+    return false;
+  }
+  for (int i = 0; i < 5; i++) {
+    if (sep[i] != ':' && sep[i] != '-') return false;
+  }
+  for (int i = 0; i < 6; i++) {
+    mac[i] = bytes[i];
+  }
+  return true;
+}
+
 // Глобальные переменные
 extern DeviceSettings globalDeviceSettings;
 
@@ -39,15 +39,15 @@
 // ======== НАСТРОЙКИ HONEYPOT ========
 
 // Максимальное количество соединений в логе Honeypot
-#define MAX_HONEYPOT_CONNECTIONS 10
+#define MAX_HONEYPOT_CONNECTIONS 32
 
 // ======== НАСТРОЙКИ IR-КОНТРОЛЛЕРА ========
 
 // Пин для ИК-передатчика
-#define IR_TX_PIN 9
+#define IR_TX_PIN 19
 
 // Максимальное количество сохраненных ИК-команд
-#define MAX_IR_COMMANDS 20
+#define MAX_IR_COMMANDS 128
 
 // ======== НАСТРОЙКИ ОТЛАДКИ ========
 
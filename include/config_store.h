@@ -0,0 +1,370 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <Arduino.h>
+#include <vector>
+#include <functional>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include <rom/crc.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#define CONFIG_STORE_FILE "/config.bin"
+#define CONFIG_STORE_MAGIC 0x31474643  // "CFG1"
+#define CONFIG_STORE_VERSION 1
+#define CONFIG_STORE_MAX_RECORDS 32
+#define CONFIG_STORE_MAX_RECORD 16384
+#define CONFIG_STORE_MAX_KEY 15
+#define CONFIG_COMMIT_DELAY_MS 500     // Окно объединения записей
+
+// Сериализация полей записи в байты (little-endian, как в памяти ESP32)
+class ConfigWriter {
+private:
+  std::vector<uint8_t> data;
+
+public:
+  void putU8(uint8_t v) { data.push_back(v); }
+  void putBool(bool v) { data.push_back(v ? 1 : 0); }
+  void putU16(uint16_t v) { putRaw(&v, sizeof(v)); }
+  void putU32(uint32_t v) { putRaw(&v, sizeof(v)); }
+  void putI32(int32_t v) { putRaw(&v, sizeof(v)); }
+  void putString(const String& s) {
+    uint16_t len = min(s.length(), (unsigned int)UINT16_MAX);
+    putU16(len);
+    putRaw(s.c_str(), len);
+  }
+  void putRaw(const void* p, size_t len) {
+    const uint8_t* b = (const uint8_t*)p;
+    data.insert(data.end(), b, b + len);
+  }
+  const std::vector<uint8_t>& bytes() const { return data; }
+};
+
+// Чтение полей записи. При выходе за границы ok() становится false,
+// а все последующие чтения возвращают нули
+class ConfigReader {
+private:
+  const uint8_t* data;
+  size_t len;
+  size_t pos;
+  bool valid;
+
+  bool take(void* out, size_t n) {
+    if (!valid || pos + n > len) {
+      valid = false;
+      memset(out, 0, n);
+      return false;
+    }
+    memcpy(out, data + pos, n);
+    pos += n;
+    return true;
+  }
+
+public:
+  ConfigReader(const std::vector<uint8_t>& bytes)
+    : data(bytes.data()), len(bytes.size()), pos(0), valid(true) {}
+
+  uint8_t getU8() { uint8_t v; take(&v, sizeof(v)); return v; }
+  bool getBool() { return getU8() != 0; }
+  uint16_t getU16() { uint16_t v; take(&v, sizeof(v)); return v; }
+  uint32_t getU32() { uint32_t v; take(&v, sizeof(v)); return v; }
+  int32_t getI32() { int32_t v; take(&v, sizeof(v)); return v; }
+  String getString() {
+    uint16_t n = getU16();
+    if (!valid || pos + n > len) {
+      valid = false;
+      return String();
+    }
+    String s;
+    s.reserve(n);
+    for (uint16_t i = 0; i < n; i++) {
+      s += (char)data[pos + i];
+    }
+    pos += n;
+    return s;
+  }
+  bool ok() const { return valid; }
+};
+
+// Единое хранилище настроек во флеше.
+//
+// Настройки модулей - типизированные записи с ключом и версией схемы,
+// которые модули сами сериализуют через ConfigWriter. Все записи лежат в
+// одном бинарном файле с CRC32; сохранение пишет новый файл рядом и
+// атомарно подменяет им старый, так что при потере питания остается либо
+// прежняя, либо новая версия целиком. put() лишь помечает хранилище
+// измененным: серия изменений за CONFIG_COMMIT_DELAY_MS сохраняется одной
+// записью во флеш, а неизменившиеся записи флеш не трогают вовсе.
+class ConfigStore {
+private:
+  struct Record {
+    char key[CONFIG_STORE_MAX_KEY + 1];
+    uint16_t version;
+    std::vector<uint8_t> data;
+  };
+
+  struct FileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+  };
+
+  std::vector<Record> records;
+  SemaphoreHandle_t lock;
+  std::function<void()> onDirty;
+  bool dirty;
+  uint32_t commits;
+  uint32_t coalesced;      // Изменений, попавших в уже ожидающее сохранение
+  uint32_t lastCommitUs;
+
+  Record* find(const char* key) {
+    for (auto& record : records) {
+      if (strcmp(record.key, key) == 0) {
+        return &record;
+      }
+    }
+    return nullptr;
+  }
+
+  bool readFile(const char* path) {
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+      return false;
+    }
+
+    FileHeader header;
+    bool ok = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              header.magic == CONFIG_STORE_MAGIC && header.version == CONFIG_STORE_VERSION &&
+              header.count <= CONFIG_STORE_MAX_RECORDS;
+    uint32_t crc = crc32_le(0, (const uint8_t*)&header, sizeof(header));
+
+    std::vector<Record> loaded;
+    for (uint16_t i = 0; ok && i < header.count; i++) {
+      Record record;
+      uint8_t keyLen = 0;
+      uint32_t size = 0;
+      ok = file.read(&keyLen, 1) == 1 && keyLen <= CONFIG_STORE_MAX_KEY &&
+           file.read((uint8_t*)record.key, keyLen) == keyLen &&
+           file.read((uint8_t*)&record.version, sizeof(record.version)) == sizeof(record.version) &&
+           file.read((uint8_t*)&size, sizeof(size)) == sizeof(size) &&
+           size <= CONFIG_STORE_MAX_RECORD;
+      if (!ok) break;
+      record.key[keyLen] = '\0';
+      record.data.resize(size);
+      ok = file.read(record.data.data(), size) == size;
+      if (!ok) break;
+
+      crc = crc32_le(crc, &keyLen, 1);
+      crc = crc32_le(crc, (const uint8_t*)record.key, keyLen);
+      crc = crc32_le(crc, (const uint8_t*)&record.version, sizeof(record.version));
+      crc = crc32_le(crc, (const uint8_t*)&size, sizeof(size));
+      crc = crc32_le(crc, record.data.data(), size);
+      loaded.push_back(std::move(record));
+    }
+
+    uint32_t stored = 0;
+    ok = ok && file.read((uint8_t*)&stored, sizeof(stored)) == sizeof(stored) && stored == crc;
+    file.close();
+
+    if (ok) {
+      records = std::move(loaded);
+    }
+    return ok;
+  }
+
+public:
+  ConfigStore() : lock(nullptr), dirty(false), commits(0), coalesced(0), lastCommitUs(0) {}
+
+  // Загрузка. Вызывать после LittleFS.begin()
+  bool begin() {
+    lock = xSemaphoreCreateMutex();
+
+    if (readFile(CONFIG_STORE_FILE)) {
+      Serial.printf("Config store: %u records\n", (unsigned)records.size());
+      return true;
+    }
+    // Питание пропало между записью нового файла и подменой
+    if (readFile(CONFIG_STORE_FILE ".tmp")) {
+      Serial.println("Config store: recovered from pending commit");
+      LittleFS.rename(CONFIG_STORE_FILE ".tmp", CONFIG_STORE_FILE);
+      return true;
+    }
+    if (LittleFS.exists(CONFIG_STORE_FILE)) {
+      Serial.println("Config store: file is corrupted, starting empty");
+    }
+    records.clear();
+    return false;
+  }
+
+  // Колбэк при первом изменении после сохранения - для отложенного commit()
+  void setCommitHook(std::function<void()> hook) {
+    onDirty = hook;
+  }
+
+  bool has(const char* key) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool found = find(key) != nullptr;
+    xSemaphoreGive(lock);
+    return found;
+  }
+
+  // Чтение записи. false - нет записи или другая версия схемы
+  bool get(const char* key, uint16_t version, std::vector<uint8_t>& out) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Record* record = find(key);
+    bool ok = record && record->version == version;
+    if (ok) {
+      out = record->data;
+    }
+    xSemaphoreGive(lock);
+    return ok;
+  }
+
+  // Запись (в памяти). Во флеш попадет при ближайшем commit()
+  void put(const char* key, uint16_t version, const std::vector<uint8_t>& data) {
+    if (strlen(key) > CONFIG_STORE_MAX_KEY || data.size() > CONFIG_STORE_MAX_RECORD) {
+      Serial.printf("Config store: record %s rejected\n", key);
+      return;
+    }
+
+    bool notify = false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Record* record = find(key);
+    if (record && record->version == version && record->data == data) {
+      xSemaphoreGive(lock);
+      return;
+    }
+    if (!record) {
+      if (records.size() >= CONFIG_STORE_MAX_RECORDS) {
+        xSemaphoreGive(lock);
+        Serial.printf("Config store: no room for %s\n", key);
+        return;
+      }
+      records.emplace_back();
+      record = &records.back();
+      strlcpy(record->key, key, sizeof(record->key));
+    }
+    record->version = version;
+    record->data = data;
+    if (dirty) {
+      coalesced++;
+    } else {
+      dirty = true;
+      notify = true;
+    }
+    xSemaphoreGive(lock);
+
+    if (notify && onDirty) {
+      onDirty();
+    }
+  }
+
+  void remove(const char* key) {
+    bool notify = false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (auto it = records.begin(); it != records.end(); ++it) {
+      if (strcmp(it->key, key) == 0) {
+        records.erase(it);
+        notify = !dirty;
+        dirty = true;
+        break;
+      }
+    }
+    xSemaphoreGive(lock);
+
+    if (notify && onDirty) {
+      onDirty();
+    }
+  }
+
+  // Сохранение во флеш, если есть изменения
+  bool commit() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (!dirty) {
+      xSemaphoreGive(lock);
+      return true;
+    }
+
+    uint32_t started = micros();
+    File file = LittleFS.open(CONFIG_STORE_FILE ".tmp", "w");
+    if (!file) {
+      xSemaphoreGive(lock);
+      Serial.println("Config store: failed to open file for writing");
+      return false;
+    }
+
+    FileHeader header;
+    header.magic = CONFIG_STORE_MAGIC;
+    header.version = CONFIG_STORE_VERSION;
+    header.count = records.size();
+    uint32_t crc = crc32_le(0, (const uint8_t*)&header, sizeof(header));
+    bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+
+    for (const auto& record : records) {
+      uint8_t keyLen = strlen(record.key);
+      uint32_t size = record.data.size();
+      crc = crc32_le(crc, &keyLen, 1);
+      crc = crc32_le(crc, (const uint8_t*)record.key, keyLen);
+      crc = crc32_le(crc, (const uint8_t*)&record.version, sizeof(record.version));
+      crc = crc32_le(crc, (const uint8_t*)&size, sizeof(size));
+      crc = crc32_le(crc, record.data.data(), size);
+      ok = ok && file.write(&keyLen, 1) == 1 &&
+           file.write((const uint8_t*)record.key, keyLen) == keyLen &&
+           file.write((const uint8_t*)&record.version, sizeof(record.version)) == sizeof(record.version) &&
+           file.write((const uint8_t*)&size, sizeof(size)) == sizeof(size) &&
+           file.write(record.data.data(), size) == size;
+    }
+    ok = ok && file.write((const uint8_t*)&crc, sizeof(crc)) == sizeof(crc);
+    file.close();
+
+    // rename в LittleFS атомарно заменяет существующий файл
+    ok = ok && LittleFS.rename(CONFIG_STORE_FILE ".tmp", CONFIG_STORE_FILE);
+    if (ok) {
+      dirty = false;
+      commits++;
+      lastCommitUs = micros() - started;
+    } else {
+      LittleFS.remove(CONFIG_STORE_FILE ".tmp");
+    }
+    xSemaphoreGive(lock);
+
+    if (!ok) {
+      // Изменения остаются в памяти, сохранение повторится
+      Serial.println("Config store: commit failed");
+      if (onDirty) onDirty();
+    }
+    return ok;
+  }
+
+  // Старые JSON-файлы настроек: читаются один раз при миграции
+  bool readLegacy(const char* path, JsonDocument& doc) {
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+      return false;
+    }
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+    if (error) {
+      Serial.printf("Config store: %s is unreadable: %s\n", path, error.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  // Удаление старого файла - только после того, как его данные попали во флеш
+  void retireLegacy(const char* path) {
+    if (commit()) {
+      LittleFS.remove(path);
+      Serial.printf("Config store: migrated %s\n", path);
+    }
+  }
+
+  bool isDirty() const { return dirty; }
+  size_t recordCount() const { return records.size(); }
+  uint32_t getCommits() const { return commits; }
+  uint32_t getCoalesced() const { return coalesced; }
+  uint32_t getLastCommitUs() const { return lastCommitUs; }
+};
+
+#endif // CONFIG_STORE_H
@@ -2,9 +2,14 @@
 #define DEVICE_MANAGER_H
 
 #include <M5StickCPlus2.h>
+#include <utility>
 #include <vector>
 #include <WiFi.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include "common_structures.h"
+#include "sensor_history.h"
 
 // Структура для хранения данных датчиков
 struct SensorData {
@@ -32,9 +37,12 @@ struct NetworkInfo {
 // Класс для управления устройством и его датчиками
 class DeviceManager {
 private:
-  // Датчики и данные
+  // Датчики и данные. Обновляет задача интерфейса, читают сетевая задача
+  // и веб-сервер - только копией под блокировкой (строки NetworkInfo
+  // перевыделяются при каждом обновлении)
   SensorData sensorData;
   NetworkInfo networkInfo;
+  SemaphoreHandle_t dataLock;
   
   // Бипер для сигнала Find Me
   bool findMeActive;
@@ -45,9 +53,8 @@ private:
   unsigned long sensorUpdateInterval;
   unsigned long lastSensorUpdate;
   
-  // Данные мониторинга
-  std::vector<SensorData> sensorHistory;
-  unsigned long historyMaxDuration; // Максимальная длительность истории в мс
+  // Данные мониторинга: кольца фиксированного размера с 1 с / 1 мин / 10 мин
+  SensorHistory sensorHistory;
   
   // Обработчик сигнализации Find Me
   void handleFindMeSignal() {
@@ -91,9 +98,9 @@ public:
       findMeStartTime(0), 
       findMeDuration(5000), // 5 секунд по умолчанию
       sensorUpdateInterval(1000), // 1 секунда по умолчанию
-      lastSensorUpdate(0),
-      historyMaxDuration(3600000) // 1 час по умолчанию
+      lastSensorUpdate(0)
   {
+    dataLock = xSemaphoreCreateMutex();
     // Инициализация данных сенсоров
     sensorData.batteryVoltage = 0.0f;
     sensorData.batteryPercentage = 0.0f;
@@ -131,13 +138,7 @@ public:
       lastSensorUpdate = currentMillis;
       
       // Добавляем текущие данные в историю
-      sensorHistory.push_back(sensorData);
-      
-      // Удаляем устаревшие данные из истории
-      while (!sensorHistory.empty() && 
-            (currentMillis - sensorHistory.front().timestamp > historyMaxDuration)) {
-        sensorHistory.erase(sensorHistory.begin());
-      }
+      recordHistory();
     }
     
     // Обработка сигнала Find Me
@@ -146,9 +147,12 @@ public:
   
   // Обновление данных сенсоров
   void updateSensorData() {
+    // Показания собираются в копию, опрос датчиков идет без блокировки
+    SensorData data = sensorData;
+    
     // Обновляем данные батареи
-    sensorData.batteryVoltage = M5.Power.getBatteryVoltage() / 1000.0f; // В вольтах
-    sensorData.batteryPercentage = M5.Power.getBatteryLevel();
+    data.batteryVoltage = M5.Power.getBatteryVoltage() / 1000.0f; // В вольтах
+    data.batteryPercentage = M5.Power.getBatteryLevel();
     
     // Обновляем данные IMU (гироскоп, акселерометр)
     if (M5.Imu.isEnabled()) {
@@ -156,34 +160,67 @@ public:
         auto imuData = M5.Imu.getImuData();
         
         // Используем поля gyro из структуры imu_data_t
-        sensorData.gyroX = imuData.gyro.x;
-        sensorData.gyroY = imuData.gyro.y;
-        sensorData.gyroZ = imuData.gyro.z;
+        data.gyroX = imuData.gyro.x;
+        data.gyroY = imuData.gyro.y;
+        data.gyroZ = imuData.gyro.z;
+        
+        // Температура кристалла IMU
+        M5.Imu.getTemp(&data.temperature);
     }
     
     // Устанавливаем временную метку
-    sensorData.timestamp = millis();
+    data.timestamp = millis();
+    
+    xSemaphoreTake(dataLock, portMAX_DELAY);
+    sensorData = data;
+    xSemaphoreGive(dataLock);
+  }
+  
+  // Запись текущих показаний в историю (время - секунды с загрузки,
+  // esp_timer не переполняется в отличие от millis())
+  void recordHistory() {
+    bool imu = M5.Imu.isEnabled();
+    float values[SENSOR_METRICS];
+    bool valid[SENSOR_METRICS];
+    values[METRIC_BATTERY] = sensorData.batteryVoltage;
+    values[METRIC_PERCENT] = sensorData.batteryPercentage;
+    values[METRIC_TEMPERATURE] = sensorData.temperature;
+    values[METRIC_MOTION] = sqrtf(sensorData.gyroX * sensorData.gyroX +
+                                  sensorData.gyroY * sensorData.gyroY +
+                                  sensorData.gyroZ * sensorData.gyroZ);
+    valid[METRIC_BATTERY] = sensorData.batteryVoltage > 0.0f;
+    valid[METRIC_PERCENT] = sensorData.batteryPercentage >= 0.0f;
+    valid[METRIC_TEMPERATURE] = imu;
+    valid[METRIC_MOTION] = imu;
+    sensorHistory.add((uint32_t)(esp_timer_get_time() / 1000000), values, valid);
   }
   
   // Обновление информации о сети
   void updateNetworkInfo() {
-    networkInfo.connected = WiFi.status() == WL_CONNECTED;
+    NetworkInfo info;
+    info.connected = WiFi.status() == WL_CONNECTED;
+    info.mac = WiFi.macAddress();
     
-    if (networkInfo.connected) {
-      networkInfo.ssid = WiFi.SSID();
-      networkInfo.rssi = WiFi.RSSI();
-      networkInfo.localIP = WiFi.localIP().toString();
-      networkInfo.gateway = WiFi.gatewayIP().toString();
-      networkInfo.subnet = WiFi.subnetMask().toString();
-      networkInfo.dns = WiFi.dnsIP().toString();
+    if (info.connected) {
+      info.ssid = WiFi.SSID();
+      info.rssi = WiFi.RSSI();
+      info.localIP = WiFi.localIP().toString();
+      info.gateway = WiFi.gatewayIP().toString();
+      info.subnet = WiFi.subnetMask().toString();
+      info.dns = WiFi.dnsIP().toString();
     } else {
-      networkInfo.ssid = "";
-      networkInfo.rssi = 0;
-      networkInfo.localIP = "0.0.0.0";
-      networkInfo.gateway = "0.0.0.0";
-      networkInfo.subnet = "0.0.0.0";
-      networkInfo.dns = "0.0.0.0";
+      info.ssid = "";
+      info.rssi = 0;
+      info.localIP = "0.0.0.0";
+      info.gateway = "0.0.0.0";
+      info.subnet = "0.0.0.0";
+      info.dns = "0.0.0.0";
     }
+    
+    // Старые строки освобождаются при выходе, уже вне блокировки
+    xSemaphoreTake(dataLock, portMAX_DELAY);
+    std::swap(networkInfo, info);
+    xSemaphoreGive(dataLock);
   }
   
   // Активация сигнала Find Me
@@ -203,17 +240,23 @@ public:
   }
   
   // Получение текущих данных сенсоров
-  const SensorData& getSensorData() const {
-    return sensorData;
+  SensorData getSensorData() const {
+    xSemaphoreTake(dataLock, portMAX_DELAY);
+    SensorData data = sensorData;
+    xSemaphoreGive(dataLock);
+    return data;
   }
   
   // Получение информации о сети
-  const NetworkInfo& getNetworkInfo() const {
-    return networkInfo;
+  NetworkInfo getNetworkInfo() const {
+    xSemaphoreTake(dataLock, portMAX_DELAY);
+    NetworkInfo info = networkInfo;
+    xSemaphoreGive(dataLock);
+    return info;
   }
   
   // Получение истории данных сенсоров
-  const std::vector<SensorData>& getSensorHistory() const {
+  const SensorHistory& getSensorHistory() const {
     return sensorHistory;
   }
   
@@ -227,11 +270,6 @@ public:
     return sensorUpdateInterval;
   }
   
-  // Установка максимальной длительности истории
-  void setHistoryMaxDuration(unsigned long duration) {
-    historyMaxDuration = duration;
-  }
-  
   // Перезагрузка устройства
   void restart() {
     ESP.restart();
@@ -3,26 +3,63 @@
 
 #include <ESPAsyncWebServer.h>
 #include <IPAddress.h>
+#include <LittleFS.h>
 #include <vector>
 #include <M5StickCPlus2.h>
 
-// Максимальное количество соединений для логирования
-#define MAX_HONEYPOT_CONNECTIONS 10
+// Максимальное количество соединений в кольцевом логе (в памяти)
+#ifndef MAX_HONEYPOT_CONNECTIONS
+#define MAX_HONEYPOT_CONNECTIONS 32
+#endif
 
-// Структура для хранения информации о соединении
+#define HONEYPOT_URL_LEN 64
+#define HONEYPOT_DATA_LEN 160
+
+// Журнал на флеше: записи фиксированного размера дописываются пачками,
+// при переполнении сегмент становится предыдущим (хранится один)
+#define HONEYPOT_LOG_FILE "/honeypot.log"
+#define HONEYPOT_LOG_PREV_FILE "/honeypot.log.1"
+#define HONEYPOT_LOG_SEGMENT_MAX (32 * 1024)
+#define HONEYPOT_FLUSH_BATCH 8          // Записей, после которых пишем сразу
+#define HONEYPOT_FLUSH_INTERVAL 5000    // Иначе не реже, мс
+
+#define HONEYPOT_DISPLAY_INTERVAL 1000  // Перерисовка экрана активности не чаще, мс
+#define HONEYPOT_PAGE_MAX 50            // Записей на страницу /ap/honeypot/logs
+
+// Служба ловушки, принявшая соединение
+enum HoneypotService : uint8_t {
+  HONEYPOT_SVC_HTTP,
+  HONEYPOT_SVC_DNS,
+  HONEYPOT_SVC_TCP
+};
+
+// Запись о соединении. Поля ограничены: сканер с длинными заголовками
+// не может раздуть память, лишнее обрезается
 struct HoneypotConnection {
-  IPAddress clientIP;
-  uint16_t port;
-  String requestData;
-  unsigned long timestamp;
+  uint32_t seq;                    // Порядковый номер с запуска
+  uint32_t clientIP;
+  uint16_t port;                   // Порт клиента
+  uint16_t localPort;              // Порт ловушки
+  uint8_t service;                 // HoneypotService
+  uint8_t method;                  // WebRequestMethod (HTTP), тип запроса (DNS)
+  uint8_t truncated;
+  uint32_t timestamp;              // millis()
+  char url[HONEYPOT_URL_LEN];      // URL, имя DNS или метка порта
+  char data[HONEYPOT_DATA_LEN];    // Заголовки и параметры "имя:значение", первые байты TCP
 };
 
 // Класс Honeypot для управления режимом ловушки
 class Honeypot {
 private:
-  // Буфер соединений
+  // Кольцевой лог соединений: запись нового - O(1), старые перезаписываются.
+  // Пишет задача AsyncTCP, читают сетевая задача (сброс на флеш) и веб-обработчики
   HoneypotConnection connections[MAX_HONEYPOT_CONNECTIONS];
-  int connectionCount;
+  uint32_t head;                   // seq следующей записи
+  uint32_t tail;                   // seq самой старой записи после очистки
+  uint32_t flushedSeq;             // Записи до этого seq уже на флеше
+  uint32_t lastFlush;
+  uint32_t archived;               // Записей в текущем сегменте на флеше
+  mutable portMUX_TYPE mux;
   
   // Точка доступа
   String ssid;
@@ -35,10 +72,38 @@ private:
   
   // Колбэк для обработки соединений
   std::function<void(HoneypotConnection&)> onConnectionCallback;
+  
+  // Колбэк для запросов без маршрута (замер производительности)
+  std::function<void()> onUnroutedCallback;
+  
+  // Экран обновляется задачей интерфейса по этому флагу
+  volatile bool activityPending;
+
+  // Дописывание в буфер с обрезкой; false - места больше нет
+  static bool append(char* out, size_t size, size_t& len, const String& a, char sep, const String& b) {
+    int n = snprintf(out + len, size - len, " %s%c%s", a.c_str(), sep, b.c_str());
+    if (n < 0 || len + n >= size) {
+      len = size - 1;
+      return false;
+    }
+    len += n;
+    return true;
+  }
+
+  // Запись с порядковым номером seq, если она еще в кольце
+  bool readLocked(uint32_t seq, HoneypotConnection& out) const {
+    if (seq >= head || seq < tail || head - seq > MAX_HONEYPOT_CONNECTIONS) {
+      return false;
+    }
+    out = connections[seq % MAX_HONEYPOT_CONNECTIONS];
+    return true;
+  }
 
 public:
   // Конструктор
-  Honeypot() : connectionCount(0), ssid("HoneyPot"), channel(1) {
+  Honeypot() : head(0), tail(0), flushedSeq(0), lastFlush(0), archived(0),
+               ssid("HoneyPot"), channel(1), activityPending(false) {
+    mux = portMUX_INITIALIZER_UNLOCKED;
     localIP.fromString("192.168.4.1");
     gateway.fromString("192.168.4.1");
     subnet.fromString("255.255.255.0");
@@ -51,11 +116,18 @@ public:
     WiFi.softAP(ssid.c_str(), "", channel); // Открытая точка доступа без пароля
     WiFi.softAPConfig(localIP, gateway, subnet);
     
-    // Сбрасываем счетчик соединений
-    connectionCount = 0;
+    // Продолжаем текущий сегмент журнала
+    File log = LittleFS.open(HONEYPOT_LOG_FILE, "r");
+    archived = log ? log.size() / sizeof(HoneypotConnection) : 0;
+    if (log) {
+      log.close();
+    }
     
     // Настраиваем запись всех соединений
     server.onNotFound([this](AsyncWebServerRequest *request){
+      if (onUnroutedCallback) {
+        onUnroutedCallback();
+      }
       // Логируем соединение
       logConnection(request, this);
       
@@ -105,7 +177,7 @@ public:
         "</body></html>");
     });
     
-    M5.Lcd.println("Honeypot started on " + WiFi.softAPIP().toString());
+    Serial.println("Honeypot started on " + WiFi.softAPIP().toString());
   }
   
   // Установить SSID точки доступа
@@ -125,89 +197,207 @@ public:
     }
   }
   
-  // Получить все логи соединений
-  const HoneypotConnection* getConnections() const {
-    return connections;
+  // Копия записей кольца, начиная с offset-й от новой к старой (не более max).
+  // Возвращает количество скопированных записей
+  size_t getConnections(size_t offset, HoneypotConnection* out, size_t max) const {
+    size_t copied = 0;
+    portENTER_CRITICAL(&mux);
+    uint32_t start = offset < head ? head - offset : 0;
+    for (uint32_t seq = start; seq-- > 0 && copied < max; ) {
+      if (!readLocked(seq, out[copied])) break;
+      copied++;
+    }
+    portEXIT_CRITICAL(&mux);
+    return copied;
+  }
+  
+  // Записей в кольце
+  size_t getStoredCount() const {
+    portENTER_CRITICAL(&mux);
+    uint32_t start = max(tail, head > MAX_HONEYPOT_CONNECTIONS ? head - MAX_HONEYPOT_CONNECTIONS : 0u);
+    size_t stored = head - start;
+    portEXIT_CRITICAL(&mux);
+    return stored;
   }
   
-  // Получить количество логов
-  int getConnectionCount() const {
-    return connectionCount;
+  // Всего соединений с запуска
+  uint32_t getConnectionCount() const {
+    return head;
   }
   
-  // Очистить логи
+  // Очистить лог в памяти (журнал на флеше остается)
   void clearConnections() {
-    connectionCount = 0;
+    portENTER_CRITICAL(&mux);
+    tail = head;
+    portEXIT_CRITICAL(&mux);
   }
   
-  // Установить колбэк для обработки новых соединений
-  void setOnConnectionCallback(std::function<void(HoneypotConnection&)> callback) {
-    onConnectionCallback = callback;
+  // Удалить журнал на флеше
+  void clearArchive() {
+    LittleFS.remove(HONEYPOT_LOG_FILE);
+    LittleFS.remove(HONEYPOT_LOG_PREV_FILE);
+    archived = 0;
   }
   
-  // Статический метод для логирования соединений
-  static void logConnection(AsyncWebServerRequest* request, Honeypot* honeypot) {
-    // Проверяем, не переполнен ли буфер
-    if (honeypot->connectionCount >= MAX_HONEYPOT_CONNECTIONS) {
-      // Если буфер заполнен, смещаем все записи на одну позицию назад
-      for (int i = 0; i < MAX_HONEYPOT_CONNECTIONS - 1; i++) {
-        honeypot->connections[i] = honeypot->connections[i + 1];
+  // Записей в журнале на флеше (текущий и предыдущий сегменты)
+  uint32_t getArchivedCount() const {
+    File prev = LittleFS.open(HONEYPOT_LOG_PREV_FILE, "r");
+    uint32_t count = archived;
+    if (prev) {
+      count += prev.size() / sizeof(HoneypotConnection);
+      prev.close();
+    }
+    return count;
+  }
+  
+  // Чтение журнала с флеша от новых к старым: записи фиксированного
+  // размера, поэтому страница - это позиционирование, а не чтение всего файла
+  size_t readArchive(size_t offset, HoneypotConnection* out, size_t max) const {
+    size_t copied = 0;
+    const char* files[2] = {HONEYPOT_LOG_FILE, HONEYPOT_LOG_PREV_FILE};
+    for (const char* path : files) {
+      File file = LittleFS.open(path, "r");
+      if (!file) continue;
+      size_t count = file.size() / sizeof(HoneypotConnection);
+      if (offset >= count) {
+        offset -= count;
+        file.close();
+        continue;
       }
-      honeypot->connectionCount = MAX_HONEYPOT_CONNECTIONS - 1;
+      for (size_t i = count - offset; i-- > 0 && copied < max; ) {
+        file.seek(i * sizeof(HoneypotConnection));
+        HoneypotConnection& entry = out[copied];
+        if (file.read((uint8_t*)&entry, sizeof(entry)) != sizeof(entry)) break;
+        // Файл мог быть поврежден - строки всегда завершаем
+        entry.url[sizeof(entry.url) - 1] = '\0';
+        entry.data[sizeof(entry.data) - 1] = '\0';
+        copied++;
+      }
+      offset = 0;
+      file.close();
+      if (copied >= max) break;
     }
+    return copied;
+  }
+  
+  // Сброс новых записей на флеш (из сетевой задачи). Пишется пачкой за одно открытие
+  // файла: после HONEYPOT_FLUSH_BATCH записей или по интервалу
+  void flush(bool force = false) {
+    portENTER_CRITICAL(&mux);
+    uint32_t end = head;
+    // Не успевшие на флеш и уже перезаписанные записи теряются
+    uint32_t oldest = end > MAX_HONEYPOT_CONNECTIONS ? end - MAX_HONEYPOT_CONNECTIONS : 0;
+    if (flushedSeq < oldest) {
+      flushedSeq = oldest;
+    }
+    uint32_t pending = end - flushedSeq;
+    portEXIT_CRITICAL(&mux);
     
-    // Получаем индекс для новой записи
-    int index = honeypot->connectionCount;
-    
-    // Заполняем информацию о соединении
-    honeypot->connections[index].clientIP = request->client()->remoteIP();
-    honeypot->connections[index].port = request->client()->remotePort();
-    honeypot->connections[index].timestamp = millis();
-    
-    // Собираем информацию о запросе
-    String requestData = request->url();
-    // Исправление строки для устранения ошибки конкатенации
-    String methodStr = " [";
-    methodStr += request->methodToString();
-    methodStr += "]";
-    requestData += methodStr;
-    
-    // Добавляем информацию о заголовках
-    for (int i = 0; i < request->headers(); i++) {
-      // Используем const AsyncWebHeader* вместо AsyncWebHeader*
-      const AsyncWebHeader* h = request->getHeader(i);
-      requestData += " " + h->name() + ":" + h->value();
+    if (pending == 0) return;
+    if (!force && pending < HONEYPOT_FLUSH_BATCH && millis() - lastFlush < HONEYPOT_FLUSH_INTERVAL) {
+      return;
     }
+    lastFlush = millis();
     
-    // Добавляем информацию о параметрах
-    for (int i = 0; i < request->params(); i++) {
-      // Используем const AsyncWebParameter* вместо AsyncWebParameter*
-      const AsyncWebParameter* p = request->getParam(i);
-      requestData += " " + p->name() + "=" + p->value();
+    // Сегмент заполнен - он становится предыдущим
+    if ((archived + pending) * sizeof(HoneypotConnection) > HONEYPOT_LOG_SEGMENT_MAX) {
+      LittleFS.remove(HONEYPOT_LOG_PREV_FILE);
+      LittleFS.rename(HONEYPOT_LOG_FILE, HONEYPOT_LOG_PREV_FILE);
+      archived = 0;
     }
     
-    // Сохраняем данные запроса
-    honeypot->connections[index].requestData = requestData;
+    File file = LittleFS.open(HONEYPOT_LOG_FILE, "a");
+    if (!file) {
+      return;
+    }
+    HoneypotConnection entry;
+    for (uint32_t seq = flushedSeq; seq < end; seq++) {
+      portENTER_CRITICAL(&mux);
+      bool ok = seq + MAX_HONEYPOT_CONNECTIONS > head;
+      if (ok) {
+        entry = connections[seq % MAX_HONEYPOT_CONNECTIONS];
+      }
+      portEXIT_CRITICAL(&mux);
+      if (!ok) continue;
+      file.write((const uint8_t*)&entry, sizeof(entry));
+      archived++;
+    }
+    file.close();
+    flushedSeq = end;
+  }
+  
+  // Было ли новое соединение с прошлого вызова (сбрасывает флаг)
+  bool consumeActivity() {
+    bool pending = activityPending;
+    activityPending = false;
+    return pending;
+  }
+  
+  // Последнее соединение (для экрана). false - соединений еще не было
+  bool getLast(HoneypotConnection& out) const {
+    portENTER_CRITICAL(&mux);
+    bool ok = head > 0 && readLocked(head - 1, out);
+    portEXIT_CRITICAL(&mux);
+    return ok;
+  }
+  
+  // Установить колбэк для обработки новых соединений
+  void setOnConnectionCallback(std::function<void(HoneypotConnection&)> callback) {
+    onConnectionCallback = callback;
+  }
+  
+  // Установить колбэк для запросов, не попавших ни в один маршрут
+  void setOnUnroutedCallback(std::function<void()> callback) {
+    onUnroutedCallback = callback;
+  }
+  
+  // Запись соединения любой службы. Вызывается из задач AsyncTCP и
+  // AsyncUDP: запись копируется в кольцо одной операцией под mux
+  void record(HoneypotConnection& entry) {
+    entry.timestamp = millis();
+    entry.url[sizeof(entry.url) - 1] = '\0';
+    entry.data[sizeof(entry.data) - 1] = '\0';
     
-    // Увеличиваем счетчик соединений
-    honeypot->connectionCount++;
+    portENTER_CRITICAL(&mux);
+    entry.seq = head;
+    connections[head % MAX_HONEYPOT_CONNECTIONS] = entry;
+    head++;
+    portEXIT_CRITICAL(&mux);
     
     // Вызываем колбэк, если он установлен
-    if (honeypot->onConnectionCallback) {
-      honeypot->onConnectionCallback(honeypot->connections[index]);
+    if (onConnectionCallback) {
+      onConnectionCallback(entry);
+    }
+    
+    // Экран обновляется задачей интерфейса: рисовать из сетевых задач небезопасно
+    activityPending = true;
+  }
+  
+  // Статический метод для логирования HTTP-запросов
+  static void logConnection(AsyncWebServerRequest* request, Honeypot* honeypot) {
+    HoneypotConnection entry;
+    entry.clientIP = (uint32_t)request->client()->remoteIP();
+    entry.port = request->client()->remotePort();
+    entry.localPort = request->client()->localPort();
+    entry.service = HONEYPOT_SVC_HTTP;
+    entry.method = request->method();
+    strlcpy(entry.url, request->url().c_str(), sizeof(entry.url));
+    
+    // Заголовки и параметры - до заполнения поля
+    size_t len = 0;
+    entry.data[0] = '\0';
+    bool fits = true;
+    for (int i = 0; fits && i < request->headers(); i++) {
+      const AsyncWebHeader* h = request->getHeader(i);
+      fits = append(entry.data, sizeof(entry.data), len, h->name(), ':', h->value());
+    }
+    for (int i = 0; fits && i < request->params(); i++) {
+      const AsyncWebParameter* p = request->getParam(i);
+      fits = append(entry.data, sizeof(entry.data), len, p->name(), '=', p->value());
     }
+    entry.truncated = !fits || request->url().length() >= sizeof(entry.url);
     
-    // Выводим информацию на экран
-    M5.Lcd.fillScreen(BLACK);
-    M5.Lcd.setCursor(0, 0);
-    M5.Lcd.println("Honeypot Activity");
-    M5.Lcd.println("-----------------");
-    M5.Lcd.print("Client: ");
-    M5.Lcd.println(honeypot->connections[index].clientIP.toString());
-    M5.Lcd.print("URL: ");
-    M5.Lcd.println(request->url());
-    M5.Lcd.print("Total connections: ");
-    M5.Lcd.println(honeypot->connectionCount);
+    honeypot->record(entry);
   }
 };
 
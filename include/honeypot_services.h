@@ -0,0 +1,295 @@
+#ifndef HONEYPOT_SERVICES_H
+#define HONEYPOT_SERVICES_H
+
+#include <Arduino.h>
+#include <AsyncTCP.h>
+#include <AsyncUDP.h>
+#include "honeypot.h"
+
+#define HONEYPOT_DNS_PORT 53
+#define HONEYPOT_DNS_TTL 60
+
+#define HONEYPOT_MAX_PORTS 8             // Слушаемых TCP-портов
+#define HONEYPOT_MAX_SESSIONS 8          // Одновременных TCP-сессий на все порты
+#define HONEYPOT_SESSION_TIMEOUT 10      // Секунд без данных до закрытия сессии
+
+// Порты по умолчанию: telnet, SSH, FTP, SMTP
+#define HONEYPOT_DEFAULT_PORTS {23, 22, 21, 25}
+#define HONEYPOT_DEFAULT_PORT_COUNT 4
+
+// Настройки служб ловушки
+struct HoneypotServiceConfig {
+  bool dns;                              // Отвечать на все DNS-запросы адресом AP
+  uint8_t portCount;
+  uint16_t ports[HONEYPOT_MAX_PORTS];
+  uint16_t captureBytes;                 // Сколько первых байт сессии сохранять
+};
+
+inline HoneypotServiceConfig defaultHoneypotServiceConfig() {
+  HoneypotServiceConfig config = {true, HONEYPOT_DEFAULT_PORT_COUNT, HONEYPOT_DEFAULT_PORTS,
+                                  HONEYPOT_DATA_LEN - 1};
+  return config;
+}
+
+// DNS-ответчик захваченного портала.
+//
+// На любой запрос типа A (и ANY) отвечает адресом точки доступа, поэтому
+// проверки подключения у телефонов и ноутбуков приходят на веб-ловушку,
+// а сами имена попадают в журнал. Разбор и ответ выполняются в задаче
+// AsyncUDP в буфере на стеке, без выделения памяти.
+class HoneypotDNS {
+private:
+  Honeypot& honeypot;
+  AsyncUDP udp;
+  uint32_t answerIP;
+  bool running;
+  uint32_t queries;
+
+  // Имя из секции вопроса в виде "a.b.c". Возвращает смещение за именем или 0
+  static size_t readName(const uint8_t* msg, size_t len, size_t pos, char* out, size_t outSize) {
+    size_t written = 0;
+    while (pos < len) {
+      uint8_t label = msg[pos++];
+      if (label == 0) {
+        out[written < outSize ? written : outSize - 1] = '\0';
+        return pos;
+      }
+      // Сжатие имен в вопросе не встречается
+      if ((label & 0xC0) || pos + label > len) {
+        return 0;
+      }
+      if (written > 0 && written + 1 < outSize) {
+        out[written++] = '.';
+      }
+      for (uint8_t i = 0; i < label; i++) {
+        if (written + 1 < outSize) {
+          uint8_t c = msg[pos + i];
+          out[written++] = isprint(c) ? (char)c : '?';
+        }
+      }
+      pos += label;
+    }
+    return 0;
+  }
+
+  void onPacket(AsyncUDPPacket& packet) {
+    const uint8_t* msg = packet.data();
+    size_t len = packet.length();
+    // Только стандартные запросы с одним вопросом
+    if (len < 12 || len > 512 || (msg[2] & 0x80) || (msg[2] & 0x78) || msg[4] != 0 || msg[5] != 1) {
+      return;
+    }
+
+    HoneypotConnection entry;
+    entry.clientIP = (uint32_t)packet.remoteIP();
+    entry.port = packet.remotePort();
+    entry.localPort = HONEYPOT_DNS_PORT;
+    entry.service = HONEYPOT_SVC_DNS;
+    entry.truncated = 0;
+    size_t end = readName(msg, len, 12, entry.url, sizeof(entry.url));
+    if (end == 0 || end + 4 > len) {
+      return;
+    }
+    uint16_t qtype = (msg[end] << 8) | msg[end + 1];
+    entry.method = qtype < 256 ? qtype : 255;
+    snprintf(entry.data, sizeof(entry.data), "qtype=%u", qtype);
+    end += 4;
+
+    // Ответ: заголовок и вопрос из запроса, плюс одна запись A
+    uint8_t reply[512 + 16];
+    memcpy(reply, msg, end);
+    bool answer = qtype == 1 || qtype == 255;
+    reply[2] = 0x84 | (msg[2] & 0x01);   // QR, AA, RD из запроса
+    reply[3] = 0x80;                      // RA, NOERROR
+    reply[6] = 0;
+    reply[7] = answer ? 1 : 0;
+    memset(reply + 8, 0, 4);             // NSCOUNT, ARCOUNT
+    size_t pos = end;
+    if (answer) {
+      const uint8_t record[] = {
+        0xC0, 0x0C,                       // Указатель на имя из вопроса
+        0x00, 0x01, 0x00, 0x01,           // A, IN
+        0x00, 0x00, 0x00, HONEYPOT_DNS_TTL,
+        0x00, 0x04
+      };
+      memcpy(reply + pos, record, sizeof(record));
+      pos += sizeof(record);
+      memcpy(reply + pos, &answerIP, 4);  // Уже в сетевом порядке
+      pos += 4;
+    }
+    packet.write(reply, pos);
+
+    queries++;
+    honeypot.record(entry);
+  }
+
+public:
+  explicit HoneypotDNS(Honeypot& honeypot)
+    : honeypot(honeypot), answerIP(0), running(false), queries(0) {}
+
+  bool begin(const IPAddress& apIP) {
+    if (running) return true;
+    answerIP = (uint32_t)apIP;
+    if (!udp.listen(HONEYPOT_DNS_PORT)) {
+      Serial.println("Honeypot DNS: failed to listen");
+      return false;
+    }
+    udp.onPacket([this](AsyncUDPPacket& packet) { onPacket(packet); });
+    running = true;
+    return true;
+  }
+
+  void end() {
+    if (!running) return;
+    udp.close();
+    running = false;
+  }
+
+  bool isRunning() const { return running; }
+  uint32_t getQueries() const { return queries; }
+};
+
+// Слушатель TCP-портов ловушки.
+//
+// Все порты обслуживает одна задача AsyncTCP: на каждый порт - AsyncServer,
+// на сессию - небольшая запись с буфером первых байт. Клиент получает
+// приветствие службы (баннер SSH, FTP, SMTP, приглашение telnet), первые
+// captureBytes байт его ввода сохраняются в журнал ловушки, после чего
+// сессия закрывается. Соединение без данных (сканер портов) тоже
+// журналируется - при отключении или по тайм-ауту.
+class HoneypotListener {
+private:
+  struct Session {
+    HoneypotListener* owner;
+    HoneypotConnection entry;
+    uint16_t len;
+    bool logged;
+  };
+
+  Honeypot& honeypot;
+  AsyncServer* servers[HONEYPOT_MAX_PORTS];
+  uint16_t ports[HONEYPOT_MAX_PORTS];
+  uint8_t portCount;
+  uint16_t captureBytes;
+  volatile uint8_t sessions;
+  uint32_t accepted;
+  uint32_t rejected;
+
+  static const char* bannerFor(uint16_t port) {
+    switch (port) {
+      case 21:  return "220 FTP server ready\r\n";
+      case 22:  return "SSH-2.0-OpenSSH_8.9p1 Ubuntu-3ubuntu0.4\r\n";
+      case 23:  return "\r\nlogin: ";
+      case 25:  return "220 mail.local ESMTP Postfix\r\n";
+      case 110: return "+OK POP3 server ready\r\n";
+      default:  return nullptr;
+    }
+  }
+
+  void finish(Session* session) {
+    if (session->logged) return;
+    session->logged = true;
+    session->entry.data[session->len] = '\0';
+    honeypot.record(session->entry);
+  }
+
+  void onClient(AsyncClient* client, uint16_t port) {
+    if (sessions >= HONEYPOT_MAX_SESSIONS) {
+      rejected++;
+      client->close(true);
+      delete client;
+      return;
+    }
+    sessions++;
+    accepted++;
+
+    Session* session = new Session();
+    session->owner = this;
+    session->len = 0;
+    session->logged = false;
+    HoneypotConnection& entry = session->entry;
+    entry.clientIP = (uint32_t)client->remoteIP();
+    entry.port = client->remotePort();
+    entry.localPort = port;
+    entry.service = HONEYPOT_SVC_TCP;
+    entry.method = 0;
+    entry.truncated = 0;
+    entry.data[0] = '\0';
+    snprintf(entry.url, sizeof(entry.url), "tcp/%u", port);
+
+    client->setRxTimeout(HONEYPOT_SESSION_TIMEOUT);
+    client->onData([](void* arg, AsyncClient* c, void* data, size_t len) {
+      Session* s = (Session*)arg;
+      const uint8_t* bytes = (const uint8_t*)data;
+      uint16_t limit = s->owner->captureBytes;
+      // Непечатаемые байты заменяются точкой: поле показывается как текст
+      for (size_t i = 0; i < len && s->len < limit; i++) {
+        s->entry.data[s->len++] = isprint(bytes[i]) ? (char)bytes[i] : '.';
+      }
+      if (s->len >= limit) {
+        s->entry.truncated = 1;
+        s->owner->finish(s);
+        c->close();
+      }
+    }, session);
+    client->onTimeout([](void* arg, AsyncClient* c, uint32_t time) {
+      c->close();
+    }, session);
+    client->onDisconnect([](void* arg, AsyncClient* c) {
+      Session* s = (Session*)arg;
+      s->owner->finish(s);
+      s->owner->sessions--;
+      delete s;
+      delete c;
+    }, session);
+
+    const char* banner = bannerFor(port);
+    if (banner) {
+      client->write(banner);
+    }
+  }
+
+public:
+  explicit HoneypotListener(Honeypot& honeypot)
+    : honeypot(honeypot), portCount(0), captureBytes(HONEYPOT_DATA_LEN - 1),
+      sessions(0), accepted(0), rejected(0) {
+    memset(servers, 0, sizeof(servers));
+  }
+
+  // Запуск на портах из настроек. Уже идущий слушатель перезапускается
+  void begin(const HoneypotServiceConfig& config) {
+    end();
+    captureBytes = constrain(config.captureBytes, (uint16_t)1, (uint16_t)(HONEYPOT_DATA_LEN - 1));
+    for (uint8_t i = 0; i < config.portCount && i < HONEYPOT_MAX_PORTS; i++) {
+      uint16_t port = config.ports[i];
+      // Порт 80 занят веб-ловушкой
+      if (port == 0 || port == 80) continue;
+      AsyncServer* server = new AsyncServer(port);
+      server->onClient([this, port](void* arg, AsyncClient* client) {
+        onClient(client, port);
+      }, nullptr);
+      server->setNoDelay(true);
+      server->begin();
+      servers[portCount] = server;
+      ports[portCount] = port;
+      portCount++;
+    }
+  }
+
+  void end() {
+    for (uint8_t i = 0; i < portCount; i++) {
+      servers[i]->end();
+      delete servers[i];
+      servers[i] = nullptr;
+    }
+    portCount = 0;
+  }
+
+  uint8_t getPortCount() const { return portCount; }
+  uint16_t getPort(uint8_t i) const { return ports[i]; }
+  uint8_t getSessions() const { return sessions; }
+  uint32_t getAccepted() const { return accepted; }
+  uint32_t getRejected() const { return rejected; }
+};
+
+#endif // HONEYPOT_SERVICES_H
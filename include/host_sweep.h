@@ -0,0 +1,333 @@
+#ifndef HOST_SWEEP_H
+#define HOST_SWEEP_H
+
+#include <Arduino.h>
+#include <vector>
+#include <atomic>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <lwip/sockets.h>
+#include <lwip/icmp.h>
+#include <lwip/inet_chksum.h>
+#include <lwip/ip.h>
+
+// Максимальное количество хостов за одно сканирование
+#define HOST_SWEEP_MAX_HOSTS 1024
+
+// Количество одновременно ожидающих ответа запросов.
+// По умолчанию не больше размера ARP-таблицы lwIP (10), иначе в локальной
+// подсети записи вытесняют друг друга до прихода ответа
+#define HOST_SWEEP_DEFAULT_WINDOW 8
+#define HOST_SWEEP_MAX_WINDOW 32
+
+#define HOST_SWEEP_DEFAULT_TIMEOUT 1000  // мс на одну попытку
+#define HOST_SWEEP_DEFAULT_RETRIES 1     // Дополнительных попыток на хост
+#define HOST_SWEEP_PAYLOAD_SIZE 32
+
+// Состояние сканирования
+enum SweepState {
+  SWEEP_IDLE,
+  SWEEP_RUNNING,
+  SWEEP_DONE,
+  SWEEP_CANCELLED,
+  SWEEP_ERROR
+};
+
+// Найденный хост
+struct SweepHost {
+  IPAddress ip;
+  float response_time;  // мс
+};
+
+// Параметры сканирования
+struct SweepConfig {
+  uint16_t window = HOST_SWEEP_DEFAULT_WINDOW;
+  uint16_t timeoutMs = HOST_SWEEP_DEFAULT_TIMEOUT;
+  uint8_t retries = HOST_SWEEP_DEFAULT_RETRIES;
+};
+
+// Параллельное ICMP-сканирование диапазона адресов.
+//
+// Все запросы идут через один raw-сокет lwIP: в полете держится до window
+// эхо-запросов, ответы сопоставляются по идентификатору и номеру
+// последовательности (номер = индекс хоста в диапазоне). Сканирование
+// выполняется либо в собственной задаче FreeRTOS (start), либо в вызывающей
+// задаче (run).
+class HostSweep {
+private:
+  // Состояние хоста в процессе сканирования
+  struct HostSlot {
+    int64_t sentAt;    // esp_timer_get_time() последней отправки
+    uint8_t attempts;
+    uint8_t done;      // 0 - ожидает, 1 - ответил, 2 - не ответил
+  };
+
+  uint32_t startAddr;  // Порядок байт хоста
+  uint32_t total;
+  SweepConfig config;
+  uint16_t echoId;
+
+  std::vector<HostSlot> slots;
+  std::vector<SweepHost> found;
+  SemaphoreHandle_t resultsMutex;
+  TaskHandle_t task;
+
+  std::atomic<int> state;
+  std::atomic<bool> cancelRequested;
+  std::atomic<uint32_t> sentCount;
+  std::atomic<uint32_t> completedCount;
+  int64_t startedAt;
+  int64_t finishedAt;
+  String error;
+
+  static void taskEntry(void* param) {
+    HostSweep* self = (HostSweep*)param;
+    self->execute();
+    self->task = nullptr;
+    vTaskDelete(NULL);
+  }
+
+  bool sendEcho(int sock, uint32_t index) {
+    uint8_t packet[sizeof(struct icmp_echo_hdr) + HOST_SWEEP_PAYLOAD_SIZE];
+    struct icmp_echo_hdr* echo = (struct icmp_echo_hdr*)packet;
+    echo->type = ICMP_ECHO;
+    echo->code = 0;
+    echo->chksum = 0;
+    echo->id = htons(echoId);
+    echo->seqno = htons((uint16_t)index);
+    for (int i = 0; i < HOST_SWEEP_PAYLOAD_SIZE; i++) {
+      packet[sizeof(struct icmp_echo_hdr) + i] = (uint8_t)i;
+    }
+    echo->chksum = inet_chksum(packet, sizeof(packet));
+
+    struct sockaddr_in to;
+    memset(&to, 0, sizeof(to));
+    to.sin_len = sizeof(to);
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = htonl(startAddr + index);
+
+    slots[index].sentAt = esp_timer_get_time();
+    slots[index].attempts++;
+    sentCount.fetch_add(1);
+
+    return lwip_sendto(sock, packet, sizeof(packet), 0, (struct sockaddr*)&to, sizeof(to)) >= 0;
+  }
+
+  // Разбор всех ответов, накопившихся в сокете
+  void drainReplies(int sock, uint32_t& inFlight) {
+    uint8_t buffer[64 + sizeof(struct icmp_echo_hdr) + HOST_SWEEP_PAYLOAD_SIZE];
+    struct sockaddr_in from;
+
+    while (true) {
+      socklen_t fromLen = sizeof(from);
+      int len = lwip_recvfrom(sock, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr*)&from, &fromLen);
+      if (len <= 0) {
+        return;
+      }
+
+      // Raw-сокет возвращает кадр вместе с IP-заголовком
+      const struct ip_hdr* iphdr = (const struct ip_hdr*)buffer;
+      int ipLen = IPH_HL_BYTES(iphdr);
+      if (len < ipLen + (int)sizeof(struct icmp_echo_hdr)) {
+        continue;
+      }
+
+      const struct icmp_echo_hdr* echo = (const struct icmp_echo_hdr*)(buffer + ipLen);
+      if (echo->type != ICMP_ER || ntohs(echo->id) != echoId) {
+        continue;
+      }
+
+      uint32_t index = ntohs(echo->seqno);
+      if (index >= total || ntohl(from.sin_addr.s_addr) != startAddr + index) {
+        continue;
+      }
+
+      HostSlot& slot = slots[index];
+      if (slot.done != 0) {
+        continue;  // Дубликат или ответ после таймаута
+      }
+
+      slot.done = 1;
+      inFlight--;
+      completedCount.fetch_add(1);
+
+      SweepHost host;
+      host.ip = IPAddress(htonl(startAddr + index));
+      host.response_time = (esp_timer_get_time() - slot.sentAt) / 1000.0f;
+
+      xSemaphoreTake(resultsMutex, portMAX_DELAY);
+      found.push_back(host);
+      xSemaphoreGive(resultsMutex);
+    }
+  }
+
+  // Основной цикл сканирования
+  void execute() {
+    int sock = lwip_socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+    if (sock < 0) {
+      error = "Failed to open ICMP socket";
+      finishedAt = esp_timer_get_time();
+      state.store(SWEEP_ERROR);
+      return;
+    }
+    lwip_fcntl(sock, F_SETFL, lwip_fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+    const int64_t timeoutUs = (int64_t)config.timeoutMs * 1000;
+    uint32_t nextIndex = 0;
+    uint32_t inFlight = 0;
+    uint32_t scanFrom = 0;  // Все хосты до этого индекса уже завершены
+
+    while (completedCount.load() < total && !cancelRequested.load()) {
+      // Заполняем окно новыми запросами
+      while (inFlight < config.window && nextIndex < total) {
+        sendEcho(sock, nextIndex++);
+        inFlight++;
+      }
+
+      // Ждем ответов не дольше 10 мс, чтобы вовремя обрабатывать таймауты
+      fd_set readSet;
+      FD_ZERO(&readSet);
+      FD_SET(sock, &readSet);
+      struct timeval tv = {0, 10000};
+      if (lwip_select(sock + 1, &readSet, NULL, NULL, &tv) > 0) {
+        drainReplies(sock, inFlight);
+      }
+
+      // Повтор или завершение запросов с истекшим таймаутом
+      int64_t now = esp_timer_get_time();
+      while (scanFrom < nextIndex && slots[scanFrom].done != 0) {
+        scanFrom++;
+      }
+      for (uint32_t i = scanFrom; i < nextIndex; i++) {
+        HostSlot& slot = slots[i];
+        if (slot.done != 0 || now - slot.sentAt < timeoutUs) {
+          continue;
+        }
+        if (slot.attempts <= config.retries) {
+          sendEcho(sock, i);
+        } else {
+          slot.done = 2;
+          inFlight--;
+          completedCount.fetch_add(1);
+        }
+      }
+    }
+
+    lwip_close(sock);
+    finishedAt = esp_timer_get_time();
+    state.store(cancelRequested.load() ? SWEEP_CANCELLED : SWEEP_DONE);
+  }
+
+  // Подготовка состояния перед запуском
+  bool prepare(const IPAddress& startIP, const IPAddress& endIP, const SweepConfig& cfg) {
+    if (state.load() == SWEEP_RUNNING) {
+      return false;
+    }
+
+    uint32_t first = ntohl((uint32_t)startIP);
+    uint32_t last = ntohl((uint32_t)endIP);
+    if (last < first) {
+      return false;
+    }
+
+    startAddr = first;
+    total = min(last - first + 1, (uint32_t)HOST_SWEEP_MAX_HOSTS);
+    config = cfg;
+    config.window = constrain(config.window, (uint16_t)1, (uint16_t)HOST_SWEEP_MAX_WINDOW);
+    config.timeoutMs = max(config.timeoutMs, (uint16_t)50);
+    echoId = (uint16_t)(esp_random() & 0xFFFF);
+
+    slots.assign(total, HostSlot{0, 0, 0});
+    xSemaphoreTake(resultsMutex, portMAX_DELAY);
+    found.clear();
+    xSemaphoreGive(resultsMutex);
+
+    cancelRequested.store(false);
+    sentCount.store(0);
+    completedCount.store(0);
+    error = "";
+    startedAt = esp_timer_get_time();
+    finishedAt = 0;
+    state.store(SWEEP_RUNNING);
+    return true;
+  }
+
+public:
+  HostSweep()
+    : startAddr(0), total(0), echoId(0), task(nullptr), state(SWEEP_IDLE),
+      cancelRequested(false), sentCount(0), completedCount(0), startedAt(0), finishedAt(0) {
+    resultsMutex = xSemaphoreCreateMutex();
+  }
+
+  // Запуск сканирования в отдельной задаче
+  bool start(const IPAddress& startIP, const IPAddress& endIP, const SweepConfig& cfg = SweepConfig()) {
+    if (task != nullptr || !prepare(startIP, endIP, cfg)) {
+      return false;
+    }
+
+    if (xTaskCreatePinnedToCore(taskEntry, "host_sweep", 4096, this, 1, &task, PRO_CPU_NUM) != pdPASS) {
+      task = nullptr;
+      error = "Failed to create task";
+      state.store(SWEEP_ERROR);
+      return false;
+    }
+    return true;
+  }
+
+  // Сканирование в вызывающей задаче (блокирующее)
+  bool run(const IPAddress& startIP, const IPAddress& endIP, const SweepConfig& cfg = SweepConfig()) {
+    if (task != nullptr || !prepare(startIP, endIP, cfg)) {
+      return false;
+    }
+    execute();
+    return state.load() == SWEEP_DONE;
+  }
+
+  // Запрос на остановку
+  void cancel() {
+    cancelRequested.store(true);
+  }
+
+  // Копия найденных хостов
+  std::vector<SweepHost> getResults() {
+    xSemaphoreTake(resultsMutex, portMAX_DELAY);
+    std::vector<SweepHost> copy = found;
+    xSemaphoreGive(resultsMutex);
+    return copy;
+  }
+
+  size_t getFoundCount() {
+    xSemaphoreTake(resultsMutex, portMAX_DELAY);
+    size_t count = found.size();
+    xSemaphoreGive(resultsMutex);
+    return count;
+  }
+
+  // Название состояния для API
+  const char* getStateName() const {
+    switch (state.load()) {
+      case SWEEP_RUNNING: return "scanning";
+      case SWEEP_DONE: return "ready";
+      case SWEEP_CANCELLED: return "cancelled";
+      case SWEEP_ERROR: return "error";
+      default: return "idle";
+    }
+  }
+
+  SweepState getState() const { return (SweepState)state.load(); }
+  bool isRunning() const { return state.load() == SWEEP_RUNNING; }
+  uint32_t getTotal() const { return total; }
+  uint32_t getSent() const { return sentCount.load(); }
+  uint32_t getCompleted() const { return completedCount.load(); }
+  const SweepConfig& getConfig() const { return config; }
+  const String& getError() const { return error; }
+
+  // Время сканирования в мс
+  uint32_t getElapsed() const {
+    if (startedAt == 0) return 0;
+    int64_t end = finishedAt ? finishedAt : esp_timer_get_time();
+    return (uint32_t)((end - startedAt) / 1000);
+  }
+};
+
+#endif // HOST_SWEEP_H
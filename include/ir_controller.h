@@ -7,9 +7,21 @@
 #include <ArduinoJson.h>
 #include <vector>
 #include <LittleFS.h>
+#include "ir_engine.h"
+#include "json_response.h"
 
-// Максимальное количество сохраненных ИК команд
-#define MAX_IR_COMMANDS 10
+// Максимальное количество сохраненных ИК команд.
+// Конфигурация читается и пишется по одной команде, так что предел задает
+// только место в памяти и во флеше, а не размер JSON-документа
+#define MAX_IR_COMMANDS 128
+
+// ИК-светодиод M5StickC PLUS2
+#define IR_DEFAULT_TX_PIN 19
+
+// Документ одной команды с полным набором сырых таймингов
+#define IR_COMMAND_DOC_SIZE (JSON_ARRAY_SIZE(IR_MAX_RAW_TIMINGS) + JSON_OBJECT_SIZE(8) + 256)
+
+#define IR_LEARN_DEFAULT_TIMEOUT_MS 15000
 
 // Структура для хранения ИК команды
 struct IRCommand {
@@ -17,170 +29,382 @@ struct IRCommand {
     uint32_t code;
     uint8_t bits;
     String description;
+    IRProtocol protocol;
+    uint16_t carrierHz;
+    std::vector<uint16_t> raw;   // Тайминги для IR_PROTOCOL_RAW, мкс
+    IRFrame frame;               // Символы RMT, строятся при добавлении
 };
 
-// Класс для управления ИК-функционалом
+// Состояние обучения
+enum IRLearnState {
+    IR_LEARN_IDLE,
+    IR_LEARN_LISTENING,
+    IR_LEARN_DONE,
+    IR_LEARN_TIMEOUT,
+    IR_LEARN_FAILED
+};
+
+// Класс для управления ИК-функционалом.
+// Команды добавляет обучение в задаче интерфейса, а меняют и читают
+// обработчики /api/ir/* в задаче AsyncTCP, поэтому список - под
+// рекурсивной блокировкой, а наружу выдаются копии
 class IRController {
 private:
     AsyncWebServer* server;
     std::vector<IRCommand> commands;
+    SemaphoreHandle_t commandsLock;
+    IREngine engine;
     bool irEnabled;
     int irPin;
-    
+
+    // Обучение
+    IRLearnState learnState;
+    String learnName;
+    String learnDescription;
+    unsigned long learnStarted;
+    unsigned long learnTimeoutMs;
+    int learnedIndex;
+    std::vector<uint16_t> rxTimings;
+
+    void lockCommands() const { xSemaphoreTakeRecursive(commandsLock, portMAX_DELAY); }
+    void unlockCommands() const { xSemaphoreGiveRecursive(commandsLock); }
+
+    static void buildFrame(IRCommand& cmd);
+    int findCommand(const String& name) const;
+    bool storeCommand(IRCommand& cmd);
+
 public:
     IRController(AsyncWebServer* server);
-    
+
     // Инициализация
-    void begin(int pin = 9); // GPIO9 - стандартный ИК-пин для M5StickC PLUS2
-    
+    void begin(int pin = IR_DEFAULT_TX_PIN);
+
+    // Обработка принятых кадров, вызывать периодически из основного цикла
+    void update();
+
     // Управление командами
     bool addCommand(const String& name, uint32_t code, uint8_t bits, const String& description);
+    bool addRawCommand(const String& name, const std::vector<uint16_t>& timings, uint16_t carrierHz,
+                       const String& description);
     bool removeCommand(int index);
-    bool transmitCommand(int index);
-    bool transmitRawCode(uint32_t code, uint8_t bits);
-    
-    // Получение списка команд
-    const std::vector<IRCommand>& getCommands() const;
-    
+    bool transmitCommand(int index, uint16_t repeats = 0);
+    bool transmitRawCode(uint32_t code, uint8_t bits, uint16_t repeats = 0);
+    bool transmitTimings(const std::vector<uint16_t>& timings, uint16_t carrierHz, uint16_t repeats = 0);
+
+    // Обучение: следующая принятая команда сохраняется под именем name
+    bool startLearning(const String& name, const String& description, int rxPin, unsigned long timeoutMs);
+    void stopLearning();
+
+    // Копия списка команд и одной команды (false - индекса нет)
+    std::vector<IRCommand> getCommands() const;
+    bool getCommand(int index, IRCommand& out) const;
+    size_t commandCount() const;
+
     // Запись и чтение конфигурации
     void saveConfig(fs::FS &fs);
     void loadConfig(fs::FS &fs);
-    
+
     // Настройка API
     void setupAPI();
-    
+
     // Проверка статуса
     bool isEnabled() const;
-    
-    // Функция для симуляции (заглушка)
-    bool simulateTransmit(const String& name);
+    bool isBusy() const;
+
+    // Отправка команды по имени
+    bool simulateTransmit(const String& name, uint16_t repeats = 0);
 };
 
+// Разбор JSON-массива таймингов [9000,4500,560,...]
+inline bool parseIRTimings(const String& json, std::vector<uint16_t>& timings) {
+    DynamicJsonDocument doc(JSON_ARRAY_SIZE(IR_MAX_RAW_TIMINGS) + 64);
+    if (deserializeJson(doc, json)) {
+        return false;
+    }
+    JsonArrayConst array = doc.as<JsonArrayConst>();
+    if (array.size() < 2 || array.size() > IR_MAX_RAW_TIMINGS) {
+        return false;
+    }
+    timings.clear();
+    timings.reserve(array.size());
+    for (JsonVariantConst value : array) {
+        uint32_t us = value.as<uint32_t>();
+        if (us == 0 || us > UINT16_MAX) {
+            return false;
+        }
+        timings.push_back(us);
+    }
+    return true;
+}
+
 // Реализация класса IRController
 
-IRController::IRController(AsyncWebServer* server) : 
-    server(server), 
+IRController::IRController(AsyncWebServer* server) :
+    server(server),
     irEnabled(false),
-    irPin(9) {
-    commands.reserve(MAX_IR_COMMANDS);
+    irPin(IR_DEFAULT_TX_PIN),
+    learnState(IR_LEARN_IDLE),
+    learnStarted(0),
+    learnTimeoutMs(0),
+    learnedIndex(-1) {
+    commandsLock = xSemaphoreCreateRecursiveMutex();
 }
 
 void IRController::begin(int pin) {
     irPin = pin;
-    
-    // В реальной реализации здесь была бы инициализация ИК-передатчика
-    // Например: irSender.begin(irPin);
-    
-    // Пока это просто заглушка
-    irEnabled = true;
-    
+
+    // Передатчик на RMT с аппаратной несущей
+    irEnabled = engine.begin(irPin);
+
     // Загружаем сохраненные команды
     loadConfig(LittleFS);
-    
+
     // Настраиваем API
     setupAPI();
 }
 
-bool IRController::addCommand(const String& name, uint32_t code, uint8_t bits, const String& description) {
-    // Проверяем, не превышен ли лимит команд
-    if (commands.size() >= MAX_IR_COMMANDS) {
-        return false;
+void IRController::buildFrame(IRCommand& cmd) {
+    if (cmd.protocol == IR_PROTOCOL_RAW) {
+        cmd.frame = irMakeRawFrame(cmd.raw, cmd.carrierHz);
+    } else {
+        cmd.frame = irMakeNECFrame(cmd.code, cmd.bits);
     }
-    
-    // Проверяем, что нет команды с таким же именем
-    for (const auto& cmd : commands) {
-        if (cmd.name == name) {
-            return false;
+}
+
+int IRController::findCommand(const String& name) const {
+    int found = -1;
+    lockCommands();
+    for (int i = 0; i < commands.size(); i++) {
+        if (commands[i].name == name) {
+            found = i;
+            break;
         }
     }
-    
-    // Добавляем новую команду
-    IRCommand newCommand = {
-        name,
-        code,
-        bits,
-        description
-    };
-    
-    commands.push_back(newCommand);
+    unlockCommands();
+    return found;
+}
+
+bool IRController::storeCommand(IRCommand& cmd) {
+    buildFrame(cmd);
+
+    // Проверяем лимит и уникальность имени
+    lockCommands();
+    if (commands.size() >= MAX_IR_COMMANDS || findCommand(cmd.name) >= 0) {
+        unlockCommands();
+        return false;
+    }
+    commands.push_back(cmd);
     saveConfig(LittleFS);
+    unlockCommands();
     return true;
 }
 
+bool IRController::addCommand(const String& name, uint32_t code, uint8_t bits, const String& description) {
+    if (bits == 0 || bits > 32) {
+        return false;
+    }
+
+    IRCommand newCommand;
+    newCommand.name = name;
+    newCommand.code = code;
+    newCommand.bits = bits;
+    newCommand.description = description;
+    newCommand.protocol = IR_PROTOCOL_NEC;
+    newCommand.carrierHz = IR_DEFAULT_CARRIER_HZ;
+    return storeCommand(newCommand);
+}
+
+bool IRController::addRawCommand(const String& name, const std::vector<uint16_t>& timings,
+                                 uint16_t carrierHz, const String& description) {
+    if (timings.size() < 2 || timings.size() > IR_MAX_RAW_TIMINGS) {
+        return false;
+    }
+
+    IRCommand newCommand;
+    newCommand.name = name;
+    newCommand.code = 0;
+    newCommand.bits = 0;
+    newCommand.description = description;
+    newCommand.protocol = IR_PROTOCOL_RAW;
+    newCommand.carrierHz = carrierHz;
+    newCommand.raw = timings;
+    return storeCommand(newCommand);
+}
+
 bool IRController::removeCommand(int index) {
+    lockCommands();
     if (index < 0 || index >= commands.size()) {
+        unlockCommands();
         return false;
     }
-    
+
+    // Символы в очереди передачи разделяются с командой и остаются живы
     commands.erase(commands.begin() + index);
     saveConfig(LittleFS);
+    unlockCommands();
     return true;
 }
 
-bool IRController::transmitCommand(int index) {
-    if (!irEnabled || index < 0 || index >= commands.size()) {
+bool IRController::transmitCommand(int index, uint16_t repeats) {
+    if (!irEnabled) {
+        return false;
+    }
+
+    // Кадр копируется под блокировкой: символы разделяются, а не копируются
+    lockCommands();
+    if (index < 0 || index >= commands.size()) {
+        unlockCommands();
         return false;
     }
-    
-    // В реальной реализации здесь был бы код для отправки ИК сигнала
-    // Например: irSender.sendNEC(commands[index].code, commands[index].bits);
-    
-    // Пока просто симулируем отправку
-    Serial.printf("IR: Transmitting %s (0x%08X, %d bits)\n", 
-                 commands[index].name.c_str(), 
-                 commands[index].code, 
-                 commands[index].bits);
-    
-    // Имитируем передачу с помощью светодиода
-    M5.Power.setLed(true);   // Включить LED
-    delay(100);
-    M5.Power.setLed(false);  // Выключить LED
-    
-    return true;
+    IRFrame frame = commands[index].frame;
+    Serial.printf("IR: Transmitting %s (%s, %u repeats)\n",
+                 commands[index].name.c_str(),
+                 commands[index].protocol == IR_PROTOCOL_RAW ? "raw" : "NEC",
+                 repeats);
+    unlockCommands();
+    return engine.send(frame, repeats);
 }
 
-bool IRController::transmitRawCode(uint32_t code, uint8_t bits) {
+bool IRController::transmitRawCode(uint32_t code, uint8_t bits, uint16_t repeats) {
     if (!irEnabled) {
         return false;
     }
-    
-    // В реальной реализации здесь был бы код для отправки ИК сигнала
-    // Например: irSender.sendNEC(code, bits);
-    
-    // Пока просто симулируем отправку
+
     Serial.printf("IR: Transmitting raw code 0x%08X (%d bits)\n", code, bits);
-    
-    // Имитируем передачу с помощью светодиода
-    M5.Power.setLed(true);   // Включить LED
-    delay(100);
-    M5.Power.setLed(false);  // Выключить LED
-    
+    return engine.send(irMakeNECFrame(code, bits), repeats);
+}
+
+bool IRController::transmitTimings(const std::vector<uint16_t>& timings, uint16_t carrierHz, uint16_t repeats) {
+    if (!irEnabled) {
+        return false;
+    }
+    return engine.send(irMakeRawFrame(timings, carrierHz), repeats);
+}
+
+bool IRController::startLearning(const String& name, const String& description, int rxPin,
+                                 unsigned long timeoutMs) {
+    if (name.length() == 0 || findCommand(name) >= 0 || commandCount() >= MAX_IR_COMMANDS) {
+        return false;
+    }
+    if (!engine.startReceive(rxPin)) {
+        return false;
+    }
+
+    learnName = name;
+    learnDescription = description;
+    learnStarted = millis();
+    learnTimeoutMs = timeoutMs;
+    learnedIndex = -1;
+    learnState = IR_LEARN_LISTENING;
+    Serial.printf("IR: Learning '%s' on GPIO%d\n", name.c_str(), rxPin);
     return true;
 }
 
-const std::vector<IRCommand>& IRController::getCommands() const {
-    return commands;
+void IRController::stopLearning() {
+    engine.stopReceive();
+    if (learnState == IR_LEARN_LISTENING) {
+        learnState = IR_LEARN_IDLE;
+    }
 }
 
-void IRController::saveConfig(fs::FS &fs) {
-    DynamicJsonDocument doc(2048);
-    
-    JsonArray commandsArray = doc.createNestedArray("commands");
-    for (const auto& cmd : commands) {
-        JsonObject cmdObj = commandsArray.createNestedObject();
-        cmdObj["name"] = cmd.name;
+void IRController::update() {
+    if (learnState != IR_LEARN_LISTENING) {
+        return;
+    }
+
+    if (engine.poll(rxTimings)) {
+        // Кадр NEC сохраняется кодом, остальное - сырыми таймингами
+        uint32_t code = 0;
+        uint8_t bits = 0;
+        bool stored;
+        if (irDecodeNEC(rxTimings, code, bits)) {
+            stored = addCommand(learnName, code, bits, learnDescription);
+        } else {
+            stored = addRawCommand(learnName, rxTimings, IR_DEFAULT_CARRIER_HZ, learnDescription);
+        }
+        learnedIndex = stored ? findCommand(learnName) : -1;
+        learnState = stored ? IR_LEARN_DONE : IR_LEARN_FAILED;
+        engine.stopReceive();
+        Serial.printf("IR: Learned '%s' (%u timings)\n", learnName.c_str(), (unsigned)rxTimings.size());
+        return;
+    }
+
+    if (millis() - learnStarted > learnTimeoutMs) {
+        learnState = IR_LEARN_TIMEOUT;
+        engine.stopReceive();
+    }
+}
+
+std::vector<IRCommand> IRController::getCommands() const {
+    lockCommands();
+    std::vector<IRCommand> copy = commands;
+    unlockCommands();
+    return copy;
+}
+
+bool IRController::getCommand(int index, IRCommand& out) const {
+    bool found = false;
+    lockCommands();
+    if (index >= 0 && index < commands.size()) {
+        out = commands[index];
+        found = true;
+    }
+    unlockCommands();
+    return found;
+}
+
+size_t IRController::commandCount() const {
+    lockCommands();
+    size_t count = commands.size();
+    unlockCommands();
+    return count;
+}
+
+// Команда в JSON в том же виде, в каком она хранится
+inline void irCommandToJson(const IRCommand& cmd, JsonObject cmdObj) {
+    cmdObj["name"] = cmd.name;
+    cmdObj["description"] = cmd.description;
+    if (cmd.protocol == IR_PROTOCOL_RAW) {
+        cmdObj["protocol"] = "raw";
+        cmdObj["carrier"] = cmd.carrierHz;
+        JsonArray rawArray = cmdObj.createNestedArray("raw");
+        for (uint16_t t : cmd.raw) {
+            rawArray.add(t);
+        }
+    } else {
+        cmdObj["protocol"] = "nec";
         cmdObj["code"] = cmd.code;
         cmdObj["bits"] = cmd.bits;
-        cmdObj["description"] = cmd.description;
     }
-    
-    File configFile = fs.open("/ir_config.json", "w");
+}
+
+void IRController::saveConfig(fs::FS &fs) {
+    // Пишем рядом и подменяем: обрыв питания не оставит половину файла
+    File configFile = fs.open("/ir_config.json.tmp", "w");
     if (!configFile) {
         return;
     }
-    
-    serializeJson(doc, configFile);
+
+    // Команды пишутся по одной, без общего документа. Блокировка держится
+    // до подмены: два сохранения не пишут временный файл одновременно
+    DynamicJsonDocument doc(IR_COMMAND_DOC_SIZE);
+    lockCommands();
+    configFile.print("{\"commands\":[");
+    for (size_t i = 0; i < commands.size(); i++) {
+        doc.clear();
+        irCommandToJson(commands[i], doc.to<JsonObject>());
+        if (i > 0) {
+            configFile.print(',');
+        }
+        serializeJson(doc, configFile);
+    }
+    bool ok = configFile.print("]}") == 2;
     configFile.close();
+
+    if (!ok || !fs.rename("/ir_config.json.tmp", "/ir_config.json")) {
+        fs.remove("/ir_config.json.tmp");
+    }
+    unlockCommands();
 }
 
 void IRController::loadConfig(fs::FS &fs) {
@@ -193,59 +417,70 @@ void IRController::loadConfig(fs::FS &fs) {
         addCommand("Channel Down", 0x20DF807F, 32, "Previous Channel");
         return;
     }
-    
+
     File configFile = fs.open("/ir_config.json", "r");
     if (!configFile) {
         return;
     }
-    
-    DynamicJsonDocument doc(2048);
-    DeserializationError error = deserializeJson(doc, configFile);
-    configFile.close();
-    
-    if (error) {
-        return;
-    }
-    
-    commands.clear();
-    
-    if (doc.containsKey("commands")) {
-        JsonArray commandsArray = doc["commands"];
-        
-        for (JsonObject cmdObj : commandsArray) {
-            if (commands.size() < MAX_IR_COMMANDS) {
-                IRCommand cmd;
-                cmd.name = cmdObj["name"].as<String>();
-                cmd.code = cmdObj["code"].as<uint32_t>();
-                cmd.bits = cmdObj["bits"].as<uint8_t>();
-                cmd.description = cmdObj["description"].as<String>();
-                
-                commands.push_back(cmd);
+
+    // Массив разбирается поэлементно прямо из файла и подменяет список целиком
+    std::vector<IRCommand> loaded;
+    if (configFile.find("\"commands\"") && configFile.find("[")) {
+        DynamicJsonDocument doc(IR_COMMAND_DOC_SIZE);
+        do {
+            if (deserializeJson(doc, configFile)) {
+                break;
             }
-        }
+            JsonObjectConst cmdObj = doc.as<JsonObjectConst>();
+
+            IRCommand cmd;
+            cmd.name = cmdObj["name"].as<String>();
+            cmd.description = cmdObj["description"].as<String>();
+            cmd.code = cmdObj["code"].as<uint32_t>();
+            cmd.bits = cmdObj["bits"] | 32;
+            cmd.carrierHz = cmdObj["carrier"] | IR_DEFAULT_CARRIER_HZ;
+            cmd.protocol = cmdObj["protocol"] == "raw" ? IR_PROTOCOL_RAW : IR_PROTOCOL_NEC;
+            for (JsonVariantConst t : cmdObj["raw"].as<JsonArrayConst>()) {
+                cmd.raw.push_back(t.as<uint16_t>());
+            }
+            if (cmd.protocol == IR_PROTOCOL_RAW && cmd.raw.size() < 2) {
+                continue;
+            }
+
+            buildFrame(cmd);
+            loaded.push_back(cmd);
+        } while (loaded.size() < MAX_IR_COMMANDS && configFile.findUntil(",", "]"));
     }
+    configFile.close();
+
+    lockCommands();
+    commands.swap(loaded);
+    unlockCommands();
 }
 
 void IRController::setupAPI() {
     // API для получения списка команд
     server->on("/api/ir/commands", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        DynamicJsonDocument doc(2048);
-        JsonArray commandsArray = doc.createNestedArray("commands");
-        
-        for (int i = 0; i < commands.size(); i++) {
-            JsonObject cmdObj = commandsArray.createNestedObject();
+        std::vector<IRCommand> snapshot = getCommands();
+        JsonListWriter list(request, "commands", 256 + snapshot.size() * 160);
+
+        for (int i = 0; i < snapshot.size(); i++) {
+            DynamicJsonDocument cmdDoc(IR_COMMAND_DOC_SIZE);
+            JsonObject cmdObj = cmdDoc.to<JsonObject>();
             cmdObj["index"] = i;
-            cmdObj["name"] = commands[i].name;
-            cmdObj["code"] = commands[i].code;
-            cmdObj["bits"] = commands[i].bits;
-            cmdObj["description"] = commands[i].description;
+            irCommandToJson(snapshot[i], cmdObj);
+            list.add(cmdDoc);
         }
-        
-        String response;
-        serializeJson(doc, response);
-        request->send(200, "application/json", response);
+
+        StaticJsonDocument<128> extra;
+        extra["enabled"] = irEnabled;
+        extra["pin"] = irPin;
+        extra["queued"] = engine.queued();
+        extra["sent"] = engine.getFramesSent();
+        extra["dropped"] = engine.getDropped();
+        list.send(&extra);
     });
-    
+
     // API для отправки команды
     server->on("/api/ir/transmit", HTTP_POST, [this](AsyncWebServerRequest *request) {
         // Проверяем активность ИК-функции
@@ -253,96 +488,168 @@ void IRController::setupAPI() {
             request->send(503, "application/json", "{\"error\":\"IR functionality is not enabled\"}");
             return;
         }
-        
+
         bool success = false;
         String message = "Invalid parameters";
-        
+        uint16_t repeats = 0;
+        if (request->hasParam("repeats", true)) {
+            repeats = constrain(request->getParam("repeats", true)->value().toInt(), 0, IR_MAX_REPEATS);
+        }
+
         if (request->hasParam("index", true)) {
             // Отправка команды по индексу
             int index = request->getParam("index", true)->value().toInt();
-            if (index >= 0 && index < commands.size()) {
-                success = transmitCommand(index);
-                message = success ? "Command transmitted" : "Failed to transmit command";
+            if (index >= 0 && index < commandCount()) {
+                success = transmitCommand(index, repeats);
+                message = success ? "Command queued" : "Transmit queue is full";
             } else {
                 message = "Invalid command index";
             }
+        } else if (request->hasParam("raw", true)) {
+            // Отправка произвольных таймингов
+            std::vector<uint16_t> timings;
+            if (parseIRTimings(request->getParam("raw", true)->value(), timings)) {
+                uint16_t carrier = IR_DEFAULT_CARRIER_HZ;
+                if (request->hasParam("carrier", true)) {
+                    carrier = constrain(request->getParam("carrier", true)->value().toInt(), 0, 60000);
+                }
+                success = transmitTimings(timings, carrier, repeats);
+                message = success ? "Timings queued" : "Transmit queue is full";
+            } else {
+                message = "Invalid raw timings";
+            }
         } else if (request->hasParam("code", true) && request->hasParam("bits", true)) {
             // Отправка произвольного кода
             uint32_t code = strtoul(request->getParam("code", true)->value().c_str(), NULL, 16);
             uint8_t bits = request->getParam("bits", true)->value().toInt();
-            
+
             if (bits > 0 && bits <= 32) {
-                success = transmitRawCode(code, bits);
-                message = success ? "Raw code transmitted" : "Failed to transmit raw code";
+                success = transmitRawCode(code, bits, repeats);
+                message = success ? "Raw code queued" : "Transmit queue is full";
             } else {
                 message = "Invalid number of bits (must be between 1 and 32)";
             }
         } else if (request->hasParam("name", true)) {
             // Отправка команды по имени
             String name = request->getParam("name", true)->value();
-            success = simulateTransmit(name);
-            message = success ? "Command transmitted" : "Command not found";
+            success = simulateTransmit(name, repeats);
+            message = success ? "Command queued" : "Command not found";
         }
-        
-        DynamicJsonDocument doc(256);
+
+        StaticJsonDocument<256> doc;
         doc["success"] = success;
         doc["message"] = message;
-        
-        String response;
-        serializeJson(doc, response);
-        request->send(200, "application/json", response);
+        sendJson(request, doc);
     });
-    
-    // API для добавления новой команды
+
+    // API для добавления новой команды: code/bits (NEC) или raw=[...] с carrier
     server->on("/api/ir/add", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (!request->hasParam("name", true) || 
-            !request->hasParam("code", true) || 
-            !request->hasParam("bits", true)) {
+        if (!request->hasParam("name", true) ||
+            (!request->hasParam("raw", true) &&
+             (!request->hasParam("code", true) || !request->hasParam("bits", true)))) {
             request->send(400, "application/json", "{\"error\":\"Missing required parameters\"}");
             return;
         }
-        
+
         String name = request->getParam("name", true)->value();
-        uint32_t code = strtoul(request->getParam("code", true)->value().c_str(), NULL, 16);
-        uint8_t bits = request->getParam("bits", true)->value().toInt();
         String description = "";
-        
+
         if (request->hasParam("description", true)) {
             description = request->getParam("description", true)->value();
         }
-        
-        bool success = addCommand(name, code, bits, description);
-        
-        DynamicJsonDocument doc(256);
+
+        bool success;
+        if (request->hasParam("raw", true)) {
+            std::vector<uint16_t> timings;
+            if (!parseIRTimings(request->getParam("raw", true)->value(), timings)) {
+                request->send(400, "application/json", "{\"error\":\"Invalid raw timings\"}");
+                return;
+            }
+            uint16_t carrier = IR_DEFAULT_CARRIER_HZ;
+            if (request->hasParam("carrier", true)) {
+                carrier = constrain(request->getParam("carrier", true)->value().toInt(), 0, 60000);
+            }
+            success = addRawCommand(name, timings, carrier, description);
+        } else {
+            uint32_t code = strtoul(request->getParam("code", true)->value().c_str(), NULL, 16);
+            uint8_t bits = request->getParam("bits", true)->value().toInt();
+            success = addCommand(name, code, bits, description);
+        }
+
+        StaticJsonDocument<256> doc;
         doc["success"] = success;
         if (!success) {
             doc["error"] = "Failed to add command. Maximum limit reached or duplicate name.";
         }
-        
-        String response;
-        serializeJson(doc, response);
-        request->send(200, "application/json", response);
+        sendJson(request, doc);
     });
-    
+
     // API для удаления команды
     server->on("/api/ir/remove", HTTP_POST, [this](AsyncWebServerRequest *request) {
         if (!request->hasParam("index", true)) {
             request->send(400, "application/json", "{\"error\":\"Missing index parameter\"}");
             return;
         }
-        
+
         int index = request->getParam("index", true)->value().toInt();
         bool success = removeCommand(index);
-        
-        DynamicJsonDocument doc(256);
+
+        StaticJsonDocument<256> doc;
         doc["success"] = success;
         if (!success) {
             doc["error"] = "Invalid command index";
         }
-        
-        String response;
-        serializeJson(doc, response);
-        request->send(200, "application/json", response);
+        sendJson(request, doc);
+    });
+
+    // Отмена обучения (регистрируется раньше /api/ir/learn)
+    server->on("/api/ir/learn/cancel", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        stopLearning();
+        request->send(200, "application/json", "{\"success\":true}");
+    });
+
+    // Обучение: name, description, pin (выход ИК-приемника), timeout (мс)
+    server->on("/api/ir/learn", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        if (!request->hasParam("name", true) || !request->hasParam("pin", true)) {
+            request->send(400, "application/json", "{\"error\":\"Missing name or pin parameter\"}");
+            return;
+        }
+
+        String name = request->getParam("name", true)->value();
+        String description = request->hasParam("description", true)
+            ? request->getParam("description", true)->value() : String("");
+        int pin = request->getParam("pin", true)->value().toInt();
+        unsigned long timeout = IR_LEARN_DEFAULT_TIMEOUT_MS;
+        if (request->hasParam("timeout", true)) {
+            timeout = constrain(request->getParam("timeout", true)->value().toInt(), 1000, 120000);
+        }
+
+        if (pin < 0 || pin >= 40 || pin == irPin) {
+            request->send(400, "application/json", "{\"error\":\"Invalid receiver pin\"}");
+            return;
+        }
+        if (!startLearning(name, description, pin, timeout)) {
+            request->send(409, "application/json", "{\"error\":\"Duplicate name, command limit or receiver unavailable\"}");
+            return;
+        }
+        request->send(200, "application/json", "{\"success\":true}");
+    });
+
+    server->on("/api/ir/learn", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        static const char* const stateNames[] = {"idle", "listening", "done", "timeout", "failed"};
+        StaticJsonDocument<192> doc;
+        doc["state"] = stateNames[learnState];
+        doc["name"] = learnName;
+        if (learnState == IR_LEARN_LISTENING) {
+            doc["pin"] = engine.getRxPin();
+            doc["remainingMs"] = learnTimeoutMs - min(learnTimeoutMs, millis() - learnStarted);
+        }
+        IRCommand learned;
+        if (learnState == IR_LEARN_DONE && getCommand(learnedIndex, learned)) {
+            doc["index"] = learnedIndex;
+            doc["protocol"] = learned.protocol == IR_PROTOCOL_RAW ? "raw" : "nec";
+        }
+        sendJson(request, doc);
     });
 }
 
@@ -350,13 +657,14 @@ bool IRController::isEnabled() const {
     return irEnabled;
 }
 
-bool IRController::simulateTransmit(const String& name) {
-    for (int i = 0; i < commands.size(); i++) {
-        if (commands[i].name == name) {
-            return transmitCommand(i);
-        }
-    }
-    return false;
+// Передача или прием в процессе
+bool IRController::isBusy() const {
+    return engine.isBusy() || engine.isReceiving();
+}
+
+bool IRController::simulateTransmit(const String& name, uint16_t repeats) {
+    int index = findCommand(name);
+    return index >= 0 && transmitCommand(index, repeats);
 }
 
-#endif // IR_CONTROLLER_H
\ No newline at end of file
+#endif // IR_CONTROLLER_H
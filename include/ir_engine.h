@@ -0,0 +1,418 @@
+#ifndef IR_ENGINE_H
+#define IR_ENGINE_H
+
+#include <Arduino.h>
+#include <driver/rmt.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/ringbuf.h>
+#include <memory>
+#include <vector>
+
+#define IR_TX_CHANNEL RMT_CHANNEL_0
+#define IR_RX_CHANNEL RMT_CHANNEL_4   // Каналы 4-7: блоки памяти под прием
+#define IR_RX_MEM_BLOCKS 4
+#define IR_RMT_CLK_DIV 80             // 80 МГц / 80: один тик - 1 мкс
+#define IR_RMT_MAX_TICKS 32767        // Предел длительности в элементе RMT
+#define IR_APB_HZ 80000000UL
+#define IR_DEFAULT_CARRIER_HZ 38000
+#define IR_CARRIER_DUTY 33
+#define IR_TX_QUEUE_DEPTH 8
+#define IR_MAX_REPEATS 20
+#define IR_MAX_RAW_TIMINGS 512
+#define IR_RAW_GAP_US 40000           // Пауза между повторами сырого кадра
+#define IR_RX_IDLE_US 12000           // Тишина, завершающая принимаемый кадр
+#define IR_RX_FILTER_TICKS 100        // Фильтр помех приемника, тики APB
+#define IR_RX_BUFFER_SIZE 4096
+#define IR_RX_MIN_TIMINGS 4           // Короче - помеха, а не команда
+
+// Тайминги NEC, мкс
+#define IR_NEC_HDR_MARK 9000
+#define IR_NEC_HDR_SPACE 4500
+#define IR_NEC_BIT_MARK 560
+#define IR_NEC_ONE_SPACE 1690
+#define IR_NEC_ZERO_SPACE 560
+#define IR_NEC_RPT_SPACE 2250
+#define IR_NEC_PERIOD_US 108000
+
+enum IRProtocol : uint8_t {
+  IR_PROTOCOL_NEC,
+  IR_PROTOCOL_RAW    // Последовательность импульс/пауза в мкс
+};
+
+typedef std::vector<rmt_item32_t> IRSymbols;
+typedef std::shared_ptr<const IRSymbols> IRSymbolsPtr;
+
+// Готовая к передаче команда. Символы неизменяемы и разделяются между
+// командой, очередью и выдаваемой посылкой (ее символы движок держит,
+// пока RMT не закончит подгрузку), поэтому удаление команды во время
+// отправки безопасно
+struct IRFrame {
+  IRSymbolsPtr first;    // Первая посылка
+  IRSymbolsPtr repeat;   // Посылка повтора (nullptr - повторяется first)
+  uint32_t periodUs;     // Период повтора от начала до начала
+  uint16_t carrierHz;    // 0 - без несущей
+};
+
+// Символы RMT из чередующихся длительностей импульс/пауза (начиная с импульса).
+// Длительности больше предела элемента RMT делятся на несколько элементов
+inline IRSymbolsPtr irEncodeTimings(const std::vector<uint16_t>& timings) {
+  auto symbols = std::make_shared<IRSymbols>();
+  symbols->reserve(timings.size() / 2 + 2);
+
+  rmt_item32_t item = {};
+  bool half = false;
+  for (size_t i = 0; i < timings.size(); i++) {
+    uint32_t left = timings[i];
+    uint32_t level = (i % 2 == 0) ? 1 : 0;
+    while (left > 0) {
+      uint32_t ticks = min(left, (uint32_t)IR_RMT_MAX_TICKS);
+      left -= ticks;
+      if (!half) {
+        item.val = 0;
+        item.duration0 = ticks;
+        item.level0 = level;
+      } else {
+        item.duration1 = ticks;
+        item.level1 = level;
+        symbols->push_back(item);
+      }
+      half = !half;
+    }
+  }
+  if (half) {
+    // Нулевая вторая половина - признак конца для RMT
+    item.duration1 = 0;
+    item.level1 = 0;
+    symbols->push_back(item);
+  }
+  return symbols;
+}
+
+// Тайминги NEC для кода (старший бит первым, как в распространенных таблицах кодов)
+inline std::vector<uint16_t> irNECTimings(uint32_t code, uint8_t bits) {
+  std::vector<uint16_t> timings;
+  timings.reserve(2 + bits * 2 + 1);
+  timings.push_back(IR_NEC_HDR_MARK);
+  timings.push_back(IR_NEC_HDR_SPACE);
+  for (int i = bits - 1; i >= 0; i--) {
+    timings.push_back(IR_NEC_BIT_MARK);
+    timings.push_back((code >> i) & 1 ? IR_NEC_ONE_SPACE : IR_NEC_ZERO_SPACE);
+  }
+  timings.push_back(IR_NEC_BIT_MARK);
+  return timings;
+}
+
+inline IRFrame irMakeNECFrame(uint32_t code, uint8_t bits) {
+  static const IRSymbolsPtr repeat = irEncodeTimings({IR_NEC_HDR_MARK, IR_NEC_RPT_SPACE, IR_NEC_BIT_MARK});
+  IRFrame frame;
+  frame.first = irEncodeTimings(irNECTimings(code, bits));
+  frame.repeat = repeat;
+  frame.periodUs = IR_NEC_PERIOD_US;
+  frame.carrierHz = IR_DEFAULT_CARRIER_HZ;
+  return frame;
+}
+
+inline IRFrame irMakeRawFrame(const std::vector<uint16_t>& timings, uint16_t carrierHz) {
+  uint32_t duration = 0;
+  for (uint16_t t : timings) duration += t;
+  IRFrame frame;
+  frame.first = irEncodeTimings(timings);
+  frame.repeat = nullptr;
+  frame.periodUs = duration + IR_RAW_GAP_US;
+  frame.carrierHz = carrierHz;
+  return frame;
+}
+
+inline bool irMatch(uint32_t measured, uint32_t expected) {
+  // Допуск 25%: приемники заметно растягивают импульсы
+  return measured >= expected * 3 / 4 && measured <= expected * 5 / 4;
+}
+
+// Распознавание NEC в принятых таймингах
+inline bool irDecodeNEC(const std::vector<uint16_t>& timings, uint32_t& code, uint8_t& bits) {
+  if (timings.size() < 4 || !irMatch(timings[0], IR_NEC_HDR_MARK) ||
+      !irMatch(timings[1], IR_NEC_HDR_SPACE)) {
+    return false;
+  }
+  size_t dataBits = (timings.size() - 3) / 2;
+  if (dataBits == 0 || dataBits > 32 || timings.size() != 3 + dataBits * 2) {
+    return false;
+  }
+  uint32_t value = 0;
+  for (size_t i = 0; i < dataBits; i++) {
+    uint16_t mark = timings[2 + i * 2];
+    uint16_t space = timings[3 + i * 2];
+    if (!irMatch(mark, IR_NEC_BIT_MARK)) {
+      return false;
+    }
+    if (irMatch(space, IR_NEC_ONE_SPACE)) {
+      value = (value << 1) | 1;
+    } else if (irMatch(space, IR_NEC_ZERO_SPACE)) {
+      value <<= 1;
+    } else {
+      return false;
+    }
+  }
+  code = value;
+  bits = dataBits;
+  return true;
+}
+
+// Передача и прием ИК на RMT.
+//
+// Передача не блокирует вызывающего: кадры ставятся в очередь, очередную
+// посылку запускает обработчик esp_timer, а RMT выдает ее сам, с несущей,
+// подгружая длинные кадры в свою память по прерываниям. Повторы идут с
+// периодом протокола. Прием (обучение) включается по запросу на отдельном
+// канале; готовые кадры забираются через poll() из основного цикла.
+class IREngine {
+private:
+  struct Job {
+    IRFrame frame;
+    uint16_t repeats;
+  };
+
+  int txPin;
+  int rxPin;
+  bool txReady;
+  RingbufHandle_t rxRing;
+  SemaphoreHandle_t lock;
+  esp_timer_handle_t timer;
+
+  Job queue[IR_TX_QUEUE_DEPTH];
+  uint8_t queueHead;
+  uint8_t queueCount;
+  Job current;
+  IRSymbolsPtr inFlight;   // Символы посылки, которые RMT еще подгружает из памяти
+  bool busy;
+  bool timerPending;
+  uint16_t sent;
+  uint16_t carrierHz;
+  uint32_t framesSent;
+  uint32_t dropped;
+
+  static void onTimer(void* arg) {
+    ((IREngine*)arg)->pump();
+  }
+
+  void applyCarrier(uint16_t hz) {
+    if (hz == carrierHz) {
+      return;
+    }
+    if (hz == 0) {
+      rmt_set_tx_carrier(IR_TX_CHANNEL, false, 0, 0, RMT_CARRIER_LEVEL_HIGH);
+    } else {
+      uint32_t period = IR_APB_HZ / hz;
+      uint16_t high = period * IR_CARRIER_DUTY / 100;
+      rmt_set_tx_carrier(IR_TX_CHANNEL, true, high, period - high, RMT_CARRIER_LEVEL_HIGH);
+    }
+    carrierHz = hz;
+  }
+
+  // Выполняется в задаче esp_timer: запуск очередной посылки
+  void pump() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    timerPending = false;
+
+    // Кадры длиннее блока памяти RMT дочитывает по прерываниям из буфера
+    // символов - он освобождается только после конца выдачи
+    bool txDone = rmt_wait_tx_done(IR_TX_CHANNEL, 0) == ESP_OK;
+    if (txDone) {
+      inFlight = nullptr;
+    }
+
+    if (!busy) {
+      if (queueCount == 0) {
+        if (inFlight) {
+          timerPending = true;
+          esp_timer_start_once(timer, 1000);
+        }
+        xSemaphoreGive(lock);
+        return;
+      }
+      current = queue[queueHead];
+      queue[queueHead] = Job();
+      queueHead = (queueHead + 1) % IR_TX_QUEUE_DEPTH;
+      queueCount--;
+      busy = true;
+      sent = 0;
+      applyCarrier(current.frame.carrierHz);
+    }
+
+    uint32_t delayUs = current.frame.periodUs;
+    if (!txDone) {
+      // Предыдущая посылка еще выдается
+      delayUs = 1000;
+    } else {
+      inFlight = (sent == 0 || !current.frame.repeat)
+        ? current.frame.first : current.frame.repeat;
+      rmt_write_items(IR_TX_CHANNEL, inFlight->data(), inFlight->size(), false);
+      framesSent++;
+      if (++sent > current.repeats) {
+        // Следующая команда очереди - не раньше конца периода этой
+        busy = false;
+        current = Job();
+      }
+    }
+
+    timerPending = true;
+    esp_timer_start_once(timer, delayUs);
+    xSemaphoreGive(lock);
+  }
+
+public:
+  IREngine() : txPin(-1), rxPin(-1), txReady(false), rxRing(nullptr), lock(nullptr),
+               timer(nullptr), queueHead(0), queueCount(0), busy(false), timerPending(false),
+               sent(0), carrierHz(0), framesSent(0), dropped(0) {}
+
+  bool begin(int pin) {
+    txPin = pin;
+    lock = xSemaphoreCreateMutex();
+
+    rmt_config_t config = RMT_DEFAULT_CONFIG_TX((gpio_num_t)pin, IR_TX_CHANNEL);
+    config.clk_div = IR_RMT_CLK_DIV;
+    config.tx_config.carrier_en = true;
+    config.tx_config.carrier_freq_hz = IR_DEFAULT_CARRIER_HZ;
+    config.tx_config.carrier_duty_percent = IR_CARRIER_DUTY;
+    config.tx_config.carrier_level = RMT_CARRIER_LEVEL_HIGH;
+    config.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+    config.tx_config.idle_output_en = true;
+    if (rmt_config(&config) != ESP_OK || rmt_driver_install(IR_TX_CHANNEL, 0, 0) != ESP_OK) {
+      Serial.printf("IR: failed to set up RMT transmitter on GPIO%d\n", pin);
+      return false;
+    }
+    carrierHz = IR_DEFAULT_CARRIER_HZ;
+
+    esp_timer_create_args_t args = {};
+    args.callback = onTimer;
+    args.arg = this;
+    args.name = "ir_tx";
+    esp_timer_create(&args, &timer);
+
+    txReady = true;
+    return true;
+  }
+
+  // Постановка кадра в очередь с repeats повторами. false - очередь заполнена
+  bool send(const IRFrame& frame, uint16_t repeats) {
+    if (!txReady || !frame.first) {
+      return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (queueCount >= IR_TX_QUEUE_DEPTH) {
+      dropped++;
+      xSemaphoreGive(lock);
+      return false;
+    }
+    Job& job = queue[(queueHead + queueCount) % IR_TX_QUEUE_DEPTH];
+    job.frame = frame;
+    job.repeats = min(repeats, (uint16_t)IR_MAX_REPEATS);
+    queueCount++;
+    if (!timerPending) {
+      timerPending = true;
+      esp_timer_start_once(timer, 0);
+    }
+    xSemaphoreGive(lock);
+    return true;
+  }
+
+  // Сброс очереди; текущая посылка досылается до конца
+  void clear() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (auto& job : queue) {
+      job = Job();
+    }
+    queueCount = 0;
+    if (busy) {
+      busy = false;
+      current = Job();
+    }
+    xSemaphoreGive(lock);
+  }
+
+  // Включение приема на пине (выход демодулирующего приемника)
+  bool startReceive(int pin) {
+    stopReceive();
+
+    rmt_config_t config = RMT_DEFAULT_CONFIG_RX((gpio_num_t)pin, IR_RX_CHANNEL);
+    config.clk_div = IR_RMT_CLK_DIV;
+    config.mem_block_num = IR_RX_MEM_BLOCKS;
+    config.rx_config.filter_en = true;
+    config.rx_config.filter_ticks_thresh = IR_RX_FILTER_TICKS;
+    config.rx_config.idle_threshold = IR_RX_IDLE_US;
+    if (rmt_config(&config) != ESP_OK ||
+        rmt_driver_install(IR_RX_CHANNEL, IR_RX_BUFFER_SIZE, 0) != ESP_OK) {
+      Serial.printf("IR: failed to set up RMT receiver on GPIO%d\n", pin);
+      return false;
+    }
+    rmt_get_ringbuf_handle(IR_RX_CHANNEL, &rxRing);
+    rmt_rx_start(IR_RX_CHANNEL, true);
+    rxPin = pin;
+    return true;
+  }
+
+  void stopReceive() {
+    if (rxPin < 0) {
+      return;
+    }
+    rmt_rx_stop(IR_RX_CHANNEL);
+    rmt_driver_uninstall(IR_RX_CHANNEL);
+    rxRing = nullptr;
+    rxPin = -1;
+  }
+
+  // Очередной принятый кадр в виде длительностей импульс/пауза, мкс.
+  // Уровень импульса определяется по первому элементу, так что подходят
+  // приемники с любой полярностью выхода
+  bool poll(std::vector<uint16_t>& timings) {
+    if (!rxRing) {
+      return false;
+    }
+    size_t size = 0;
+    rmt_item32_t* items = (rmt_item32_t*)xRingbufferReceive(rxRing, &size, 0);
+    if (!items) {
+      return false;
+    }
+
+    timings.clear();
+    size_t count = size / sizeof(rmt_item32_t);
+    uint32_t markLevel = count > 0 ? items[0].level0 : 0;
+    uint32_t run = 0;
+    uint32_t runLevel = markLevel;
+    for (size_t i = 0; i < count && timings.size() < IR_MAX_RAW_TIMINGS; i++) {
+      uint32_t durations[2] = {items[i].duration0, items[i].duration1};
+      uint32_t levels[2] = {items[i].level0, items[i].level1};
+      for (int h = 0; h < 2; h++) {
+        if (durations[h] == 0) {
+          break;
+        }
+        // Соседние отрезки одного уровня склеиваются
+        if (levels[h] != runLevel && run > 0) {
+          timings.push_back(min(run, (uint32_t)UINT16_MAX));
+          run = 0;
+        }
+        runLevel = levels[h];
+        run += durations[h];
+      }
+    }
+    // Завершающая пауза - это тишина после кадра, она не сохраняется
+    if (run > 0 && runLevel == markLevel && timings.size() < IR_MAX_RAW_TIMINGS) {
+      timings.push_back(min(run, (uint32_t)UINT16_MAX));
+    }
+    vRingbufferReturnItem(rxRing, items);
+    return timings.size() >= IR_RX_MIN_TIMINGS;
+  }
+
+  bool isReady() const { return txReady; }
+  bool isBusy() const { return busy || queueCount > 0; }
+  bool isReceiving() const { return rxPin >= 0; }
+  int getTxPin() const { return txPin; }
+  int getRxPin() const { return rxPin; }
+  size_t queued() const { return queueCount; }
+  uint32_t getFramesSent() const { return framesSent; }
+  uint32_t getDropped() const { return dropped; }
+};
+
+#endif // IR_ENGINE_H
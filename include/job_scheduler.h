@@ -0,0 +1,284 @@
+#ifndef JOB_SCHEDULER_H
+#define JOB_SCHEDULER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+
+// Количество хранимых заданий (выполненные вытесняются самыми старыми)
+#define JOB_MAX_JOBS 8
+// Глубина очереди ожидающих выполнения заданий
+#define JOB_QUEUE_DEPTH 4
+#define JOB_WORKER_STACK 6144
+#define JOB_WORKER_PRIORITY 1
+#define JOB_WORKER_CORE PRO_CPU_NUM  // Задания сетевые - на ядре стека WiFi
+
+// Состояние задания
+enum JobState {
+  JOB_FREE,
+  JOB_QUEUED,
+  JOB_RUNNING,
+  JOB_DONE,
+  JOB_FAILED,
+  JOB_CANCELLED
+};
+
+class JobScheduler;
+
+// Задание, выполняемое рабочей задачей.
+// Функция задания обновляет прогресс и проверяет запрос отмены, а по
+// завершении записывает результат (готовый JSON) или ошибку.
+class Job {
+  friend class JobScheduler;
+
+private:
+  uint32_t id;
+  const char* type;
+  std::atomic<int> state;
+  std::atomic<uint32_t> progressDone;
+  std::atomic<uint32_t> progressTotal;
+  std::atomic<bool> cancelRequested;
+  uint32_t createdAt;
+  uint32_t startedAt;
+  uint32_t finishedAt;
+  String result;
+  String error;
+  std::function<void(Job&)> work;
+
+public:
+  Job() : id(0), type(""), state(JOB_FREE), progressDone(0), progressTotal(0),
+          cancelRequested(false), createdAt(0), startedAt(0), finishedAt(0) {}
+
+  void setProgress(uint32_t done, uint32_t total) {
+    progressDone.store(done);
+    progressTotal.store(total);
+  }
+
+  bool isCancelRequested() const {
+    return cancelRequested.load();
+  }
+
+  // Результат в формате JSON
+  void setResult(const String& json) {
+    result = json;
+  }
+
+  void fail(const String& message) {
+    error = message;
+  }
+};
+
+// Снимок состояния задания для выдачи через API
+struct JobInfo {
+  uint32_t id;
+  const char* type;
+  JobState state;
+  uint32_t progressDone;
+  uint32_t progressTotal;
+  uint32_t elapsed;  // мс
+  String result;
+  String error;
+};
+
+// Планировщик заданий с одной рабочей задачей.
+//
+// Обработчики HTTP только ставят задание в ограниченную очередь и сразу
+// возвращают его идентификатор, а длительная работа выполняется рабочей
+// задачей на ядре стека WiFi (JOB_WORKER_CORE), рядом с сетью, с которой
+// она работает. Это не блокирует задачу AsyncTCP, которая обслуживает всех
+// клиентов веб-сервера, и не отнимает время у интерфейса на другом ядре.
+class JobScheduler {
+private:
+  Job jobs[JOB_MAX_JOBS];
+  QueueHandle_t queue;
+  SemaphoreHandle_t mutex;
+  TaskHandle_t worker;
+  uint32_t nextId;
+
+  static void workerEntry(void* param) {
+    ((JobScheduler*)param)->workerLoop();
+  }
+
+  void workerLoop() {
+    while (true) {
+      Job* job = nullptr;
+      if (xQueueReceive(queue, &job, portMAX_DELAY) != pdTRUE || job == nullptr) {
+        continue;
+      }
+
+      // Задание отменено, пока ожидало в очереди
+      if (job->cancelRequested.load()) {
+        finish(*job, JOB_CANCELLED);
+        continue;
+      }
+
+      job->startedAt = millis();
+      job->state.store(JOB_RUNNING);
+      job->work(*job);
+
+      JobState finalState = JOB_DONE;
+      if (job->cancelRequested.load()) {
+        finalState = JOB_CANCELLED;
+      } else if (!job->error.isEmpty()) {
+        finalState = JOB_FAILED;
+      }
+      finish(*job, finalState);
+    }
+  }
+
+  void finish(Job& job, JobState finalState) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    job.finishedAt = millis();
+    job.work = nullptr;  // Освобождаем захваченные лямбдой данные
+    job.state.store(finalState);
+    xSemaphoreGive(mutex);
+  }
+
+  // Поиск слота под новое задание: свободный или самый старый завершенный
+  Job* allocateSlot() {
+    Job* oldest = nullptr;
+    for (auto& job : jobs) {
+      int state = job.state.load();
+      if (state == JOB_FREE) {
+        return &job;
+      }
+      if (state != JOB_QUEUED && state != JOB_RUNNING &&
+          (oldest == nullptr || job.id < oldest->id)) {
+        oldest = &job;
+      }
+    }
+    return oldest;
+  }
+
+  Job* findJob(uint32_t id) {
+    for (auto& job : jobs) {
+      if (job.id == id && job.state.load() != JOB_FREE) {
+        return &job;
+      }
+    }
+    return nullptr;
+  }
+
+public:
+  JobScheduler() : queue(nullptr), mutex(nullptr), worker(nullptr), nextId(1) {}
+
+  // Создание очереди и рабочей задачи
+  bool begin() {
+    if (worker != nullptr) {
+      return true;
+    }
+
+    queue = xQueueCreate(JOB_QUEUE_DEPTH, sizeof(Job*));
+    mutex = xSemaphoreCreateMutex();
+    if (!queue || !mutex) {
+      return false;
+    }
+
+    return xTaskCreatePinnedToCore(workerEntry, "jobs", JOB_WORKER_STACK, this,
+                                   JOB_WORKER_PRIORITY, &worker, JOB_WORKER_CORE) == pdPASS;
+  }
+
+  // Постановка задания в очередь. Возвращает идентификатор или 0, если очередь заполнена
+  uint32_t submit(const char* type, std::function<void(Job&)> work) {
+    if (!queue) {
+      return 0;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    Job* job = uxQueueSpacesAvailable(queue) > 0 ? allocateSlot() : nullptr;
+    if (job == nullptr) {
+      xSemaphoreGive(mutex);
+      return 0;
+    }
+
+    job->id = nextId++;
+    job->type = type;
+    job->progressDone.store(0);
+    job->progressTotal.store(0);
+    job->cancelRequested.store(false);
+    job->createdAt = millis();
+    job->startedAt = 0;
+    job->finishedAt = 0;
+    job->result = "";
+    job->error = "";
+    job->work = work;
+    job->state.store(JOB_QUEUED);
+    uint32_t id = job->id;
+    xSemaphoreGive(mutex);
+
+    if (xQueueSend(queue, &job, 0) != pdTRUE) {
+      job->error = "Queue full";
+      finish(*job, JOB_FAILED);
+      return 0;
+    }
+    return id;
+  }
+
+  // Снимок состояния задания
+  bool getInfo(uint32_t id, JobInfo& info) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    Job* job = findJob(id);
+    if (job == nullptr) {
+      xSemaphoreGive(mutex);
+      return false;
+    }
+
+    info.id = job->id;
+    info.type = job->type;
+    info.state = (JobState)job->state.load();
+    info.progressDone = job->progressDone.load();
+    info.progressTotal = job->progressTotal.load();
+    uint32_t end = job->finishedAt ? job->finishedAt : millis();
+    info.elapsed = job->startedAt ? end - job->startedAt : 0;
+    // Результат и ошибка меняются рабочей задачей только до перехода в конечное состояние
+    if (info.state != JOB_QUEUED && info.state != JOB_RUNNING) {
+      info.result = job->result;
+      info.error = job->error;
+    }
+    xSemaphoreGive(mutex);
+    return true;
+  }
+
+  // Идентификаторы всех хранимых заданий
+  size_t listJobs(uint32_t* ids, size_t max) {
+    size_t count = 0;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (auto& job : jobs) {
+      if (count < max && job.state.load() != JOB_FREE) {
+        ids[count++] = job.id;
+      }
+    }
+    xSemaphoreGive(mutex);
+    return count;
+  }
+
+  // Запрос отмены задания
+  bool cancel(uint32_t id) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    Job* job = findJob(id);
+    bool active = job != nullptr &&
+                  (job->state.load() == JOB_QUEUED || job->state.load() == JOB_RUNNING);
+    if (active) {
+      job->cancelRequested.store(true);
+    }
+    xSemaphoreGive(mutex);
+    return active;
+  }
+
+  size_t getQueued() const {
+    return queue ? uxQueueMessagesWaiting(queue) : 0;
+  }
+
+  static const char* stateName(JobState state) {
+    switch (state) {
+      case JOB_QUEUED: return "queued";
+      case JOB_RUNNING: return "running";
+      case JOB_DONE: return "done";
+      case JOB_FAILED: return "failed";
+      case JOB_CANCELLED: return "cancelled";
+      default: return "free";
+    }
+  }
+};
+
+#endif // JOB_SCHEDULER_H
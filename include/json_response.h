@@ -0,0 +1,72 @@
+#ifndef JSON_RESPONSE_H
+#define JSON_RESPONSE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+
+// Размер буфера потока по умолчанию (один TCP-сегмент)
+#define JSON_STREAM_DEFAULT_SIZE 1460
+
+// Отправка JSON-документа.
+// Документ сериализуется прямо в буфер ответа точного размера, без
+// промежуточной String: одно выделение памяти вместо трех
+inline void sendJson(AsyncWebServerRequest* request, const JsonDocument& doc, int code = 200) {
+  AsyncResponseStream* response = request->beginResponseStream("application/json", measureJson(doc));
+  response->setCode(code);
+  serializeJson(doc, *response);
+  request->send(response);
+}
+
+// Ответ вида {"<key>":[...], <доп. поля>} для списков переменной длины.
+//
+// Элементы сериализуются по одному из небольшого документа на стеке,
+// поэтому размер ответа не ограничен емкостью документа, а куча не
+// дробится под большой DynamicJsonDocument. sizeHint - ожидаемый размер
+// ответа, чтобы буфер потока выделился один раз.
+class JsonListWriter {
+private:
+  AsyncWebServerRequest* request;
+  AsyncResponseStream* response;
+  size_t count;
+
+public:
+  JsonListWriter(AsyncWebServerRequest* req, const char* key, size_t sizeHint = JSON_STREAM_DEFAULT_SIZE)
+    : request(req), count(0) {
+    response = request->beginResponseStream("application/json", sizeHint);
+    response->print("{\"");
+    response->print(key);
+    response->print("\":[");
+  }
+
+  // Добавление элемента списка
+  void add(const JsonDocument& item) {
+    if (count++ > 0) {
+      response->print(',');
+    }
+    serializeJson(item, *response);
+  }
+
+  size_t size() const {
+    return count;
+  }
+
+  // Завершение списка и отправка. Поля объекта extra (если задан)
+  // добавляются в ответ после списка
+  void send(const JsonDocument* extra = nullptr) {
+    response->print(']');
+    if (extra && extra->size() > 0) {
+      char buffer[256];
+      size_t len = serializeJson(*extra, buffer, sizeof(buffer));
+      // Поля без внешних фигурных скобок
+      if (len > 2 && len < sizeof(buffer) - 1) {
+        response->print(',');
+        response->write((const uint8_t*)buffer + 1, len - 2);
+      }
+    }
+    response->print('}');
+    request->send(response);
+  }
+};
+
+#endif // JSON_RESPONSE_H
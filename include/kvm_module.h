@@ -252,10 +252,7 @@ void KVMModule::updatePinMonitoring() {
           } else {
             M5.Speaker.tone(lowToneFrequency, toneDuration);
           }
-          
-          // Через заданное время отключаем сигнал
-          delay(toneDuration + 10);
-          M5.Speaker.stop();
+          // Сигнал с длительностью выключается сам, ждать его не нужно
         }
       }
     }
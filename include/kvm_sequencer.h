@@ -0,0 +1,284 @@
+#ifndef KVM_SEQUENCER_H
+#define KVM_SEQUENCER_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <esp_timer.h>
+#include <functional>
+#include <vector>
+
+#define KVM_MAX_SEQUENCES 8
+#define KVM_MAX_SEQUENCE_STEPS 24
+#define KVM_SEQUENCE_MAX_STEP_US 60000000UL   // Минута на шаг: сумма умещается в 32 бита
+#define KVM_SEQUENCE_LEAD_US 200              // Задержка старта после запуска
+
+// Шаг сценария
+enum KVMStepType : uint8_t {
+  KVM_STEP_SET,   // Установить уровень пина
+  KVM_STEP_HOLD,  // Удерживать активный уровень durationUs, затем вернуть
+  KVM_STEP_WAIT   // Пауза
+};
+
+#define KVM_LEVEL_INVERT 2  // Активный уровень - инверсия текущего (как pulsePin)
+
+struct KVMSequenceStep {
+  KVMStepType type;
+  int8_t gpio;
+  uint8_t level;        // 0, 1 или KVM_LEVEL_INVERT
+  uint32_t durationUs;
+};
+
+// Именованный сценарий, хранится в kvm_config.json
+struct KVMSequence {
+  String name;
+  std::vector<KVMSequenceStep> steps;
+};
+
+// Разбор шага из JSON:
+//   {"index":0,"hold":5000}       - удерживать пин 0 пять секунд
+//   {"gpio":26,"set":1}           - установить уровень
+//   {"wait":2000}                 - пауза
+// Длительности в мс, либо в мкс через holdUs/waitUs. Для hold можно задать
+// "level"; по умолчанию активный уровень - инверсия текущего состояния.
+// resolveIndex переводит индекс пина KVM в GPIO (-1 - нет такого пина)
+inline bool parseSequenceStep(JsonObjectConst obj, std::function<int(int)> resolveIndex,
+                              KVMSequenceStep& step) {
+  int gpio = -1;
+  if (obj.containsKey("gpio")) {
+    gpio = obj["gpio"].as<int>();
+  } else if (obj.containsKey("index")) {
+    gpio = resolveIndex(obj["index"].as<int>());
+  }
+
+  uint64_t us = 0;
+  if (obj.containsKey("hold") || obj.containsKey("holdUs")) {
+    step.type = KVM_STEP_HOLD;
+    us = obj.containsKey("holdUs") ? obj["holdUs"].as<uint64_t>() : obj["hold"].as<uint64_t>() * 1000;
+    step.level = obj.containsKey("level") ? (obj["level"].as<int>() ? 1 : 0) : KVM_LEVEL_INVERT;
+  } else if (obj.containsKey("set")) {
+    step.type = KVM_STEP_SET;
+    step.level = obj["set"].as<int>() ? 1 : 0;
+  } else if (obj.containsKey("wait") || obj.containsKey("waitUs")) {
+    step.type = KVM_STEP_WAIT;
+    us = obj.containsKey("waitUs") ? obj["waitUs"].as<uint64_t>() : obj["wait"].as<uint64_t>() * 1000;
+    step.level = 0;
+    gpio = -1;
+  } else {
+    return false;
+  }
+
+  if (step.type != KVM_STEP_WAIT && gpio < 0) {
+    return false;
+  }
+  if (us > KVM_SEQUENCE_MAX_STEP_US) {
+    return false;
+  }
+  step.gpio = gpio;
+  step.durationUs = us;
+  return true;
+}
+
+// Шаг в JSON в том же виде, в каком он принимается
+inline void sequenceStepToJson(const KVMSequenceStep& step, JsonObject obj) {
+  switch (step.type) {
+    case KVM_STEP_HOLD:
+      obj["gpio"] = step.gpio;
+      obj["holdUs"] = step.durationUs;
+      if (step.level != KVM_LEVEL_INVERT) obj["level"] = step.level;
+      break;
+    case KVM_STEP_SET:
+      obj["gpio"] = step.gpio;
+      obj["set"] = step.level;
+      break;
+    case KVM_STEP_WAIT:
+      obj["waitUs"] = step.durationUs;
+      break;
+  }
+}
+
+// Воспроизведение сценариев по esp_timer.
+//
+// Перед запуском сценарий разворачивается в список переключений с временем
+// от старта. Обработчик таймера переключает пины и взводит таймер на
+// следующее переключение по абсолютному времени, поэтому задержки
+// обработчика не накапливаются, а веб-сервер и задача интерфейса
+// не блокируются.
+class KVMSequencer {
+public:
+  // Переключение пина через atUs от старта (gpio = -1 - конец сценария)
+  struct Op {
+    int8_t gpio;
+    uint8_t level;
+    uint32_t atUs;
+  };
+
+private:
+  std::vector<Op> ops;
+  size_t next;
+  int64_t startUs;
+  volatile bool running;
+  volatile bool inCallback;  // advance() выполняется, ops и onDone заняты
+  esp_timer_handle_t timer;
+  portMUX_TYPE mux;
+  String currentName;
+  std::function<void()> onDone;
+  uint32_t maxLateUs;   // Максимальное опоздание переключения
+  uint32_t runs;
+
+  static void onTimer(void* arg) {
+    ((KVMSequencer*)arg)->advance();
+  }
+
+  // Ожидание выхода из advance(): esp_timer_stop не ждет уже начавшийся
+  // обработчик. Не вызывать из onDone
+  void waitCallback() {
+    while (inCallback) {
+      vTaskDelay(1);
+    }
+  }
+
+  // Выполняется в задаче esp_timer
+  void advance() {
+    portENTER_CRITICAL(&mux);
+    bool active = running;
+    inCallback = active;
+    portEXIT_CRITICAL(&mux);
+    if (!active) {
+      return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    while (next < ops.size() && startUs + ops[next].atUs <= now) {
+      const Op& op = ops[next];
+      if (op.gpio >= 0) {
+        digitalWrite(op.gpio, op.level ? HIGH : LOW);
+      }
+      uint32_t late = (uint32_t)(now - (startUs + op.atUs));
+      if (late > maxLateUs) maxLateUs = late;
+      next++;
+      now = esp_timer_get_time();
+    }
+
+    if (next < ops.size()) {
+      esp_timer_start_once(timer, startUs + ops[next].atUs - now);
+      inCallback = false;
+      return;
+    }
+
+    // stop() мог завершить сценарий параллельно - колбэк вызывается один раз
+    portENTER_CRITICAL(&mux);
+    bool finished = running;
+    running = false;
+    portEXIT_CRITICAL(&mux);
+    if (finished) {
+      runs++;
+      if (onDone) onDone();
+    }
+    inCallback = false;
+  }
+
+public:
+  KVMSequencer() : next(0), startUs(0), running(false), inCallback(false), timer(nullptr),
+                   maxLateUs(0), runs(0) {
+    portMUX_TYPE init = portMUX_INITIALIZER_UNLOCKED;
+    mux = init;
+  }
+
+  void begin() {
+    esp_timer_create_args_t args = {};
+    args.callback = onTimer;
+    args.arg = this;
+    args.name = "kvm_seq";
+    esp_timer_create(&args, &timer);
+  }
+
+  // Развертывание шагов в переключения. stateOf - текущий уровень пина,
+  // нужен для шагов hold с инверсией
+  static std::vector<Op> compile(const std::vector<KVMSequenceStep>& steps,
+                                 std::function<bool(int)> stateOf) {
+    std::vector<Op> out;
+    bool levels[64] = {false};
+    bool known[64] = {false};
+    uint32_t t = 0;
+
+    for (const auto& step : steps) {
+      bool current = false;
+      if (step.gpio >= 0 && step.gpio < 64) {
+        if (!known[step.gpio]) {
+          levels[step.gpio] = stateOf(step.gpio);
+          known[step.gpio] = true;
+        }
+        current = levels[step.gpio];
+      }
+
+      switch (step.type) {
+        case KVM_STEP_SET:
+          out.push_back({step.gpio, step.level, t});
+          levels[step.gpio] = step.level;
+          break;
+        case KVM_STEP_HOLD: {
+          uint8_t active = step.level == KVM_LEVEL_INVERT ? !current : step.level;
+          out.push_back({step.gpio, active, t});
+          t += step.durationUs;
+          out.push_back({step.gpio, (uint8_t)current, t});
+          break;
+        }
+        case KVM_STEP_WAIT:
+          t += step.durationUs;
+          break;
+      }
+    }
+    // Пауза в конце тоже часть сценария
+    out.push_back({-1, 0, t});
+    return out;
+  }
+
+  // Запуск. false - уже выполняется другой сценарий
+  bool start(const String& name, const std::vector<Op>& program, std::function<void()> done) {
+    portENTER_CRITICAL(&mux);
+    bool busy = running;
+    running = true;
+    portEXIT_CRITICAL(&mux);
+    if (busy) {
+      return false;
+    }
+
+    // Прошлый сценарий мог еще выходить из обработчика
+    waitCallback();
+    ops = program;
+    next = 0;
+    currentName = name;
+    onDone = done;
+    maxLateUs = 0;
+    startUs = esp_timer_get_time() + KVM_SEQUENCE_LEAD_US;
+    esp_timer_start_once(timer, KVM_SEQUENCE_LEAD_US);
+    return true;
+  }
+
+  // Остановка. Пины остаются в текущем состоянии. Возвращается после
+  // выхода из обработчика: начавшийся проход мог снова взвести таймер
+  bool stop() {
+    portENTER_CRITICAL(&mux);
+    bool stopped = running;
+    running = false;
+    portEXIT_CRITICAL(&mux);
+    esp_timer_stop(timer);
+    waitCallback();
+    esp_timer_stop(timer);
+    if (stopped && onDone) onDone();
+    return stopped;
+  }
+
+  bool isRunning() const { return running; }
+  const String& getCurrentName() const { return currentName; }
+  size_t getProgress() const { return next; }
+  size_t getLength() const { return ops.size(); }
+  uint32_t getTotalUs() const { return ops.empty() ? 0 : ops.back().atUs; }
+  uint32_t getElapsedUs() const {
+    return running ? (uint32_t)max((int64_t)0, esp_timer_get_time() - startUs) : 0;
+  }
+  uint32_t getMaxLateUs() const { return maxLateUs; }
+  uint32_t getRuns() const { return runs; }
+};
+
+#endif // KVM_SEQUENCER_H
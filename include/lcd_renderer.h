@@ -0,0 +1,103 @@
+#ifndef LCD_RENDERER_H
+#define LCD_RENDERER_H
+
+#include <Arduino.h>
+#include <M5StickCPlus2.h>
+#include <rom/crc.h>
+
+#define LCD_BAND_HEIGHT 8     // Высота полосы экрана в строках
+#define LCD_MAX_BANDS 32      // 240 строк / 8 с запасом
+
+// Отрисовка экрана через буфер в памяти.
+//
+// Кадр рисуется в M5Canvas, затем экран делится на горизонтальные полосы
+// по LCD_BAND_HEIGHT строк: для каждой считается CRC32 и по SPI
+// отправляются только полосы, содержимое которых изменилось. Экран не
+// мерцает от fillScreen, а обновление монитора KVM со сменой пары чисел
+// передает несколько сотен байт вместо 64 КБ.
+//
+// Если памяти под буфер нет, target() возвращает сам экран и отрисовка
+// идет напрямую, как раньше.
+class LcdRenderer {
+private:
+  M5Canvas canvas;
+  LovyanGFX* lcd;
+  bool ready;
+  uint32_t bandHash[LCD_MAX_BANDS];
+  bool bandValid[LCD_MAX_BANDS];
+  uint32_t framesPresented;
+  uint32_t bandsPushed;
+
+public:
+  LcdRenderer() : lcd(nullptr), ready(false), framesPresented(0), bandsPushed(0) {
+    invalidate();
+  }
+
+  // Создание буфера под текущий размер экрана.
+  // Повторять после смены ориентации с другими размерами
+  bool begin(LovyanGFX& display) {
+    lcd = &display;
+    if (ready) {
+      canvas.deleteSprite();
+      ready = false;
+    }
+    if (display.height() > LCD_BAND_HEIGHT * LCD_MAX_BANDS) {
+      return false;
+    }
+    canvas.setColorDepth(16);
+    canvas.setPsram(true);
+    ready = canvas.createSprite(display.width(), display.height()) != nullptr;
+    invalidate();
+    return ready;
+  }
+
+  // Поверхность для рисования кадра
+  LovyanGFX& target() {
+    return ready ? (LovyanGFX&)canvas : *lcd;
+  }
+
+  // Экран был изменен в обход буфера - следующий кадр передается целиком
+  void invalidate() {
+    memset(bandValid, 0, sizeof(bandValid));
+  }
+
+  // Вывод на экран изменившихся полос кадра
+  void present() {
+    if (!ready) {
+      return;
+    }
+
+    const int32_t w = canvas.width();
+    const int32_t h = canvas.height();
+    const lgfx::swap565_t* pixels = (const lgfx::swap565_t*)canvas.getBuffer();
+    bool writing = false;
+
+    for (int32_t y = 0, band = 0; y < h; y += LCD_BAND_HEIGHT, band++) {
+      int32_t rows = min((int32_t)LCD_BAND_HEIGHT, h - y);
+      const lgfx::swap565_t* row = pixels + y * w;
+      uint32_t hash = crc32_le(0, (const uint8_t*)row, rows * w * sizeof(*row));
+      if (bandValid[band] && bandHash[band] == hash) {
+        continue;
+      }
+      if (!writing) {
+        lcd->startWrite();
+        writing = true;
+      }
+      lcd->pushImage(0, y, w, rows, row);
+      bandHash[band] = hash;
+      bandValid[band] = true;
+      bandsPushed++;
+    }
+
+    if (writing) {
+      lcd->endWrite();
+    }
+    framesPresented++;
+  }
+
+  bool isBuffered() const { return ready; }
+  uint32_t getFramesPresented() const { return framesPresented; }
+  uint32_t getBandsPushed() const { return bandsPushed; }
+};
+
+#endif // LCD_RENDERER_H
@@ -0,0 +1,486 @@
+#ifndef LOGIC_ANALYZER_H
+#define LOGIC_ANALYZER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <soc/gpio_reg.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define LA_MAX_CHANNELS 8             // Выборка - один байт, бит на канал
+#define LA_PSRAM_SAMPLES 262144       // Буфер в PSRAM
+#define LA_HEAP_SAMPLES 16384         // Буфер в обычной куче, если PSRAM нет
+#define LA_MIN_RATE 1000
+#define LA_MAX_RATE 2000000           // Предел цикла опроса регистра входов
+#define LA_DEFAULT_RATE 1000000
+#define LA_MAX_TRIGGER_WAIT_MS 10000
+#define LA_IRQ_OFF_MAX_US 5000        // Окна короче снимаются с запретом прерываний
+#define LA_SPIN_MIN_SLICE_US 2000     // Ожидание триггера без уступки процессора:
+#define LA_SPIN_MAX_SLICE_US 20000    // не короче окна до триггера, в этих пределах
+#define LA_SPIN_YIELD_RATIO 4         // Пауза между отрезками - во столько раз длиннее
+#define LA_TASK_STACK 3072
+
+enum LATriggerType : uint8_t {
+  LA_TRIGGER_NONE,     // Захват сразу
+  LA_TRIGGER_RISING,   // Фронт на канале
+  LA_TRIGGER_FALLING,  // Спад на канале
+  LA_TRIGGER_HIGH,     // Высокий уровень на канале
+  LA_TRIGGER_LOW,      // Низкий уровень на канале
+  LA_TRIGGER_PATTERN   // Совпадение (выборка & mask) == value
+};
+
+enum LAState : uint8_t {
+  LA_IDLE,
+  LA_ARMED,        // Ожидание триггера
+  LA_CAPTURING,    // Триггер сработал, идет запись
+  LA_DONE,
+  LA_TIMEOUT,      // Триггер не сработал
+  LA_CANCELLED
+};
+
+struct LAConfig {
+  int8_t gpio[LA_MAX_CHANNELS];
+  String names[LA_MAX_CHANNELS];
+  uint8_t channels;
+  uint32_t rate;           // Выборок в секунду
+  uint32_t samples;        // Полный размер захвата
+  uint8_t pretrigger;      // Доля выборок до триггера, %
+  LATriggerType trigger;
+  uint8_t triggerChannel;
+  uint8_t patternMask;
+  uint8_t patternValue;
+  uint32_t timeoutMs;
+};
+
+inline const char* laStateName(LAState state) {
+  switch (state) {
+    case LA_IDLE:      return "idle";
+    case LA_ARMED:     return "armed";
+    case LA_CAPTURING: return "capturing";
+    case LA_DONE:      return "done";
+    case LA_TIMEOUT:   return "timeout";
+    case LA_CANCELLED: return "cancelled";
+  }
+  return "unknown";
+}
+
+inline bool parseTriggerType(const String& name, LATriggerType& type) {
+  if (name == "none") type = LA_TRIGGER_NONE;
+  else if (name == "rising") type = LA_TRIGGER_RISING;
+  else if (name == "falling") type = LA_TRIGGER_FALLING;
+  else if (name == "high") type = LA_TRIGGER_HIGH;
+  else if (name == "low") type = LA_TRIGGER_LOW;
+  else if (name == "pattern") type = LA_TRIGGER_PATTERN;
+  else return false;
+  return true;
+}
+
+// Логический анализатор на KVM пинах.
+//
+// Захват выполняет отдельная задача на ядре приложения с наивысшим
+// приоритетом: она опрашивает регистры входов GPIO с шагом, отсчитанным по
+// счетчику тактов процессора, и упаковывает выбранные пины в байт выборки.
+// До триггера выборки пишутся по кругу, после него дописывается оставшаяся
+// часть окна, так что в буфере оказываются и события до триггера.
+// Короткие окна после триггера снимаются с запрещенными прерываниями без
+// пропусков; в длинных возможны редкие задержки на обработку прерываний,
+// фактическая частота измеряется и отдается вместе с данными.
+class LogicAnalyzer {
+private:
+  uint8_t* buffer;
+  uint32_t capacity;
+  bool inPsram;
+  TaskHandle_t task;
+  mutable std::atomic<int> readers;
+
+  LAConfig config;
+  volatile LAState state;
+  volatile bool cancelRequested;
+
+  // Результат последнего захвата
+  uint32_t start;          // Индекс первой выборки в кольце
+  uint32_t count;          // Выборок в захвате
+  uint32_t triggerIndex;   // Номер выборки триггера
+  bool triggered;
+  uint32_t actualRate;
+  uint32_t overruns;       // Выборки, снятые позже своего срока
+  bool irqOff;
+  uint64_t armedAtUs;
+  uint64_t triggeredAtUs;
+
+  static void taskEntry(void* arg) {
+    LogicAnalyzer* self = (LogicAnalyzer*)arg;
+    for (;;) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      self->capture();
+    }
+  }
+
+  static inline uint8_t IRAM_ATTR pack(const int8_t* gpio, uint8_t channels, bool high) {
+    uint32_t lo = REG_READ(GPIO_IN_REG);
+    uint32_t hi = high ? REG_READ(GPIO_IN1_REG) : 0;
+    uint8_t sample = 0;
+    for (uint8_t ch = 0; ch < channels; ch++) {
+      int g = gpio[ch];
+      uint32_t bit = g < 32 ? (lo >> g) : (hi >> (g - 32));
+      sample |= (bit & 1) << ch;
+    }
+    return sample;
+  }
+
+  void capture() {
+    const uint32_t total = config.samples;
+    // Без триггера все окно записывается сразу
+    const uint32_t pre = config.trigger == LA_TRIGGER_NONE
+      ? 0 : (uint32_t)((uint64_t)total * config.pretrigger / 100);
+    const uint32_t post = total - pre;
+    const uint32_t cpuHz = getCpuFrequencyMhz() * 1000000UL;
+    const uint32_t period = max((uint32_t)1, cpuHz / config.rate);
+    const int8_t* gpio = config.gpio;
+    const uint8_t channels = config.channels;
+
+    bool high = false;
+    for (uint8_t ch = 0; ch < channels; ch++) {
+      if (gpio[ch] >= 32) high = true;
+    }
+
+    // Условие триггера: ((s & mask) == value) и, для фронтов, смена бита edge
+    uint8_t mask = 0, value = 0, edge = 0;
+    uint8_t bit = 1 << config.triggerChannel;
+    switch (config.trigger) {
+      case LA_TRIGGER_NONE:    break;
+      case LA_TRIGGER_RISING:  mask = bit; value = bit; edge = bit; break;
+      case LA_TRIGGER_FALLING: mask = bit; value = 0;   edge = bit; break;
+      case LA_TRIGGER_HIGH:    mask = bit; value = bit; break;
+      case LA_TRIGGER_LOW:     mask = bit; value = 0;   break;
+      case LA_TRIGGER_PATTERN: mask = config.patternMask; value = config.patternValue; break;
+    }
+
+    uint32_t late = 0;
+    uint32_t w = 0;            // Позиция записи в кольце
+    uint32_t preWritten = 0;   // Из них непрерывно до триггера
+    bool hit = config.trigger == LA_TRIGGER_NONE;
+    int64_t deadline = esp_timer_get_time() + (int64_t)config.timeoutMs * 1000;
+
+    // Ожидание триггера. Отрезками опроса с паузой в LA_SPIN_YIELD_RATIO раз
+    // длиннее, чтобы задача интерфейса на этом же ядре получала большую часть
+    // процессора до таймаута. Отрезок покрывает окно до триггера, после паузы
+    // запись до триггера начинается заново. Уровень с конца прошлого отрезка
+    // сохраняется, так что фронт во время паузы ловится первой же выборкой
+    uint64_t preUs = (uint64_t)pre * 1000000ULL / config.rate;
+    const uint32_t sliceUs = (uint32_t)constrain(preUs + LA_SPIN_MIN_SLICE_US,
+                                                 (uint64_t)LA_SPIN_MIN_SLICE_US,
+                                                 (uint64_t)LA_SPIN_MAX_SLICE_US);
+    const TickType_t yieldTicks = max((TickType_t)1,
+                                      pdMS_TO_TICKS(sliceUs * LA_SPIN_YIELD_RATIO / 1000));
+    uint8_t prev = pack(gpio, channels, high);
+    while (!hit) {
+      int64_t sliceEnd = esp_timer_get_time() + sliceUs;
+      uint32_t next = esp_cpu_get_ccount();
+      preWritten = 0;
+
+      while (true) {
+        while ((int32_t)(esp_cpu_get_ccount() - next) < 0) {}
+        next += period;
+        uint8_t s = pack(gpio, channels, high);
+        buffer[w] = s;
+        if (++w == total) w = 0;
+        preWritten++;
+        if ((s & mask) == value && (edge == 0 || ((s ^ prev) & edge))) {
+          hit = true;
+          break;
+        }
+        prev = s;
+        // Время проверяется редко: esp_timer_get_time() дороже выборки
+        if ((preWritten & 1023) == 0 && (cancelRequested || esp_timer_get_time() >= sliceEnd)) {
+          break;
+        }
+      }
+      if (hit) {
+        break;
+      }
+      if (cancelRequested || esp_timer_get_time() >= deadline) {
+        // Конец ожидания, в буфере остаются выборки последнего отрезка
+        uint32_t kept = min(preWritten, total);
+        start = (w + total - kept) % total;
+        count = kept;
+        triggerIndex = 0;
+        triggered = false;
+        actualRate = config.rate;
+        overruns = late;
+        irqOff = false;
+        state = cancelRequested ? LA_CANCELLED : LA_TIMEOUT;
+        return;
+      }
+      vTaskDelay(yieldTicks);
+    }
+
+    triggeredAtUs = esp_timer_get_time();
+    state = LA_CAPTURING;
+
+    // Выборка триггера уже записана и входит в окно после него
+    uint32_t trigSample = preWritten > 0 ? 1 : 0;
+    uint32_t kept = trigSample ? min(preWritten - 1, pre) : 0;
+    uint32_t remaining = post - trigSample;
+    uint64_t windowUs = (uint64_t)post * 1000000ULL / config.rate;
+    irqOff = windowUs <= LA_IRQ_OFF_MAX_US;
+
+    static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+    if (irqOff) portENTER_CRITICAL(&mux);
+    uint32_t begin = esp_cpu_get_ccount();
+    uint32_t next = begin + period;
+    uint32_t taken = 0;
+    for (; taken < remaining; taken++) {
+      while ((int32_t)(esp_cpu_get_ccount() - next) < 0) {}
+      buffer[w] = pack(gpio, channels, high);
+      if (++w == total) w = 0;
+      if ((int32_t)(esp_cpu_get_ccount() - next) > (int32_t)period) late++;
+      next += period;
+      if (!irqOff && (taken & 4095) == 4095 && cancelRequested) {
+        taken++;
+        break;
+      }
+    }
+    uint32_t elapsed = esp_cpu_get_ccount() - begin;
+    if (irqOff) portEXIT_CRITICAL(&mux);
+
+    count = kept + trigSample + taken;
+    start = (w + total - count) % total;
+    triggerIndex = kept;
+    triggered = config.trigger != LA_TRIGGER_NONE;
+    actualRate = elapsed > 0 && taken > 0
+      ? (uint32_t)((uint64_t)taken * cpuHz / elapsed) : config.rate;
+    overruns = late;
+    state = cancelRequested ? LA_CANCELLED : LA_DONE;
+  }
+
+public:
+  LogicAnalyzer() : buffer(nullptr), capacity(0), inPsram(false), task(nullptr), readers(0),
+                    state(LA_IDLE), cancelRequested(false), start(0), count(0),
+                    triggerIndex(0), triggered(false), actualRate(0), overruns(0),
+                    irqOff(false), armedAtUs(0), triggeredAtUs(0) {
+    config.channels = 0;
+  }
+
+  // Выделение буфера и запуск задачи захвата
+  bool begin() {
+    buffer = (uint8_t*)heap_caps_malloc(LA_PSRAM_SAMPLES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    inPsram = buffer != nullptr;
+    capacity = LA_PSRAM_SAMPLES;
+    if (!buffer) {
+      buffer = (uint8_t*)heap_caps_malloc(LA_HEAP_SAMPLES, MALLOC_CAP_8BIT);
+      capacity = LA_HEAP_SAMPLES;
+    }
+    if (!buffer) {
+      capacity = 0;
+      Serial.println("Logic analyzer: failed to allocate sample buffer");
+      return false;
+    }
+
+    xTaskCreatePinnedToCore(taskEntry, "logic_an", LA_TASK_STACK, this,
+                            configMAX_PRIORITIES - 1, &task, APP_CPU_NUM);
+    Serial.printf("Logic analyzer: %u samples in %s\n",
+                  (unsigned)capacity, inPsram ? "PSRAM" : "heap");
+    return true;
+  }
+
+  // Запуск захвата. false - анализатор занят, error - причина
+  bool arm(const LAConfig& cfg, String& error) {
+    if (!task) {
+      error = "Logic analyzer unavailable";
+      return false;
+    }
+    if (isBusy()) {
+      error = "Capture in progress";
+      return false;
+    }
+    if (readers.load() > 0) {
+      error = "Capture download in progress";
+      return false;
+    }
+    if (cfg.channels == 0 || cfg.channels > LA_MAX_CHANNELS) {
+      error = "Invalid channel set";
+      return false;
+    }
+    for (uint8_t ch = 0; ch < cfg.channels; ch++) {
+      if (cfg.gpio[ch] < 0 || cfg.gpio[ch] >= 40) {
+        error = "Invalid GPIO";
+        return false;
+      }
+    }
+    if (cfg.trigger != LA_TRIGGER_NONE && cfg.trigger != LA_TRIGGER_PATTERN &&
+        cfg.triggerChannel >= cfg.channels) {
+      error = "Invalid trigger channel";
+      return false;
+    }
+
+    config = cfg;
+    config.rate = constrain(config.rate, (uint32_t)LA_MIN_RATE, (uint32_t)LA_MAX_RATE);
+    config.samples = constrain(config.samples, (uint32_t)2, capacity);
+    config.pretrigger = min(config.pretrigger, (uint8_t)99);
+    config.timeoutMs = min(config.timeoutMs, (uint32_t)LA_MAX_TRIGGER_WAIT_MS);
+
+    count = 0;
+    triggered = false;
+    cancelRequested = false;
+    armedAtUs = esp_timer_get_time();
+    triggeredAtUs = 0;
+    state = LA_ARMED;
+    xTaskNotifyGive(task);
+    return true;
+  }
+
+  void cancel() {
+    if (isBusy()) {
+      cancelRequested = true;
+    }
+  }
+
+  bool isBusy() const { return state == LA_ARMED || state == LA_CAPTURING; }
+  bool hasData() const { return !isBusy() && count > 0; }
+
+  // Выборка захвата по порядку (0 - самая ранняя)
+  uint8_t sampleAt(uint32_t i) const {
+    return buffer[(start + i) % config.samples];
+  }
+
+  // Выгрузка идет без копирования: пока есть читатели, новый захват запрещен
+  void acquireReader() const { readers.fetch_add(1); }
+  void releaseReader() const { readers.fetch_sub(1); }
+
+  const LAConfig& getConfig() const { return config; }
+  LAState getState() const { return state; }
+  uint32_t getCount() const { return count; }
+  uint32_t getTriggerIndex() const { return triggerIndex; }
+  bool isTriggered() const { return triggered; }
+  uint32_t getActualRate() const { return actualRate; }
+  uint32_t getOverruns() const { return overruns; }
+  bool wasIrqOff() const { return irqOff; }
+  uint32_t getCapacity() const { return capacity; }
+  bool isInPsram() const { return inPsram; }
+  uint64_t getArmedAtUs() const { return armedAtUs; }
+  uint64_t getTriggeredAtUs() const { return triggeredAtUs; }
+};
+
+// Потоковая выдача захвата: VCD (GTKWave, PulseView) или сырые байты
+// выборок для входного формата binary в sigrok (unitsize 1)
+class LogicStreamer {
+private:
+  const LogicAnalyzer& la;
+  bool vcd;
+  uint32_t next;
+  uint8_t prev;
+  bool headerDone;
+  bool finished;
+  uint64_t periodPs;       // Шаг выборки в пикосекундах
+  char pending[768];
+  size_t pendingLen;
+  size_t pendingPos;
+
+  void stageHeader() {
+    const LAConfig& cfg = la.getConfig();
+    int len = snprintf(pending, sizeof(pending),
+                       "$date uptime %llu us $end\n"
+                       "$version M5 KVM logic analyzer $end\n"
+                       "$comment rate %u Hz (requested %u), trigger at sample %u%s $end\n"
+                       "$timescale 1 ns $end\n"
+                       "$scope module kvm $end\n",
+                       (unsigned long long)la.getArmedAtUs(), (unsigned)la.getActualRate(),
+                       (unsigned)cfg.rate, (unsigned)la.getTriggerIndex(),
+                       la.isTriggered() ? "" : " (not triggered)");
+    for (uint8_t ch = 0; ch < cfg.channels && len < (int)sizeof(pending) - 80; ch++) {
+      // Имена в VCD не должны содержать пробелов
+      String name = cfg.names[ch].length() ? cfg.names[ch] : String("GPIO") + cfg.gpio[ch];
+      name.replace(' ', '_');
+      len += snprintf(pending + len, sizeof(pending) - len, "$var wire 1 %c %.32s $end\n",
+                      '!' + ch, name.c_str());
+    }
+    len += snprintf(pending + len, sizeof(pending) - len,
+                    "$upscope $end\n$enddefinitions $end\n");
+    pendingLen = min((size_t)len, sizeof(pending) - 1);
+    pendingPos = 0;
+  }
+
+  // Следующее изменение уровней в pending. false - данные закончились
+  bool stageChange() {
+    const LAConfig& cfg = la.getConfig();
+    uint32_t total = la.getCount();
+    while (next < total) {
+      uint32_t i = next++;
+      uint8_t s = la.sampleAt(i);
+      uint8_t changed = i == 0 ? 0xFF : (uint8_t)(s ^ prev);
+      changed &= (1 << cfg.channels) - 1;
+      prev = s;
+      if (!changed) {
+        continue;
+      }
+      int len = snprintf(pending, sizeof(pending), "#%llu\n",
+                         (unsigned long long)(i * periodPs / 1000));
+      for (uint8_t ch = 0; ch < cfg.channels; ch++) {
+        if (changed & (1 << ch)) {
+          pending[len++] = (s >> ch) & 1 ? '1' : '0';
+          pending[len++] = '!' + ch;
+          pending[len++] = '\n';
+        }
+      }
+      pendingLen = len;
+      pendingPos = 0;
+      return true;
+    }
+    if (!finished) {
+      // Отметка конца окна, иначе последний уровень не виден
+      finished = true;
+      pendingLen = snprintf(pending, sizeof(pending), "#%llu\n",
+                            (unsigned long long)(total * periodPs / 1000));
+      pendingPos = 0;
+      return true;
+    }
+    return false;
+  }
+
+public:
+  LogicStreamer(const LogicAnalyzer& analyzer, bool vcdFormat)
+    : la(analyzer), vcd(vcdFormat), next(0), prev(0), headerDone(false), finished(false),
+      pendingLen(0), pendingPos(0) {
+    uint32_t rate = la.getActualRate() ? la.getActualRate() : la.getConfig().rate;
+    periodPs = 1000000000000ULL / rate;
+    la.acquireReader();
+  }
+
+  ~LogicStreamer() {
+    la.releaseReader();
+  }
+
+  // Заполняющий колбэк ответа
+  size_t fill(uint8_t* buffer, size_t maxLen) {
+    if (!vcd) {
+      size_t n = 0;
+      uint32_t total = la.getCount();
+      while (n < maxLen && next < total) {
+        buffer[n++] = la.sampleAt(next++);
+      }
+      return n;
+    }
+
+    size_t filled = 0;
+    while (filled < maxLen) {
+      if (pendingPos >= pendingLen) {
+        if (!headerDone) {
+          headerDone = true;
+          stageHeader();
+        } else if (!stageChange()) {
+          break;
+        }
+      }
+      size_t chunk = min(maxLen - filled, pendingLen - pendingPos);
+      memcpy(buffer + filled, pending + pendingPos, chunk);
+      pendingPos += chunk;
+      filled += chunk;
+    }
+    return filled;
+  }
+};
+
+#endif // LOGIC_ANALYZER_H
@@ -7,6 +7,8 @@
 #include <ESPmDNS.h>
 #include <ESP32Ping.h>
 #include <WiFiClient.h>
+#include "host_sweep.h"
+#include "port_scanner.h"
 
 // Структура для результата пинга
 struct PingResult {
@@ -35,10 +37,30 @@ struct PortScanResult {
 // Класс для сетевых инструментов
 class NetworkTools {
 private:
-  std::vector<IPAddress> blockedIPs;
+  HostSweep sweep;
+  PortScanner portScanner;
+  
+  // Разбор диапазона IP
+  bool parseIPRange(const String& range, IPAddress& startIP, IPAddress& endIP) {
+    int dashIndex = range.indexOf('-');
+    if (dashIndex == -1) {
+      return false;
+    }
+    
+    String startStr = range.substring(0, dashIndex);
+    String endStr = range.substring(dashIndex + 1);
+    
+    startStr.trim();
+    endStr.trim();
+    
+    return startIP.fromString(startStr) && endIP.fromString(endStr);
+  }
+
+public:
+  NetworkTools() {}
   
   // Определение сервиса по порту
-  String identifyService(int port) {
+  static String identifyService(int port) {
     switch (port) {
       case 20: return "FTP-data";
       case 21: return "FTP";
@@ -59,24 +81,16 @@ private:
     }
   }
   
-  // Разбор диапазона IP
-  bool parseIPRange(const String& range, IPAddress& startIP, IPAddress& endIP) {
-    int dashIndex = range.indexOf('-');
-    if (dashIndex == -1) {
-      return false;
+  // Разбор диапазона вида "192.168.1.1-192.168.1.254" или префикса "192.168.1"
+  bool parseRange(const String& range, IPAddress& startIP, IPAddress& endIP) {
+    if (parseIPRange(range, startIP, endIP)) {
+      return true;
     }
     
-    String startStr = range.substring(0, dashIndex);
-    String endStr = range.substring(dashIndex + 1);
-    
-    startStr.trim();
-    endStr.trim();
-    
-    return startIP.fromString(startStr) && endIP.fromString(endStr);
+    String prefix = range;
+    prefix.trim();
+    return startIP.fromString(prefix + ".1") && endIP.fromString(prefix + ".254");
   }
-
-public:
-  NetworkTools() {}
   
   // Пинг хоста
   PingResult ping(const String& host, int count = 4) {
@@ -109,138 +123,70 @@ public:
     return result;
   }
   
-  // Сканирование сети
+  // Сканирование сети (блокирующее, в вызывающей задаче)
   std::vector<ScanResult> scanNetwork(const String& range) {
     std::vector<ScanResult> results;
     
     IPAddress startIP, endIP;
-    if (!parseIPRange(range, startIP, endIP)) {
-      return results; // Пустой результат при ошибке разбора
-    }
-    
-    // Ограничиваем диапазон для предотвращения слишком долгого сканирования
-    uint32_t startNum = startIP;
-    uint32_t endNum = endIP;
-    uint32_t maxHosts = 255;
-    
-    if (endNum - startNum > maxHosts) {
-      endNum = startNum + maxHosts;
+    if (!parseRange(range, startIP, endIP) || !sweep.run(startIP, endIP)) {
+      return results; // Пустой результат при ошибке
     }
     
-    for (uint32_t ipNum = startNum; ipNum <= endNum; ipNum++) {
-      IPAddress currentIP(ipNum);
+    for (const auto& host : sweep.getResults()) {
       ScanResult result;
-      result.ip = currentIP;
-      
-      // Пингуем хост с таймаутом
-      if (Ping.ping(currentIP, 1)) {
-        result.active = true;
-        result.response_time = Ping.averageTime();
-      } else {
-        result.active = false;
-        result.response_time = 0;
-      }
-      
+      result.ip = host.ip;
+      result.active = true;
+      result.response_time = host.response_time;
       results.push_back(result);
-      
-      // Даём возможность обработать другие задачи
-      delay(1);
-      yield();
     }
     
     return results;
   }
   
-  // Сканирование портов
+  // Запуск фонового сканирования сети
+  bool startSweep(const String& range, const SweepConfig& config) {
+    IPAddress startIP, endIP;
+    if (!parseRange(range, startIP, endIP)) {
+      return false;
+    }
+    return sweep.start(startIP, endIP, config);
+  }
+  
+  // Фоновое сканирование сети
+  HostSweep& getSweep() {
+    return sweep;
+  }
+  
+  // Разрешение адреса хоста
+  bool resolveHost(const String& host, IPAddress& ip) {
+    return ip.fromString(host) || WiFi.hostByName(host.c_str(), ip);
+  }
+  
+  // Сканирование портов (блокирующее, в вызывающей задаче)
   std::vector<PortScanResult> scanPorts(const String& host, int startPort, int endPort) {
     std::vector<PortScanResult> results;
     
     IPAddress ip;
-    if (!ip.fromString(host) && !WiFi.hostByName(host.c_str(), ip)) {
+    if (!resolveHost(host, ip)) {
       return results; // Не удалось разрешить хост
     }
     
-    // Ограничиваем количество портов
-    if (startPort < 1) startPort = 1;
-    if (endPort > 65535) endPort = 65535;
-    if (endPort - startPort > 100) endPort = startPort + 100;
-    
-    WiFiClient client;
+    portScanner.run(ip, startPort, endPort);
     
-    for (int port = startPort; port <= endPort; port++) {
+    for (uint16_t port : portScanner.getOpenPorts()) {
       PortScanResult result;
       result.port = port;
-      result.open = false;
-      
-      // Пытаемся подключиться с коротким таймаутом
-      client.setTimeout(300);
-      
-      if (client.connect(ip, port)) {
-        result.open = true;
-        result.service = identifyService(port);
-        client.stop();
-      }
-      
-      if (result.open) {
-        results.push_back(result);
-      }
-      
-      // Даём возможность обработать другие задачи
-      delay(1);
-      yield();
+      result.open = true;
+      result.service = identifyService(port);
+      results.push_back(result);
     }
     
     return results;
   }
   
-  // Блокировка IP
-  bool blockIP(const String& ipStr) {
-    IPAddress ip;
-    if (!ip.fromString(ipStr)) {
-      return false;
-    }
-    
-    // Проверяем, не заблокирован ли уже IP
-    for (const auto& blockedIP : blockedIPs) {
-      if (blockedIP == ip) {
-        return false; // Уже заблокирован
-      }
-    }
-    
-    blockedIPs.push_back(ip);
-    return true;
-  }
-  
-  // Разблокировка IP
-  bool unblockIP(const String& ipStr) {
-    IPAddress ip;
-    if (!ip.fromString(ipStr)) {
-      return false;
-    }
-    
-    for (auto it = blockedIPs.begin(); it != blockedIPs.end(); ++it) {
-      if (*it == ip) {
-        blockedIPs.erase(it);
-        return true;
-      }
-    }
-    
-    return false; // IP не был заблокирован
-  }
-  
-  // Получение списка заблокированных IP
-  const std::vector<IPAddress>& getBlockedIPs() const {
-    return blockedIPs;
-  }
-  
-  // Проверка, заблокирован ли IP
-  bool isIPBlocked(const IPAddress& ip) const {
-    for (const auto& blockedIP : blockedIPs) {
-      if (blockedIP == ip) {
-        return true;
-      }
-    }
-    return false;
+  // Фоновое сканирование портов
+  PortScanner& getPortScanner() {
+    return portScanner;
   }
 };
 
@@ -0,0 +1,139 @@
+#ifndef PACKET_RING_H
+#define PACKET_RING_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Тип перехваченного кадра (по полю Type заголовка 802.11)
+enum SniffFrameType : uint8_t {
+  SNIFF_FRAME_MGMT,
+  SNIFF_FRAME_CTRL,
+  SNIFF_FRAME_DATA,
+  SNIFF_FRAME_MISC
+};
+
+// Бинарная запись о перехваченном пакете фиксированного размера.
+// Строки не хранятся - форматирование выполняется только при чтении.
+struct SniffedPacket {
+  uint8_t sourceMAC[6];
+  uint8_t destMAC[6];
+  uint8_t type;        // SniffFrameType
+  uint8_t stream;      // Поток клиента в SniffFilter
+  int8_t rssi;
+  uint16_t size;
+  uint32_t timestamp;  // millis() в момент приема
+};
+
+// Название типа кадра для вывода
+inline const char* sniffFrameTypeName(uint8_t type) {
+  switch (type) {
+    case SNIFF_FRAME_MGMT: return "MGMT";
+    case SNIFF_FRAME_CTRL: return "CTRL";
+    case SNIFF_FRAME_DATA: return "DATA";
+    default: return "MISC";
+  }
+}
+
+// Lock-free кольцевой буфер пакетов с одним писателем.
+//
+// Писатель (колбэк promiscuous-режима в задаче WiFi-драйвера) никогда не
+// блокируется и не выделяет память: при заполнении перезаписывается самая
+// старая запись. Каждый слот помечается порядковым номером записи (seqlock),
+// поэтому читатель (веб-сервер, экран) может в любой момент снять копию без
+// блокировок и отбросить слот, который был перезаписан во время чтения.
+template <size_t N>
+class PacketRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "PacketRing size must be a power of two");
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> stamp;  // 0 - пусто/идет запись, иначе seq + 1
+    SniffedPacket packet;
+  };
+
+  Slot slots[N];
+  std::atomic<uint32_t> head;  // Порядковый номер следующей записи
+
+public:
+  PacketRing() : head(0) {
+    for (auto& slot : slots) {
+      slot.stamp.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // Добавление пакета (вызывается только из одного потока-писателя)
+  void push(const SniffedPacket& packet) {
+    uint32_t seq = head.load(std::memory_order_relaxed);
+    Slot& slot = slots[seq & (N - 1)];
+
+    slot.stamp.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.packet = packet;
+    slot.stamp.store(seq + 1, std::memory_order_release);
+
+    head.store(seq + 1, std::memory_order_release);
+  }
+
+  // Чтение записи с порядковым номером seq.
+  // Возвращает false, если запись еще не сделана или уже перезаписана.
+  bool read(uint32_t seq, SniffedPacket& out) const {
+    const Slot& slot = slots[seq & (N - 1)];
+    uint32_t before = slot.stamp.load(std::memory_order_acquire);
+    if (before != seq + 1) {
+      return false;
+    }
+
+    out = slot.packet;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.stamp.load(std::memory_order_relaxed) == before;
+  }
+
+  // Копирование последних (не более max) пакетов от старых к новым.
+  // Возвращает количество скопированных пакетов.
+  size_t snapshot(SniffedPacket* out, size_t max) const {
+    uint32_t end = head.load(std::memory_order_acquire);
+    uint32_t count = end < N ? end : N;
+    if (count > max) {
+      count = max;
+    }
+
+    size_t copied = 0;
+    for (uint32_t seq = end - count; seq != end; seq++) {
+      if (read(seq, out[copied])) {
+        copied++;
+      }
+    }
+    return copied;
+  }
+
+  // Последний записанный пакет
+  bool latest(SniffedPacket& out) const {
+    uint32_t end = head.load(std::memory_order_acquire);
+    return end > 0 && read(end - 1, out);
+  }
+
+  // Общее количество пакетов, записанных с момента очистки
+  uint32_t written() const {
+    return head.load(std::memory_order_acquire);
+  }
+
+  // Количество пакетов, доступных для чтения
+  size_t size() const {
+    uint32_t end = written();
+    return end < N ? end : N;
+  }
+
+  static constexpr size_t capacity() {
+    return N;
+  }
+
+  // Очистка буфера (только при остановленном писателе)
+  void clear() {
+    for (auto& slot : slots) {
+      slot.stamp.store(0, std::memory_order_relaxed);
+    }
+    head.store(0, std::memory_order_release);
+  }
+};
+
+#endif // PACKET_RING_H
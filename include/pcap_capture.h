@@ -0,0 +1,389 @@
+#ifndef PCAP_CAPTURE_H
+#define PCAP_CAPTURE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <memory>
+#include <esp_wifi.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <ESPAsyncWebServer.h>
+
+// Глубина буфера захвата по умолчанию (количество кадров)
+#ifndef SNIFF_CAPTURE_DEFAULT_DEPTH
+#define SNIFF_CAPTURE_DEFAULT_DEPTH 512
+#endif
+
+// Максимальная длина сохраняемой части кадра по умолчанию (байт)
+#ifndef SNIFF_CAPTURE_DEFAULT_SNAPLEN
+#define SNIFF_CAPTURE_DEFAULT_SNAPLEN 256
+#endif
+
+// Ограничения на параметры буфера захвата
+#define SNIFF_CAPTURE_MIN_DEPTH 16
+#define SNIFF_CAPTURE_MAX_DEPTH 8192
+#define SNIFF_CAPTURE_MIN_SNAPLEN 32
+#define SNIFF_CAPTURE_MAX_SNAPLEN 2324
+
+// Тип канального уровня PCAP: 802.11 с заголовком radiotap
+#define PCAP_LINKTYPE_IEEE802_11_RADIOTAP 127
+
+// Заголовок кадра в буфере захвата
+struct CaptureRecordHeader {
+  uint64_t timestampUs;  // esp_timer_get_time() в момент приема
+  uint16_t origLen;      // Длина кадра в эфире (без FCS)
+  uint16_t capLen;       // Сохраненная длина
+  int8_t rssi;
+  uint8_t channel;
+  uint8_t frameType;     // wifi_promiscuous_pkt_type_t
+  uint8_t stream;        // Поток клиента в SniffFilter
+};
+
+// Глобальный заголовок файла PCAP
+struct __attribute__((packed)) PcapGlobalHeader {
+  uint32_t magic;
+  uint16_t versionMajor;
+  uint16_t versionMinor;
+  int32_t thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t network;
+};
+
+// Заголовок записи PCAP
+struct __attribute__((packed)) PcapRecordHeader {
+  uint32_t tsSec;
+  uint32_t tsUsec;
+  uint32_t inclLen;
+  uint32_t origLen;
+};
+
+// Минимальный заголовок radiotap: flags, channel, dBm antenna signal
+struct __attribute__((packed)) RadiotapHeader {
+  uint8_t version;
+  uint8_t pad;
+  uint16_t length;
+  uint32_t present;
+  uint8_t flags;
+  uint8_t alignPad;      // Выравнивание поля channel на 2 байта
+  uint16_t channelFreq;
+  uint16_t channelFlags;
+  int8_t antennaSignal;
+};
+
+// Кольцевой буфер захвата кадров целиком.
+//
+// Размер задается во время работы и выделяется в PSRAM (если есть) или в
+// обычной куче. Как и PacketRing, буфер имеет одного писателя (колбэк
+// сниффера) и любое количество читателей: каждый слот помечен порядковым
+// номером записи, читатель отбрасывает слоты, перезаписанные во время чтения.
+class CaptureRing {
+private:
+  uint8_t* storage;
+  std::atomic<uint32_t>* stamps;
+  uint32_t depth;
+  uint16_t snaplen;
+  size_t slotSize;
+  bool inPsram;
+  std::atomic<uint32_t> head;
+  mutable std::atomic<int> readers;  // Активные потоки выгрузки, удерживающие буфер
+
+  uint8_t* slotAt(uint32_t seq) const {
+    return storage + (size_t)(seq % depth) * slotSize;
+  }
+
+public:
+  CaptureRing()
+    : storage(nullptr), stamps(nullptr), depth(0),
+      snaplen(SNIFF_CAPTURE_DEFAULT_SNAPLEN), slotSize(0), inPsram(false), head(0), readers(0) {}
+
+  ~CaptureRing() {
+    release();
+  }
+
+  // Выделение буфера. Вызывать только при остановленном сниффере.
+  bool allocate(uint32_t newDepth, uint16_t newSnaplen) {
+    newDepth = constrain(newDepth, (uint32_t)SNIFF_CAPTURE_MIN_DEPTH, (uint32_t)SNIFF_CAPTURE_MAX_DEPTH);
+    newSnaplen = constrain(newSnaplen, (uint16_t)SNIFF_CAPTURE_MIN_SNAPLEN, (uint16_t)SNIFF_CAPTURE_MAX_SNAPLEN);
+
+    if (storage && newDepth == depth && newSnaplen == snaplen) {
+      clear();
+      return true;
+    }
+
+    // Пока идет выгрузка, буфер нельзя освободить - оставляем прежний размер
+    if (storage && readers.load() > 0) {
+      clear();
+      return false;
+    }
+
+    release();
+
+    size_t newSlotSize = (sizeof(CaptureRecordHeader) + newSnaplen + 3) & ~(size_t)3;
+    size_t bytes = newSlotSize * newDepth;
+
+    // Сначала пробуем PSRAM, затем обычную кучу
+    storage = (uint8_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    inPsram = storage != nullptr;
+    if (!storage) {
+      // В куче оставляем не меньше половины свободной памяти для остальной прошивки
+      size_t freeHeap = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+      if (bytes > freeHeap / 2) {
+        newDepth = max((uint32_t)SNIFF_CAPTURE_MIN_DEPTH, (uint32_t)(freeHeap / 2 / newSlotSize));
+        bytes = newSlotSize * newDepth;
+      }
+      storage = (uint8_t*)heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+    }
+
+    stamps = (std::atomic<uint32_t>*)heap_caps_malloc(sizeof(std::atomic<uint32_t>) * newDepth,
+                                                      MALLOC_CAP_8BIT);
+    if (!storage || !stamps) {
+      Serial.printf("Capture ring: failed to allocate %u bytes\n", (unsigned)bytes);
+      release();
+      return false;
+    }
+
+    depth = newDepth;
+    snaplen = newSnaplen;
+    slotSize = newSlotSize;
+    clear();
+
+    Serial.printf("Capture ring: %u frames x %u bytes in %s\n",
+                  (unsigned)depth, (unsigned)snaplen, inPsram ? "PSRAM" : "heap");
+    return true;
+  }
+
+  // Освобождение буфера (не выполняется, пока идет выгрузка)
+  void release() {
+    if (readers.load() > 0) return;
+    if (storage) {
+      heap_caps_free(storage);
+      storage = nullptr;
+    }
+    if (stamps) {
+      heap_caps_free(stamps);
+      stamps = nullptr;
+    }
+    depth = 0;
+    slotSize = 0;
+    head.store(0);
+  }
+
+  // Сброс содержимого (только при остановленном писателе)
+  void clear() {
+    for (uint32_t i = 0; i < depth; i++) {
+      new (&stamps[i]) std::atomic<uint32_t>(0);
+    }
+    head.store(0, std::memory_order_release);
+  }
+
+  // Запись кадра (вызывается только из колбэка сниффера)
+  void push(const wifi_promiscuous_pkt_t* pkt, wifi_promiscuous_pkt_type_t type, uint8_t stream) {
+    if (!storage) return;
+
+    const wifi_pkt_rx_ctrl_t& ctrl = pkt->rx_ctrl;
+    // sig_len включает 4 байта FCS, которые в файл не пишем
+    uint16_t frameLen = ctrl.sig_len > 4 ? ctrl.sig_len - 4 : ctrl.sig_len;
+
+    uint32_t seq = head.load(std::memory_order_relaxed);
+    uint8_t* slot = slotAt(seq);
+    std::atomic<uint32_t>& stamp = stamps[seq % depth];
+
+    stamp.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    CaptureRecordHeader* hdr = (CaptureRecordHeader*)slot;
+    hdr->timestampUs = esp_timer_get_time();
+    hdr->origLen = frameLen;
+    hdr->capLen = frameLen < snaplen ? frameLen : snaplen;
+    hdr->rssi = ctrl.rssi;
+    hdr->channel = ctrl.channel;
+    hdr->frameType = (uint8_t)type;
+    hdr->stream = stream;
+    memcpy(slot + sizeof(CaptureRecordHeader), pkt->payload, hdr->capLen);
+
+    stamp.store(seq + 1, std::memory_order_release);
+    head.store(seq + 1, std::memory_order_release);
+  }
+
+  // Копирование кадра с порядковым номером seq в out (размер не менее slotSize).
+  // Возвращает false, если кадр еще не записан или уже перезаписан.
+  bool read(uint32_t seq, uint8_t* out) const {
+    if (!storage) return false;
+
+    const std::atomic<uint32_t>& stamp = stamps[seq % depth];
+    uint32_t before = stamp.load(std::memory_order_acquire);
+    if (before != seq + 1) {
+      return false;
+    }
+
+    const uint8_t* slot = slotAt(seq);
+    const CaptureRecordHeader* hdr = (const CaptureRecordHeader*)slot;
+    size_t len = sizeof(CaptureRecordHeader) + min(hdr->capLen, snaplen);
+    memcpy(out, slot, len);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return stamp.load(std::memory_order_relaxed) == before;
+  }
+
+  // Порядковый номер самого старого доступного кадра
+  uint32_t oldest() const {
+    uint32_t end = written();
+    return end > depth ? end - depth : 0;
+  }
+
+  // Учет читателей, удерживающих буфер от освобождения
+  void acquireReader() const { readers.fetch_add(1); }
+  void releaseReader() const { readers.fetch_sub(1); }
+
+  uint32_t written() const { return head.load(std::memory_order_acquire); }
+  uint32_t getDepth() const { return depth; }
+  uint16_t getSnaplen() const { return snaplen; }
+  size_t getSlotSize() const { return slotSize; }
+  size_t getMemoryUsage() const { return slotSize * depth + sizeof(std::atomic<uint32_t>) * depth; }
+  bool isAllocated() const { return storage != nullptr; }
+  bool isInPsram() const { return inPsram; }
+};
+
+// Потоковая выдача содержимого CaptureRing в формате PCAP.
+//
+// Состояние хранится между вызовами заполняющего колбэка chunked-ответа:
+// каждая запись сериализуется во временный буфер и выдается по частям,
+// поэтому весь захват никогда не собирается в памяти целиком.
+class PcapStreamer {
+private:
+  const CaptureRing& ring;
+  uint32_t nextSeq;
+  uint32_t endSeq;           // Для снимка - граница, для live - не используется
+  bool live;
+  const volatile bool* liveActive;
+  int stream;                // -1 - все потоки
+  uint32_t lost;
+
+  std::unique_ptr<uint8_t[]> slotBuf;
+  std::unique_ptr<uint8_t[]> pending;
+  size_t pendingLen;
+  size_t pendingPos;
+
+  static uint16_t channelFreq(uint8_t channel) {
+    if (channel == 14) return 2484;
+    return 2407 + 5 * channel;
+  }
+
+  // Сериализация глобального заголовка в pending
+  void stageGlobalHeader() {
+    PcapGlobalHeader hdr;
+    hdr.magic = 0xa1b2c3d4;
+    hdr.versionMajor = 2;
+    hdr.versionMinor = 4;
+    hdr.thiszone = 0;
+    hdr.sigfigs = 0;
+    hdr.snaplen = ring.getSnaplen() + sizeof(RadiotapHeader);
+    hdr.network = PCAP_LINKTYPE_IEEE802_11_RADIOTAP;
+    memcpy(pending.get(), &hdr, sizeof(hdr));
+    pendingLen = sizeof(hdr);
+    pendingPos = 0;
+  }
+
+  // Сериализация очередного кадра в pending. false - кадров больше нет.
+  bool stageNextRecord() {
+    while (true) {
+      uint32_t written = ring.written();
+      // Буфер был очищен перезапуском сниффинга - начинаем сначала
+      if (live && nextSeq > written) {
+        nextSeq = 0;
+      }
+      uint32_t limit = live ? written : endSeq;
+      if (nextSeq >= limit) {
+        return false;
+      }
+
+      // Читатель отстал - пропускаем перезаписанные кадры
+      uint32_t oldest = ring.oldest();
+      if (nextSeq < oldest) {
+        lost += oldest - nextSeq;
+        nextSeq = oldest;
+        continue;
+      }
+
+      uint32_t seq = nextSeq++;
+      if (!ring.read(seq, slotBuf.get())) {
+        lost++;
+        continue;
+      }
+
+      const CaptureRecordHeader* src = (const CaptureRecordHeader*)slotBuf.get();
+      if (stream >= 0 && src->stream != stream) {
+        continue;
+      }
+
+      PcapRecordHeader rec;
+      rec.tsSec = (uint32_t)(src->timestampUs / 1000000ULL);
+      rec.tsUsec = (uint32_t)(src->timestampUs % 1000000ULL);
+      rec.inclLen = sizeof(RadiotapHeader) + src->capLen;
+      rec.origLen = sizeof(RadiotapHeader) + src->origLen;
+
+      RadiotapHeader rt;
+      rt.version = 0;
+      rt.pad = 0;
+      rt.length = sizeof(RadiotapHeader);
+      rt.present = (1 << 1) | (1 << 3) | (1 << 5);  // flags, channel, dbm_antsignal
+      rt.flags = 0;
+      rt.alignPad = 0;
+      rt.channelFreq = channelFreq(src->channel);
+      rt.channelFlags = 0x0080;  // 2 ГГц
+      rt.antennaSignal = src->rssi;
+
+      uint8_t* out = pending.get();
+      memcpy(out, &rec, sizeof(rec));
+      memcpy(out + sizeof(rec), &rt, sizeof(rt));
+      memcpy(out + sizeof(rec) + sizeof(rt), slotBuf.get() + sizeof(CaptureRecordHeader), src->capLen);
+      pendingLen = sizeof(rec) + sizeof(rt) + src->capLen;
+      pendingPos = 0;
+      return true;
+    }
+  }
+
+public:
+  // liveFlag - признак активного сниффинга для live-режима,
+  // stream - отбор кадров одного клиента (-1 - все)
+  PcapStreamer(const CaptureRing& ring, bool live, const volatile bool* liveFlag, int stream = -1)
+    : ring(ring), nextSeq(ring.oldest()), endSeq(ring.written()), live(live),
+      liveActive(liveFlag), stream(stream), lost(0), pendingLen(0), pendingPos(0) {
+    size_t slot = ring.getSlotSize() ? ring.getSlotSize() : sizeof(CaptureRecordHeader);
+    slotBuf.reset(new uint8_t[slot]);
+    pending.reset(new uint8_t[sizeof(PcapRecordHeader) + sizeof(RadiotapHeader) + ring.getSnaplen()]);
+    ring.acquireReader();
+    stageGlobalHeader();
+  }
+
+  ~PcapStreamer() {
+    ring.releaseReader();
+  }
+
+  // Заполняющий колбэк для beginChunkedResponse
+  size_t fill(uint8_t* buffer, size_t maxLen) {
+    size_t filled = 0;
+
+    while (filled < maxLen) {
+      if (pendingPos >= pendingLen && !stageNextRecord()) {
+        break;
+      }
+
+      size_t chunk = min(maxLen - filled, pendingLen - pendingPos);
+      memcpy(buffer + filled, pending.get() + pendingPos, chunk);
+      pendingPos += chunk;
+      filled += chunk;
+    }
+
+    // В live-режиме держим соединение, пока идет сниффинг
+    if (filled == 0 && live && liveActive && *liveActive) {
+      return RESPONSE_TRY_AGAIN;
+    }
+    return filled;
+  }
+
+  uint32_t getLost() const { return lost; }
+};
+
+#endif // PCAP_CAPTURE_H
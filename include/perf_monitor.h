@@ -0,0 +1,291 @@
+#ifndef PERF_MONITOR_H
+#define PERF_MONITOR_H
+
+#include <Arduino.h>
+#include <memory>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+
+#define PERF_LOOP_BUCKETS 10
+#define PERF_MAX_ROUTES 32
+#define PERF_ROUTE_LEN 40
+#define PERF_MAX_TASKS 32
+#define PERF_SLOW_REQUEST_US 50000   // Обработчик дольше - считается медленным
+
+// Верхние границы корзин гистограммы прохода цикла, мкс (последняя - все, что дольше)
+static const uint32_t PERF_LOOP_BOUNDS_US[PERF_LOOP_BUCKETS - 1] = {
+  100, 250, 500, 1000, 2000, 5000, 10000, 20000, 50000
+};
+
+// Счетчики одного маршрута
+struct PerfRouteStats {
+  char path[PERF_ROUTE_LEN];
+  uint8_t method;              // WebRequestMethod
+  uint32_t count;
+  uint32_t slow;               // Дольше PERF_SLOW_REQUEST_US
+  uint64_t totalUs;
+  uint32_t maxUs;
+  uint32_t lastUs;
+};
+
+// Сбор показателей производительности для /api/perf.
+//
+// Время прохода цикла пишет задача интерфейса (проходы ее планировщика),
+// время обработчиков - промежуточный
+// обработчик веб-сервера в задаче AsyncTCP; счетчики обновляются под
+// одним mux и копируются при чтении. Время обработчика - это синхронная
+// часть до send(): выдача chunked-ответов идет позже и сюда не входит.
+// Загрузка CPU по задачам считается между двумя запросами снимка, если
+// FreeRTOS собран со статистикой времени выполнения.
+class PerfMonitor {
+private:
+  uint32_t loopBuckets[PERF_LOOP_BUCKETS];
+  uint32_t loopCount;
+  uint32_t loopMaxUs;
+  uint64_t loopTotalUs;
+
+  PerfRouteStats routes[PERF_MAX_ROUTES];
+  uint8_t routeCount;
+  uint32_t unlistedRequests;   // Маршруты, не поместившиеся в таблицу
+  uint32_t unroutedRequests;   // Запросы без маршрута (onNotFound)
+  uint32_t requests;
+  bool unrouted;               // Текущий запрос ушел в onNotFound (задача AsyncTCP)
+
+  struct TaskRuntime {
+    UBaseType_t number;
+    uint32_t runtime;
+  };
+  TaskRuntime prevRuntime[PERF_MAX_TASKS];
+  uint8_t prevCount;
+  uint32_t prevTotalRuntime;
+
+  mutable portMUX_TYPE mux;
+
+  // Маршрут в таблице; вызывать под mux
+  PerfRouteStats* routeFor(const char* path, uint8_t method) {
+    for (uint8_t i = 0; i < routeCount; i++) {
+      if (routes[i].method == method && strncmp(routes[i].path, path, PERF_ROUTE_LEN - 1) == 0) {
+        return &routes[i];
+      }
+    }
+    if (routeCount >= PERF_MAX_ROUTES) {
+      return nullptr;
+    }
+    PerfRouteStats* route = &routes[routeCount++];
+    memset(route, 0, sizeof(*route));
+    strlcpy(route->path, path, sizeof(route->path));
+    route->method = method;
+    return route;
+  }
+
+  // Ключ маршрута: сегменты пути с цифрами (идентификаторы, версии
+  // ресурсов) сводятся к "*", чтобы /jobs/<id> занимал одну строку таблицы
+  static void routeKey(const String& url, char* out, size_t size) {
+    size_t len = 0;
+    size_t i = 0;
+    while (i < url.length() && len + 1 < size) {
+      if (url[i] == '/') {
+        out[len++] = '/';
+        i++;
+        continue;
+      }
+      size_t end = i;
+      bool digits = false;
+      while (end < url.length() && url[end] != '/') {
+        digits = digits || isdigit((unsigned char)url[end]);
+        end++;
+      }
+      if (digits) {
+        out[len++] = '*';
+      } else {
+        for (size_t j = i; j < end && len + 1 < size; j++) {
+          out[len++] = url[j];
+        }
+      }
+      i = end;
+    }
+    out[len] = '\0';
+  }
+
+  uint32_t previousRuntime(UBaseType_t number) const {
+    for (uint8_t i = 0; i < prevCount; i++) {
+      if (prevRuntime[i].number == number) return prevRuntime[i].runtime;
+    }
+    return 0;
+  }
+
+public:
+  PerfMonitor() : unrouted(false), prevCount(0), prevTotalRuntime(0) {
+    mux = portMUX_INITIALIZER_UNLOCKED;
+    reset();
+  }
+
+  void reset() {
+    portENTER_CRITICAL(&mux);
+    memset(loopBuckets, 0, sizeof(loopBuckets));
+    loopCount = 0;
+    loopMaxUs = 0;
+    loopTotalUs = 0;
+    routeCount = 0;
+    unlistedRequests = 0;
+    unroutedRequests = 0;
+    requests = 0;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // Промежуточный обработчик: замер каждого запроса к серверу. Запросы,
+  // о которых обработчик onNotFound сообщил через markUnrouted(), в таблицу
+  // маршрутов не попадают: сканеры иначе забили бы ее случайными путями
+  void attach(AsyncWebServer& server) {
+    server.addMiddleware([this](AsyncWebServerRequest* request, ArMiddlewareNext next) {
+      unrouted = false;
+      int64_t start = esp_timer_get_time();
+      next();
+      uint32_t us = (uint32_t)(esp_timer_get_time() - start);
+      if (unrouted) {
+        portENTER_CRITICAL(&mux);
+        requests++;
+        unroutedRequests++;
+        portEXIT_CRITICAL(&mux);
+        return;
+      }
+      char key[PERF_ROUTE_LEN];
+      routeKey(request->url(), key, sizeof(key));
+      recordRequest(key, request->method(), us);
+    });
+  }
+
+  // Вызывается из обработчика onNotFound (в задаче AsyncTCP)
+  void markUnrouted() { unrouted = true; }
+
+  // Проход цикла, в котором выполнялись задачи (из задачи интерфейса)
+  void recordLoop(uint32_t us) {
+    uint8_t bucket = 0;
+    while (bucket < PERF_LOOP_BUCKETS - 1 && us > PERF_LOOP_BOUNDS_US[bucket]) {
+      bucket++;
+    }
+    portENTER_CRITICAL(&mux);
+    loopBuckets[bucket]++;
+    loopCount++;
+    loopTotalUs += us;
+    if (us > loopMaxUs) loopMaxUs = us;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  void recordRequest(const char* path, uint8_t method, uint32_t us) {
+    portENTER_CRITICAL(&mux);
+    requests++;
+    PerfRouteStats* route = routeFor(path, method);
+    if (route) {
+      route->count++;
+      route->totalUs += us;
+      route->lastUs = us;
+      if (us > route->maxUs) route->maxUs = us;
+      if (us > PERF_SLOW_REQUEST_US) route->slow++;
+    } else {
+      unlistedRequests++;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // Куча: внутренняя память и PSRAM, минимум за все время и фрагментация
+  void heapToJson(JsonObject obj) const {
+    size_t freeInternal = heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    obj["free"] = freeInternal;
+    obj["minFree"] = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    obj["largestBlock"] = largest;
+    obj["total"] = heap_caps_get_total_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    obj["fragmentation"] = freeInternal > 0 ? 100 - (uint32_t)(largest * 100 / freeInternal) : 0;
+
+    size_t psramTotal = heap_caps_get_total_size(MALLOC_CAP_SPIRAM);
+    if (psramTotal > 0) {
+      JsonObject psram = obj.createNestedObject("psram");
+      psram["total"] = psramTotal;
+      psram["free"] = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+      psram["minFree"] = heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+      psram["largestBlock"] = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+    }
+  }
+
+  // Задачи FreeRTOS: запас стека и доля CPU с прошлого снимка
+  void tasksToJson(JsonArray array) {
+#if configUSE_TRACE_FACILITY
+    UBaseType_t capacity = min((UBaseType_t)PERF_MAX_TASKS, uxTaskGetNumberOfTasks() + 2);
+    std::unique_ptr<TaskStatus_t[]> tasks(new TaskStatus_t[capacity]);
+    uint32_t totalRuntime = 0;
+    UBaseType_t count = uxTaskGetSystemState(tasks.get(), capacity, &totalRuntime);
+
+#if configGENERATE_RUN_TIME_STATS
+    // Время идет на всех ядрах сразу, поэтому делим на их число
+    uint32_t elapsed = (totalRuntime - prevTotalRuntime) * portNUM_PROCESSORS;
+#endif
+    for (UBaseType_t i = 0; i < count; i++) {
+      const TaskStatus_t& task = tasks[i];
+      JsonObject obj = array.createNestedObject();
+      obj["name"] = task.pcTaskName;
+      obj["priority"] = task.uxCurrentPriority;
+      obj["stackFree"] = task.usStackHighWaterMark;  // Минимум за все время, байт
+#if configTASKLIST_INCLUDE_COREID
+      obj["core"] = task.xCoreID < portNUM_PROCESSORS ? (int)task.xCoreID : -1;
+#endif
+#if configGENERATE_RUN_TIME_STATS
+      if (prevTotalRuntime > 0 && elapsed > 0) {
+        uint32_t delta = task.ulRunTimeCounter - previousRuntime(task.xTaskNumber);
+        obj["cpu"] = (float)delta * 100.0f / elapsed;
+      }
+#endif
+    }
+
+#if configGENERATE_RUN_TIME_STATS
+    prevCount = 0;
+    for (UBaseType_t i = 0; i < count && prevCount < PERF_MAX_TASKS; i++) {
+      prevRuntime[prevCount++] = {tasks[i].xTaskNumber, tasks[i].ulRunTimeCounter};
+    }
+    prevTotalRuntime = totalRuntime;
+#endif
+#endif
+  }
+
+  // Гистограмма проходов цикла
+  void loopToJson(JsonObject obj) const {
+    uint32_t buckets[PERF_LOOP_BUCKETS];
+    portENTER_CRITICAL(&mux);
+    memcpy(buckets, loopBuckets, sizeof(buckets));
+    uint32_t count = loopCount;
+    uint32_t maxUs = loopMaxUs;
+    uint64_t totalUs = loopTotalUs;
+    portEXIT_CRITICAL(&mux);
+
+    obj["count"] = count;
+    obj["maxUs"] = maxUs;
+    obj["avgUs"] = count > 0 ? (uint32_t)(totalUs / count) : 0;
+    JsonArray histogram = obj.createNestedArray("histogram");
+    for (uint8_t i = 0; i < PERF_LOOP_BUCKETS; i++) {
+      JsonObject bucket = histogram.createNestedObject();
+      if (i < PERF_LOOP_BUCKETS - 1) {
+        bucket["leUs"] = PERF_LOOP_BOUNDS_US[i];
+      }
+      bucket["count"] = buckets[i];
+    }
+  }
+
+  // Копия таблицы маршрутов (для сериализации вне mux)
+  uint8_t snapshotRoutes(PerfRouteStats* out, uint32_t& total, uint32_t& unlisted,
+                         uint32_t& unrouted) const {
+    portENTER_CRITICAL(&mux);
+    uint8_t count = routeCount;
+    memcpy(out, routes, sizeof(PerfRouteStats) * count);
+    total = requests;
+    unlisted = unlistedRequests;
+    unrouted = unroutedRequests;
+    portEXIT_CRITICAL(&mux);
+    return count;
+  }
+};
+
+#endif // PERF_MONITOR_H
@@ -0,0 +1,258 @@
+#ifndef PIN_EDGE_CAPTURE_H
+#define PIN_EDGE_CAPTURE_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <soc/gpio_reg.h>
+
+#define PIN_EDGE_MAX_CHANNELS 8
+#define PIN_EDGE_MAX_GPIO 40           // GPIO0..GPIO39 у ESP32
+#define PIN_EDGE_RING_SIZE 64          // Фронтов на пин (степень двойки)
+#define PIN_EDGE_DEFAULT_DEBOUNCE_US 0 // Без подавления дребезга
+#define PIN_EDGE_DEFAULT_GLITCH_US 0   // Без фильтра коротких импульсов
+
+// Флаги фронта
+#define PIN_EDGE_GLITCH  0x01  // Импульс короче порога: фронт и возврат в одной записи
+#define PIN_EDGE_SETTLED 0x02  // Уровень установлен после подавленного дребезга
+
+// Зафиксированный фронт
+struct PinEdge {
+  uint64_t timeUs;   // esp_timer_get_time() в момент фронта
+  uint32_t widthUs;  // Длительность импульса для PIN_EDGE_GLITCH
+  uint8_t level;     // Уровень после фронта (для импульса - уровень импульса)
+  uint8_t flags;
+};
+
+// Захват фронтов KVM пинов по прерываниям GPIO.
+//
+// Обработчик прерывания читает уровень прямо из регистра входов и пишет
+// фронт с микросекундной меткой в кольцевой буфер своего пина. Счетчик head
+// растет монотонно и служит номером фронта: читатели запрашивают фронты
+// начиная с известного номера, а при переполнении кольца узнают, сколько
+// фронтов потеряно.
+//
+// Дребезг: фронты ближе debounceUs к предыдущему не записываются, итоговый
+// уровень досписывается settle() из основного цикла. Короткие импульсы:
+// возврат к прежнему уровню быстрее glitchUs сворачивает оба фронта в одну
+// запись с флагом PIN_EDGE_GLITCH.
+class PinEdgeCapture {
+private:
+  struct Channel {
+    int gpio;                 // -1 - канал свободен
+    volatile uint32_t head;   // Всего записано фронтов
+    PinEdge ring[PIN_EDGE_RING_SIZE];
+    uint64_t lastEdgeUs;
+    uint8_t level;            // Последний записанный уровень
+    uint32_t bounces;
+    uint32_t glitches;
+    uint32_t debounceUs;
+    uint32_t glitchUs;
+  };
+
+  Channel channels[PIN_EDGE_MAX_CHANNELS];
+  static portMUX_TYPE mux;
+  uint32_t debounceUs;
+  uint32_t glitchUs;
+
+  static inline uint8_t IRAM_ATTR readLevel(int gpio) {
+    if (gpio < 32) {
+      return (REG_READ(GPIO_IN_REG) >> gpio) & 1;
+    }
+    return (REG_READ(GPIO_IN1_REG) >> (gpio - 32)) & 1;
+  }
+
+  static inline void IRAM_ATTR push(Channel& ch, uint64_t now, uint8_t level, uint8_t flags) {
+    PinEdge& edge = ch.ring[ch.head & (PIN_EDGE_RING_SIZE - 1)];
+    edge.timeUs = now;
+    edge.widthUs = 0;
+    edge.level = level;
+    edge.flags = flags;
+    ch.head = ch.head + 1;
+    ch.lastEdgeUs = now;
+    ch.level = level;
+  }
+
+  // Общая для обработчика и settle() запись фронта (под mux)
+  static inline void IRAM_ATTR record(Channel& ch, uint64_t now, uint8_t level) {
+    if (level == ch.level) {
+      return;
+    }
+    uint64_t dt = now - ch.lastEdgeUs;
+
+    // Возврат к прежнему уровню сразу после фронта - короткий импульс
+    if (ch.glitchUs > 0 && ch.head > 0 && dt < ch.glitchUs) {
+      PinEdge& last = ch.ring[(ch.head - 1) & (PIN_EDGE_RING_SIZE - 1)];
+      if (!(last.flags & PIN_EDGE_GLITCH)) {
+        last.flags |= PIN_EDGE_GLITCH;
+        last.widthUs = (uint32_t)dt;
+        ch.level = level;
+        ch.glitches++;
+        return;
+      }
+    }
+
+    if (ch.debounceUs > 0 && ch.head > 0 && dt < ch.debounceUs) {
+      ch.bounces++;
+      return;
+    }
+
+    push(ch, now, level, 0);
+  }
+
+  static void IRAM_ATTR onEdge(void* arg) {
+    Channel* ch = (Channel*)arg;
+    uint64_t now = esp_timer_get_time();
+    uint8_t level = readLevel(ch->gpio);
+    portENTER_CRITICAL_ISR(&mux);
+    record(*ch, now, level);
+    portEXIT_CRITICAL_ISR(&mux);
+  }
+
+  Channel* find(int gpio) {
+    for (auto& ch : channels) {
+      if (ch.gpio == gpio) {
+        return &ch;
+      }
+    }
+    return nullptr;
+  }
+
+public:
+  PinEdgeCapture() : debounceUs(PIN_EDGE_DEFAULT_DEBOUNCE_US), glitchUs(PIN_EDGE_DEFAULT_GLITCH_US) {
+    for (auto& ch : channels) {
+      ch.gpio = -1;
+    }
+  }
+
+  // Включение захвата на пине. Пин должен быть настроен на вход
+  // (или вход/выход) до вызова
+  bool attach(int gpio) {
+    if (gpio < 0 || gpio >= PIN_EDGE_MAX_GPIO) {
+      return false;
+    }
+    if (find(gpio)) {
+      return true;
+    }
+    Channel* ch = find(-1);
+    if (!ch) {
+      return false;
+    }
+
+    portENTER_CRITICAL(&mux);
+    ch->head = 0;
+    ch->lastEdgeUs = esp_timer_get_time();
+    ch->level = readLevel(gpio);
+    ch->bounces = 0;
+    ch->glitches = 0;
+    ch->debounceUs = debounceUs;
+    ch->glitchUs = glitchUs;
+    ch->gpio = gpio;
+    portEXIT_CRITICAL(&mux);
+
+    attachInterruptArg(gpio, onEdge, ch, CHANGE);
+    return true;
+  }
+
+  void detach(int gpio) {
+    Channel* ch = find(gpio);
+    if (ch) {
+      detachInterrupt(gpio);
+      portENTER_CRITICAL(&mux);
+      ch->gpio = -1;
+      portEXIT_CRITICAL(&mux);
+    }
+  }
+
+  bool isAttached(int gpio) {
+    return find(gpio) != nullptr;
+  }
+
+  uint8_t attachedCount() const {
+    uint8_t count = 0;
+    for (const auto& ch : channels) {
+      if (ch.gpio >= 0) count++;
+    }
+    return count;
+  }
+
+  // Параметры фильтрации (мкс) для всех пинов
+  void setFilter(uint32_t debounce, uint32_t glitch) {
+    debounceUs = debounce;
+    glitchUs = glitch;
+    portENTER_CRITICAL(&mux);
+    for (auto& ch : channels) {
+      ch.debounceUs = debounce;
+      ch.glitchUs = glitch;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  uint32_t getDebounceUs() const { return debounceUs; }
+  uint32_t getGlitchUs() const { return glitchUs; }
+
+  // Досписывание уровня, на котором пин успокоился после подавленного
+  // дребезга. Вызывать периодически из основного цикла
+  void settle() {
+    uint64_t now = esp_timer_get_time();
+    for (auto& ch : channels) {
+      if (ch.gpio < 0) {
+        continue;
+      }
+      uint8_t level = readLevel(ch.gpio);
+      portENTER_CRITICAL(&mux);
+      if (level != ch.level && now - ch.lastEdgeUs >= ch.debounceUs &&
+          now - ch.lastEdgeUs >= ch.glitchUs) {
+        push(ch, now, level, PIN_EDGE_SETTLED);
+      }
+      portEXIT_CRITICAL(&mux);
+    }
+  }
+
+  // Уровень пина после фильтрации
+  bool level(int gpio) {
+    Channel* ch = find(gpio);
+    return ch && ch->level;
+  }
+
+  // Номер следующего фронта (всего записано) для пина
+  uint32_t head(int gpio) {
+    Channel* ch = find(gpio);
+    return ch ? ch->head : 0;
+  }
+
+  // Копирование фронтов с номерами от since. Возвращает количество,
+  // в dropped - сколько запрошенных фронтов уже вытеснено из кольца
+  size_t read(int gpio, uint32_t since, PinEdge* out, size_t maxCount,
+              uint32_t* first = nullptr, uint32_t* dropped = nullptr) {
+    Channel* ch = find(gpio);
+    size_t count = 0;
+    uint32_t lost = 0;
+    if (ch) {
+      portENTER_CRITICAL(&mux);
+      uint32_t end = ch->head;
+      uint32_t oldest = end > PIN_EDGE_RING_SIZE ? end - PIN_EDGE_RING_SIZE : 0;
+      if (since > end) since = end;
+      if (since < oldest) {
+        lost = oldest - since;
+        since = oldest;
+      }
+      for (uint32_t seq = since; seq < end && count < maxCount; seq++) {
+        out[count++] = ch->ring[seq & (PIN_EDGE_RING_SIZE - 1)];
+      }
+      portEXIT_CRITICAL(&mux);
+    }
+    if (first) *first = since;
+    if (dropped) *dropped = lost;
+    return count;
+  }
+
+  void getStats(int gpio, uint32_t& bounces, uint32_t& glitches) {
+    Channel* ch = find(gpio);
+    bounces = ch ? ch->bounces : 0;
+    glitches = ch ? ch->glitches : 0;
+  }
+};
+
+portMUX_TYPE PinEdgeCapture::mux = portMUX_INITIALIZER_UNLOCKED;
+
+#endif // PIN_EDGE_CAPTURE_H
@@ -0,0 +1,325 @@
+#ifndef PORT_SCANNER_H
+#define PORT_SCANNER_H
+
+#include <Arduino.h>
+#include <vector>
+#include <atomic>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+
+// Количество одновременно открытых сокетов.
+// Часть сокетов lwIP нужна веб-серверу, поэтому окно меньше общего лимита
+#ifndef CONFIG_LWIP_MAX_SOCKETS
+#define CONFIG_LWIP_MAX_SOCKETS 10
+#endif
+#define PORT_SCAN_MAX_WINDOW (CONFIG_LWIP_MAX_SOCKETS > 6 ? CONFIG_LWIP_MAX_SOCKETS - 4 : 2)
+#define PORT_SCAN_DEFAULT_WINDOW (PORT_SCAN_MAX_WINDOW < 8 ? PORT_SCAN_MAX_WINDOW : 8)
+#define PORT_SCAN_DEFAULT_TIMEOUT 300  // мс на одно подключение
+
+// Состояние сканирования портов
+enum PortScanState {
+  PORT_SCAN_IDLE,
+  PORT_SCAN_RUNNING,
+  PORT_SCAN_DONE,
+  PORT_SCAN_CANCELLED,
+  PORT_SCAN_ERROR
+};
+
+// Параметры сканирования портов
+struct PortScanConfig {
+  uint16_t window = PORT_SCAN_DEFAULT_WINDOW;
+  uint16_t timeoutMs = PORT_SCAN_DEFAULT_TIMEOUT;
+};
+
+// Параллельное сканирование TCP-портов неблокирующими подключениями.
+//
+// Одновременно открыто до window сокетов, их завершение отслеживается одним
+// select() по записи. Сокеты закрываются с SO_LINGER = 0 (RST вместо FIN),
+// чтобы PCB не оставались в TIME_WAIT и не исчерпывали пул lwIP на длинных
+// диапазонах. Открытые порты доступны по мере обнаружения через
+// getOpenPorts(from), что позволяет выдавать их клиенту потоком.
+class PortScanner {
+private:
+  // Ожидающее подключение
+  struct PendingConnect {
+    int fd;
+    uint16_t port;
+    int64_t startedAt;
+  };
+
+  IPAddress target;
+  uint16_t startPort;
+  uint16_t endPort;
+  PortScanConfig config;
+
+  std::vector<uint16_t> openPorts;
+  SemaphoreHandle_t resultsMutex;
+  TaskHandle_t task;
+
+  std::atomic<int> state;
+  std::atomic<bool> cancelRequested;
+  std::atomic<uint32_t> scannedCount;
+  uint32_t scanId;           // Номер сканирования, увеличивается при каждом запуске
+  int64_t startedAt;
+  int64_t finishedAt;
+  String error;
+
+  static void taskEntry(void* param) {
+    PortScanner* self = (PortScanner*)param;
+    self->execute();
+    self->task = nullptr;
+    vTaskDelete(NULL);
+  }
+
+  void closeSocket(int fd) {
+    struct linger lin = {1, 0};
+    lwip_setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+    lwip_close(fd);
+  }
+
+  void addOpenPort(uint16_t port) {
+    xSemaphoreTake(resultsMutex, portMAX_DELAY);
+    openPorts.push_back(port);
+    xSemaphoreGive(resultsMutex);
+  }
+
+  // Открытие неблокирующего подключения.
+  // Возвращает 1 - ожидает, 0 - порт завершен сразу, -1 - нет свободных сокетов
+  int beginConnect(uint16_t port, PendingConnect& pending) {
+    int fd = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+      return -1;
+    }
+    lwip_fcntl(fd, F_SETFL, lwip_fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_len = sizeof(addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = (uint32_t)target;
+
+    int res = lwip_connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+    if (res == 0) {
+      // Подключение установлено сразу (обычно только для локального адреса)
+      addOpenPort(port);
+      closeSocket(fd);
+      return 0;
+    }
+    if (errno != EINPROGRESS) {
+      closeSocket(fd);
+      return 0;
+    }
+
+    pending.fd = fd;
+    pending.port = port;
+    pending.startedAt = esp_timer_get_time();
+    return 1;
+  }
+
+  // Основной цикл сканирования
+  void execute() {
+    std::vector<PendingConnect> pending;
+    pending.reserve(config.window);
+
+    const int64_t timeoutUs = (int64_t)config.timeoutMs * 1000;
+    uint32_t nextPort = startPort;
+    uint16_t window = config.window;
+
+    while ((nextPort <= endPort || !pending.empty()) && !cancelRequested.load()) {
+      // Заполняем окно новыми подключениями
+      while (pending.size() < window && nextPort <= endPort) {
+        PendingConnect connect;
+        int res = beginConnect((uint16_t)nextPort, connect);
+        if (res < 0) {
+          // Сокеты закончились - уменьшаем окно до текущего числа подключений
+          if (pending.empty()) {
+            error = "No free sockets";
+            break;
+          }
+          window = pending.size();
+          break;
+        }
+        nextPort++;
+        if (res > 0) {
+          pending.push_back(connect);
+        } else {
+          scannedCount.fetch_add(1);
+        }
+      }
+
+      if (pending.empty()) {
+        if (!error.isEmpty()) {
+          break;
+        }
+        continue;
+      }
+
+      fd_set writeSet;
+      FD_ZERO(&writeSet);
+      int maxFd = -1;
+      for (const auto& p : pending) {
+        FD_SET(p.fd, &writeSet);
+        maxFd = max(maxFd, p.fd);
+      }
+
+      struct timeval tv = {0, 10000};
+      int ready = lwip_select(maxFd + 1, NULL, &writeSet, NULL, &tv);
+
+      int64_t now = esp_timer_get_time();
+      for (size_t i = 0; i < pending.size();) {
+        PendingConnect& p = pending[i];
+        bool finished = false;
+
+        if (ready > 0 && FD_ISSET(p.fd, &writeSet)) {
+          int sockErr = 0;
+          socklen_t len = sizeof(sockErr);
+          lwip_getsockopt(p.fd, SOL_SOCKET, SO_ERROR, &sockErr, &len);
+          if (sockErr == 0) {
+            addOpenPort(p.port);
+          }
+          finished = true;
+        } else if (now - p.startedAt >= timeoutUs) {
+          finished = true;  // Порт фильтруется или хост не отвечает
+        }
+
+        if (finished) {
+          closeSocket(p.fd);
+          scannedCount.fetch_add(1);
+          pending[i] = pending.back();
+          pending.pop_back();
+        } else {
+          i++;
+        }
+      }
+    }
+
+    for (const auto& p : pending) {
+      closeSocket(p.fd);
+    }
+
+    finishedAt = esp_timer_get_time();
+    if (!error.isEmpty()) {
+      state.store(PORT_SCAN_ERROR);
+    } else {
+      state.store(cancelRequested.load() ? PORT_SCAN_CANCELLED : PORT_SCAN_DONE);
+    }
+  }
+
+  // Подготовка состояния перед запуском
+  bool prepare(const IPAddress& ip, int fromPort, int toPort, const PortScanConfig& cfg) {
+    if (state.load() == PORT_SCAN_RUNNING) {
+      return false;
+    }
+
+    fromPort = constrain(fromPort, 1, 65535);
+    toPort = constrain(toPort, 1, 65535);
+    if (toPort < fromPort) {
+      return false;
+    }
+
+    target = ip;
+    startPort = fromPort;
+    endPort = toPort;
+    config = cfg;
+    config.window = constrain(config.window, (uint16_t)1, (uint16_t)PORT_SCAN_MAX_WINDOW);
+    config.timeoutMs = max(config.timeoutMs, (uint16_t)50);
+
+    xSemaphoreTake(resultsMutex, portMAX_DELAY);
+    openPorts.clear();
+    xSemaphoreGive(resultsMutex);
+
+    cancelRequested.store(false);
+    scannedCount.store(0);
+    scanId++;
+    error = "";
+    startedAt = esp_timer_get_time();
+    finishedAt = 0;
+    state.store(PORT_SCAN_RUNNING);
+    return true;
+  }
+
+public:
+  PortScanner()
+    : startPort(0), endPort(0), task(nullptr), state(PORT_SCAN_IDLE),
+      cancelRequested(false), scannedCount(0), scanId(0), startedAt(0), finishedAt(0) {
+    resultsMutex = xSemaphoreCreateMutex();
+  }
+
+  // Запуск сканирования в отдельной задаче
+  bool start(const IPAddress& ip, int fromPort, int toPort, const PortScanConfig& cfg = PortScanConfig()) {
+    if (task != nullptr || !prepare(ip, fromPort, toPort, cfg)) {
+      return false;
+    }
+
+    // На ядре стека lwIP, чтобы не занимать ядро интерфейса
+    if (xTaskCreatePinnedToCore(taskEntry, "port_scan", 4096, this, 1, &task, PRO_CPU_NUM) != pdPASS) {
+      task = nullptr;
+      error = "Failed to create task";
+      state.store(PORT_SCAN_ERROR);
+      return false;
+    }
+    return true;
+  }
+
+  // Сканирование в вызывающей задаче (блокирующее)
+  bool run(const IPAddress& ip, int fromPort, int toPort, const PortScanConfig& cfg = PortScanConfig()) {
+    if (task != nullptr || !prepare(ip, fromPort, toPort, cfg)) {
+      return false;
+    }
+    execute();
+    return state.load() == PORT_SCAN_DONE;
+  }
+
+  // Запрос на остановку
+  void cancel() {
+    cancelRequested.store(true);
+  }
+
+  // Открытые порты, найденные начиная с индекса from
+  std::vector<uint16_t> getOpenPorts(size_t from = 0) {
+    std::vector<uint16_t> copy;
+    xSemaphoreTake(resultsMutex, portMAX_DELAY);
+    if (from < openPorts.size()) {
+      copy.assign(openPorts.begin() + from, openPorts.end());
+    }
+    xSemaphoreGive(resultsMutex);
+    return copy;
+  }
+
+  size_t getOpenCount() {
+    xSemaphoreTake(resultsMutex, portMAX_DELAY);
+    size_t count = openPorts.size();
+    xSemaphoreGive(resultsMutex);
+    return count;
+  }
+
+  // Название состояния для API
+  const char* getStateName() const {
+    switch (state.load()) {
+      case PORT_SCAN_RUNNING: return "scanning";
+      case PORT_SCAN_DONE: return "ready";
+      case PORT_SCAN_CANCELLED: return "cancelled";
+      case PORT_SCAN_ERROR: return "error";
+      default: return "idle";
+    }
+  }
+
+  PortScanState getState() const { return (PortScanState)state.load(); }
+  bool isRunning() const { return state.load() == PORT_SCAN_RUNNING; }
+  const IPAddress& getTarget() const { return target; }
+  uint32_t getTotal() const { return startPort ? endPort - startPort + 1 : 0; }
+  uint32_t getScanned() const { return scannedCount.load(); }
+  uint32_t getScanId() const { return scanId; }
+  const PortScanConfig& getConfig() const { return config; }
+  const String& getError() const { return error; }
+
+  // Время сканирования в мс
+  uint32_t getElapsed() const {
+    if (startedAt == 0) return 0;
+    int64_t end = finishedAt ? finishedAt : esp_timer_get_time();
+    return (uint32_t)((end - startedAt) / 1000);
+  }
+};
+
+#endif // PORT_SCANNER_H
@@ -0,0 +1,368 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <M5StickCPlus2.h>
+#include <functional>
+#include <esp_pm.h>
+#include <esp_wifi.h>
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+#include "sensor_history.h"
+
+#define POWER_DEFAULT_MAX_MHZ 240
+#define POWER_DEFAULT_MIN_MHZ 80        // Ниже 80 МГц WiFi не работает
+#define POWER_DEFAULT_DIM_AFTER 60      // Секунд без действий до приглушения экрана
+#define POWER_DEFAULT_DIM_BRIGHTNESS 10
+#define POWER_WEB_ACTIVE_MS 30000       // Клиент на связи, если запрос был не раньше
+#define POWER_TREND_MINUTES 60          // Окно оценки разряда
+#define POWER_TREND_MIN_POINTS 10       // Минимум минутных точек для оценки
+
+enum PowerDisplayState : uint8_t {
+  POWER_DISPLAY_ON,
+  POWER_DISPLAY_DIM,
+  POWER_DISPLAY_OFF
+};
+
+enum PowerWakeSource : uint8_t {
+  POWER_WAKE_BUTTON,
+  POWER_WAKE_GPIO,       // Фронт на пине монитора KVM
+  POWER_WAKE_STATION,    // Подключение станции к AP
+  POWER_WAKE_SOURCES
+};
+
+static const char* const powerWakeNames[POWER_WAKE_SOURCES] = {"button", "gpio", "station"};
+static const char* const powerDisplayNames[] = {"on", "dim", "off"};
+
+// Настройки питания
+struct PowerConfig {
+  bool lowPower;          // Частота по нагрузке, light sleep и modem sleep
+  bool lightSleep;        // Автоматический light sleep в простое
+  uint16_t minMhz;
+  uint16_t maxMhz;
+  uint16_t dimAfter;      // Секунд, 0 - не приглушать
+  uint8_t dimBrightness;
+};
+
+// Частоты CPU, которые поддерживают и esp_pm, и setCpuFrequencyMhz при кварце 40 МГц
+inline bool isValidCpuMhz(uint16_t mhz) {
+  return mhz == 80 || mhz == 160 || mhz == 240;
+}
+
+inline PowerConfig defaultPowerConfig() {
+  PowerConfig config = {false, true, POWER_DEFAULT_MIN_MHZ, POWER_DEFAULT_MAX_MHZ,
+                        POWER_DEFAULT_DIM_AFTER, POWER_DEFAULT_DIM_BRIGHTNESS};
+  return config;
+}
+
+// Состояние остальной прошивки на момент обновления
+struct PowerInputs {
+  uint16_t blankAfter;    // Секунд до гашения экрана, 0 - не гасить
+  bool busy;              // Захват или передача, которым нужна полная частота
+  bool pinsMonitored;     // Фронты ловятся прерываниями GPIO - без light sleep
+  bool staLinked;         // Modem sleep применим только к подключению STA
+  uint16_t webSockets;
+};
+
+// Оценка времени работы по тренду заряда
+struct PowerEstimate {
+  float percent;
+  float percentPerHour;   // Отрицательное - разряд
+  float millivoltsPerHour;
+  int32_t runtimeMinutes; // -1 - оценки нет (мало данных, заряд или нет разряда)
+  uint16_t points;
+};
+
+// Управление питанием.
+//
+// Экран приглушается и гаснет по времени без действий пользователя (кнопка,
+// фронт на пине монитора, подключение станции). В режиме lowPower частоту
+// CPU выбирает esp_pm между minMhz и maxMhz: блокировка на максимум
+// держится, пока экран включен, идет захват или в сети есть клиент
+// веб-интерфейса, а без нее система может уходить в light sleep. Пока
+// клиентов нет, подключение STA работает в modem sleep. Если прошивка
+// собрана без CONFIG_PM_ENABLE, частота переключается вручную между теми
+// же пределами (APB на 80 МГц и выше не меняется, периферия не страдает).
+//
+// Вызовы - только из задачи интерфейса, кроме промежуточного обработчика
+// веб-сервера.
+class PowerManager {
+private:
+  PowerConfig config;
+  PowerDisplayState display;
+  uint32_t lastActivity;
+  volatile uint32_t lastWebRequest;
+  uint32_t wakes[POWER_WAKE_SOURCES];
+  int8_t lastWake;
+  uint8_t brightness;
+
+  esp_pm_lock_handle_t cpuLock;
+  esp_pm_lock_handle_t noSleepLock;
+  bool pmAvailable;
+  esp_err_t pmResult;     // Итог последнего применения частоты
+  bool lightSleepActive;
+  bool cpuHeld;
+  bool noSleepHeld;
+  bool idle;
+  int8_t modemSleep;      // Последний выставленный режим, -1 - не менялся
+
+  uint32_t stateSince;
+  uint32_t displayMs[3];  // Время в каждом состоянии экрана
+  uint32_t idleMs;
+
+  std::function<void()> onWake;
+
+  void holdLock(esp_pm_lock_handle_t lock, bool& held, bool want) {
+    if (held == want) return;
+    if (want) esp_pm_lock_acquire(lock);
+    else esp_pm_lock_release(lock);
+    held = want;
+  }
+
+  void setDisplay(PowerDisplayState state) {
+    if (state == display) return;
+    if (display == POWER_DISPLAY_OFF) {
+      M5.Lcd.wakeup();
+    }
+    switch (state) {
+      case POWER_DISPLAY_ON:  M5.Lcd.setBrightness(brightness); break;
+      case POWER_DISPLAY_DIM: M5.Lcd.setBrightness(min(brightness, config.dimBrightness)); break;
+      case POWER_DISPLAY_OFF:
+        M5.Lcd.setBrightness(0);
+        M5.Lcd.sleep();
+        break;
+    }
+    bool wasOff = display == POWER_DISPLAY_OFF;
+    display = state;
+    // Пока экран был выключен, меню не рисовалось
+    if (wasOff && onWake) onWake();
+  }
+
+  void setModemSleep(wifi_ps_type_t mode) {
+    if (modemSleep == mode) return;
+    if (esp_wifi_set_ps(mode) == ESP_OK) modemSleep = mode;
+  }
+
+  void accountTime() {
+    uint32_t now = millis();
+    uint32_t elapsed = now - stateSince;
+    displayMs[display] += elapsed;
+    if (idle) idleMs += elapsed;
+    stateSince = now;
+  }
+
+  // Частота по нагрузке: через esp_pm или вручную, light sleep - если собран
+  void applyFrequency() {
+    if (pmAvailable) {
+      esp_pm_config_esp32_t pm = {};
+      pm.max_freq_mhz = config.maxMhz;
+      pm.min_freq_mhz = config.lowPower ? config.minMhz : config.maxMhz;
+      pm.light_sleep_enable = config.lowPower && config.lightSleep;
+      esp_err_t err = esp_pm_configure(&pm);
+      if (err == ESP_ERR_NOT_SUPPORTED && pm.light_sleep_enable) {
+        // Без tickless idle light sleep недоступен, DFS работает
+        pm.light_sleep_enable = false;
+        err = esp_pm_configure(&pm);
+      }
+      pmResult = err;
+      lightSleepActive = err == ESP_OK && pm.light_sleep_enable;
+    } else {
+      lightSleepActive = false;
+      pmResult = setCpuFrequencyMhz(config.lowPower && idle ? config.minMhz : config.maxMhz)
+        ? ESP_OK : ESP_FAIL;
+    }
+  }
+
+public:
+  PowerManager()
+    : config(defaultPowerConfig()), display(POWER_DISPLAY_ON), lastActivity(0), lastWebRequest(0),
+      lastWake(-1), brightness(100), cpuLock(nullptr), noSleepLock(nullptr), pmAvailable(false),
+      pmResult(ESP_OK), lightSleepActive(false), cpuHeld(false), noSleepHeld(false), idle(false), modemSleep(-1),
+      stateSince(0), idleMs(0) {
+    memset(wakes, 0, sizeof(wakes));
+    memset(displayMs, 0, sizeof(displayMs));
+  }
+
+  void begin(const PowerConfig& initial, uint8_t initialBrightness) {
+    brightness = initialBrightness;
+    lastActivity = millis();
+    stateSince = lastActivity;
+    pmAvailable = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "power_active", &cpuLock) == ESP_OK &&
+                  esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "power_gpio", &noSleepLock) == ESP_OK;
+    configure(initial);
+  }
+
+  // Перерисовка экрана после пробуждения из выключенного состояния
+  void setWakeHandler(std::function<void()> handler) {
+    onWake = handler;
+  }
+
+  // Замер активности веб-клиентов: любой запрос к серверу продлевает ее
+  void attach(AsyncWebServer& server) {
+    server.addMiddleware([this](AsyncWebServerRequest* request, ArMiddlewareNext next) {
+      lastWebRequest = millis();
+      next();
+    });
+  }
+
+  void configure(const PowerConfig& updated) {
+    config = updated;
+    // Сохраненные прежними прошивками промежуточные частоты - к пределам
+    if (!isValidCpuMhz(config.maxMhz)) config.maxMhz = POWER_DEFAULT_MAX_MHZ;
+    if (!isValidCpuMhz(config.minMhz) || config.minMhz > config.maxMhz) config.minMhz = POWER_DEFAULT_MIN_MHZ;
+    if (!config.lowPower) {
+      // Обычный режим: полная частота, modem sleep по умолчанию драйвера
+      if (pmAvailable) {
+        holdLock(cpuLock, cpuHeld, false);
+        holdLock(noSleepLock, noSleepHeld, false);
+      }
+      if (modemSleep >= 0) {
+        esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+        modemSleep = -1;
+      }
+      idle = false;
+    } else if (pmAvailable) {
+      // До первого update частота не должна падать
+      holdLock(cpuLock, cpuHeld, !idle);
+    }
+    applyFrequency();
+  }
+
+  // Действие пользователя или событие. true - экран был приглушен или
+  // выключен: нажатие кнопки, разбудившее экран, действия не выполняет
+  bool wake(PowerWakeSource source) {
+    lastActivity = millis();
+    if (display == POWER_DISPLAY_ON) {
+      return false;
+    }
+    wakes[source]++;
+    lastWake = source;
+    accountTime();
+    setDisplay(POWER_DISPLAY_ON);
+    return true;
+  }
+
+  // Яркость из настроек. Применяется сразу, если экран не приглушен и не выключен
+  void setBrightness(uint8_t value) {
+    brightness = value;
+    if (display == POWER_DISPLAY_ON) M5.Lcd.setBrightness(brightness);
+  }
+
+  // Раз в секунду из задачи интерфейса
+  void update(const PowerInputs& in) {
+    accountTime();
+    uint32_t now = millis();
+    uint32_t quiet = now - lastActivity;
+
+    PowerDisplayState target = POWER_DISPLAY_ON;
+    if (in.blankAfter > 0 && quiet >= (uint32_t)in.blankAfter * 1000) {
+      target = POWER_DISPLAY_OFF;
+    } else if (config.dimAfter > 0 && quiet >= (uint32_t)config.dimAfter * 1000) {
+      target = POWER_DISPLAY_DIM;
+    }
+    setDisplay(target);
+
+    if (!config.lowPower) {
+      return;
+    }
+    bool web = isWebActive(in.webSockets);
+    bool wasIdle = idle;
+    idle = display != POWER_DISPLAY_ON && !in.busy && !web;
+    if (pmAvailable) {
+      holdLock(cpuLock, cpuHeld, !idle);
+      holdLock(noSleepLock, noSleepHeld, in.pinsMonitored);
+    } else if (idle != wasIdle) {
+      applyFrequency();
+    }
+    if (in.staLinked) {
+      // Клиенту веб-интерфейса - без задержки на DTIM
+      setModemSleep(web ? WIFI_PS_NONE : WIFI_PS_MIN_MODEM);
+    }
+  }
+
+  bool isWebActive(uint16_t webSockets) const {
+    return webSockets > 0 || millis() - lastWebRequest < POWER_WEB_ACTIVE_MS;
+  }
+
+  // Оценка по минутным средним заряда за последние POWER_TREND_MINUTES минут
+  // (наклон - методом наименьших квадратов)
+  void estimate(const SensorHistory& history, float percent, PowerEstimate& out) const {
+    out.percent = percent;
+    out.percentPerHour = 0.0f;
+    out.millivoltsPerHour = 0.0f;
+    out.runtimeMinutes = -1;
+    out.points = 0;
+
+    uint32_t first, last;
+    if (!history.range(HISTORY_TIER_MINUTE, first, last)) return;
+    if (last - first + 1 > POWER_TREND_MINUTES) first = last - POWER_TREND_MINUTES + 1;
+
+    double n = 0, sx = 0, sxx = 0, sp = 0, sxp = 0, sv = 0, sxv = 0;
+    for (uint32_t bucket = first; bucket <= last; bucket++) {
+      SensorRollup point;
+      if (!history.get(HISTORY_TIER_MINUTE, bucket, point) ||
+          point.avg[METRIC_PERCENT] == SENSOR_VALUE_EMPTY ||
+          point.avg[METRIC_BATTERY] == SENSOR_VALUE_EMPTY) {
+        continue;
+      }
+      double x = bucket - first;
+      double p = decodeSensorValue(METRIC_PERCENT, point.avg[METRIC_PERCENT]);
+      double v = decodeSensorValue(METRIC_BATTERY, point.avg[METRIC_BATTERY]) * 1000.0;
+      n++;
+      sx += x;
+      sxx += x * x;
+      sp += p;
+      sxp += x * p;
+      sv += v;
+      sxv += x * v;
+    }
+    out.points = n;
+    double d = n * sxx - sx * sx;
+    if (n < POWER_TREND_MIN_POINTS || d <= 0) return;
+
+    // Наклон в минуту, переводится в час
+    out.percentPerHour = (n * sxp - sx * sp) / d * 60.0;
+    out.millivoltsPerHour = (n * sxv - sx * sv) / d * 60.0;
+    if (out.percentPerHour < -0.1f) {
+      out.runtimeMinutes = percent / -out.percentPerHour * 60.0f;
+    }
+  }
+
+  void toJson(JsonObject obj, uint16_t webSockets) const {
+    obj["lowPower"] = config.lowPower;
+    obj["lightSleep"] = config.lightSleep;
+    obj["minMhz"] = config.minMhz;
+    obj["maxMhz"] = config.maxMhz;
+    obj["dimAfter"] = config.dimAfter;
+    obj["dimBrightness"] = config.dimBrightness;
+
+    JsonObject state = obj.createNestedObject("state");
+    state["display"] = powerDisplayNames[display];
+    state["idle"] = idle;
+    state["webActive"] = isWebActive(webSockets);
+    state["cpuMhz"] = getCpuFrequencyMhz();
+    state["dfs"] = pmAvailable ? "esp_pm" : "manual";
+    state["pmResult"] = esp_err_to_name(pmResult);
+    state["lightSleepActive"] = lightSleepActive;
+    state["modemSleep"] = modemSleep < 0 ? "default" : (modemSleep == WIFI_PS_NONE ? "off" : "min");
+    state["inactiveSeconds"] = (millis() - lastActivity) / 1000;
+    state["lastWake"] = lastWake >= 0 ? powerWakeNames[lastWake] : nullptr;
+
+    JsonObject wakeCounts = state.createNestedObject("wakes");
+    for (uint8_t i = 0; i < POWER_WAKE_SOURCES; i++) {
+      wakeCounts[powerWakeNames[i]] = wakes[i];
+    }
+    // Накопленное до последнего обновления время, с
+    JsonObject time = state.createNestedObject("seconds");
+    for (uint8_t i = 0; i < 3; i++) {
+      time[powerDisplayNames[i]] = displayMs[i] / 1000;
+    }
+    time["idle"] = idleMs / 1000;
+  }
+
+  const PowerConfig& getConfig() const { return config; }
+  PowerDisplayState getDisplay() const { return display; }
+  bool isDisplayOff() const { return display == POWER_DISPLAY_OFF; }
+  bool isIdle() const { return idle; }
+};
+
+#endif // POWER_MANAGER_H
@@ -0,0 +1,334 @@
+#ifndef REPEATER_PATH_H
+#define REPEATER_PATH_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <memory>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+
+extern "C" {
+  #include "lwip/lwip_napt.h"
+}
+
+#define REPEATER_DEFAULT_NAPT_ENTRIES 512
+#define REPEATER_MIN_NAPT_ENTRIES 64
+// Своя таблица потоков того же размера идет сверху таблицы lwIP, а PSRAM нет
+#define REPEATER_MAX_NAPT_ENTRIES 512
+#define REPEATER_DEFAULT_PORTMAPS 16
+#define REPEATER_DEFAULT_MSS 1360     // С запасом под PPPoE/VPN основной сети
+#define REPEATER_DEFAULT_MAX_CLIENTS 4
+#define REPEATER_MIN_MSS 536
+#define REPEATER_MAX_TRACKED_CLIENTS ESP_WIFI_MAX_CONN_NUM
+#define REPEATER_FLOW_PROBE 8         // Слотов, просматриваемых при поиске потока
+
+// Таймауты записей NAPT в lwIP (ip4_napt.c): по ним считается заполненность
+#define REPEATER_TCP_TIMEOUT_MS (30UL * 60 * 1000)
+#define REPEATER_TCP_CLOSED_TIMEOUT_MS 20000
+#define REPEATER_UDP_TIMEOUT_MS 2000
+
+// Счетчики пересылки для одного клиента AP
+struct RepeaterClientStats {
+  uint8_t mac[6];
+  uint32_t upPackets;      // От клиента в основную сеть
+  uint32_t upBytes;
+  uint32_t downPackets;    // Из основной сети клиенту
+  uint32_t downBytes;
+  uint32_t drops;          // Отброшено фильтром или не ушло в драйвер
+};
+
+// Заполненность таблицы NAPT (оценка по наблюдаемым потокам)
+struct RepeaterNaptUsage {
+  uint16_t tcp;
+  uint16_t udp;
+  uint16_t icmp;
+};
+
+// Путь данных режима ретранслятора.
+//
+// NAPT выполняет lwIP, но размер его таблицы задается только один раз -
+// до первого включения, а занятость таблицы он не сообщает. Поэтому
+// модуль сам ведет таблицу потоков, проходящих через AP, того же размера
+// и с теми же таймаутами: ее заполненность и вытеснения показывают, когда
+// клиентам перестает хватать записей NAPT. Заодно у пересылаемых SYN
+// уменьшается MSS, чтобы сегменты проходили основную сеть без фрагментации.
+//
+// Вызывается из APNetifHook: onInput - в задаче драйвера WiFi,
+// onOutput - в задаче lwIP.
+class RepeaterPath {
+private:
+  struct Flow {
+    uint32_t srcIP;
+    uint32_t dstIP;
+    uint16_t srcPort;
+    uint16_t dstPort;
+    uint8_t proto;       // 0 - свободно
+    uint8_t closed;      // Видели FIN/RST
+    uint32_t lastSeen;   // millis()
+  };
+
+  static bool naptInitialized;
+  static uint16_t naptEntries;
+  static std::atomic<bool> active;
+  static uint32_t apAddr;          // Сетевой порядок байтов, как в заголовке
+  static uint32_t apMask;
+  static uint16_t mssClamp;        // 0 - не менять
+  static std::unique_ptr<Flow[]> flows;
+  static uint16_t flowCount;
+  static RepeaterClientStats clients[REPEATER_MAX_TRACKED_CLIENTS];
+  static uint8_t clientCount;
+  static portMUX_TYPE mux;
+  static std::atomic<uint32_t> clamped;
+  static std::atomic<uint32_t> evictions;
+
+  static bool isLocal(uint32_t addr) {
+    return (addr & apMask) == (apAddr & apMask) || addr == 0xFFFFFFFF;
+  }
+
+  // Счетчики клиента; вызывать под mux
+  static RepeaterClientStats* client(const uint8_t* mac) {
+    for (uint8_t i = 0; i < clientCount; i++) {
+      if (memcmp(clients[i].mac, mac, 6) == 0) {
+        return &clients[i];
+      }
+    }
+    if (clientCount >= REPEATER_MAX_TRACKED_CLIENTS) {
+      return nullptr;
+    }
+    RepeaterClientStats* stats = &clients[clientCount++];
+    memset(stats, 0, sizeof(*stats));
+    memcpy(stats->mac, mac, 6);
+    return stats;
+  }
+
+  static bool expired(const Flow& flow, uint32_t now) {
+    uint32_t timeout;
+    if (flow.proto == 6) {
+      timeout = flow.closed ? REPEATER_TCP_CLOSED_TIMEOUT_MS : REPEATER_TCP_TIMEOUT_MS;
+    } else {
+      timeout = REPEATER_UDP_TIMEOUT_MS;
+    }
+    return now - flow.lastSeen > timeout;
+  }
+
+  // Учет потока клиента. Пишет только задача драйвера WiFi
+  static void trackFlow(uint8_t proto, uint32_t src, uint32_t dst,
+                        uint16_t sport, uint16_t dport, bool closing) {
+    if (!flows || flowCount == 0) return;
+
+    uint32_t now = millis();
+    uint32_t hash = (src * 2654435761u) ^ (dst * 40503u) ^ ((uint32_t)sport << 16 | dport) ^ proto;
+    Flow* victim = nullptr;
+    for (int i = 0; i < REPEATER_FLOW_PROBE; i++) {
+      Flow& flow = flows[(hash + i) % flowCount];
+      if (flow.proto == proto && flow.srcIP == src && flow.dstIP == dst &&
+          flow.srcPort == sport && flow.dstPort == dport) {
+        flow.lastSeen = now;
+        flow.closed |= closing;
+        return;
+      }
+      if (flow.proto == 0 || expired(flow, now)) {
+        victim = &flow;
+        break;
+      }
+      if (!victim || (int32_t)(flow.lastSeen - victim->lastSeen) < 0) {
+        victim = &flow;
+      }
+    }
+    if (victim->proto != 0 && !expired(*victim, now)) {
+      // Живая запись вытесняется - NAPT в этот момент тоже на пределе
+      evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    victim->proto = proto;
+    victim->srcIP = src;
+    victim->dstIP = dst;
+    victim->srcPort = sport;
+    victim->dstPort = dport;
+    victim->closed = closing;
+    victim->lastSeen = now;
+  }
+
+  // Уменьшение MSS в опциях SYN с пересчетом контрольной суммы (RFC 1624)
+  static void clampMSS(uint8_t* tcp, int tcpLen) {
+    int dataOffset = (tcp[12] >> 4) * 4;
+    if (dataOffset < 20 || dataOffset > tcpLen) return;
+
+    for (int i = 20; i < dataOffset;) {
+      uint8_t kind = tcp[i];
+      if (kind == 0) break;
+      if (kind == 1) { i++; continue; }
+      if (i + 1 >= dataOffset) break;
+      uint8_t len = tcp[i + 1];
+      if (len < 2 || i + len > dataOffset) break;
+      if (kind == 2 && len == 4) {
+        uint16_t mss = (tcp[i + 2] << 8) | tcp[i + 3];
+        if (mss > mssClamp) {
+          uint32_t sum = (uint16_t)~((tcp[16] << 8) | tcp[17]);
+          sum += (uint16_t)~mss;
+          sum += mssClamp;
+          sum = (sum & 0xFFFF) + (sum >> 16);
+          sum = (sum & 0xFFFF) + (sum >> 16);
+          uint16_t check = ~sum;
+          tcp[i + 2] = mssClamp >> 8;
+          tcp[i + 3] = mssClamp & 0xFF;
+          tcp[16] = check >> 8;
+          tcp[17] = check & 0xFF;
+          clamped.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+      }
+      i += len;
+    }
+  }
+
+public:
+  // Включение NAPT на интерфейсе AP. Размер таблицы применяется только при
+  // первом включении после загрузки - lwIP не умеет его менять.
+  // false - не хватило памяти под таблицу потоков: NAPT работает, но
+  // заполненность и вытеснения не считаются
+  static bool enable(IPAddress apIP, IPAddress mask, uint16_t entries, uint16_t mss) {
+    if (!naptInitialized) {
+      entries = constrain(entries, REPEATER_MIN_NAPT_ENTRIES, REPEATER_MAX_NAPT_ENTRIES);
+      ip_napt_init(entries, REPEATER_DEFAULT_PORTMAPS);
+      naptInitialized = true;
+      naptEntries = entries;
+      flows.reset(new (std::nothrow) Flow[entries]());
+      flowCount = flows ? entries : 0;
+    }
+    apAddr = (uint32_t)apIP;
+    apMask = (uint32_t)mask;
+    mssClamp = mss;
+
+    portENTER_CRITICAL(&mux);
+    clientCount = 0;
+    portEXIT_CRITICAL(&mux);
+    ip_napt_enable(apAddr, 1);
+    active = true;
+    return flowCount > 0;
+  }
+
+  static void disable() {
+    if (!active) return;
+    active = false;
+    ip_napt_enable(apAddr, 0);
+  }
+
+  // Кадр от клиента AP, до передачи в lwIP
+  static void onInput(uint8_t* frame, uint16_t len) {
+    if (!active || len < 14 + 20) return;
+    if (frame[12] != 0x08 || frame[13] != 0x00) return;  // Только IPv4
+
+    uint8_t* ip = frame + 14;
+    int ihl = (ip[0] & 0x0F) * 4;
+    if (ihl < 20 || 14 + ihl > len) return;  // Битый заголовок
+    uint32_t src, dst;
+    memcpy(&src, ip + 12, 4);
+    memcpy(&dst, ip + 16, 4);
+    if (isLocal(dst)) return;  // Трафик внутри AP не пересылается
+
+    uint16_t total = (ip[2] << 8) | ip[3];
+    portENTER_CRITICAL(&mux);
+    RepeaterClientStats* stats = client(frame + 6);
+    if (stats) {
+      stats->upPackets++;
+      stats->upBytes += total;
+    }
+    portEXIT_CRITICAL(&mux);
+
+    uint8_t proto = ip[9];
+    uint8_t* l4 = ip + ihl;
+    int l4Len = len - 14 - ihl;
+    bool firstFragment = (((ip[6] & 0x1F) << 8) | ip[7]) == 0;
+    if (!firstFragment) return;
+
+    if (proto == 6 && l4Len >= 20) {
+      uint8_t flags = l4[13];
+      if ((flags & 0x02) && mssClamp > 0) {  // SYN
+        clampMSS(l4, l4Len);
+      }
+      trackFlow(6, src, dst, (l4[0] << 8) | l4[1], (l4[2] << 8) | l4[3], flags & 0x05);
+    } else if (proto == 17 && l4Len >= 8) {
+      trackFlow(17, src, dst, (l4[0] << 8) | l4[1], (l4[2] << 8) | l4[3], false);
+    } else if (proto == 1 && l4Len >= 8) {
+      trackFlow(1, src, dst, (l4[4] << 8) | l4[5], 0, false);  // ID эхо-запроса
+    }
+  }
+
+  // Кадр клиенту AP после передачи в драйвер
+  static void onOutput(const uint8_t* frame, uint16_t len, bool sent) {
+    if (!active || len < 14 + 20) return;
+    if (frame[12] != 0x08 || frame[13] != 0x00 || (frame[0] & 0x01)) return;
+
+    uint32_t src;
+    memcpy(&src, frame + 14 + 12, 4);
+    if (isLocal(src)) return;  // Ответы самого устройства
+
+    uint16_t total = (frame[16] << 8) | frame[17];
+    portENTER_CRITICAL(&mux);
+    RepeaterClientStats* stats = client(frame);
+    if (stats) {
+      if (sent) {
+        stats->downPackets++;
+        stats->downBytes += total;
+      } else {
+        stats->drops++;
+      }
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // Кадр клиента отброшен фильтром до пересылки
+  static void onDrop(const uint8_t* mac) {
+    if (!active) return;
+    portENTER_CRITICAL(&mux);
+    RepeaterClientStats* stats = client(mac);
+    if (stats) stats->drops++;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // Снимок счетчиков клиентов
+  static uint8_t getClients(RepeaterClientStats* out, uint8_t max) {
+    portENTER_CRITICAL(&mux);
+    uint8_t count = min(clientCount, max);
+    memcpy(out, clients, count * sizeof(RepeaterClientStats));
+    portEXIT_CRITICAL(&mux);
+    return count;
+  }
+
+  // Обход таблицы потоков; значения приблизительные, таблицу пишет драйвер
+  static RepeaterNaptUsage getNaptUsage() {
+    RepeaterNaptUsage usage = {0, 0, 0};
+    uint32_t now = millis();
+    for (uint16_t i = 0; i < flowCount; i++) {
+      Flow flow = flows[i];
+      if (flow.proto == 0 || expired(flow, now)) continue;
+      if (flow.proto == 6) usage.tcp++;
+      else if (flow.proto == 17) usage.udp++;
+      else usage.icmp++;
+    }
+    return usage;
+  }
+
+  static bool isActive() { return active; }
+  static uint16_t getNaptEntries() { return naptEntries; }
+  static bool isTracking() { return flowCount > 0; }
+  static uint16_t getMSSClamp() { return mssClamp; }
+  static uint32_t getClamped() { return clamped.load(); }
+  static uint32_t getEvictions() { return evictions.load(); }
+};
+
+bool RepeaterPath::naptInitialized = false;
+uint16_t RepeaterPath::naptEntries = 0;
+std::atomic<bool> RepeaterPath::active(false);
+uint32_t RepeaterPath::apAddr = 0;
+uint32_t RepeaterPath::apMask = 0;
+uint16_t RepeaterPath::mssClamp = 0;
+std::unique_ptr<RepeaterPath::Flow[]> RepeaterPath::flows;
+uint16_t RepeaterPath::flowCount = 0;
+RepeaterClientStats RepeaterPath::clients[REPEATER_MAX_TRACKED_CLIENTS];
+uint8_t RepeaterPath::clientCount = 0;
+portMUX_TYPE RepeaterPath::mux = portMUX_INITIALIZER_UNLOCKED;
+std::atomic<uint32_t> RepeaterPath::clamped(0);
+std::atomic<uint32_t> RepeaterPath::evictions(0);
+
+#endif // REPEATER_PATH_H
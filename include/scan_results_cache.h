@@ -0,0 +1,286 @@
+#ifndef SCAN_RESULTS_CACHE_H
+#define SCAN_RESULTS_CACHE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <esp_wifi.h>
+#include "common_structures.h"
+
+#define SCAN_PAGE_DEFAULT 10       // Размер страницы, если задан только page
+#define SCAN_PAGE_MAX 50
+#define SCAN_CACHED_BODIES 4       // Готовых ответов на разные запросы
+#define SCAN_MIN_RSSI_ANY -128     // Фильтр по уровню не задан
+
+enum ScanSortKey : uint8_t {
+  SCAN_SORT_NONE,                  // Порядок драйвера
+  SCAN_SORT_RSSI,
+  SCAN_SORT_CHANNEL,
+  SCAN_SORT_SSID,
+  SCAN_SORT_ENCRYPTION
+};
+
+// Параметры запроса /scan-results. Маски пустые - фильтра нет
+struct ScanQuery {
+  uint16_t page;
+  uint16_t size;                   // 0 - весь список одной страницей
+  uint8_t sort;                    // ScanSortKey
+  bool descending;
+  int16_t minRssi;
+  uint16_t channels;               // Бит n - канал n (1-14)
+  uint16_t encryptions;            // Бит n - wifi_auth_mode_t n
+
+  bool operator==(const ScanQuery& other) const {
+    return page == other.page && size == other.size && sort == other.sort &&
+           descending == other.descending && minRssi == other.minRssi &&
+           channels == other.channels && encryptions == other.encryptions;
+  }
+};
+
+inline ScanQuery defaultScanQuery() {
+  ScanQuery query = {0, 0, SCAN_SORT_NONE, false, SCAN_MIN_RSSI_ANY, 0, 0};
+  return query;
+}
+
+// Ключи режимов шифрования для фильтра enc= (индекс - wifi_auth_mode_t)
+static const char* const SCAN_ENCRYPTION_KEYS[] = {
+  "open", "wep", "wpa", "wpa2", "wpa-wpa2", "wpa2-enterprise", "wpa3", "wpa2-wpa3"
+};
+#define SCAN_ENCRYPTION_KEY_COUNT (sizeof(SCAN_ENCRYPTION_KEYS) / sizeof(SCAN_ENCRYPTION_KEYS[0]))
+
+// Режим шифрования по ключу фильтра или -1
+inline int scanEncryptionFromKey(const String& key) {
+  for (uint8_t i = 0; i < SCAN_ENCRYPTION_KEY_COUNT; i++) {
+    if (key.equalsIgnoreCase(SCAN_ENCRYPTION_KEYS[i])) return i;
+  }
+  return -1;
+}
+
+typedef void (*ScanItemSerializer)(const WiFiResult& network, JsonDocument& netObj);
+typedef std::shared_ptr<const std::vector<char>> ScanBodyPtr;
+
+// Результаты одного сканирования в готовом к выдаче виде: элементы JSON
+// сериализованы один раз подряд в общий буфер, рядом - поля для сортировки
+// и фильтров. Снимок неизменяем и разделяется между ответами
+struct ScanSnapshot {
+  struct Entry {
+    uint32_t offset;
+    uint16_t len;
+    int8_t rssi;
+    uint8_t channel;
+    uint8_t encryption;
+  };
+
+  uint32_t generation;
+  std::vector<char> items;
+  std::vector<Entry> entries;
+  std::vector<String> ssids;       // Только для сортировки по имени
+};
+
+// Кэш ответов /scan-results.
+//
+// Снимок публикует сетевая задача по завершении сканирования, и только тогда кэш
+// сбрасывается. Ответ на запрос собирается из готовых элементов снимка
+// (фильтр, сортировка индексов, вырезка страницы - без сериализации) и
+// хранится до следующего сканирования, так что повторные обновления
+// панели с теми же параметрами отдают уже собранное тело. Тело
+// неизменяемо: подменить его на середине выдачи нельзя, новый снимок
+// просто перестает раздавать старое.
+class ScanResultsCache {
+private:
+  struct CachedBody {
+    ScanQuery query;
+    uint32_t generation;
+    uint32_t lastUse;
+    ScanBodyPtr body;
+  };
+
+  std::shared_ptr<const ScanSnapshot> snapshot;
+  CachedBody bodies[SCAN_CACHED_BODIES];
+  uint32_t generation;
+  uint32_t useCounter;
+  uint32_t hits;
+  uint32_t misses;
+  mutable portMUX_TYPE mux;
+
+  static void appendText(std::vector<char>& out, const char* text) {
+    out.insert(out.end(), text, text + strlen(text));
+  }
+
+  static bool matches(const ScanSnapshot::Entry& entry, const ScanQuery& query) {
+    if (entry.rssi < query.minRssi) return false;
+    if (query.channels && !(entry.channel < 16 && (query.channels & (1u << entry.channel)))) return false;
+    if (query.encryptions && !(entry.encryption < 16 && (query.encryptions & (1u << entry.encryption)))) return false;
+    return true;
+  }
+
+  static ScanBodyPtr build(const ScanSnapshot& snap, const ScanQuery& query) {
+    std::vector<uint16_t> order;
+    order.reserve(snap.entries.size());
+    for (uint16_t i = 0; i < snap.entries.size(); i++) {
+      if (matches(snap.entries[i], query)) order.push_back(i);
+    }
+
+    if (query.sort != SCAN_SORT_NONE) {
+      // Устойчивая сортировка: при равных ключах остается порядок драйвера (по уровню)
+      std::stable_sort(order.begin(), order.end(), [&snap, &query](uint16_t a, uint16_t b) {
+        const ScanSnapshot::Entry& ea = snap.entries[a];
+        const ScanSnapshot::Entry& eb = snap.entries[b];
+        int cmp;
+        switch (query.sort) {
+          case SCAN_SORT_RSSI: cmp = ea.rssi - eb.rssi; break;
+          case SCAN_SORT_CHANNEL: cmp = ea.channel - eb.channel; break;
+          case SCAN_SORT_ENCRYPTION: cmp = ea.encryption - eb.encryption; break;
+          default: cmp = strcasecmp(snap.ssids[a].c_str(), snap.ssids[b].c_str()); break;
+        }
+        return query.descending ? cmp > 0 : cmp < 0;
+      });
+    }
+
+    size_t matched = order.size();
+    size_t first = 0;
+    size_t last = matched;
+    uint16_t pages = 1;
+    if (query.size > 0) {
+      pages = matched > 0 ? (matched + query.size - 1) / query.size : 1;
+      first = min((size_t)query.page * query.size, matched);
+      last = min(first + query.size, matched);
+    }
+
+    size_t bytes = 128;
+    for (size_t i = first; i < last; i++) {
+      bytes += snap.entries[order[i]].len + 1;
+    }
+    auto body = std::make_shared<std::vector<char>>();
+    body->reserve(bytes);
+    appendText(*body, "{\"networks\":[");
+    for (size_t i = first; i < last; i++) {
+      const ScanSnapshot::Entry& entry = snap.entries[order[i]];
+      if (i > first) body->push_back(',');
+      body->insert(body->end(), snap.items.begin() + entry.offset,
+                   snap.items.begin() + entry.offset + entry.len);
+    }
+    char tail[128];
+    snprintf(tail, sizeof(tail),
+             "],\"totalNetworks\":%u,\"matched\":%u,\"page\":%u,\"size\":%u,\"pages\":%u,\"generation\":%u}",
+             (unsigned)snap.entries.size(), (unsigned)matched, (unsigned)query.page,
+             (unsigned)query.size, (unsigned)pages, (unsigned)snap.generation);
+    appendText(*body, tail);
+    return body;
+  }
+
+  // Подмена снимка. Старые данные освобождаются вне критической секции
+  void replace(std::shared_ptr<ScanSnapshot> snap) {
+    std::shared_ptr<const ScanSnapshot> old;
+    ScanBodyPtr oldBodies[SCAN_CACHED_BODIES];
+    portENTER_CRITICAL(&mux);
+    generation++;
+    if (snap) snap->generation = generation;
+    old.swap(snapshot);
+    snapshot = snap;
+    for (uint8_t i = 0; i < SCAN_CACHED_BODIES; i++) {
+      oldBodies[i].swap(bodies[i].body);
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+public:
+  ScanResultsCache() : generation(0), useCounter(0), hits(0), misses(0) {
+    mux = portMUX_INITIALIZER_UNLOCKED;
+    for (auto& cached : bodies) {
+      cached.generation = 0;
+      cached.lastUse = 0;
+    }
+  }
+
+  // Публикация результатов сканирования (из сетевой задачи). Элементы сериализуются здесь
+  void publish(const std::vector<WiFiResult>& networks, ScanItemSerializer toJson) {
+    auto snap = std::make_shared<ScanSnapshot>();
+    snap->entries.reserve(networks.size());
+    snap->ssids.reserve(networks.size());
+    snap->items.reserve(networks.size() * 80);
+    for (const WiFiResult& network : networks) {
+      StaticJsonDocument<192> netObj;
+      toJson(network, netObj);
+      size_t offset = snap->items.size();
+      size_t len = measureJson(netObj);
+      // serializeJson дописывает завершающий ноль, он отрезается
+      snap->items.resize(offset + len + 1);
+      serializeJson(netObj, snap->items.data() + offset, len + 1);
+      snap->items.resize(offset + len);
+
+      ScanSnapshot::Entry entry;
+      entry.offset = offset;
+      entry.len = len;
+      entry.rssi = constrain(network.rssi, -128, 127);
+      entry.channel = network.channel;
+      entry.encryption = network.encryptionType;
+      snap->entries.push_back(entry);
+      snap->ssids.push_back(network.ssid);
+    }
+    replace(snap);
+  }
+
+  // Сброс перед новым сканированием
+  void clear() {
+    replace(nullptr);
+  }
+
+  bool hasResults() const {
+    portENTER_CRITICAL(&mux);
+    bool present = snapshot != nullptr;
+    portEXIT_CRITICAL(&mux);
+    return present;
+  }
+
+  // Тело ответа на запрос или nullptr, если результатов нет
+  ScanBodyPtr body(const ScanQuery& query) {
+    portENTER_CRITICAL(&mux);
+    std::shared_ptr<const ScanSnapshot> snap = snapshot;
+    for (auto& cached : bodies) {
+      if (cached.body && cached.generation == generation && cached.query == query) {
+        cached.lastUse = ++useCounter;
+        hits++;
+        ScanBodyPtr body = cached.body;
+        portEXIT_CRITICAL(&mux);
+        return body;
+      }
+    }
+    misses++;
+    portEXIT_CRITICAL(&mux);
+
+    if (!snap) {
+      return nullptr;
+    }
+    ScanBodyPtr body = build(*snap, query);
+
+    // Вытесняется самое старое тело; за время сборки могло пройти новое сканирование
+    ScanBodyPtr evicted;
+    portENTER_CRITICAL(&mux);
+    if (snap->generation == generation) {
+      CachedBody* slot = &bodies[0];
+      for (auto& cached : bodies) {
+        if (!cached.body || cached.generation != generation) {
+          slot = &cached;
+          break;
+        }
+        if (cached.lastUse < slot->lastUse) slot = &cached;
+      }
+      evicted.swap(slot->body);
+      slot->query = query;
+      slot->generation = generation;
+      slot->lastUse = ++useCounter;
+      slot->body = body;
+    }
+    portEXIT_CRITICAL(&mux);
+    return body;
+  }
+
+  uint32_t getGeneration() const { return generation; }
+  uint32_t getHits() const { return hits; }
+  uint32_t getMisses() const { return misses; }
+};
+
+#endif // SCAN_RESULTS_CACHE_H
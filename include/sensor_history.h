@@ -0,0 +1,418 @@
+#ifndef SENSOR_HISTORY_H
+#define SENSOR_HISTORY_H
+
+#include <Arduino.h>
+
+// Показатели в истории
+enum SensorMetric : uint8_t {
+  METRIC_BATTERY,       // Напряжение батареи
+  METRIC_PERCENT,       // Заряд, %
+  METRIC_TEMPERATURE,   // Температура IMU
+  METRIC_MOTION,        // Модуль угловой скорости, град/с
+  SENSOR_METRICS
+};
+
+#define SENSOR_VALUE_EMPTY 0xFF   // Нет данных за интервал
+
+// Емкость уровней: 15 минут по секунде, 12 часов по минуте, 7 дней по 10 минут
+#define HISTORY_RAW_SLOTS 900
+#define HISTORY_MINUTE_SLOTS 720
+#define HISTORY_TEN_MINUTE_SLOTS 1008
+
+static const char* const sensorMetricNames[SENSOR_METRICS] = {"battery", "percent", "temperature", "motion"};
+
+// Квантование в байт (0..254, 255 - нет данных):
+// батарея 3.00..4.27 В с шагом 5 мВ, заряд 0..100 %,
+// температура -20..107 °C с шагом 0.5 °C, вращение 0..508 °/с с шагом 2
+inline uint8_t encodeSensorValue(SensorMetric metric, float value) {
+  float q;
+  switch (metric) {
+    case METRIC_BATTERY:     q = (value * 1000.0f - 3000.0f) / 5.0f; break;
+    case METRIC_PERCENT:     q = value; break;
+    case METRIC_TEMPERATURE: q = (value + 20.0f) * 2.0f; break;
+    case METRIC_MOTION:      q = value / 2.0f; break;
+    default:                 return SENSOR_VALUE_EMPTY;
+  }
+  return (uint8_t)constrain(lroundf(q), 0L, 254L);
+}
+
+inline float decodeSensorValue(SensorMetric metric, uint8_t q) {
+  switch (metric) {
+    case METRIC_BATTERY:     return (3000.0f + q * 5.0f) / 1000.0f;
+    case METRIC_PERCENT:     return q;
+    case METRIC_TEMPERATURE: return q / 2.0f - 20.0f;
+    case METRIC_MOTION:      return q * 2.0f;
+    default:                 return 0.0f;
+  }
+}
+
+// Отсчет за секунду
+struct SensorSample {
+  uint8_t value[SENSOR_METRICS];
+
+  static SensorSample empty() {
+    SensorSample s;
+    memset(s.value, SENSOR_VALUE_EMPTY, sizeof(s.value));
+    return s;
+  }
+  bool isEmpty() const {
+    for (uint8_t v : value) {
+      if (v != SENSOR_VALUE_EMPTY) return false;
+    }
+    return true;
+  }
+};
+
+// Свертка интервала: минимум, среднее и максимум по каждому показателю
+struct SensorRollup {
+  uint8_t min[SENSOR_METRICS];
+  uint8_t avg[SENSOR_METRICS];
+  uint8_t max[SENSOR_METRICS];
+
+  static SensorRollup empty() {
+    SensorRollup r;
+    memset(&r, SENSOR_VALUE_EMPTY, sizeof(r));
+    return r;
+  }
+  bool isEmpty() const {
+    for (uint8_t v : avg) {
+      if (v != SENSOR_VALUE_EMPTY) return false;
+    }
+    return true;
+  }
+};
+
+// Кольцо фиксированной емкости, адресуемое номером интервала
+// (время / период). Пропущенные интервалы заполняются пустыми записями,
+// поэтому время записи вычисляется по ее месту и не хранится.
+template<typename T, size_t N>
+class HistoryRing {
+private:
+  T slots[N];
+  uint32_t first;    // Номер первого записанного интервала
+  uint32_t newest;   // Номер последнего записанного интервала
+  bool started;
+
+public:
+  HistoryRing() : first(0), newest(0), started(false) {}
+
+  void put(uint32_t bucket, const T& item) {
+    if (started && bucket < newest) {
+      return;
+    }
+    if (started) {
+      uint32_t gap = min((uint32_t)N, bucket - newest);
+      for (uint32_t i = 1; i < gap; i++) {
+        slots[(bucket - i) % N] = T::empty();
+      }
+    }
+    if (!started) {
+      first = bucket;
+    }
+    slots[bucket % N] = item;
+    newest = bucket;
+    started = true;
+  }
+
+  bool get(uint32_t bucket, T& item) const {
+    if (!started || bucket > newest || bucket < oldest()) {
+      return false;
+    }
+    item = slots[bucket % N];
+    return true;
+  }
+
+  // Номер самого старого хранимого интервала
+  uint32_t oldest() const {
+    return newest - first >= N ? newest - (N - 1) : first;
+  }
+  uint32_t latest() const { return newest; }
+  bool isEmpty() const { return !started; }
+  static constexpr size_t capacity() { return N; }
+};
+
+// Накопитель текущего интервала свертки
+class RollupAccumulator {
+private:
+  uint32_t bucket;
+  uint32_t sum[SENSOR_METRICS];
+  uint16_t count[SENSOR_METRICS];
+  uint8_t lo[SENSOR_METRICS];
+  uint8_t hi[SENSOR_METRICS];
+  bool active;
+
+public:
+  RollupAccumulator() : bucket(0), active(false) {
+    reset(0);
+  }
+
+  void reset(uint32_t newBucket) {
+    bucket = newBucket;
+    memset(sum, 0, sizeof(sum));
+    memset(count, 0, sizeof(count));
+    memset(lo, 0xFF, sizeof(lo));
+    memset(hi, 0, sizeof(hi));
+  }
+
+  // Добавление отсчета. true - предыдущий интервал закрыт и выдан в done
+  bool add(uint32_t sampleBucket, const SensorSample& sample, uint32_t& doneBucket, SensorRollup& done) {
+    bool closed = false;
+    if (active && sampleBucket != bucket) {
+      doneBucket = bucket;
+      done = result();
+      closed = true;
+      reset(sampleBucket);
+    } else if (!active) {
+      reset(sampleBucket);
+      active = true;
+    }
+
+    for (uint8_t m = 0; m < SENSOR_METRICS; m++) {
+      uint8_t v = sample.value[m];
+      if (v == SENSOR_VALUE_EMPTY) continue;
+      sum[m] += v;
+      count[m]++;
+      if (v < lo[m]) lo[m] = v;
+      if (v > hi[m]) hi[m] = v;
+    }
+    return closed;
+  }
+
+  // Свертка по накопленному (для незакрытого интервала - частичная)
+  SensorRollup result() const {
+    SensorRollup r = SensorRollup::empty();
+    for (uint8_t m = 0; m < SENSOR_METRICS; m++) {
+      if (count[m] == 0) continue;
+      r.min[m] = lo[m];
+      r.max[m] = hi[m];
+      r.avg[m] = (sum[m] + count[m] / 2) / count[m];
+    }
+    return r;
+  }
+
+  bool isActive() const { return active; }
+  uint32_t getBucket() const { return bucket; }
+};
+
+// Уровни истории
+enum HistoryTier : uint8_t {
+  HISTORY_TIER_RAW,         // 1 с
+  HISTORY_TIER_MINUTE,      // 1 мин
+  HISTORY_TIER_TEN_MINUTES  // 10 мин
+};
+
+// История показателей датчиков в ограниченной памяти.
+//
+// Каждый отсчет квантуется в 4 байта и пишется в секундное кольцо, а
+// одновременно в накопители минутных и десятиминутных сверток мин/сред/макс.
+// Вся история - около 24 КБ при любой длительности работы, добавление
+// отсчета - O(1) без выделений памяти.
+class SensorHistory {
+private:
+  HistoryRing<SensorSample, HISTORY_RAW_SLOTS> raw;
+  HistoryRing<SensorRollup, HISTORY_MINUTE_SLOTS> minutes;
+  HistoryRing<SensorRollup, HISTORY_TEN_MINUTE_SLOTS> tenMinutes;
+  RollupAccumulator minuteAcc;
+  RollupAccumulator tenMinuteAcc;
+  uint32_t samples;
+
+public:
+  SensorHistory() : samples(0) {}
+
+  static uint32_t tierPeriod(HistoryTier tier) {
+    switch (tier) {
+      case HISTORY_TIER_MINUTE:      return 60;
+      case HISTORY_TIER_TEN_MINUTES: return 600;
+      default:                       return 1;
+    }
+  }
+
+  // Отсчет на момент uptimeSec (секунды с загрузки)
+  void add(uint32_t uptimeSec, const float* values, const bool* valid) {
+    SensorSample sample;
+    for (uint8_t m = 0; m < SENSOR_METRICS; m++) {
+      sample.value[m] = valid[m] ? encodeSensorValue((SensorMetric)m, values[m]) : SENSOR_VALUE_EMPTY;
+    }
+    raw.put(uptimeSec, sample);
+
+    uint32_t doneBucket;
+    SensorRollup done;
+    if (minuteAcc.add(uptimeSec / 60, sample, doneBucket, done)) {
+      minutes.put(doneBucket, done);
+    }
+    if (tenMinuteAcc.add(uptimeSec / 600, sample, doneBucket, done)) {
+      tenMinutes.put(doneBucket, done);
+    }
+    samples++;
+  }
+
+  // Первый и последний номер интервала уровня (с учетом незакрытого)
+  bool range(HistoryTier tier, uint32_t& first, uint32_t& last) const {
+    switch (tier) {
+      case HISTORY_TIER_RAW:
+        if (raw.isEmpty()) return false;
+        first = raw.oldest();
+        last = raw.latest();
+        return true;
+      case HISTORY_TIER_MINUTE:
+        if (!minuteAcc.isActive()) return false;
+        last = minuteAcc.getBucket();
+        first = minutes.isEmpty() ? last : minutes.oldest();
+        return true;
+      case HISTORY_TIER_TEN_MINUTES:
+        if (!tenMinuteAcc.isActive()) return false;
+        last = tenMinuteAcc.getBucket();
+        first = tenMinutes.isEmpty() ? last : tenMinutes.oldest();
+        return true;
+    }
+    return false;
+  }
+
+  // Свертка интервала. Для секундного уровня min = avg = max = отсчет
+  bool get(HistoryTier tier, uint32_t bucket, SensorRollup& out) const {
+    switch (tier) {
+      case HISTORY_TIER_RAW: {
+        SensorSample sample;
+        if (!raw.get(bucket, sample) || sample.isEmpty()) return false;
+        memcpy(out.min, sample.value, SENSOR_METRICS);
+        memcpy(out.avg, sample.value, SENSOR_METRICS);
+        memcpy(out.max, sample.value, SENSOR_METRICS);
+        return true;
+      }
+      case HISTORY_TIER_MINUTE:
+        if (bucket == minuteAcc.getBucket()) {
+          out = minuteAcc.result();
+        } else if (!minutes.get(bucket, out)) {
+          return false;
+        }
+        return !out.isEmpty();
+      case HISTORY_TIER_TEN_MINUTES:
+        if (bucket == tenMinuteAcc.getBucket()) {
+          out = tenMinuteAcc.result();
+        } else if (!tenMinutes.get(bucket, out)) {
+          return false;
+        }
+        return !out.isEmpty();
+    }
+    return false;
+  }
+
+  uint32_t getSamples() const { return samples; }
+
+  static constexpr size_t memoryUsage() {
+    return sizeof(SensorSample) * HISTORY_RAW_SLOTS +
+           sizeof(SensorRollup) * (HISTORY_MINUTE_SLOTS + HISTORY_TEN_MINUTE_SLOTS);
+  }
+};
+
+// Потоковая выдача уровня истории в JSON:
+// {"resolution":60,"now":..,"points":[{"t":..,"battery":[min,avg,max],...},...]}
+// Для секундного уровня значения выдаются числами, а не тройками.
+// Запись выполняется по ходу выдачи; самые старые точки могут смениться
+// новыми, если выгрузка идет дольше емкости уровня.
+class HistoryStreamer {
+private:
+  const SensorHistory& history;
+  HistoryTier tier;
+  uint32_t next;
+  uint32_t last;
+  uint32_t nowSec;
+  uint32_t emitted;
+  bool any;
+  uint8_t stage;    // 0 - заголовок, 1 - точки, 2 - конец, 3 - все выдано
+  char pending[320];
+  size_t pendingLen;
+  size_t pendingPos;
+
+  static int formatValue(char* out, size_t size, SensorMetric metric, uint8_t q) {
+    if (q == SENSOR_VALUE_EMPTY) {
+      return snprintf(out, size, "null");
+    }
+    float v = decodeSensorValue(metric, q);
+    return metric == METRIC_BATTERY ? snprintf(out, size, "%.3f", v) : snprintf(out, size, "%.1f", v);
+  }
+
+  bool stagePoint() {
+    SensorRollup point;
+    while (next <= last) {
+      uint32_t bucket = next++;
+      if (!history.get(tier, bucket, point)) {
+        continue;
+      }
+      int len = snprintf(pending, sizeof(pending), "%s{\"t\":%u", any ? "," : "",
+                         (unsigned)(bucket * SensorHistory::tierPeriod(tier)));
+      for (uint8_t m = 0; m < SENSOR_METRICS; m++) {
+        SensorMetric metric = (SensorMetric)m;
+        len += snprintf(pending + len, sizeof(pending) - len, ",\"%s\":", sensorMetricNames[m]);
+        if (tier == HISTORY_TIER_RAW) {
+          len += formatValue(pending + len, sizeof(pending) - len, metric, point.avg[m]);
+          continue;
+        }
+        pending[len++] = '[';
+        len += formatValue(pending + len, sizeof(pending) - len, metric, point.min[m]);
+        pending[len++] = ',';
+        len += formatValue(pending + len, sizeof(pending) - len, metric, point.avg[m]);
+        pending[len++] = ',';
+        len += formatValue(pending + len, sizeof(pending) - len, metric, point.max[m]);
+        pending[len++] = ']';
+      }
+      pending[len++] = '}';
+      pendingLen = len;
+      pendingPos = 0;
+      any = true;
+      emitted++;
+      return true;
+    }
+    return false;
+  }
+
+  bool stageNext() {
+    switch (stage) {
+      case 0:
+        pendingLen = snprintf(pending, sizeof(pending), "{\"resolution\":%u,\"now\":%u,\"points\":[",
+                              (unsigned)SensorHistory::tierPeriod(tier), (unsigned)nowSec);
+        pendingPos = 0;
+        stage = 1;
+        return true;
+      case 1:
+        if (stagePoint()) return true;
+        stage = 2;
+        // fallthrough
+      case 2:
+        pendingLen = snprintf(pending, sizeof(pending), "],\"count\":%u,\"samples\":%u}",
+                              (unsigned)emitted, (unsigned)history.getSamples());
+        pendingPos = 0;
+        stage = 3;
+        return true;
+    }
+    return false;
+  }
+
+public:
+  // Точки уровня tier начиная со времени fromSec (секунды с загрузки)
+  HistoryStreamer(const SensorHistory& history, HistoryTier tier, uint32_t fromSec, uint32_t nowSec)
+    : history(history), tier(tier), next(1), last(0), nowSec(nowSec), emitted(0), any(false),
+      stage(0), pendingLen(0), pendingPos(0) {
+    uint32_t first;
+    if (history.range(tier, first, last)) {
+      next = max(first, fromSec / SensorHistory::tierPeriod(tier));
+    }
+  }
+
+  // Заполняющий колбэк chunked-ответа
+  size_t fill(uint8_t* buffer, size_t maxLen) {
+    size_t filled = 0;
+    while (filled < maxLen) {
+      if (pendingPos >= pendingLen && !stageNext()) {
+        break;
+      }
+      size_t chunk = min(maxLen - filled, pendingLen - pendingPos);
+      memcpy(buffer + filled, pending + pendingPos, chunk);
+      pendingPos += chunk;
+      filled += chunk;
+    }
+    return filled;
+  }
+};
+
+#endif // SENSOR_HISTORY_H
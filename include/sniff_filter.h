@@ -0,0 +1,217 @@
+#ifndef SNIFF_FILTER_H
+#define SNIFF_FILTER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_wifi.h>
+#include "common_structures.h"
+
+// Клиентов, которых можно сниффить одновременно
+#define SNIFF_FILTER_MAX_CLIENTS 8
+
+// Направление кадров относительно клиента
+#define SNIFF_DIR_UPLINK   0x01  // Клиент - передатчик (addr2)
+#define SNIFF_DIR_DOWNLINK 0x02  // Клиент - получатель (addr1)
+#define SNIFF_DIR_BOTH     (SNIFF_DIR_UPLINK | SNIFF_DIR_DOWNLINK)
+
+// Классы кадров по полю Type заголовка 802.11
+#define SNIFF_CLASS_MGMT 0x01
+#define SNIFF_CLASS_CTRL 0x02
+#define SNIFF_CLASS_DATA 0x04
+#define SNIFF_CLASS_ALL  (SNIFF_CLASS_MGMT | SNIFF_CLASS_CTRL | SNIFF_CLASS_DATA)
+
+// Правило для одного клиента
+struct SniffTarget {
+  uint8_t mac[6];
+  uint8_t directions;     // SNIFF_DIR_*
+  uint8_t classes;        // SNIFF_CLASS_*
+  uint16_t subtypes[3];   // Маски подтипов для MGMT/CTRL/DATA (бит = подтип 0..15)
+};
+
+// Счетчики потока одного клиента (пишет только колбэк сниффера)
+struct SniffStreamStats {
+  std::atomic<uint32_t> packets;
+  std::atomic<uint32_t> bytes;
+  std::atomic<uint32_t> uplink;
+  std::atomic<uint32_t> downlink;
+};
+
+// Фильтр сниффера на несколько клиентов.
+//
+// Правила компилируются в компактную форму: 256-битная карта по хэшу MAC
+// отсекает почти все чужие кадры одной проверкой бита, и только при
+// попадании идет точное сравнение 48-битных ключей. Классы кадров, не
+// нужные ни одному правилу, отбрасывает сам драйвер
+// (esp_wifi_set_promiscuous_filter), так что колбэк их не получает.
+//
+// Номер потока - это номер слота правила; он не меняется, пока клиент в
+// фильтре, поэтому записи в буфере захвата можно отбирать по клиенту.
+// Правила меняются только при выключенном promiscuous-режиме, поэтому
+// колбэк читает их без синхронизации.
+class SniffFilter {
+private:
+  struct Compiled {
+    uint64_t key;          // macToKey, 0 - слот свободен
+    uint8_t directions;
+    uint16_t subtypes[3];  // 0 - класс не нужен
+  };
+
+  SniffTarget targets[SNIFF_FILTER_MAX_CLIENTS];
+  Compiled compiled[SNIFF_FILTER_MAX_CLIENTS];
+  SniffStreamStats stats[SNIFF_FILTER_MAX_CLIENTS];
+  uint32_t bitmap[8];
+  uint8_t used;            // Биты занятых слотов
+  uint8_t classes;         // Объединение классов всех правил
+
+  static uint8_t hashMAC(const uint8_t* mac) {
+    return mac[5] ^ (mac[4] << 1) ^ (mac[3] >> 1);
+  }
+
+  bool inBitmap(const uint8_t* mac) const {
+    uint8_t h = hashMAC(mac);
+    return bitmap[h >> 5] & (1u << (h & 31));
+  }
+
+  int find(uint64_t key) const {
+    for (uint8_t i = 0; i < SNIFF_FILTER_MAX_CLIENTS; i++) {
+      if ((used & (1 << i)) && compiled[i].key == key) return i;
+    }
+    return -1;
+  }
+
+  void compile() {
+    memset(bitmap, 0, sizeof(bitmap));
+    classes = 0;
+    for (uint8_t i = 0; i < SNIFF_FILTER_MAX_CLIENTS; i++) {
+      Compiled& c = compiled[i];
+      if (!(used & (1 << i))) {
+        c.key = 0;
+        continue;
+      }
+      const SniffTarget& t = targets[i];
+      c.key = macToKey(t.mac);
+      c.directions = t.directions;
+      for (uint8_t cls = 0; cls < 3; cls++) {
+        c.subtypes[cls] = (t.classes & (1 << cls)) ? t.subtypes[cls] : 0;
+      }
+      classes |= t.classes;
+      uint8_t h = hashMAC(t.mac);
+      bitmap[h >> 5] |= 1u << (h & 31);
+    }
+  }
+
+  // Поиск правила для адреса с проверкой направления и подтипа
+  int matchAddress(const uint8_t* mac, uint8_t direction, uint8_t cls, uint8_t subtype) const {
+    if (!inBitmap(mac)) return -1;
+    int i = find(macToKey(mac));
+    if (i < 0) return -1;
+    const Compiled& c = compiled[i];
+    if (!(c.directions & direction) || !(c.subtypes[cls] & (1u << subtype))) return -1;
+    return i;
+  }
+
+public:
+  SniffFilter() : used(0), classes(0) {
+    memset(bitmap, 0, sizeof(bitmap));
+  }
+
+  // Добавление или замена правила клиента. Вызывать при остановленном колбэке
+  bool set(const SniffTarget& target) {
+    int i = find(macToKey(target.mac));
+    if (i < 0) {
+      for (i = 0; i < SNIFF_FILTER_MAX_CLIENTS && (used & (1 << i)); i++) {}
+      if (i >= SNIFF_FILTER_MAX_CLIENTS) return false;
+      used |= 1 << i;
+      resetStream(i);
+    }
+    targets[i] = target;
+    compile();
+    return true;
+  }
+
+  // Удаление правила клиента. Вызывать при остановленном колбэке
+  bool remove(const uint8_t* mac) {
+    int i = find(macToKey(mac));
+    if (i < 0) return false;
+    used &= ~(1 << i);
+    compile();
+    return true;
+  }
+
+  void clear() {
+    used = 0;
+    compile();
+  }
+
+  // Маска для esp_wifi_set_promiscuous_filter по классам всех правил
+  uint32_t driverMask() const {
+    uint32_t mask = 0;
+    if (classes & SNIFF_CLASS_MGMT) mask |= WIFI_PROMIS_FILTER_MASK_MGMT;
+    if (classes & SNIFF_CLASS_CTRL) mask |= WIFI_PROMIS_FILTER_MASK_CTRL;
+    if (classes & SNIFF_CLASS_DATA) mask |= WIFI_PROMIS_FILTER_MASK_DATA;
+    return mask;
+  }
+
+  // Проверка кадра (из колбэка сниффера). Возвращает номер потока или -1.
+  // Кадр, адресованный клиенту, относится к downlink, переданный им - к uplink
+  int match(const uint8_t* frame, uint16_t len, bool* uplink = nullptr) const {
+    if (used == 0 || len < 10) return -1;
+    uint8_t cls = (frame[0] >> 2) & 0x03;
+    if (cls > 2) return -1;
+    uint8_t subtype = frame[0] >> 4;
+
+    // addr2 есть не у всех управляющих кадров (ACK и CTS - только addr1)
+    if (len >= 16) {
+      int i = matchAddress(frame + 10, SNIFF_DIR_UPLINK, cls, subtype);
+      if (i >= 0) {
+        if (uplink) *uplink = true;
+        return i;
+      }
+    }
+    int i = matchAddress(frame + 4, SNIFF_DIR_DOWNLINK, cls, subtype);
+    if (i >= 0 && uplink) *uplink = false;
+    return i;
+  }
+
+  // Учет кадра в потоке (из колбэка сниффера, писатель единственный)
+  void account(int stream, uint16_t len, bool uplink) {
+    SniffStreamStats& s = stats[stream];
+    s.packets.store(s.packets.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    s.bytes.store(s.bytes.load(std::memory_order_relaxed) + len, std::memory_order_relaxed);
+    std::atomic<uint32_t>& dir = uplink ? s.uplink : s.downlink;
+    dir.store(dir.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  void resetStream(int stream) {
+    stats[stream].packets.store(0);
+    stats[stream].bytes.store(0);
+    stats[stream].uplink.store(0);
+    stats[stream].downlink.store(0);
+  }
+
+  // Номер потока клиента или -1
+  int streamOf(const uint8_t* mac) const {
+    return find(macToKey(mac));
+  }
+
+  uint8_t size() const { return __builtin_popcount(used); }
+  bool isUsed(uint8_t i) const { return i < SNIFF_FILTER_MAX_CLIENTS && (used & (1 << i)); }
+  const SniffTarget& target(uint8_t i) const { return targets[i]; }
+  const SniffStreamStats& stream(uint8_t i) const { return stats[i]; }
+  bool contains(const uint8_t* mac) const { return find(macToKey(mac)) >= 0; }
+};
+
+// Правило по умолчанию: оба направления, все кадры
+inline SniffTarget makeSniffTarget(const uint8_t* mac, uint8_t directions = SNIFF_DIR_BOTH,
+                                   uint8_t classes = SNIFF_CLASS_ALL) {
+  SniffTarget target;
+  memcpy(target.mac, mac, 6);
+  target.directions = directions;
+  target.classes = classes;
+  for (auto& mask : target.subtypes) {
+    mask = 0xFFFF;
+  }
+  return target;
+}
+
+#endif // SNIFF_FILTER_H
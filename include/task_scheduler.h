@@ -0,0 +1,268 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <Arduino.h>
+#include <functional>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#define SCHEDULER_MAX_TASKS 24
+#define SCHEDULER_MAX_WAIT_MS 1000  // Страховочный предел ожидания
+
+typedef std::function<void()> TaskCallback;
+typedef std::function<void(uint32_t passUs)> PassHook;
+
+// Кооперативный планировщик основного цикла.
+//
+// Модули регистрируют периодические (every) и однократные (after, post)
+// задачи; run() выполняет наступившие и усыпляет свою задачу до ближайшего
+// срока. Срок отсчитывает один однократный esp_timer, который будит задачу
+// через уведомление FreeRTOS, поэтому между событиями процессор простаивает,
+// а не крутит цикл с delay(). Задачи выполняются в задаче, вызывающей run()
+// (loop или собственная задача, запущенная start()), ставить их можно из
+// любой задачи; из прерывания - только notifyFromISR().
+class TaskScheduler {
+private:
+  struct Task {
+    TaskCallback callback;
+    int64_t due;        // мкс, esp_timer_get_time()
+    uint32_t periodUs;  // 0 - однократная задача
+    uint16_t id;        // 0 - слот свободен
+  };
+
+  Task tasks[SCHEDULER_MAX_TASKS];
+  SemaphoreHandle_t lock;
+  esp_timer_handle_t timer;
+  volatile TaskHandle_t owner;
+  uint16_t nextId;
+  uint32_t executed;
+  uint32_t wakeups;
+  uint32_t lastPassUs;     // Время выполнения задач за последний проход (без ожидания)
+  uint8_t lastPassTasks;
+  PassHook passHook;
+
+  static void onTimer(void* arg) {
+    ((TaskScheduler*)arg)->notify();
+  }
+
+  static void taskEntry(void* arg) {
+    TaskScheduler* self = (TaskScheduler*)arg;
+    self->owner = xTaskGetCurrentTaskHandle();
+    for (;;) {
+      self->run();
+      // Проходы без задач (только ожидание) в замер не идут
+      if (self->passHook && self->lastPassTasks > 0) {
+        self->passHook(self->lastPassUs);
+      }
+    }
+  }
+
+  uint16_t add(uint32_t delayMs, uint32_t periodMs, TaskCallback callback) {
+    uint16_t id = 0;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (auto& task : tasks) {
+      if (task.id == 0) {
+        if (++nextId == 0) nextId = 1;
+        task.id = id = nextId;
+        task.callback = callback;
+        task.due = esp_timer_get_time() + (int64_t)delayMs * 1000;
+        task.periodUs = periodMs * 1000;
+        break;
+      }
+    }
+    xSemaphoreGive(lock);
+
+    if (id == 0) {
+      Serial.println("Scheduler: no free task slots");
+    } else if (xTaskGetCurrentTaskHandle() != owner) {
+      // Новый срок может оказаться раньше того, на который взведен таймер
+      notify();
+    }
+    return id;
+  }
+
+  // Извлечение одной наступившей задачи. false - таких нет
+  bool takeDue(int64_t now, TaskCallback& callback) {
+    bool found = false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (auto& task : tasks) {
+      if (task.id != 0 && task.due <= now) {
+        callback = task.callback;
+        if (task.periodUs > 0) {
+          // Пропущенные из-за долгой задачи периоды не догоняем
+          task.due += task.periodUs;
+          if (task.due <= now) task.due = now + task.periodUs;
+        } else {
+          task.id = 0;
+          task.callback = nullptr;
+        }
+        found = true;
+        break;
+      }
+    }
+    xSemaphoreGive(lock);
+    return found;
+  }
+
+  int64_t nextDue() {
+    int64_t due = INT64_MAX;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (const auto& task : tasks) {
+      if (task.id != 0 && task.due < due) due = task.due;
+    }
+    xSemaphoreGive(lock);
+    return due;
+  }
+
+public:
+  TaskScheduler() : lock(nullptr), timer(nullptr), owner(nullptr),
+                    nextId(0), executed(0), wakeups(0),
+                    lastPassUs(0), lastPassTasks(0) {
+    for (auto& task : tasks) {
+      task.id = 0;
+    }
+  }
+
+  // Вызывать из задачи, которая будет выполнять run()
+  void begin() {
+    owner = xTaskGetCurrentTaskHandle();
+    lock = xSemaphoreCreateMutex();
+
+    esp_timer_create_args_t args = {};
+    args.callback = onTimer;
+    args.arg = this;
+    args.name = "scheduler";
+    esp_timer_create(&args, &timer);
+  }
+
+  // Перенос run() в собственную задачу FreeRTOS на заданном ядре.
+  // Уже добавленные задачи сохраняются; после запуска run() не вызывать
+  bool start(const char* name, BaseType_t core, UBaseType_t priority, uint32_t stackSize) {
+    TaskHandle_t handle = nullptr;
+    if (xTaskCreatePinnedToCore(taskEntry, name, stackSize, this, priority, &handle, core) != pdPASS) {
+      Serial.printf("Scheduler: failed to start task %s\n", name);
+      return false;
+    }
+    owner = handle;
+    return true;
+  }
+
+  // Замер каждого прохода с задачами (для задачи, запущенной start())
+  void setPassHook(PassHook hook) {
+    passHook = hook;
+  }
+
+  // Периодическая задача. Первый запуск - через период или сразу (runNow)
+  uint16_t every(uint32_t periodMs, TaskCallback callback, bool runNow = false) {
+    return add(runNow ? 0 : periodMs, periodMs, callback);
+  }
+
+  // Однократная задача через delayMs
+  uint16_t after(uint32_t delayMs, TaskCallback callback) {
+    return add(delayMs, 0, callback);
+  }
+
+  // Выполнение в задаче планировщика при ближайшем проходе
+  uint16_t post(TaskCallback callback) {
+    return add(0, 0, callback);
+  }
+
+  bool cancel(uint16_t id) {
+    if (id == 0) {
+      return false;
+    }
+    bool removed = false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (auto& task : tasks) {
+      if (task.id == id) {
+        task.id = 0;
+        task.callback = nullptr;
+        removed = true;
+        break;
+      }
+    }
+    xSemaphoreGive(lock);
+    return removed;
+  }
+
+  // Смена периода задачи. Если новый период короче, срок подтягивается
+  bool setPeriod(uint16_t id, uint32_t periodMs) {
+    if (id == 0) {
+      return false;
+    }
+    bool found = false;
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (auto& task : tasks) {
+      if (task.id == id && task.periodUs > 0) {
+        task.periodUs = periodMs * 1000;
+        if (task.due > now + (int64_t)task.periodUs) {
+          task.due = now + task.periodUs;
+        }
+        found = true;
+        break;
+      }
+    }
+    xSemaphoreGive(lock);
+    if (found) notify();
+    return found;
+  }
+
+  // Разбудить run() досрочно (из любой задачи)
+  void notify() {
+    if (owner) xTaskNotifyGive(owner);
+  }
+
+  void notifyFromISR() {
+    BaseType_t woken = pdFALSE;
+    if (owner) vTaskNotifyGiveFromISR(owner, &woken);
+    if (woken) portYIELD_FROM_ISR();
+  }
+
+  // Выполнение наступивших задач и ожидание следующего срока
+  void run() {
+    TaskCallback callback;
+    int64_t start = esp_timer_get_time();
+    int ran = 0;
+    // Предел на проход, чтобы задачи с нулевым периодом не зациклили run()
+    for (; ran < SCHEDULER_MAX_TASKS && takeDue(esp_timer_get_time(), callback); ran++) {
+      callback();
+      executed++;
+    }
+    callback = nullptr;
+
+    int64_t now = esp_timer_get_time();
+    lastPassUs = now - start;
+    lastPassTasks = ran;
+    int64_t due = nextDue();
+    if (due <= now) {
+      return;
+    }
+
+    int64_t waitUs = min(due - now, (int64_t)SCHEDULER_MAX_WAIT_MS * 1000);
+    esp_timer_stop(timer);
+    esp_timer_start_once(timer, waitUs);
+    // Таймаут FreeRTOS - только страховка на случай потерянного уведомления
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitUs / 1000 + 10));
+    wakeups++;
+  }
+
+  size_t taskCount() {
+    size_t count = 0;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (const auto& task : tasks) {
+      if (task.id != 0) count++;
+    }
+    xSemaphoreGive(lock);
+    return count;
+  }
+
+  uint32_t getExecuted() const { return executed; }
+  uint32_t getWakeups() const { return wakeups; }
+  uint32_t getLastPassUs() const { return lastPassUs; }
+  uint8_t getLastPassTasks() const { return lastPassTasks; }
+};
+
+#endif // TASK_SCHEDULER_H
@@ -0,0 +1,264 @@
+#ifndef TELEMETRY_HUB_H
+#define TELEMETRY_HUB_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+#include <memory>
+#include <vector>
+
+// По умолчанию AsyncWebSocket на ESP32 держит до 8 клиентов
+#define TELEMETRY_MAX_SUBSCRIBERS 8
+#define TELEMETRY_DEFAULT_INTERVAL 500  // мс между рассылками
+#define TELEMETRY_MIN_INTERVAL 100
+#define TELEMETRY_MAX_INTERVAL 10000
+
+// Темы телеметрии
+enum TelemetryTopic : uint8_t {
+  TOPIC_CLIENTS,   // Подключение/отключение клиентов AP
+  TOPIC_TRAFFIC,   // Счетчики трафика клиентов
+  TOPIC_SNIFF,     // Новые перехваченные пакеты
+  TOPIC_PINS,      // Изменения состояния пинов KVM
+  TOPIC_SENSORS,   // Показания сенсоров
+  TOPIC_STATUS,    // Состояние WiFi и точки доступа
+  TOPIC_EDGES,     // Фронты отслеживаемых пинов KVM
+  TOPIC_COUNT
+};
+
+inline const char* telemetryTopicName(uint8_t topic) {
+  switch (topic) {
+    case TOPIC_CLIENTS: return "clients";
+    case TOPIC_TRAFFIC: return "traffic";
+    case TOPIC_SNIFF: return "sniff";
+    case TOPIC_PINS: return "pins";
+    case TOPIC_SENSORS: return "sensors";
+    case TOPIC_STATUS: return "status";
+    case TOPIC_EDGES: return "edges";
+    default: return "";
+  }
+}
+
+inline int telemetryTopicFromName(const char* name) {
+  if (!name) {
+    return -1;
+  }
+  for (uint8_t topic = 0; topic < TOPIC_COUNT; topic++) {
+    if (strcmp(name, telemetryTopicName(topic)) == 0) {
+      return topic;
+    }
+  }
+  return -1;
+}
+
+// Канал телеметрии поверх WebSocket.
+//
+// Клиент подписывается на темы сообщением {"sub":["traffic","pins"]}
+// (отписка - {"unsub":[...]}, частота - {"interval":мс}). Изменения
+// собираются сетевой задачей с заданной частотой: каждое сообщение сериализуется
+// один раз в общий буфер и отправляется всем подписчикам темы. После новой
+// подписки тема помечается для полной рассылки, чтобы клиент получил
+// текущее состояние, а не только последующие изменения.
+class TelemetryHub {
+private:
+  struct Subscriber {
+    uint32_t clientId;  // 0 - свободно
+    uint32_t topics;    // Битовая маска тем
+  };
+
+  AsyncWebSocket ws;
+  Subscriber subscribers[TELEMETRY_MAX_SUBSCRIBERS];
+  portMUX_TYPE mux;
+  uint32_t resyncTopics;   // Темы, требующие полной рассылки
+  uint16_t intervalMs;
+  unsigned long lastPublish;
+  uint32_t messagesSent;
+
+  Subscriber* findLocked(uint32_t clientId) {
+    for (auto& sub : subscribers) {
+      if (sub.clientId == clientId) {
+        return &sub;
+      }
+    }
+    return nullptr;
+  }
+
+  void addClient(uint32_t clientId) {
+    portENTER_CRITICAL(&mux);
+    Subscriber* sub = findLocked(0);
+    if (sub) {
+      sub->clientId = clientId;
+      sub->topics = 0;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  void removeClient(uint32_t clientId) {
+    portENTER_CRITICAL(&mux);
+    Subscriber* sub = findLocked(clientId);
+    if (sub) {
+      sub->clientId = 0;
+      sub->topics = 0;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // Разбор команды клиента (выполняется в задаче AsyncTCP)
+  void handleMessage(AsyncWebSocketClient* client, const uint8_t* data, size_t len) {
+    StaticJsonDocument<256> doc;
+    if (deserializeJson(doc, data, len)) {
+      client->text("{\"t\":\"error\",\"error\":\"Invalid JSON\"}");
+      return;
+    }
+
+    uint32_t add = 0;
+    uint32_t remove = 0;
+    for (JsonVariant v : doc["sub"].as<JsonArray>()) {
+      int topic = telemetryTopicFromName(v.as<const char*>());
+      if (topic >= 0) add |= 1UL << topic;
+    }
+    for (JsonVariant v : doc["unsub"].as<JsonArray>()) {
+      int topic = telemetryTopicFromName(v.as<const char*>());
+      if (topic >= 0) remove |= 1UL << topic;
+    }
+    if (doc.containsKey("interval")) {
+      setInterval(doc["interval"].as<int>());
+    }
+
+    portENTER_CRITICAL(&mux);
+    Subscriber* sub = findLocked(client->id());
+    if (sub) {
+      sub->topics = (sub->topics | add) & ~remove;
+      resyncTopics |= add;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  void onEvent(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type,
+               void* arg, uint8_t* data, size_t len) {
+    switch (type) {
+      case WS_EVT_CONNECT:
+        addClient(client->id());
+        break;
+      case WS_EVT_DISCONNECT:
+        removeClient(client->id());
+        break;
+      case WS_EVT_DATA: {
+        // Команды короткие - принимаем только цельные текстовые кадры
+        AwsFrameInfo* info = (AwsFrameInfo*)arg;
+        if (info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT) {
+          handleMessage(client, data, len);
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+public:
+  TelemetryHub(const char* url)
+    : ws(url), resyncTopics(0), intervalMs(TELEMETRY_DEFAULT_INTERVAL),
+      lastPublish(0), messagesSent(0) {
+    memset(subscribers, 0, sizeof(subscribers));
+    portMUX_TYPE init = portMUX_INITIALIZER_UNLOCKED;
+    mux = init;
+  }
+
+  void begin(AsyncWebServer& server) {
+    ws.onEvent([this](AsyncWebSocket* s, AsyncWebSocketClient* c, AwsEventType type,
+                      void* arg, uint8_t* data, size_t len) {
+      onEvent(s, c, type, arg, data, len);
+    });
+    server.addHandler(&ws);
+  }
+
+  // Пора ли собирать изменения (вызывать из сетевой задачи)
+  bool due() {
+    unsigned long now = millis();
+    if (now - lastPublish < intervalMs) {
+      return false;
+    }
+    lastPublish = now;
+    ws.cleanupClients();
+    return topicMask() != 0;
+  }
+
+  // Объединение подписок всех клиентов
+  uint32_t topicMask() {
+    uint32_t mask = 0;
+    portENTER_CRITICAL(&mux);
+    for (const auto& sub : subscribers) {
+      if (sub.clientId) mask |= sub.topics;
+    }
+    portEXIT_CRITICAL(&mux);
+    return mask;
+  }
+
+  bool wants(TelemetryTopic topic) {
+    return (topicMask() >> topic) & 1;
+  }
+
+  // Нужна ли полная рассылка темы (сбрасывает флаг)
+  bool consumeResync(TelemetryTopic topic) {
+    portENTER_CRITICAL(&mux);
+    bool resync = (resyncTopics >> topic) & 1;
+    resyncTopics &= ~(1UL << topic);
+    portEXIT_CRITICAL(&mux);
+    return resync;
+  }
+
+  // Отправка готового сообщения подписчикам темы.
+  // Клиент с переполненной очередью пропускает сообщение и получит полное
+  // состояние темы при следующей рассылке
+  void publish(TelemetryTopic topic, const char* json, size_t len) {
+    uint32_t ids[TELEMETRY_MAX_SUBSCRIBERS];
+    size_t count = 0;
+    portENTER_CRITICAL(&mux);
+    for (const auto& sub : subscribers) {
+      if (sub.clientId && ((sub.topics >> topic) & 1)) {
+        ids[count++] = sub.clientId;
+      }
+    }
+    portEXIT_CRITICAL(&mux);
+
+    if (count == 0) {
+      return;
+    }
+
+    AsyncWebSocketSharedBuffer buffer = std::make_shared<std::vector<uint8_t>>(json, json + len);
+    for (size_t i = 0; i < count; i++) {
+      AsyncWebSocketClient* client = ws.client(ids[i]);
+      if (!client) {
+        continue;
+      }
+      if (client->queueIsFull()) {
+        portENTER_CRITICAL(&mux);
+        resyncTopics |= 1UL << topic;
+        portEXIT_CRITICAL(&mux);
+        continue;
+      }
+      client->text(buffer);
+      messagesSent++;
+    }
+  }
+
+  // Сериализация документа во временный буфер и отправка.
+  // Буфер переиспользуется между вызовами (только из сетевой задачи)
+  void publish(TelemetryTopic topic, const JsonDocument& doc) {
+    static char buffer[2048];
+    size_t len = serializeJson(doc, buffer, sizeof(buffer));
+    if (len > 0 && len < sizeof(buffer) - 1) {
+      publish(topic, buffer, len);
+    }
+  }
+
+  void setInterval(int ms) {
+    intervalMs = constrain(ms, TELEMETRY_MIN_INTERVAL, TELEMETRY_MAX_INTERVAL);
+  }
+
+  uint16_t getInterval() const { return intervalMs; }
+  size_t getClientCount() const { return ws.count(); }
+  uint32_t getMessagesSent() const { return messagesSent; }
+};
+
+#endif // TELEMETRY_HUB_H
@@ -0,0 +1,108 @@
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <Arduino.h>
+#include <vector>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+
+#define WEB_ASSETS_MANIFEST "/web_manifest.json"
+
+// Ресурс веб-интерфейса, собранный tools/build_web.py
+struct WebAsset {
+  String uri;
+  String file;       // Сжатый gzip файл в LittleFS
+  String type;
+  String etag;       // В кавычках, как в заголовке
+  bool immutable;    // Ссылка содержит версию - можно кешировать надолго
+};
+
+// Раздача предварительно сжатого веб-интерфейса.
+//
+// Манифест читается один раз при запуске, поэтому проверка If-None-Match
+// и ответ 304 обходятся без обращения к флеш-памяти.
+class WebAssets {
+private:
+  std::vector<WebAsset> assets;
+
+  static bool etagMatches(AsyncWebServerRequest* request, const String& etag) {
+    if (!request->hasHeader("If-None-Match")) {
+      return false;
+    }
+    String header = request->getHeader("If-None-Match")->value();
+    return header == "*" || header.indexOf(etag) >= 0;
+  }
+
+  static void addCacheHeaders(AsyncWebServerResponse* response, const WebAsset& asset) {
+    response->addHeader("ETag", asset.etag);
+    response->addHeader("Cache-Control", asset.immutable ?
+                        "public, max-age=31536000, immutable" : "no-cache");
+  }
+
+public:
+  // Загрузка манифеста. false - интерфейс не собран или файл поврежден
+  bool load() {
+    assets.clear();
+
+    File file = LittleFS.open(WEB_ASSETS_MANIFEST, "r");
+    if (!file) {
+      return false;
+    }
+
+    DynamicJsonDocument doc(2048);
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+    if (error) {
+      Serial.println("Failed to parse web manifest");
+      return false;
+    }
+
+    for (JsonObject item : doc["assets"].as<JsonArray>()) {
+      WebAsset asset;
+      asset.uri = item["uri"].as<String>();
+      asset.file = item["file"].as<String>();
+      asset.type = item["type"].as<String>();
+      asset.etag = "\"" + item["etag"].as<String>() + "\"";
+      asset.immutable = item["immutable"] | false;
+      if (LittleFS.exists(asset.file)) {
+        assets.push_back(asset);
+      }
+    }
+    return !assets.empty();
+  }
+
+  // Регистрация маршрутов для всех ресурсов манифеста
+  void registerRoutes(AsyncWebServer& server) {
+    for (size_t i = 0; i < assets.size(); i++) {
+      server.on(assets[i].uri.c_str(), HTTP_GET, [this, i](AsyncWebServerRequest* request) {
+        send(request, assets[i]);
+      });
+    }
+  }
+
+  void send(AsyncWebServerRequest* request, const WebAsset& asset) {
+    AsyncWebServerResponse* response;
+    if (etagMatches(request, asset.etag)) {
+      response = request->beginResponse(304);
+    } else {
+      response = request->beginResponse(LittleFS, asset.file, asset.type);
+      response->addHeader("Content-Encoding", "gzip");
+    }
+    addCacheHeaders(response, asset);
+    request->send(response);
+  }
+
+  bool hasRoot() const {
+    for (const auto& asset : assets) {
+      if (asset.uri == "/") return true;
+    }
+    return false;
+  }
+
+  size_t size() const {
+    return assets.size();
+  }
+};
+
+#endif // WEB_ASSETS_H
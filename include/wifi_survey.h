@@ -0,0 +1,486 @@
+#ifndef WIFI_SURVEY_H
+#define WIFI_SURVEY_H
+
+#include <Arduino.h>
+#include <vector>
+#include <atomic>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "common_structures.h"
+
+#define SURVEY_RING_SIZE 64           // Наблюдений между разборами (степень двойки)
+#define SURVEY_MAX_BSS 160            // Предел таблицы; при переполнении вытесняется самая давняя
+#define SURVEY_MAX_CLIENTS 8          // Запоминаемых MAC клиентов на BSS
+#define SURVEY_STALE_MS 300000        // BSS без кадров дольше - удаляется
+#define SURVEY_MAX_CHANNEL 14
+#define SURVEY_DEFAULT_DWELL_MS 150
+#define SURVEY_DEFAULT_HOME_MS 200
+
+// Защита сети, битовая маска: точка может объявлять несколько вариантов
+enum SurveySecurity : uint8_t {
+  SURVEY_SEC_OPEN = 0,
+  SURVEY_SEC_WEP  = 1 << 0,
+  SURVEY_SEC_WPA  = 1 << 1,
+  SURVEY_SEC_WPA2 = 1 << 2,
+  SURVEY_SEC_WPA3 = 1 << 3
+};
+
+enum SurveyObservationKind : uint8_t {
+  SURVEY_OBS_BEACON,
+  SURVEY_OBS_PROBE_RESP,
+  SURVEY_OBS_DATA,
+  SURVEY_OBS_SCAN      // Результат активного сканирования
+};
+
+// Наблюдение из колбэка promiscuous-режима. Фиксированного размера,
+// чтобы колбэк в задаче WiFi-драйвера не выделял память
+struct SurveyObservation {
+  uint8_t bssid[6];
+  uint8_t station[6];        // Для кадров данных - MAC клиента
+  char ssid[33];
+  uint8_t kind;              // SurveyObservationKind
+  uint8_t channel;           // Из DS Parameter Set, иначе канал приема
+  int8_t rssi;
+  uint8_t security;          // SurveySecurity
+  uint8_t utilization;       // BSS Load: занятость канала 0..255, 255 - нет данных
+  uint16_t beaconInterval;   // TU (1024 мкс)
+  uint16_t stationCount;     // BSS Load, 0xFFFF - нет данных
+};
+
+// Точка доступа в таблице обзора
+struct SurveyBSS {
+  uint8_t bssid[6];
+  char ssid[33];
+  uint8_t channel;
+  uint8_t security;
+  uint16_t beaconInterval;
+  int8_t rssiMin;
+  int8_t rssiMax;
+  int8_t rssiLast;
+  int32_t rssiSum;
+  uint32_t samples;
+  uint32_t beacons;
+  uint32_t probeResponses;
+  uint32_t dataFrames;
+  uint32_t firstSeen;        // millis()
+  uint32_t lastSeen;
+  uint8_t utilization;       // Последнее значение BSS Load
+  uint16_t stationCount;     // Последнее значение BSS Load
+  uint8_t clientCount;
+  uint8_t clients[SURVEY_MAX_CLIENTS][6];
+
+  int8_t rssiAvg() const { return samples > 0 ? rssiSum / (int32_t)samples : rssiLast; }
+};
+
+// Статистика канала за время, проведенное на нем
+struct SurveyChannelStats {
+  uint32_t frames;
+  uint32_t bytes;
+  uint32_t dwellMs;
+};
+
+inline const char* surveySecurityName(uint8_t security) {
+  if (security & SURVEY_SEC_WPA3) return (security & SURVEY_SEC_WPA2) ? "WPA2/WPA3" : "WPA3";
+  if (security & SURVEY_SEC_WPA2) return (security & SURVEY_SEC_WPA) ? "WPA/WPA2" : "WPA2";
+  if (security & SURVEY_SEC_WPA) return "WPA";
+  if (security & SURVEY_SEC_WEP) return "WEP";
+  return "Open";
+}
+
+// Непрерывный пассивный обзор WiFi.
+//
+// В promiscuous-режиме собирает beacon и probe response (SSID, канал,
+// защита, интервал маяков, BSS Load) и кадры данных (клиенты BSS),
+// переключая каналы по расписанию. Колбэк только кладет наблюдения в
+// кольцо; таблица BSS обновляется в задаче интерфейса инкрементально, записи живут,
+// пока точка слышна, и не сбрасываются при каждом проходе.
+//
+// Если устройство подключено к сети или раздает AP, после каждого чужого
+// канала оно возвращается на свой на homeMs, чтобы не терять связь.
+class WiFiSurvey {
+private:
+  static WiFiSurvey* instance;
+
+  SurveyObservation ring[SURVEY_RING_SIZE];
+  std::atomic<uint32_t> head;
+  std::atomic<uint32_t> tail;
+  std::atomic<uint32_t> drops;
+
+  // Счетчики каналов ведет колбэк (единственный писатель)
+  volatile uint32_t channelFrames[SURVEY_MAX_CHANNEL + 1];
+  volatile uint32_t channelBytes[SURVEY_MAX_CHANNEL + 1];
+  uint32_t channelDwell[SURVEY_MAX_CHANNEL + 1];
+
+  std::vector<SurveyBSS> table;      // Пишет задача интерфейса, читает веб-сервер - под lock
+  SemaphoreHandle_t lock;
+  std::vector<uint8_t> schedule;
+  size_t scheduleIndex;
+  uint32_t dwellMs;
+  uint32_t homeMs;
+  uint8_t homeChannel;       // 0 - возвращаться не нужно
+  uint8_t currentChannel;
+  bool onHome;
+  uint32_t channelSince;
+  uint32_t hops;
+  uint32_t startedAt;
+  volatile bool running;
+
+  static void parseIEs(const uint8_t* ie, int len, SurveyObservation& obs) {
+    while (len >= 2) {
+      uint8_t id = ie[0];
+      uint8_t size = ie[1];
+      if (size + 2 > len) break;
+      const uint8_t* body = ie + 2;
+
+      switch (id) {
+        case 0:  // SSID
+          if (size <= 32) {
+            memcpy(obs.ssid, body, size);
+            obs.ssid[size] = '\0';
+          }
+          break;
+        case 3:  // DS Parameter Set
+          if (size >= 1) obs.channel = body[0];
+          break;
+        case 11: // BSS Load
+          if (size >= 5) {
+            obs.stationCount = body[0] | (body[1] << 8);
+            obs.utilization = body[2];
+          }
+          break;
+        case 48: // RSN: версия, групповой шифр, парные шифры, затем AKM
+          obs.security |= SURVEY_SEC_WPA2;
+          if (size >= 8) {
+            int pairwise = body[6] | (body[7] << 8);
+            int akmAt = 8 + pairwise * 4;
+            if (akmAt + 2 <= size) {
+              int akms = body[akmAt] | (body[akmAt + 1] << 8);
+              for (int i = 0; i < akms && akmAt + 2 + i * 4 + 4 <= size; i++) {
+                uint8_t type = body[akmAt + 2 + i * 4 + 3];
+                if (type == 8 || type == 24) {  // SAE
+                  obs.security |= SURVEY_SEC_WPA3;
+                }
+              }
+            }
+          }
+          break;
+        case 221: // Vendor: WPA1 - OUI 00:50:F2, тип 1
+          if (size >= 4 && body[0] == 0x00 && body[1] == 0x50 && body[2] == 0xF2 && body[3] == 1) {
+            obs.security |= SURVEY_SEC_WPA;
+          }
+          break;
+      }
+      ie += size + 2;
+      len -= size + 2;
+    }
+  }
+
+  void push(const SurveyObservation& obs) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= SURVEY_RING_SIZE) {
+      drops.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    ring[h & (SURVEY_RING_SIZE - 1)] = obs;
+    head.store(h + 1, std::memory_order_release);
+  }
+
+  static void onFrame(void* buf, wifi_promiscuous_pkt_type_t type) {
+    WiFiSurvey* self = instance;
+    if (!self || !self->running) return;
+
+    const wifi_promiscuous_pkt_t* pkt = (const wifi_promiscuous_pkt_t*)buf;
+    const wifi_pkt_rx_ctrl_t& ctrl = pkt->rx_ctrl;
+    int len = (int)ctrl.sig_len - 4;  // Без FCS
+    if (len < 24) return;
+
+    uint8_t rxChannel = ctrl.channel;
+    if (rxChannel >= 1 && rxChannel <= SURVEY_MAX_CHANNEL) {
+      self->channelFrames[rxChannel] = self->channelFrames[rxChannel] + 1;
+      self->channelBytes[rxChannel] = self->channelBytes[rxChannel] + ctrl.sig_len;
+    }
+
+    const uint8_t* frame = pkt->payload;
+    uint8_t fc = frame[0];
+    uint8_t flags = frame[1];
+
+    SurveyObservation obs;
+    memset(&obs, 0, sizeof(obs));
+    obs.channel = rxChannel;
+    obs.rssi = ctrl.rssi;
+    obs.utilization = 255;
+    obs.stationCount = 0xFFFF;
+
+    if (type == WIFI_PKT_MGMT && (fc == 0x80 || fc == 0x50)) {
+      // Заголовок 24 байта, затем timestamp(8), интервал(2), capability(2)
+      if (len < 36) return;
+      obs.kind = fc == 0x80 ? SURVEY_OBS_BEACON : SURVEY_OBS_PROBE_RESP;
+      memcpy(obs.bssid, frame + 16, 6);
+      obs.beaconInterval = frame[32] | (frame[33] << 8);
+      uint16_t capability = frame[34] | (frame[35] << 8);
+      parseIEs(frame + 36, len - 36, obs);
+      if (obs.security == SURVEY_SEC_OPEN && (capability & 0x0010)) {
+        obs.security = SURVEY_SEC_WEP;
+      }
+    } else if (type == WIFI_PKT_DATA) {
+      bool toDS = flags & 0x01;
+      bool fromDS = flags & 0x02;
+      if (toDS == fromDS) return;  // WDS и IBSS не учитываем
+      const uint8_t* bssid = toDS ? frame + 4 : frame + 10;
+      const uint8_t* station = toDS ? frame + 10 : frame + 4;
+      if (station[0] & 0x01) return;  // Групповой адрес - не клиент
+      obs.kind = SURVEY_OBS_DATA;
+      memcpy(obs.bssid, bssid, 6);
+      memcpy(obs.station, station, 6);
+    } else {
+      return;
+    }
+    self->push(obs);
+  }
+
+  SurveyBSS* findOrAdd(const uint8_t* bssid, uint32_t now) {
+    for (auto& bss : table) {
+      if (memcmp(bss.bssid, bssid, 6) == 0) {
+        return &bss;
+      }
+    }
+
+    SurveyBSS* slot;
+    if (table.size() < SURVEY_MAX_BSS) {
+      table.emplace_back();
+      slot = &table.back();
+    } else {
+      slot = &table[0];
+      for (auto& bss : table) {
+        if ((int32_t)(bss.lastSeen - slot->lastSeen) < 0) {
+          slot = &bss;
+        }
+      }
+    }
+    memset(slot, 0, sizeof(*slot));
+    memcpy(slot->bssid, bssid, 6);
+    slot->rssiMin = 127;
+    slot->rssiMax = -128;
+    slot->utilization = 255;
+    slot->stationCount = 0xFFFF;
+    slot->firstSeen = now;
+    return slot;
+  }
+
+  void noteClient(SurveyBSS& bss, const uint8_t* station) {
+    for (uint8_t i = 0; i < bss.clientCount; i++) {
+      if (memcmp(bss.clients[i], station, 6) == 0) return;
+    }
+    if (bss.clientCount < SURVEY_MAX_CLIENTS) {
+      memcpy(bss.clients[bss.clientCount++], station, 6);
+    }
+  }
+
+  void apply(const SurveyObservation& obs, uint32_t now) {
+    SurveyBSS* bss = findOrAdd(obs.bssid, now);
+    bss->lastSeen = now;
+
+    if (obs.kind == SURVEY_OBS_DATA) {
+      bss->dataFrames++;
+      noteClient(*bss, obs.station);
+      return;
+    }
+
+    if (obs.ssid[0] != '\0' || bss->ssid[0] == '\0') {
+      memcpy(bss->ssid, obs.ssid, sizeof(bss->ssid));
+    }
+    bss->channel = obs.channel;
+    bss->security = obs.security;
+    if (obs.beaconInterval) bss->beaconInterval = obs.beaconInterval;
+    if (obs.utilization != 255) bss->utilization = obs.utilization;
+    if (obs.stationCount != 0xFFFF) bss->stationCount = obs.stationCount;
+    if (obs.kind == SURVEY_OBS_BEACON) bss->beacons++;
+    if (obs.kind == SURVEY_OBS_PROBE_RESP) bss->probeResponses++;
+
+    bss->rssiLast = obs.rssi;
+    bss->rssiMin = min(bss->rssiMin, obs.rssi);
+    bss->rssiMax = max(bss->rssiMax, obs.rssi);
+    bss->rssiSum += obs.rssi;
+    bss->samples++;
+  }
+
+  void setChannel(uint8_t channel) {
+    uint32_t now = millis();
+    if (currentChannel >= 1 && currentChannel <= SURVEY_MAX_CHANNEL) {
+      channelDwell[currentChannel] += now - channelSince;
+    }
+    channelSince = now;
+    if (channel == currentChannel) return;
+    if (esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE) == ESP_OK) {
+      currentChannel = channel;
+      hops++;
+    }
+  }
+
+public:
+  WiFiSurvey()
+    : head(0), tail(0), drops(0), lock(nullptr), scheduleIndex(0),
+      dwellMs(SURVEY_DEFAULT_DWELL_MS), homeMs(SURVEY_DEFAULT_HOME_MS), homeChannel(0),
+      currentChannel(0), onHome(false), channelSince(0), hops(0), startedAt(0), running(false) {
+    instance = this;
+    memset((void*)channelFrames, 0, sizeof(channelFrames));
+    memset((void*)channelBytes, 0, sizeof(channelBytes));
+    memset(channelDwell, 0, sizeof(channelDwell));
+  }
+
+  void begin() {
+    lock = xSemaphoreCreateMutex();
+  }
+
+  // Запуск. channels - расписание обхода, home - свой канал (0 - нет)
+  bool start(const std::vector<uint8_t>& channels, uint32_t dwell, uint32_t home, uint8_t homeCh) {
+    if (running || channels.empty()) {
+      return false;
+    }
+    schedule = channels;
+    scheduleIndex = 0;
+    dwellMs = dwell;
+    homeMs = home;
+    homeChannel = homeCh;
+    onHome = false;
+    hops = 0;
+    startedAt = millis();
+    channelSince = startedAt;
+    currentChannel = homeCh;
+
+    wifi_promiscuous_filter_t filter = {WIFI_PROMIS_FILTER_MASK_MGMT | WIFI_PROMIS_FILTER_MASK_DATA};
+    esp_wifi_set_promiscuous_filter(&filter);
+    esp_wifi_set_promiscuous_rx_cb(&WiFiSurvey::onFrame);
+    running = true;
+    esp_wifi_set_promiscuous(true);
+    return true;
+  }
+
+  void stop() {
+    if (!running) return;
+    running = false;
+    esp_wifi_set_promiscuous(false);
+    wifi_promiscuous_filter_t filter = {WIFI_PROMIS_FILTER_MASK_ALL};
+    esp_wifi_set_promiscuous_filter(&filter);
+    if (homeChannel) {
+      setChannel(homeChannel);
+    }
+    drain();
+  }
+
+  // Переход на следующий канал. Возвращает время до следующего вызова, мс
+  uint32_t hop() {
+    if (!running) return 0;
+    if (homeChannel && !onHome) {
+      onHome = true;
+      setChannel(homeChannel);
+      return homeMs;
+    }
+    onHome = false;
+    uint8_t channel = schedule[scheduleIndex];
+    scheduleIndex = (scheduleIndex + 1) % schedule.size();
+    setChannel(channel);
+    return dwellMs;
+  }
+
+  // Перенос наблюдений из кольца в таблицу (из задачи интерфейса)
+  void drain() {
+    uint32_t now = millis();
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t h = head.load(std::memory_order_acquire);
+    xSemaphoreTake(lock, portMAX_DELAY);
+    while (t != h) {
+      apply(ring[t & (SURVEY_RING_SIZE - 1)], now);
+      t++;
+      tail.store(t, std::memory_order_release);
+    }
+
+    for (size_t i = 0; i < table.size();) {
+      if (now - table[i].lastSeen > SURVEY_STALE_MS) {
+        table[i] = table.back();
+        table.pop_back();
+      } else {
+        i++;
+      }
+    }
+    xSemaphoreGive(lock);
+  }
+
+  // Результат активного сканирования (WiFi.scanNetworks) в ту же таблицу
+  void addScanResult(const uint8_t* bssid, const String& ssid, uint8_t channel,
+                     int8_t rssi, wifi_auth_mode_t auth) {
+    SurveyObservation obs;
+    memset(&obs, 0, sizeof(obs));
+    memcpy(obs.bssid, bssid, 6);
+    strlcpy(obs.ssid, ssid.c_str(), sizeof(obs.ssid));
+    obs.kind = SURVEY_OBS_SCAN;
+    obs.channel = channel;
+    obs.rssi = rssi;
+    obs.utilization = 255;
+    obs.stationCount = 0xFFFF;
+    switch (auth) {
+      case WIFI_AUTH_OPEN: obs.security = SURVEY_SEC_OPEN; break;
+      case WIFI_AUTH_WEP: obs.security = SURVEY_SEC_WEP; break;
+      case WIFI_AUTH_WPA_PSK: obs.security = SURVEY_SEC_WPA; break;
+      case WIFI_AUTH_WPA_WPA2_PSK: obs.security = SURVEY_SEC_WPA | SURVEY_SEC_WPA2; break;
+      case WIFI_AUTH_WPA3_PSK: obs.security = SURVEY_SEC_WPA3; break;
+      case WIFI_AUTH_WPA2_WPA3_PSK: obs.security = SURVEY_SEC_WPA2 | SURVEY_SEC_WPA3; break;
+      default: obs.security = SURVEY_SEC_WPA2; break;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    apply(obs, millis());
+    xSemaphoreGive(lock);
+  }
+
+  void clear() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    table.clear();
+    xSemaphoreGive(lock);
+    memset((void*)channelFrames, 0, sizeof(channelFrames));
+    memset((void*)channelBytes, 0, sizeof(channelBytes));
+    memset(channelDwell, 0, sizeof(channelDwell));
+  }
+
+  SurveyChannelStats channelStats(uint8_t channel) const {
+    SurveyChannelStats stats = {0, 0, 0};
+    if (channel >= 1 && channel <= SURVEY_MAX_CHANNEL) {
+      stats.frames = channelFrames[channel];
+      stats.bytes = channelBytes[channel];
+      stats.dwellMs = channelDwell[channel];
+      if (running && channel == currentChannel) {
+        stats.dwellMs += millis() - channelSince;
+      }
+    }
+    return stats;
+  }
+
+  bool isRunning() const { return running; }
+  // Обход таблицы под блокировкой (для веб-сервера)
+  template <typename Fn>
+  void forEach(Fn fn) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (const auto& bss : table) {
+      fn(bss);
+    }
+    xSemaphoreGive(lock);
+  }
+
+  size_t size() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    size_t count = table.size();
+    xSemaphoreGive(lock);
+    return count;
+  }
+  uint8_t getChannel() const { return currentChannel; }
+  uint8_t getHomeChannel() const { return homeChannel; }
+  uint32_t getHops() const { return hops; }
+  uint32_t getDrops() const { return drops.load(std::memory_order_relaxed); }
+  uint32_t getDwellMs() const { return dwellMs; }
+  uint32_t getStartedAt() const { return startedAt; }
+  const std::vector<uint8_t>& getSchedule() const { return schedule; }
+};
+
+WiFiSurvey* WiFiSurvey::instance = nullptr;
+
+#endif // WIFI_SURVEY_H
@@ -10,6 +10,7 @@
 #include <ArduinoJson.h>
 #include <LittleFS.h>
 #include <vector>
+#include <atomic>
 #include <esp_wifi.h>
 #include <tcpip_adapter.h>
 #include <esp_system.h>
@@ -27,8 +28,34 @@ extern "C" {
 
 #include "common_structures.h"
 #include "honeypot.h"
+#include "honeypot_services.h"
 #include "network_tools.h"
 #include "device_manager.h"
+#include "packet_ring.h"
+#include "pcap_capture.h"
+#include "sniff_filter.h"
+#include "job_scheduler.h"
+#include "ap_client_table.h"
+#include "blocklist.h"
+#include "ap_netif_hook.h"
+#include "web_assets.h"
+#include "telemetry_hub.h"
+#include "json_response.h"
+#include "lcd_renderer.h"
+#include "task_scheduler.h"
+#include "pin_edge_capture.h"
+#include "kvm_sequencer.h"
+#include "logic_analyzer.h"
+#include "ir_controller.h"
+#include "config_store.h"
+#include "boot_profile.h"
+#include "wifi_survey.h"
+#include "perf_monitor.h"
+#include "scan_results_cache.h"
+#include "power_manager.h"
+#ifdef BENCH_BUILD
+#include "bench_harness.h"
+#endif
 
 // Определение разделов меню
 enum MenuSection {
@@ -63,16 +90,6 @@ const char* apUserMenuOptions[] = {
 };
 #define AP_USER_MENU_OPTIONS_COUNT (sizeof(apUserMenuOptions) / sizeof(char*))
 
-// Структура для хранения информации о клиенте AP
-struct APClient {
-  IPAddress ip;
-  uint8_t mac[6];
-  bool blocked;
-  unsigned int totalBytes;
-  String lastPacket;
-  unsigned long lastSeen;
-};
-
 // Структура для пунктов меню пользователя AP
 struct APUserMenuItem {
   const char* title;
@@ -95,49 +112,159 @@ struct MenuItem {
   MenuSection section;
 };
 
-#define MAX_PACKET_BUFFER 20  // Максимальное количество пакетов в буфере
+#define MAX_PACKET_BUFFER 32  // Максимальное количество пакетов в буфере (степень двойки)
 #define ESPIF_STA 0
 #define ESPIF_AP  1
 
-// Структура для хранения перехваченного пакета
-struct SniffedPacket {
-  String sourceMAC;
-  String destMAC;
-  String type;
-  int size;
-  int8_t rssi;
-  unsigned long timestamp;
+// Планировщики (нужны модулям ниже) и захват фронтов.
+// Работа разнесена по ядрам: на ядре 0 вместе со стеком WiFi/lwIP и
+// AsyncTCP - сетевые задачи (сбор сканирования, телеметрия, сверка
+// клиентов AP, запись настроек и журнала), на ядре 1 - кнопки, экран,
+// KVM, ИК и датчики. Поток веб-запросов не отнимает время у опроса кнопок
+// и импульсов на пинах, а долгая перерисовка экрана не держит сеть
+TaskScheduler scheduler;         // Интерфейс и периферия
+TaskScheduler netScheduler;      // Сеть
+PinEdgeCapture pinEdges;
+#define UI_TASK_CORE APP_CPU_NUM
+#define UI_TASK_PRIORITY 3       // Выше loopTask, ниже логического анализатора
+#define NET_TASK_CORE PRO_CPU_NUM
+#define NET_TASK_PRIORITY 2      // Ниже задач WiFi, lwIP и AsyncTCP
+#define SCHEDULER_TASK_STACK 8192
+
+// Хранилище настроек и его записи: ключ и версия схемы
+ConfigStore configStore;
+#define CFG_KEY_NETWORK "ap"
+#define CFG_NETWORK_VERSION 2
+#define CFG_KEY_DEVICE "device"
+#define CFG_DEVICE_VERSION 1
+#define CFG_KEY_NETWORKS "networks"
+#define CFG_NETWORKS_VERSION 1
+#define CFG_KEY_KVM "kvm"
+#define CFG_KVM_VERSION 1
+#define CFG_KEY_WIFI_CACHE "wifi"
+#define CFG_WIFI_CACHE_VERSION 1
+#define CFG_KEY_HONEYPOT "honeypot"
+#define CFG_HONEYPOT_VERSION 1
+#define CFG_KEY_POWER "power"
+#define CFG_POWER_VERSION 1
+
+// Отметки фаз загрузки
+BootProfile bootProfile;
+
+// Показатели производительности для /api/perf
+PerfMonitor perfMonitor;
+
+// Питание: экран, частота CPU, сон. Опрос кнопок и датчиков в простое реже
+PowerManager powerManager;
+#define BUTTON_POLL_MS 20
+#define BUTTON_POLL_IDLE_MS 100
+#define SENSOR_INTERVAL_MS 1000
+#define SENSOR_INTERVAL_IDLE_MS 10000
+uint16_t buttonTask = 0;
+
+// Предопределенные пины для M5StickC Plus2
+const struct {
+  int pin;
+  const char* name;
+  const char* description;
+} AVAILABLE_PINS[] = {
+  {0,  "GPIO0",  "GROVE"},
+  {25, "GPIO25", "GROVE"},
+  {26, "GPIO26", "GROVE"},
+  {32, "GPIO32", "GROVE"},
+  {33, "GPIO33", "GROVE"},
+  {36, "GPIO36", "GROVE (Input only)"},
 };
+#define AVAILABLE_PINS_COUNT (sizeof(AVAILABLE_PINS) / sizeof(AVAILABLE_PINS[0]))
+
+// Пин из списка выше: остальные GPIO заняты флешем или периферией платы
+bool isAvailablePin(int gpio) {
+  for (size_t i = 0; i < AVAILABLE_PINS_COUNT; i++) {
+    if (AVAILABLE_PINS[i].pin == gpio) {
+      return true;
+    }
+  }
+  return false;
+}
 
-// Класс для управления KVM пинами
+// Класс для управления KVM пинами.
+// Пины меняют задача интерфейса и веб-сервер, читает и сетевая задача
+// (телеметрия), поэтому список - под рекурсивной блокировкой, а наружу
+// отдается копией
 class KVMModule {
 private:
   std::vector<EnhancedPinConfig> pins;
+  std::vector<KVMSequence> sequences;
+  KVMSequencer sequencer;
   ConnectionCheckInterval checkInterval;
   bool useDHCP;
   unsigned long lastCheckTime;
+  SemaphoreHandle_t pinsLock;
+  
+  void lockPins() const { xSemaphoreTakeRecursive(pinsLock, portMAX_DELAY); }
+  void unlockPins() const { xSemaphoreGiveRecursive(pinsLock); }
+  
+  // Шаг сценария переключает только настроенный пин KVM
+  bool stepAllowed(const KVMSequenceStep& step) const {
+    return step.type == KVM_STEP_WAIT || findPin(step.gpio) >= 0;
+  }
+  
+  // Состояние пинов после сценария: сценарий переключает GPIO напрямую
+  void syncPinStates() {
+    lockPins();
+    bool changed = false;
+    for (auto& pin : pins) {
+      if (pin.monitorMode != PIN_MONITOR_OFF) {
+        continue; // Обновятся по фронтам
+      }
+      bool level = digitalRead(pin.pin) == HIGH;
+      if (level != pin.state) {
+        pin.state = level;
+        pin.lastStateChange = millis();
+        changed = true;
+      }
+    }
+    if (changed) {
+      saveConfig();
+    }
+    unlockPins();
+  }
 
 public:
-  KVMModule() : checkInterval(CHECK_OFF), useDHCP(true), lastCheckTime(0) {}
+  KVMModule() : checkInterval(CHECK_OFF), useDHCP(true), lastCheckTime(0) {
+    pinsLock = xSemaphoreCreateRecursiveMutex();
+  }
   
   // Инициализация
   void begin() {
+    sequencer.begin();
+    
     // Загружаем конфигурацию
     loadConfig();
-    
-    // Настраиваем пины
+    applyPins();
+  }
+  
+  // Настройка пинов по текущей конфигурации
+  void applyPins() {
+    lockPins();
     for (auto& pin : pins) {
       pinMode(pin.pin, OUTPUT);
       // При инициализации устанавливаем пины в сохраненное состояние
       digitalWrite(pin.pin, pin.state ? HIGH : LOW);
+      if (pin.monitorMode != PIN_MONITOR_OFF) {
+        pinEdges.attach(pin.pin);
+      }
     }
+    unlockPins();
   }
   
   // Добавление нового пина
   bool addPin(int pin, const String& name) {
     // Проверяем, не существует ли уже такой пин
+    lockPins();
     for (const auto& p : pins) {
       if (p.pin == pin) {
+        unlockPins();
         return false; // Пин уже добавлен
       }
     }
@@ -158,12 +285,14 @@ public:
     
     // Сохраняем конфигурацию
     saveConfig();
+    unlockPins();
     
     return true;
   }
   
   // Установка состояния пина
   void setPin(int index, bool state) {
+    lockPins();
     if (index >= 0 && index < pins.size()) {
       pins[index].state = state;
       // Физически пин всегда работает нормально: HIGH = включено, LOW = выключено
@@ -171,36 +300,148 @@ public:
       pins[index].lastStateChange = millis();
       saveConfig();
     }
+    unlockPins();
   }
   
   // Переключение состояния пина
   void togglePin(int index) {
+    lockPins();
     if (index >= 0 && index < pins.size()) {
       pins[index].state = !pins[index].state;
       digitalWrite(pins[index].pin, pins[index].state ? HIGH : LOW);
       pins[index].lastStateChange = millis();
       saveConfig();
     }
+    unlockPins();
   }
   
-  // Отправка импульса на пин
+  // Отправка импульса на пин.
+  // Не блокирует: импульс формирует движок сценариев, а если он занят -
+  // состояние возвращается задачей планировщика
   void pulsePin(int index, int duration) {
+    lockPins();
     if (index >= 0 && index < pins.size()) {
+      KVMSequence pulse;
+      pulse.name = "pulse";
+      pulse.steps.push_back({KVM_STEP_HOLD, (int8_t)pins[index].pin, KVM_LEVEL_INVERT,
+                             (uint32_t)duration * 1000});
+      if (runSequence(pulse)) {
+        unlockPins();
+        return;
+      }
+      
+      int gpio = pins[index].pin;
       bool originalState = pins[index].state;
       // Инвертируем состояние
       setPin(index, !originalState);
-      delay(duration);
-      // Возвращаем обратно
-      setPin(index, originalState);
+      // Возвращаем обратно. Пин ищем заново: за время импульса список мог измениться
+      scheduler.after(duration, [this, gpio, originalState]() {
+        int current = findPin(gpio);
+        if (current >= 0) {
+          setPin(current, originalState);
+        }
+      });
+    }
+    unlockPins();
+  }
+  
+  // Запуск сценария. false - уже выполняется другой
+  bool runSequence(const KVMSequence& sequence) {
+    lockPins();
+    auto program = KVMSequencer::compile(sequence.steps, [this](int gpio) {
+      int index = findPin(gpio);
+      return index >= 0 && pins[index].state;
+    });
+    unlockPins();
+    return sequencer.start(sequence.name, program, [this]() {
+      // Колбэк приходит из задачи esp_timer
+      scheduler.post([this]() { syncPinStates(); });
+    });
+  }
+  
+  bool stopSequence() {
+    return sequencer.stop();
+  }
+  
+  const KVMSequencer& getSequencer() const {
+    return sequencer;
+  }
+  
+  const std::vector<KVMSequence>& getSequences() const {
+    return sequences;
+  }
+  
+  const KVMSequence* findSequence(const String& name) const {
+    for (const auto& sequence : sequences) {
+      if (sequence.name == name) {
+        return &sequence;
+      }
+    }
+    return nullptr;
+  }
+  
+  // Сохранение сценария (с тем же именем - замена)
+  bool saveSequence(const KVMSequence& sequence) {
+    for (auto& existing : sequences) {
+      if (existing.name == sequence.name) {
+        existing = sequence;
+        saveConfig();
+        return true;
+      }
+    }
+    if (sequences.size() >= KVM_MAX_SEQUENCES) {
+      return false;
+    }
+    sequences.push_back(sequence);
+    saveConfig();
+    return true;
+  }
+  
+  bool deleteSequence(const String& name) {
+    for (size_t i = 0; i < sequences.size(); i++) {
+      if (sequences[i].name == name) {
+        sequences.erase(sequences.begin() + i);
+        saveConfig();
+        return true;
+      }
     }
+    return false;
+  }
+  
+  // Индекс пина по номеру GPIO, -1 - не найден
+  int findPin(int gpio) const {
+    int found = -1;
+    lockPins();
+    for (size_t i = 0; i < pins.size(); i++) {
+      if (pins[i].pin == gpio) {
+        found = i;
+        break;
+      }
+    }
+    unlockPins();
+    return found;
   }
   
   // Установка режима мониторинга пина
   void setMonitorMode(int index, PinMonitorMode mode) {
+    lockPins();
     if (index >= 0 && index < pins.size()) {
       pins[index].monitorMode = mode;
+      // Фронты отслеживаемых пинов ловятся прерыванием
+      if (mode == PIN_MONITOR_OFF) {
+        pinEdges.detach(pins[index].pin);
+      } else {
+        pinEdges.attach(pins[index].pin);
+      }
       saveConfig();
     }
+    unlockPins();
+  }
+  
+  // Параметры фильтрации фронтов (мкс)
+  void setEdgeFilter(uint32_t debounceUs, uint32_t glitchUs) {
+    pinEdges.setFilter(debounceUs, glitchUs);
+    saveConfig();
   }
   
   // Установка интервала проверки соединения
@@ -225,9 +466,12 @@ public:
     return useDHCP;
   }
   
-  // Получение списка пинов
-  const std::vector<EnhancedPinConfig>& getPins() const {
-    return pins;
+  // Копия списка пинов (индексы в ней согласованы между собой)
+  std::vector<EnhancedPinConfig> getPins() const {
+    lockPins();
+    std::vector<EnhancedPinConfig> copy = pins;
+    unlockPins();
+    return copy;
   }
   
   // Обновление состояния пинов
@@ -235,16 +479,24 @@ public:
     // Текущее время
     unsigned long currentTime = millis();
     
-    // Проверка состояния мониторинга
+    // Проверка состояния мониторинга. Фронты записывает прерывание,
+    // здесь берется уровень после фильтрации и время последнего фронта
+    pinEdges.settle();
+    lockPins();
     for (auto& pin : pins) {
       if (pin.monitorMode != PIN_MONITOR_OFF) {
-        // Считываем текущее состояние пина
-        int currentState = digitalRead(pin.pin);
+        bool currentState = pinEdges.level(pin.pin);
         
         // Если состояние изменилось
         if (currentState != pin.state) {
           pin.state = currentState;
           pin.lastStateChange = currentTime;
+          powerManager.wake(POWER_WAKE_GPIO);
+          PinEdge edge;
+          if (pinEdges.read(pin.pin, pinEdges.head(pin.pin) - 1, &edge, 1) == 1) {
+            // millis() и метка фронта отсчитываются от одного таймера
+            pin.lastStateChange = (edge.timeUs + edge.widthUs) / 1000;
+          }
           
           // Если включен режим со звуком
           if (pin.monitorMode == PIN_MONITOR_BUZZ) {
@@ -258,6 +510,7 @@ public:
         }
       }
     }
+    unlockPins();
     
     // Проверка соединения по таймеру
     if (checkInterval != CHECK_OFF) {
@@ -290,14 +543,11 @@ public:
     }
   }
   
-  // Сохранение конфигурации
-  void saveConfig() {
-    // Создаем JSON документ
-    DynamicJsonDocument doc(4096);
-    
+  // Настройки в формате JSON (экспорт и миграция kvm_config.json)
+  void configToJson(JsonObject doc) {
     // Сохраняем пины
     JsonArray pinsArray = doc.createNestedArray("pins");
-    for (const auto& pin : pins) {
+    for (const auto& pin : getPins()) {
       JsonObject pinObj = pinsArray.createNestedObject();
       pinObj["pin"] = pin.pin;
       pinObj["name"] = pin.name;
@@ -308,125 +558,264 @@ public:
     // Сохраняем настройки
     doc["checkInterval"] = checkInterval;
     doc["useDHCP"] = useDHCP;
+    doc["edgeDebounceUs"] = pinEdges.getDebounceUs();
+    doc["edgeGlitchUs"] = pinEdges.getGlitchUs();
+    
+    // Сохраняем сценарии
+    JsonArray sequencesArray = doc.createNestedArray("sequences");
+    for (const auto& sequence : sequences) {
+      JsonObject seqObj = sequencesArray.createNestedObject();
+      seqObj["name"] = sequence.name;
+      JsonArray stepsArray = seqObj.createNestedArray("steps");
+      for (const auto& step : sequence.steps) {
+        sequenceStepToJson(step, stepsArray.createNestedObject());
+      }
+    }
+  }
+  
+  // Все пины документа есть в AVAILABLE_PINS
+  static bool pinsValid(JsonObjectConst doc) {
+    for (JsonObjectConst pinObj : doc["pins"].as<JsonArrayConst>()) {
+      if (!pinObj["pin"].is<int>() || !isAvailablePin(pinObj["pin"].as<int>())) {
+        return false;
+      }
+    }
+    return true;
+  }
+  
+  // Документ с недопустимыми пинами не применяется
+  bool configFromJson(JsonObjectConst doc) {
+    if (!pinsValid(doc)) {
+      return false;
+    }
+    
+    // Загружаем пины и подменяем текущий список целиком
+    std::vector<EnhancedPinConfig> loadedPins;
+    for (JsonObjectConst pinObj : doc["pins"].as<JsonArrayConst>()) {
+      EnhancedPinConfig pin;
+      pin.pin = pinObj["pin"];
+      pin.name = pinObj["name"].as<String>();
+      pin.state = pinObj["state"];
+      pin.monitorMode = (PinMonitorMode)pinObj["monitorMode"].as<int>();
+      pin.lastStateChange = 0;
+      
+      loadedPins.push_back(pin);
+    }
+    lockPins();
+    pins.swap(loadedPins);
+    unlockPins();
     
-    // Открываем файл для записи
-    File configFile = LittleFS.open("/kvm_config.json", "w");
-    if (!configFile) {
-      Serial.println("Failed to open kvm_config.json for writing");
-      return;
+    // Загружаем настройки
+    if (doc.containsKey("checkInterval")) {
+      checkInterval = (ConnectionCheckInterval)doc["checkInterval"].as<int>();
+    }
+    
+    if (doc.containsKey("useDHCP")) {
+      useDHCP = doc["useDHCP"].as<bool>();
     }
     
-    // Записываем JSON в файл
-    serializeJson(doc, configFile);
-    configFile.close();
+    pinEdges.setFilter(doc["edgeDebounceUs"] | PIN_EDGE_DEFAULT_DEBOUNCE_US,
+                       doc["edgeGlitchUs"] | PIN_EDGE_DEFAULT_GLITCH_US);
+    
+    // Загружаем сценарии
+    sequences.clear();
+    for (JsonObjectConst seqObj : doc["sequences"].as<JsonArrayConst>()) {
+      KVMSequence sequence;
+      sequence.name = seqObj["name"].as<String>();
+      for (JsonObjectConst stepObj : seqObj["steps"].as<JsonArrayConst>()) {
+        KVMSequenceStep step;
+        if (parseSequenceStep(stepObj, [](int) { return -1; }, step) && stepAllowed(step)) {
+          sequence.steps.push_back(step);
+        }
+      }
+      if (sequence.name.length() > 0 && sequences.size() < KVM_MAX_SEQUENCES) {
+        sequences.push_back(sequence);
+      }
+    }
+    return true;
+  }
+  
+  // Сохранение конфигурации. Вызывается на каждое переключение пина,
+  // поэтому только обновляет запись - во флеш ее отложенно пишет хранилище
+  void saveConfig() {
+    ConfigWriter out;
+    lockPins();
+    out.putU8(pins.size());
+    for (const auto& pin : pins) {
+      out.putI32(pin.pin);
+      out.putString(pin.name);
+      out.putBool(pin.state);
+      out.putU8(pin.monitorMode);
+    }
+    unlockPins();
+    out.putU8(checkInterval);
+    out.putBool(useDHCP);
+    out.putU32(pinEdges.getDebounceUs());
+    out.putU32(pinEdges.getGlitchUs());
+    out.putU8(sequences.size());
+    for (const auto& sequence : sequences) {
+      out.putString(sequence.name);
+      out.putU16(sequence.steps.size());
+      for (const auto& step : sequence.steps) {
+        out.putU8(step.type);
+        out.putU8((uint8_t)step.gpio);
+        out.putU8(step.level);
+        out.putU32(step.durationUs);
+      }
+    }
+    configStore.put(CFG_KEY_KVM, CFG_KVM_VERSION, out.bytes());
   }
   
   // Загрузка конфигурации
   void loadConfig() {
-    // Проверяем, существует ли файл
-    if (!LittleFS.exists("/kvm_config.json")) {
-      Serial.println("kvm_config.json not found, using defaults");
+    std::vector<uint8_t> data;
+    if (!configStore.get(CFG_KEY_KVM, CFG_KVM_VERSION, data)) {
+      // Перенос из kvm_config.json прежних прошивок
+      DynamicJsonDocument doc(8192);
+      if (configStore.readLegacy("/kvm_config.json", doc) &&
+          configFromJson(doc.as<JsonObjectConst>())) {
+        saveConfig();
+        configStore.retireLegacy("/kvm_config.json");
+      }
       return;
     }
     
-    // Открываем файл
-    File configFile = LittleFS.open("/kvm_config.json", "r");
-    if (!configFile) {
-      Serial.println("Failed to open kvm_config.json");
-      return;
+    ConfigReader in(data);
+    std::vector<EnhancedPinConfig> loadedPins(in.getU8());
+    for (auto& pin : loadedPins) {
+      pin.pin = in.getI32();
+      pin.name = in.getString();
+      pin.state = in.getBool();
+      pin.monitorMode = (PinMonitorMode)in.getU8();
+      pin.lastStateChange = 0;
+    }
+    ConnectionCheckInterval loadedInterval = (ConnectionCheckInterval)in.getU8();
+    bool loadedDHCP = in.getBool();
+    uint32_t debounceUs = in.getU32();
+    uint32_t glitchUs = in.getU32();
+    std::vector<KVMSequence> loadedSequences(in.getU8());
+    for (auto& sequence : loadedSequences) {
+      sequence.name = in.getString();
+      sequence.steps.resize(in.getU16());
+      for (auto& step : sequence.steps) {
+        step.type = (KVMStepType)in.getU8();
+        step.gpio = (int8_t)in.getU8();
+        step.level = in.getU8();
+        step.durationUs = in.getU32();
+      }
     }
     
-    // Определяем размер файла
-    size_t size = configFile.size();
-    if (size > 4096) {
-      Serial.println("Config file size is too large");
-      configFile.close();
+    if (!in.ok()) {
+      Serial.println("KVM config record is truncated, using defaults");
       return;
     }
-    
-    // Читаем содержимое файла
-    std::unique_ptr<char[]> buf(new char[size]);
-    configFile.readBytes(buf.get(), size);
-    configFile.close();
-    
-    // Парсим JSON
-    DynamicJsonDocument doc(4096);
-    DeserializationError error = deserializeJson(doc, buf.get());
-    
-    if (error) {
-      Serial.print("JSON parsing failed: ");
-      Serial.println(error.c_str());
-      return;
+    // Записи прежних прошивок могли сохранить любой GPIO
+    for (size_t i = loadedPins.size(); i-- > 0;) {
+      if (!isAvailablePin(loadedPins[i].pin)) {
+        Serial.printf("KVM: dropping unavailable pin %d\n", loadedPins[i].pin);
+        loadedPins.erase(loadedPins.begin() + i);
+      }
     }
-    
-    // Очищаем текущий список пинов
-    pins.clear();
-    
-    // Загружаем пины
-    if (doc.containsKey("pins")) {
-      JsonArray pinsArray = doc["pins"];
-      for (JsonObject pinObj : pinsArray) {
-        EnhancedPinConfig pin;
-        pin.pin = pinObj["pin"];
-        pin.name = pinObj["name"].as<String>();
-        pin.state = pinObj["state"];
-        pin.monitorMode = (PinMonitorMode)pinObj["monitorMode"].as<int>();
-        pin.lastStateChange = 0;
-        
-        pins.push_back(pin);
+    lockPins();
+    pins.swap(loadedPins);
+    unlockPins();
+    for (auto& sequence : loadedSequences) {
+      for (size_t i = sequence.steps.size(); i-- > 0;) {
+        if (!stepAllowed(sequence.steps[i])) {
+          sequence.steps.erase(sequence.steps.begin() + i);
+        }
       }
     }
-    
-    // Загружаем настройки
-    if (doc.containsKey("checkInterval")) {
-      checkInterval = (ConnectionCheckInterval)doc["checkInterval"].as<int>();
+    checkInterval = loadedInterval;
+    useDHCP = loadedDHCP;
+    pinEdges.setFilter(debounceUs, glitchUs);
+    sequences = loadedSequences;
+  }
+  
+  // Экспорт и импорт для /config/export и /config/import
+  void exportConfig(JsonObject doc) {
+    configToJson(doc);
+  }
+  
+  bool importConfig(JsonObjectConst doc) {
+    if (!pinsValid(doc)) {
+      return false;
     }
-    
-    if (doc.containsKey("useDHCP")) {
-      useDHCP = doc["useDHCP"].as<bool>();
+    for (const auto& pin : getPins()) {
+      pinEdges.detach(pin.pin);
     }
+    configFromJson(doc);
+    applyPins();
+    saveConfig();
+    return true;
   }
 };
 
-// Предопределенные пины для M5StickC Plus2
-const struct {
-  int pin;
-  const char* name;
-  const char* description;
-} AVAILABLE_PINS[] = {
-  {0,  "GPIO0",  "GROVE"},
-  {25, "GPIO25", "GROVE"},
-  {26, "GPIO26", "GROVE"},
-  {32, "GPIO32", "GROVE"},
-  {33, "GPIO33", "GROVE"},
-  {36, "GPIO36", "GROVE (Input only)"},
-};
-#define AVAILABLE_PINS_COUNT (sizeof(AVAILABLE_PINS) / sizeof(AVAILABLE_PINS[0]))
-
 // Глобальные переменные
 MenuSection currentSection = MENU_MAIN;  // Текущий раздел меню
 int selectedMenuItem = 0;                // Выбранный пункт меню
 int menuStartPosition = 0;               // Начальная позиция для отображения меню
 AsyncWebServer server(80);               // Веб-сервер на порту 80
+WebAssets webAssets;                     // Сжатый веб-интерфейс
+TelemetryHub telemetry("/ws");           // Телеметрия через WebSocket
+AsyncEventSource portScanEvents("/network/portscan/events"); // Поток результатов сканирования портов
 WiFiManager wifiManager;                 // Менеджер WiFi
-APConfig apConfig = {AP_MODE_OFF, "M5StickDebug", "12345678", false, 1}; // Конфигурация AP
+APConfig apConfig = {AP_MODE_OFF, "M5StickDebug", "12345678", false, 1,
+                      REPEATER_DEFAULT_NAPT_ENTRIES, REPEATER_DEFAULT_MSS,
+                      REPEATER_DEFAULT_MAX_CLIENTS}; // Конфигурация AP
 DeviceSettings deviceSettings = {80, 300, "M5WifiDebugger", false, 70, false}; // Настройки устройства по умолчанию
 DeviceSettings globalDeviceSettings; // Глобальная переменная для других модулей (определена здесь)
 std::vector<SavedNetwork> savedNetworks; // Сохраненные сети
-std::vector<WiFiResult> networks;        // Список найденных сетей
-std::vector<APClient> apClients;         // Список клиентов AP
-std::vector<String> blockedMACs;         // Список заблокированных MAC адресов
-std::vector<SniffedPacket> packetBuffer;  // Буфер перехваченных пакетов
+
+// Настройки AP и сохраненные сети меняют веб-сервер и интерфейс, а читает
+// еще и сетевая задача. Строки и список - только под settingsLock
+// (рекурсивная: функции сохранения берут ее и сами)
+SemaphoreHandle_t settingsLock = nullptr;
+struct SettingsGuard {
+  SettingsGuard() { xSemaphoreTakeRecursive(settingsLock, portMAX_DELAY); }
+  ~SettingsGuard() { xSemaphoreGiveRecursive(settingsLock); }
+};
+
+// Последнее подключение STA: канал и BSSID для быстрого подключения
+struct WiFiCache {
+  String ssid;
+  uint8_t bssid[6];
+  uint8_t channel;
+  bool valid;
+};
+WiFiCache wifiCache = {"", {0}, 0, false};
+#define WIFI_CONNECT_ATTEMPTS 20       // По 500 мс
+#define WIFI_FAST_CONNECT_ATTEMPTS 8   // Прямое подключение без скана быстрое
+std::vector<WiFiResult> networks;        // Список найденных сетей (под networksLock)
+SemaphoreHandle_t networksLock = nullptr;
+ScanResultsCache scanCache;              // Готовые ответы /scan-results по последнему сканированию
+APClientTable apClients;                 // Таблица клиентов AP (по событиям WiFi)
+Blocklist blocklist;                     // Списки блокировки MAC и IP
+PacketRing<MAX_PACKET_BUFFER> packetBuffer; // Буфер перехваченных пакетов (lock-free)
 int selectedAPUser = -1;                 // Выбранный пользователь AP
-bool isSniffing = false;                 // Флаг активного сниффинга
-int currentSniffingClient = -1;          // Текущий клиент для сниффинга
-uint8_t* currentSniffingMAC = nullptr;   // MAC адрес текущего клиента для сниффинга
+volatile bool isSniffing = false;        // Флаг активного сниффинга
+SniffFilter sniffFilter;                 // Клиенты под сниффингом и их потоки
+CaptureRing captureRing;                 // Буфер полных кадров для выгрузки в PCAP
+uint32_t captureDepth = SNIFF_CAPTURE_DEFAULT_DEPTH;     // Глубина буфера захвата (кадров)
+uint16_t captureSnaplen = SNIFF_CAPTURE_DEFAULT_SNAPLEN; // Сохраняемая длина кадра
+
+// Обзор эфира: пассивный сбор маяков с переключением каналов
+WiFiSurvey wifiSurvey;
+uint16_t surveyHopTask = 0;
+uint16_t surveyDrainTask = 0;
 
 // Наши модули
 KVMModule kvmModule;
 NetworkTools networkTools;
+JobScheduler jobScheduler;
 DeviceManager deviceManager;
 Honeypot honeypot;
+HoneypotDNS honeypotDNS(honeypot);            // DNS захваченного портала
+HoneypotListener honeypotListener(honeypot);  // TCP-порты ловушки
+HoneypotServiceConfig honeypotServices = defaultHoneypotServiceConfig();
+LcdRenderer lcdRenderer;
+LogicAnalyzer logicAnalyzer;
+IRController irController(&server);
 
 // Описание пунктов главного меню
 const MenuItem mainMenuItems[] = {
@@ -504,19 +893,47 @@ unsigned long buttonCLastPress = 0;
 bool buttonALongPress = false;
 bool buttonBLongPress = false;
 bool buttonCLongPress = false;
-bool isScanningWifi = false;
-bool scanResultsReady = false;
+// Флаги сканирования пишет сетевая задача, читают веб-сервер и интерфейс
+volatile bool isScanningWifi = false;
+volatile bool scanResultsReady = false;
+volatile bool scanFailed = false;
+bool screenHeld = false;         // На экране сообщение поверх меню
+uint16_t screenHoldTask = 0;
+uint16_t connectWatchTask = 0;   // Ожидание подключения к сети
+int connectWatchAttempts = 0;
+bool shuffleInProgress = false;
 unsigned long lastScanTime = 0;
 
 // Прототипы функций
 void setupDisplay();
 void setupWiFi();
+void startConfiguredAP();
+void loadWiFiCache();
+void saveWiFiCache();
+void onWiFiGotIP(WiFiEvent_t event, WiFiEventInfo_t info);
+void bootStageNetwork();
+void bootStageServices();
 void setupWebServer();
 void handleButtons();
+void setupTasks();
+void checkRepeaterConnection();
+void onWiFiScanDone(WiFiEvent_t event, WiFiEventInfo_t info);
+void collectWiFiScanResults();
+void holdScreen(uint32_t ms);
+void releaseScreen();
 void drawMenu();
+void drawHoneypotActivity();
+const char* httpMethodName(uint8_t method);
 void handleMenuAction();
 void scanWiFiNetworks();
 void updateAccessPointMode();
+void startHoneypotServices();
+void stopHoneypotServices();
+void saveHoneypotServices();
+void loadHoneypotServices();
+void updatePower();
+void savePowerConfig();
+void loadPowerConfig();
 void performNetworkDiagnostics();
 void saveConfiguration();
 void loadConfiguration();
@@ -526,228 +943,428 @@ void playFindMeSound();
 int getMaxMenuItems();
 void saveSavedNetworks();
 void loadSavedNetworks();
+void configurationToJson(JsonObject doc);
+void configurationFromJson(JsonObjectConst doc);
+void deviceSettingsToJson(JsonObject doc);
+void deviceSettingsFromJson(JsonObjectConst doc);
+void savedNetworksToJson(JsonObject doc);
+void savedNetworksFromJson(JsonObjectConst doc);
 void connectToSavedNetwork(int index);
 void updateAPClients();
+size_t scanNetworkCount();
+bool getScanNetwork(size_t index, WiFiResult& out);
+void clearScanNetworks();
+void apUserToJson(const APClient& client, JsonDocument& userObj);
+void scanResultToJson(const WiFiResult& network, JsonDocument& netObj);
+bool parseScanQuery(AsyncWebServerRequest *request, ScanQuery& query);
+void setClientBlocked(int slot, const APClient& client, bool blocked);
 void shuffleIP();
-void startPacketSniffing(int clientIndex);
-void stopPacketSniffing();
+void shuffleReconnect(const String& ssid, const String& password);
+void watchConnection(std::function<void(bool)> onDone, int attempts = WIFI_CONNECT_ATTEMPTS);
+bool startPacketSniffing(int clientIndex, const SniffTarget* rule = nullptr);
+void stopPacketSniffing(int clientIndex = -1);
+void applySniffFilter();
+bool parseSniffTarget(AsyncWebServerRequest *request, const uint8_t* mac, SniffTarget& target);
+bool startSurvey(const std::vector<uint8_t>& channels, uint32_t dwell, uint32_t home);
+void stopSurvey();
+void surveyHop();
 void promiscuous_rx_callback(void* buf, wifi_promiscuous_pkt_type_t type);
+String formatPortEvent(uint16_t port);
+void sendJobAccepted(AsyncWebServerRequest *request, uint32_t jobId);
+void runSweepJob(Job& job, IPAddress startIP, IPAddress endIP, SweepConfig config);
+void runPortScanJob(Job& job, IPAddress ip, int startPort, int endPort, PortScanConfig config);
+void streamPortScanEvents();
+void publishTelemetry();
+void publishClientsTopic(bool full);
+void publishTrafficTopic(bool full);
+void publishSniffTopic(bool full);
+void publishPinsTopic(bool full);
+void publishSensorsTopic(bool full);
+void publishStatusTopic(bool full);
+void publishEdgesTopic(bool full);
+bool parseSequenceRequest(AsyncWebServerRequest *request, KVMSequence& sequence, String& error);
+bool parseLogicRequest(AsyncWebServerRequest *request, LAConfig& config, String& error);
+bool isSniffingClient(const APClient& client);
+void formatLastPacket(char* out, size_t size);
 bool isMACBlocked(const uint8_t* mac);
 void onStationConnected(WiFiEvent_t event, WiFiEventInfo_t info);
+void onStationDisconnected(WiFiEvent_t event, WiFiEventInfo_t info);
+void onStationIPAssigned(WiFiEvent_t event, WiFiEventInfo_t info);
+#ifdef BENCH_BUILD
+void runBenchmarks();
+#endif
 
 
-// Функция сохранения заблокированных MAC
-void saveBlockedMACs() {
-  DynamicJsonDocument doc(2048);
-  
-  JsonArray blockedArray = doc.createNestedArray("blocked");
-  for (const auto& mac : blockedMACs) {
-    blockedArray.add(mac);
-  }
-  
-  File file = LittleFS.open("/blocked_macs.json", "w");
-  if (!file) {
-    Serial.println("Failed to open blocked_macs.json for writing");
-    return;
-  }
-  
-  serializeJson(doc, file);
-  file.close();
-}
-
-// Функция загрузки заблокированных MAC
-void loadBlockedMACs() {
-  if (!LittleFS.exists("/blocked_macs.json")) {
-    return;
-  }
-  
-  File file = LittleFS.open("/blocked_macs.json", "r");
-  if (!file) {
-    return;
-  }
-  
-  DynamicJsonDocument doc(2048);
-  DeserializationError error = deserializeJson(doc, file);
-  file.close();
-  
-  if (error) {
-    return;
-  }
-  
-  blockedMACs.clear();
-  
-  if (doc.containsKey("blocked")) {
-    JsonArray blockedArray = doc["blocked"];
-    for (JsonVariant v : blockedArray) {
-      blockedMACs.push_back(v.as<String>());
-    }
-  }
-}
-
-// Функция инициализации
+// Функция инициализации.
+// Сначала поднимаются экран и кнопки, остальное - этапами из основного
+// цикла, чтобы меню отвечало, пока WiFi подключается и стартуют сервисы
 void setup() {
   // Инициализация M5StickCPlus2
   M5.begin();
+  scheduler.begin();
+  netScheduler.begin();
+  networksLock = xSemaphoreCreateMutex();
+  settingsLock = xSemaphoreCreateRecursiveMutex();
+  bootProfile.mark("m5");
   
   // Инициализация файловой системы
   if (!LittleFS.begin(true)) {
     M5.Lcd.println("LittleFS Mount Failed");
   }
   
-  // Загрузка конфигурации
-  loadConfiguration();
-  loadDeviceSettings();
-  loadSavedNetworks();
-  loadBlockedMACs(); 
+  // Хранилище настроек: изменения копятся в памяти и пишутся во флеш пачкой
+  configStore.begin();
+  configStore.setCommitHook([]() {
+    netScheduler.after(CONFIG_COMMIT_DELAY_MS, []() { configStore.commit(); });
+  });
+  wifiSurvey.begin();
+  bootProfile.mark("config");
   
-  // Инициализируем глобальные настройки
-  globalDeviceSettings = deviceSettings;
+  // Для экрана нужны только настройки устройства
+  loadDeviceSettings();
   
   // Применяем настройки устройства
   M5.Lcd.setBrightness(deviceSettings.brightness);
   M5.Lcd.setRotation(deviceSettings.rotateDisplay ? 1 : 3);
   globalDeviceSettings = deviceSettings; // Синхронизируем глобальные настройки
   
-  // Инициализируем наши модули
+  // Питание: экран после пробуждения перерисовывается целиком
+  powerManager.begin(defaultPowerConfig(), deviceSettings.brightness);
+  powerManager.setWakeHandler([]() {
+    lcdRenderer.invalidate();
+    drawMenu();
+  });
+  loadPowerConfig();
+  
+  // Настройка экрана
+  setupDisplay();
+  
+  // Кнопки опрашиваются часто, чтобы задержка реакции была ограничена
+  buttonTask = scheduler.every(BUTTON_POLL_MS, []() {
+    M5.update();
+    handleButtons();
+  });
+  
+  // Отображаем главное меню
+  drawMenu();
+  bootProfile.markUsable();
+  
+  // Остальное - по этапу за проход цикла
+  scheduler.post(bootStageNetwork);
+  
+  // Дальше планировщики работают в своих задачах, loop не нужен
+  scheduler.setPassHook([](uint32_t passUs) { perfMonitor.recordLoop(passUs); });
+  scheduler.start("ui", UI_TASK_CORE, UI_TASK_PRIORITY, SCHEDULER_TASK_STACK);
+  netScheduler.start("net", NET_TASK_CORE, NET_TASK_PRIORITY, SCHEDULER_TASK_STACK);
+}
+
+// Этап загрузки: настройки сети, KVM и подключение WiFi
+void bootStageNetwork() {
+  loadConfiguration();
+  loadSavedNetworks();
+  loadWiFiCache();
+  blocklist.load();
+  loadHoneypotServices();
+  
+  // KVM раньше сервисов: пины должны вернуться в сохраненное состояние
   kvmModule.begin();
-  deviceManager.begin();
+  bootProfile.mark("kvm");
   
   // Регистрируем обработчики событий WiFi
   WiFi.onEvent(onStationConnected, ARDUINO_EVENT_WIFI_AP_STACONNECTED);
+  WiFi.onEvent(onStationDisconnected, ARDUINO_EVENT_WIFI_AP_STADISCONNECTED);
+  WiFi.onEvent(onStationIPAssigned, ARDUINO_EVENT_WIFI_AP_STAIPASSIGNED);
+  WiFi.onEvent(onWiFiScanDone, ARDUINO_EVENT_WIFI_SCAN_DONE);
+  WiFi.onEvent(onWiFiGotIP, ARDUINO_EVENT_WIFI_STA_GOT_IP);
   
-  // Настройка экрана
-  setupDisplay();
-  
-  // Настройка WiFi
+  // Настройка WiFi (подключение завершится в фоне)
   setupWiFi();
+  bootProfile.mark("wifi");
+  
+  scheduler.post(bootStageServices);
+}
+
+// Этап загрузки: датчики, веб-сервер, ИК и задачи основного цикла
+void bootStageServices() {
+  logicAnalyzer.begin();
+  deviceManager.begin();
+  jobScheduler.begin();
+  bootProfile.mark("sensors");
   
   // Настройка веб-сервера
   setupWebServer();
+  bootProfile.mark("web");
   
-  // Отображаем главное меню
-  drawMenu();
+  // Задачи основного цикла
+  setupTasks();
+  bootProfile.mark("ready");
+  
+#ifdef BENCH_BUILD
+  // Замеры - когда WiFi и сервисы уже работают, как в обычной прошивке
+  scheduler.after(3000, runBenchmarks);
+#endif
 }
 
-// Основной цикл
+// Основной цикл не используется: всю работу выполняют задачи планировщиков
 void loop() {
-  static unsigned long lastCheck = 0;
-  static unsigned long lastRepeaterCheck = 0;
-  
-  // Проверяем состояние каждые 5 секунд
-  if (millis() - lastCheck > 5000) {
-    lastCheck = millis();
-    Serial.printf("WiFi mode: %d, Free heap: %d bytes\n", 
-                  WiFi.getMode(), ESP.getFreeHeap());
-  }
+  vTaskDelete(nullptr);
+}
+
+// Регистрация задач планировщиков
+void setupTasks() {
+  // Модули
+  scheduler.every(20, []() { kvmModule.update(); });
+  scheduler.every(50, []() { deviceManager.update(); });
+  scheduler.every(50, []() { irController.update(); });
+  
+  // Результаты сканирования портов и телеметрия
+  netScheduler.every(TELEMETRY_MIN_INTERVAL, []() {
+    streamPortScanEvents();
+    publishTelemetry();
+  });
   
-  // Проверяем состояние репитера каждые 10 секунд
-  if (apConfig.mode == AP_MODE_REPEATER && millis() - lastRepeaterCheck > 10000) {
-    lastRepeaterCheck = millis();
-    
-    // Проверяем, что мы все еще подключены к основной сети
-    if (WiFi.status() != WL_CONNECTED) {
-      Serial.println("Repeater: Lost WiFi connection, attempting to reconnect...");
-      
-      // Пытаемся переподключиться
-      if (!WiFi.reconnect()) {
-        // Если не удалось, пробуем подключиться заново
-        if (savedNetworks.size() > 0) {
-          WiFi.begin(savedNetworks[0].ssid.c_str(), savedNetworks[0].password.c_str());
-        }
-      }
-    } else {
-      // Проверяем, что AP все еще активна
-      if (WiFi.getMode() != WIFI_AP_STA) {
-        Serial.println("Repeater: AP mode lost, reactivating...");
-        updateAccessPointMode();
-      } else {
-        // Выводим статистику репитера
-        Serial.printf("Repeater stats - Clients: %d, Main IP: %s, AP IP: %s\n", 
-                     WiFi.softAPgetStationNum(),
-                     WiFi.localIP().toString().c_str(),
-                     WiFi.softAPIP().toString().c_str());
-      }
+  // Экран: монитор KVM обновляется 10 раз в секунду (кадр выводится по
+  // изменившимся полосам), активность ловушки - не чаще раза в секунду,
+  // чтобы поток запросов от сканера не занимал задачу перерисовкой
+  scheduler.every(100, []() {
+    if (currentSection == MENU_KVM_MONITOR) {
+      drawMenu();
     }
-  }
-  
-  // Обновление состояния кнопок
-  M5.update();
-  handleButtons();
+    static uint32_t lastHoneypotDraw = 0;
+    if (millis() - lastHoneypotDraw >= HONEYPOT_DISPLAY_INTERVAL && honeypot.consumeActivity()) {
+      lastHoneypotDraw = millis();
+      drawHoneypotActivity();
+    }
+  });
   
-  // Обновляем наши модули
-  kvmModule.update();
-  deviceManager.update();
+  // Журнал ловушки пишется на флеш пачками
+  netScheduler.every(1000, []() { honeypot.flush(); });
   
-  // Проверяем завершение сканирования WiFi
-  if (isScanningWifi) {
-    int scanResult = WiFi.scanComplete();
-    if (scanResult >= 0) {
-      networks.clear();
-      for (int i = 0; i < scanResult; i++) {
-        WiFiResult network;
-        network.ssid = WiFi.SSID(i);
-        network.rssi = WiFi.RSSI(i);
-        network.encryptionType = WiFi.encryptionType(i);
-        network.channel = WiFi.channel(i);
-        networks.push_back(network);
-      }
-      WiFi.scanDelete();
-      isScanningWifi = false;
-      scanResultsReady = true;  // Убедитесь, что этот флаг устанавливается!
-      
-      // Обновляем отображение
-      if (currentSection == MENU_WIFI_SCAN) {
-        drawMenu();
+  // Информация о клиентах AP: сверка - в сетевой задаче, экран - здесь
+  netScheduler.every(1000, []() {
+    if (currentSection == MENU_AP_USERS || currentSection == MENU_AP_USER_INFO) {
+      // Таблица ведется по событиям, сверка с драйвером - только при расхождении
+      if (WiFi.softAPgetStationNum() != apClients.connectedCount()) {
+        updateAPClients();
       }
     }
-  }
-  
-  // Обновляем информацию на экране в режиме мониторинга
-  if (currentSection == MENU_KVM_MONITOR) {
-    static unsigned long lastUpdateTime = 0;
-    unsigned long currentTime = millis();
-    
-    if (currentTime - lastUpdateTime > 1000) { // Обновляем раз в секунду
-      lastUpdateTime = currentTime;
+  });
+  scheduler.every(1000, []() {
+    if (currentSection == MENU_AP_USERS || currentSection == MENU_AP_USER_INFO) {
       drawMenu();
     }
-  }
+  });
   
-  // Обновляем информацию о клиентах AP
-  if (currentSection == MENU_AP_USERS || currentSection == MENU_AP_USER_INFO) {
-    static unsigned long lastAPUpdateTime = 0;
-    unsigned long currentTime = millis();
-    
-    if (currentTime - lastAPUpdateTime > 1000) { // Обновляем раз в секунду
-      lastAPUpdateTime = currentTime;
-      updateAPClients();
-      drawMenu();
-    }
-  }
+  // Скорости трафика клиентов AP
+  netScheduler.every(1000, APTrafficMeter::tick);
   
-  // Небольшая задержка для стабильности
-  delay(50);
-}
+  // Состояние устройства каждые 5 секунд
+  netScheduler.every(5000, []() {
+    Serial.printf("WiFi mode: %d, Free heap: %d bytes (min %d, largest block %d)\n",
+                  WiFi.getMode(), ESP.getFreeHeap(), ESP.getMinFreeHeap(),
+                  heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+  });
+  
+  // Состояние репитера каждые 10 секунд. В задаче интерфейса: при потере
+  // AP перезапускаются точка доступа и службы ловушки
+  scheduler.every(10000, checkRepeaterConnection);
+  
+  // Экран, частота и сон по активности
+  scheduler.every(1000, updatePower);
+}
+
+// Проверка соединений в режиме репитера
+void checkRepeaterConnection() {
+  if (apConfig.mode != AP_MODE_REPEATER) {
+    return;
+  }
+  
+  // Проверяем, что мы все еще подключены к основной сети
+  if (WiFi.status() != WL_CONNECTED) {
+    Serial.println("Repeater: Lost WiFi connection, attempting to reconnect...");
+    
+    // Пытаемся переподключиться
+    if (!WiFi.reconnect()) {
+      // Если не удалось, пробуем подключиться заново
+      SettingsGuard guard;
+      if (savedNetworks.size() > 0) {
+        WiFi.begin(savedNetworks[0].ssid.c_str(), savedNetworks[0].password.c_str());
+      }
+    }
+  } else {
+    // Проверяем, что AP все еще активна
+    if (WiFi.getMode() != WIFI_AP_STA) {
+      Serial.println("Repeater: AP mode lost, reactivating...");
+      updateAccessPointMode();
+    } else {
+      // Выводим статистику репитера (подробно - /ap/repeater/stats)
+      RepeaterNaptUsage napt = RepeaterPath::getNaptUsage();
+      Serial.printf("Repeater stats - Clients: %d, NAPT: %u/%u, evicted: %u\n",
+                   WiFi.softAPgetStationNum(),
+                   napt.tcp + napt.udp + napt.icmp, RepeaterPath::getNaptEntries(),
+                   RepeaterPath::getEvictions());
+    }
+  }
+}
+
+// Завершение сканирования WiFi.
+// Выполняется в задаче событий Arduino - результаты забирает сетевая задача
+void onWiFiScanDone(WiFiEvent_t event, WiFiEventInfo_t info) {
+  netScheduler.post(collectWiFiScanResults);
+}
+
+void collectWiFiScanResults() {
+  if (!isScanningWifi) {
+    return;
+  }
+  int scanResult = WiFi.scanComplete();
+  if (scanResult == WIFI_SCAN_RUNNING) {
+    return;
+  }
+  if (scanResult < 0) {
+    // Ошибка сканирования
+    WiFi.scanDelete();
+    isScanningWifi = false;
+    scanResultsReady = false;
+    scanFailed = true;
+    return;
+  }
+  
+  // Список собирается отдельно и подменяется целиком: экран под блокировкой
+  // читает либо старый, либо новый
+  std::vector<WiFiResult> found;
+  found.reserve(scanResult);
+  for (int i = 0; i < scanResult; i++) {
+    WiFiResult network;
+    network.ssid = WiFi.SSID(i);
+    network.rssi = WiFi.RSSI(i);
+    network.encryptionType = WiFi.encryptionType(i);
+    network.channel = WiFi.channel(i);
+    found.push_back(network);
+    // Активный скан дополняет таблицу обзора
+    wifiSurvey.addScanResult(WiFi.BSSID(i), network.ssid, network.channel,
+                             network.rssi, (wifi_auth_mode_t)network.encryptionType);
+  }
+  WiFi.scanDelete();
+  scanCache.publish(found, scanResultToJson);
+  xSemaphoreTake(networksLock, portMAX_DELAY);
+  networks.swap(found);
+  xSemaphoreGive(networksLock);
+  isScanningWifi = false;
+  scanResultsReady = true;  // Убедитесь, что этот флаг устанавливается!
+  
+  // Обновляем отображение
+  scheduler.post([]() {
+    if (currentSection == MENU_WIFI_SCAN) {
+      drawMenu();
+    }
+  });
+}
+
+// Доступ к списку сетей из веб-сервера и интерфейса
+size_t scanNetworkCount() {
+  xSemaphoreTake(networksLock, portMAX_DELAY);
+  size_t count = networks.size();
+  xSemaphoreGive(networksLock);
+  return count;
+}
+
+// Копия записи (строки копируются под блокировкой). false - индекса нет
+bool getScanNetwork(size_t index, WiFiResult& out) {
+  bool found = false;
+  xSemaphoreTake(networksLock, portMAX_DELAY);
+  if (index < networks.size()) {
+    out = networks[index];
+    found = true;
+  }
+  xSemaphoreGive(networksLock);
+  return found;
+}
+
+void clearScanNetworks() {
+  std::vector<WiFiResult> old;
+  xSemaphoreTake(networksLock, portMAX_DELAY);
+  networks.swap(old);
+  xSemaphoreGive(networksLock);
+}
+
+// Сообщение поверх меню: меню не перерисовывается, пока сообщение
+// на экране. ms = 0 - до нажатия любой кнопки
+void holdScreen(uint32_t ms) {
+  screenHeld = true;
+  scheduler.cancel(screenHoldTask);
+  screenHoldTask = ms > 0 ? scheduler.after(ms, releaseScreen) : 0;
+}
+
+void releaseScreen() {
+  scheduler.cancel(screenHoldTask);
+  screenHoldTask = 0;
+  if (screenHeld) {
+    screenHeld = false;
+    drawMenu();
+  }
+}
 
 // Настройка экрана
 void setupDisplay() {
+  // Буфер кадра для меню; без него меню рисуется прямо на экран
+  if (!lcdRenderer.begin(M5.Lcd)) {
+    Serial.println("LCD frame buffer unavailable, drawing directly");
+  }
   M5.Lcd.fillScreen(BLACK);
   M5.Lcd.setTextSize(1);
   M5.Lcd.setTextColor(WHITE);
   M5.Lcd.setCursor(0, 0);
 }
 
-// Настройка WiFi
+// Настройка WiFi.
+// Не ждет подключения: точка доступа запускается, когда станет известен
+// результат. К сети прошлой сессии подключаемся сразу по сохраненным
+// каналу и BSSID, без сканирования всех каналов
 void setupWiFi() {
   // Убедимся, что WiFi в правильном режиме
   WiFi.mode(WIFI_MODE_STA);
   
   // Проверяем сохраненные сети
-  if (savedNetworks.size() > 0) {
-    // Пробуем подключиться к последней сохраненной сети
-    connectToSavedNetwork(0);
+  SavedNetwork network;
+  {
+    SettingsGuard guard;
+    if (savedNetworks.size() > 0) {
+      network = savedNetworks[0];
+    }
+  }
+  if (network.ssid.length() == 0) {
+    startConfiguredAP();
+    return;
+  }
+  
+  bool fast = wifiCache.valid && wifiCache.ssid == network.ssid;
+  if (fast) {
+    WiFi.begin(network.ssid.c_str(), network.password.c_str(),
+               wifiCache.channel, wifiCache.bssid);
+  } else {
+    WiFi.begin(network.ssid.c_str(), network.password.c_str());
   }
   
+  watchConnection([fast, network](bool connected) {
+    bootProfile.mark(connected ? "wifi connected" : "wifi failed");
+    if (!connected && fast) {
+      // Точка сменила канал или ее заменили - обычное подключение
+      wifiCache.valid = false;
+      WiFi.disconnect();
+      WiFi.begin(network.ssid.c_str(), network.password.c_str());
+      watchConnection([](bool retried) {
+        bootProfile.mark(retried ? "wifi connected" : "wifi failed");
+        startConfiguredAP();
+      });
+      return;
+    }
+    startConfiguredAP();
+  }, fast ? WIFI_FAST_CONNECT_ATTEMPTS : WIFI_CONNECT_ATTEMPTS);
+}
+
+// Запуск AP по сохраненному режиму
+void startConfiguredAP() {
   // Проверка сохраненных настроек и режима AP
   if (apConfig.mode != AP_MODE_OFF) {
     // Переключаемся в режим AP
@@ -757,41 +1374,210 @@ void setupWiFi() {
   }
 }
 
+// Службы ловушки по настройкам: DNS-ответчик и слушатели TCP-портов
+void startHoneypotServices() {
+  if (honeypotServices.dns) {
+    honeypotDNS.begin(WiFi.softAPIP());
+  } else {
+    honeypotDNS.end();
+  }
+  honeypotListener.begin(honeypotServices);
+}
+
+void stopHoneypotServices() {
+  honeypotDNS.end();
+  honeypotListener.end();
+}
+
+void saveHoneypotServices() {
+  ConfigWriter out;
+  out.putBool(honeypotServices.dns);
+  out.putU16(honeypotServices.captureBytes);
+  out.putU8(honeypotServices.portCount);
+  for (uint8_t i = 0; i < honeypotServices.portCount; i++) {
+    out.putU16(honeypotServices.ports[i]);
+  }
+  configStore.put(CFG_KEY_HONEYPOT, CFG_HONEYPOT_VERSION, out.bytes());
+}
+
+void loadHoneypotServices() {
+  std::vector<uint8_t> data;
+  if (!configStore.get(CFG_KEY_HONEYPOT, CFG_HONEYPOT_VERSION, data)) {
+    return;
+  }
+  ConfigReader in(data);
+  HoneypotServiceConfig loaded = {};
+  loaded.dns = in.getBool();
+  loaded.captureBytes = in.getU16();
+  loaded.portCount = min((uint8_t)HONEYPOT_MAX_PORTS, in.getU8());
+  for (uint8_t i = 0; i < loaded.portCount; i++) {
+    loaded.ports[i] = in.getU16();
+  }
+  if (in.ok()) {
+    honeypotServices = loaded;
+  }
+}
+
+// Питание по активности: вызывается раз в секунду и после смены настроек
+void updatePower() {
+  PowerInputs in;
+  in.blankAfter = deviceSettings.sleepTimeout;
+  in.busy = isSniffing || wifiSurvey.isRunning() || logicAnalyzer.isBusy() ||
+            irController.isBusy() || kvmModule.getSequencer().isRunning();
+  in.pinsMonitored = pinEdges.attachedCount() > 0;
+  in.staLinked = WiFi.status() == WL_CONNECTED;
+  in.webSockets = telemetry.getClientCount();
+  powerManager.update(in);
+  
+  bool idle = powerManager.isIdle();
+  scheduler.setPeriod(buttonTask, idle ? BUTTON_POLL_IDLE_MS : BUTTON_POLL_MS);
+  deviceManager.setSensorUpdateInterval(idle ? SENSOR_INTERVAL_IDLE_MS : SENSOR_INTERVAL_MS);
+}
+
+void savePowerConfig() {
+  const PowerConfig& config = powerManager.getConfig();
+  ConfigWriter out;
+  out.putBool(config.lowPower);
+  out.putBool(config.lightSleep);
+  out.putU16(config.minMhz);
+  out.putU16(config.maxMhz);
+  out.putU16(config.dimAfter);
+  out.putU8(config.dimBrightness);
+  configStore.put(CFG_KEY_POWER, CFG_POWER_VERSION, out.bytes());
+}
+
+void loadPowerConfig() {
+  std::vector<uint8_t> data;
+  if (!configStore.get(CFG_KEY_POWER, CFG_POWER_VERSION, data)) {
+    return;
+  }
+  ConfigReader in(data);
+  PowerConfig loaded;
+  loaded.lowPower = in.getBool();
+  loaded.lightSleep = in.getBool();
+  loaded.minMhz = in.getU16();
+  loaded.maxMhz = in.getU16();
+  loaded.dimAfter = in.getU16();
+  loaded.dimBrightness = in.getU8();
+  if (in.ok()) {
+    powerManager.configure(loaded);
+  }
+}
+
+// Канал и BSSID последнего подключения для быстрого старта
+void loadWiFiCache() {
+  std::vector<uint8_t> data;
+  if (!configStore.get(CFG_KEY_WIFI_CACHE, CFG_WIFI_CACHE_VERSION, data)) {
+    return;
+  }
+  ConfigReader in(data);
+  WiFiCache loaded;
+  loaded.ssid = in.getString();
+  for (int i = 0; i < 6; i++) {
+    loaded.bssid[i] = in.getU8();
+  }
+  loaded.channel = in.getU8();
+  loaded.valid = in.ok() && loaded.channel > 0;
+  wifiCache = loaded;
+}
+
+void saveWiFiCache() {
+  if (WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+  wifiCache.ssid = WiFi.SSID();
+  memcpy(wifiCache.bssid, WiFi.BSSID(), 6);
+  wifiCache.channel = WiFi.channel();
+  wifiCache.valid = true;
+  
+  ConfigWriter out;
+  out.putString(wifiCache.ssid);
+  out.putRaw(wifiCache.bssid, 6);
+  out.putU8(wifiCache.channel);
+  // Та же точка - запись не меняется и флеш не трогается
+  configStore.put(CFG_KEY_WIFI_CACHE, CFG_WIFI_CACHE_VERSION, out.bytes());
+}
+
+// Получен адрес в сети STA. Выполняется в задаче событий Arduino
+void onWiFiGotIP(WiFiEvent_t event, WiFiEventInfo_t info) {
+  scheduler.post(saveWiFiCache);
+}
+
 // Функция подключения к сохраненной сети
 void connectToSavedNetwork(int index) {
-  if (index >= 0 && index < savedNetworks.size()) {
-    WiFi.begin(savedNetworks[index].ssid.c_str(), savedNetworks[index].password.c_str());
+  SavedNetwork network;
+  {
+    SettingsGuard guard;
+    if (index >= 0 && index < savedNetworks.size()) {
+      network = savedNetworks[index];
+    }
+  }
+  if (network.ssid.length() > 0) {
+    WiFi.begin(network.ssid.c_str(), network.password.c_str());
     
+    lcdRenderer.invalidate();
     M5.Lcd.fillScreen(BLACK);
     M5.Lcd.setCursor(0, 0);
     M5.Lcd.print("Connecting to ");
-    M5.Lcd.println(savedNetworks[index].ssid);
+    M5.Lcd.println(network.ssid);
     
-    // Ожидание подключения с таймаутом
-    int timeout = 0;
-    while (WiFi.status() != WL_CONNECTED && timeout < 20) {
-      delay(500);
-      M5.Lcd.print(".");
-      timeout++;
-    }
+    holdScreen(0);
     
-    if (WiFi.status() == WL_CONNECTED) {
-      M5.Lcd.println("\nConnected!");
-      delay(1000);
-    } else {
-      M5.Lcd.println("\nConnection failed!");
-      delay(2000);
-    }
+    // Ожидание подключения с таймаутом
+    watchConnection([](bool connected) {
+      if (connected) {
+        M5.Lcd.println("\nConnected!");
+        holdScreen(1000);
+      } else {
+        M5.Lcd.println("\nConnection failed!");
+        holdScreen(2000);
+      }
+    });
   }
 }
 
+// Ожидание подключения к сети без блокировки: до attempts проверок
+// раз в 500 мс, затем onDone с результатом
+void watchConnection(std::function<void(bool)> onDone, int attempts) {
+  scheduler.cancel(connectWatchTask);
+  connectWatchAttempts = 0;
+  connectWatchTask = scheduler.every(500, [onDone, attempts]() {
+    bool connected = WiFi.status() == WL_CONNECTED;
+    if (!connected && ++connectWatchAttempts < attempts) {
+      if (screenHeld) {
+        M5.Lcd.print(".");
+      }
+      return;
+    }
+    scheduler.cancel(connectWatchTask);
+    connectWatchTask = 0;
+    onDone(connected);
+  });
+}
+
 // Обновление режима точки доступа
 void updateAccessPointMode() {
+  String apSSID, apPassword;
+  {
+    SettingsGuard guard;
+    apSSID = apConfig.ssid;
+    apPassword = apConfig.password;
+  }
+  
+  // NAPT нужен только ретранслятору, DNS и порты - только ловушке
+  if (apConfig.mode != AP_MODE_REPEATER) {
+    RepeaterPath::disable();
+  }
+  if (apConfig.mode != AP_MODE_HONEYPOT) {
+    stopHoneypotServices();
+  }
+  
   switch (apConfig.mode) {
     case AP_MODE_OFF:
       if (WiFi.getMode() == WIFI_AP || WiFi.getMode() == WIFI_AP_STA) {
         WiFi.softAPdisconnect(true);
         WiFi.mode(WIFI_STA);
+        apClients.clear();
       }
       break;
       
@@ -808,7 +1594,7 @@ void updateAccessPointMode() {
         // Сначала конфигурируем IP, потом запускаем AP
         WiFi.softAPConfig(apIP, apGateway, apSubnet);
         
-        bool apSuccess = WiFi.softAP(apConfig.ssid.c_str(), apConfig.password.c_str(), apConfig.channel);
+        bool apSuccess = WiFi.softAP(apSSID.c_str(), apPassword.c_str(), apConfig.channel);
         if (!apSuccess) {
           Serial.println("Failed to start AP");
           return;
@@ -871,7 +1657,7 @@ void updateAccessPointMode() {
         Serial.println(WiFi.dnsIP());
       } else {
         WiFi.mode(WIFI_AP);
-        WiFi.softAP(apConfig.ssid.c_str(), apConfig.password.c_str(), apConfig.channel);
+        WiFi.softAP(apSSID.c_str(), apPassword.c_str(), apConfig.channel);
       }
       break;
       
@@ -885,7 +1671,7 @@ void updateAccessPointMode() {
         IPAddress apSubnet(255, 255, 255, 0);
         
         WiFi.softAPConfig(apIP, apIP, apSubnet);
-        WiFi.softAP(apConfig.ssid.c_str(), apConfig.password.c_str(), apConfig.channel, true);
+        WiFi.softAP(apSSID.c_str(), apPassword.c_str(), apConfig.channel, true);
         
         // Включаем маршрутизацию
         #ifdef ESP32
@@ -894,7 +1680,7 @@ void updateAccessPointMode() {
         #endif
       } else {
         WiFi.mode(WIFI_AP);
-        WiFi.softAP(apConfig.ssid.c_str(), apConfig.password.c_str(), apConfig.channel, true);
+        WiFi.softAP(apSSID.c_str(), apPassword.c_str(), apConfig.channel, true);
       }
       break;
       
@@ -907,10 +1693,13 @@ void updateAccessPointMode() {
         
         // Находим пароль от текущей сети в сохраненных
         String connectedPassword = "";
-        for (const auto& network : savedNetworks) {
-          if (network.ssid == connectedSSID) {
-            connectedPassword = network.password;
-            break;
+        {
+          SettingsGuard guard;
+          for (const auto& network : savedNetworks) {
+            if (network.ssid == connectedSSID) {
+              connectedPassword = network.password;
+              break;
+            }
           }
         }
         
@@ -924,7 +1713,8 @@ void updateAccessPointMode() {
         WiFi.softAPConfig(apIP, apIP, apSubnet);
         
         // Создаем точку доступа с теми же параметрами, что и у подключенной сети
-        bool success = WiFi.softAP(connectedSSID.c_str(), connectedPassword.c_str(), connectedChannel, false, 4);
+        bool success = WiFi.softAP(connectedSSID.c_str(), connectedPassword.c_str(), connectedChannel,
+                                   false, apConfig.maxClients);
         
         if (!success) {
           Serial.println("Failed to start repeater AP");
@@ -937,6 +1727,9 @@ void updateAccessPointMode() {
           WiFi.enableAP(true);
           WiFi.enableIpV6();
         #endif
+        if (!RepeaterPath::enable(apIP, apSubnet, apConfig.naptEntries, apConfig.mssClamp)) {
+          Serial.println("Repeater: no memory for the flow table, NAPT usage is not tracked");
+        }
         
         Serial.println("Repeater mode activated - mirroring connected network");
         Serial.print("Mirroring SSID: ");
@@ -956,12 +1749,19 @@ void updateAccessPointMode() {
       
     case AP_MODE_HONEYPOT:
       // Режим ловушки
-      honeypot.setSSID(apConfig.ssid);
+      honeypot.setSSID(apSSID);
       honeypot.setChannel(apConfig.channel);
+      honeypot.setOnUnroutedCallback([]() { perfMonitor.markUnrouted(); });
       honeypot.begin(server);
+      startHoneypotServices();
       break;
   }
   
+  // Фильтр заблокированных MAC/IP на новом интерфейсе AP
+  if (apConfig.mode != AP_MODE_OFF && (WiFi.getMode() & WIFI_MODE_AP)) {
+    APNetifHook::install(blocklist);
+  }
+  
   // Сохраняем конфигурацию
   saveConfiguration();
 }
@@ -975,39 +1775,17 @@ void setupWebServer() {
     delay(100);
   }
   
-  // Основная страница
-  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
-    Serial.println("Root page requested");
-    
-    if (LittleFS.exists("/index.html")) {
-      Serial.println("index.html found");
-      
-      // Проверяем размер файла
-      File file = LittleFS.open("/index.html", "r");
-      if (!file) {
-        Serial.println("Failed to open index.html");
-        request->send(500, "text/plain", "Failed to open file");
-        return;
-      }
-      
-      size_t fileSize = file.size();
-      Serial.printf("File size: %d bytes\n", fileSize);
-      file.close();
-      
-      // Если файл слишком большой, отправляем по частям
-      if (fileSize > 20000) {
-        request->send(LittleFS, "/index.html", "text/html", false);
-      } else {
-        request->send(LittleFS, "/index.html", "text/html");
-      }
-    } else {
-      Serial.println("index.html not found");
-      request->send(200, "text/html", "<html><body><h1>File not found</h1><p>Upload the web interface files to LittleFS</p></body></html>");
-    }
-  });
+  // Веб-интерфейс: сжатые ресурсы из манифеста сборки (ETag, 304)
+  if (webAssets.load()) {
+    webAssets.registerRoutes(server);
+    Serial.printf("Web UI: %u assets\n", (unsigned)webAssets.size());
+  }
   
-  // Обслуживание статических файлов
-  server.serveStatic("/", LittleFS, "/").setDefaultFile("index.html");
+  if (!webAssets.hasRoot()) {
+    server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
+      request->send(200, "text/html", "<html><body><h1>File not found</h1><p>Upload the web interface files to LittleFS</p></body></html>");
+    });
+  }
   
   // Маршрут для проверки статуса сканирования
   server.on("/scan-start", HTTP_GET, [](AsyncWebServerRequest *request){
@@ -1016,9 +1794,11 @@ void setupWebServer() {
       return;
     }
     
-    networks.clear();
+    clearScanNetworks();
+    scanCache.clear();
     isScanningWifi = true;
     scanResultsReady = false;
+    scanFailed = false;
     WiFi.scanNetworks(true, false, false, 300); // Асинхронное сканирование
     request->send(202, "application/json", "{\"status\":\"started\",\"message\":\"Scan started\"}");
   });
@@ -1026,87 +1806,189 @@ void setupWebServer() {
   // Маршрут для проверки статуса сканирования
   server.on("/scan-status", HTTP_GET, [](AsyncWebServerRequest *request){
     if (isScanningWifi) {
-      int scanResult = WiFi.scanComplete();
-      if (scanResult >= 0) {
-        networks.clear();
-        for (int i = 0; i < scanResult; i++) {
-          WiFiResult network;
-          network.ssid = WiFi.SSID(i);
-          network.rssi = WiFi.RSSI(i);
-          network.encryptionType = WiFi.encryptionType(i);
-          network.channel = WiFi.channel(i);
-          networks.push_back(network);
-        }
-        WiFi.scanDelete();
-        isScanningWifi = false;
-        scanResultsReady = true;  // Важно установить этот флаг!
-        request->send(200, "application/json", 
-                     "{\"status\":\"ready\",\"message\":\"Scan complete\",\"count\":" + String(networks.size()) + "}");
-      } else if (scanResult == WIFI_SCAN_RUNNING) {
-        request->send(200, "application/json", "{\"status\":\"scanning\",\"message\":\"Scanning in progress\"}");
-      } else {
-        // Ошибка сканирования
-        WiFi.scanDelete();
-        isScanningWifi = false;
-        scanResultsReady = false;  // При ошибке устанавливаем в false
-        request->send(500, "application/json", "{\"status\":\"error\",\"message\":\"Scan failed\"}");
-      }
+      // Результаты забирает сетевая задача по событию завершения сканирования
+      request->send(200, "application/json", "{\"status\":\"scanning\",\"message\":\"Scanning in progress\"}");
+    } else if (scanFailed) {
+      request->send(500, "application/json", "{\"status\":\"error\",\"message\":\"Scan failed\"}");
     } else if (scanResultsReady) {
       request->send(200, "application/json", 
-                   "{\"status\":\"ready\",\"message\":\"Results available\",\"count\":" + String(networks.size()) + "}");
+                   "{\"status\":\"ready\",\"message\":\"Results available\",\"count\":" + String(scanNetworkCount()) + "}");
     } else {
       request->send(200, "application/json", "{\"status\":\"idle\",\"message\":\"No scan performed\"}");
     }
   });
   
-  // Маршрут для получения результатов сканирования
+  // Результаты сканирования: page/size - страница (size до SCAN_PAGE_MAX),
+  // sort=rssi|channel|ssid|encryption, order=asc|desc, фильтры minRssi=-70,
+  // channel=1,6,11, enc=open,wpa2,... Тело собирается из элементов, готовых
+  // с конца сканирования, и отдается из кэша до следующего
   server.on("/scan-results", HTTP_GET, [](AsyncWebServerRequest *request){
-    if (!scanResultsReady && networks.size() == 0) {
+    ScanQuery query;
+    if (!parseScanQuery(request, query)) {
+      request->send(400, "application/json", "{\"error\":\"Invalid sort or filter\"}");
+      return;
+    }
+    ScanBodyPtr body = scanCache.body(query);
+    if (!body) {
       request->send(404, "application/json", "{\"error\":\"No scan results available\"}");
       return;
     }
     
-    DynamicJsonDocument doc(4096);  // Увеличим размер для большего количества сетей
-    doc["totalNetworks"] = networks.size();
+    AsyncWebServerResponse *response = request->beginResponse("application/json", body->size(),
+      [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        size_t len = min(maxLen, body->size() - index);
+        memcpy(buffer, body->data() + index, len);
+        return len;
+      });
+    response->addHeader("Cache-Control", "no-store");
+    request->send(response);
+  });
+
+  // Обзор эфира: channels=1,6,11 (по умолчанию 1-13), dwell - мс на канале,
+  // home - мс на своем канале между чужими, если есть подключение или AP
+  server.on("/survey/start", HTTP_POST, [](AsyncWebServerRequest *request){
+    std::vector<uint8_t> channels;
+    if (request->hasParam("channels", true)) {
+      String list = request->getParam("channels", true)->value();
+      int from = 0;
+      while (from < (int)list.length()) {
+        int comma = list.indexOf(',', from);
+        if (comma < 0) comma = list.length();
+        int channel = list.substring(from, comma).toInt();
+        if (channel < 1 || channel > SURVEY_MAX_CHANNEL) {
+          request->send(400, "application/json", "{\"error\":\"Invalid channel\"}");
+          return;
+        }
+        channels.push_back(channel);
+        from = comma + 1;
+      }
+    } else {
+      for (uint8_t channel = 1; channel <= 13; channel++) {
+        channels.push_back(channel);
+      }
+    }
+    if (channels.empty()) {
+      request->send(400, "application/json", "{\"error\":\"No channels\"}");
+      return;
+    }
     
-    JsonArray networksArray = doc.createNestedArray("networks");
+    uint32_t dwell = SURVEY_DEFAULT_DWELL_MS;
+    uint32_t home = SURVEY_DEFAULT_HOME_MS;
+    if (request->hasParam("dwell", true)) {
+      dwell = constrain(request->getParam("dwell", true)->value().toInt(), 20, 5000);
+    }
+    if (request->hasParam("home", true)) {
+      home = constrain(request->getParam("home", true)->value().toInt(), 50, 5000);
+    }
     
-    for (int i = 0; i < networks.size(); i++) {
-      JsonObject netObj = networksArray.createNestedObject();
-      netObj["ssid"] = networks[i].ssid;
-      netObj["rssi"] = networks[i].rssi;
-      
-      String encType;
-      switch (networks[i].encryptionType) {
-        case WIFI_AUTH_OPEN: encType = "Open"; break;
-        case WIFI_AUTH_WEP: encType = "WEP"; break;
-        case WIFI_AUTH_WPA_PSK: encType = "WPA-PSK"; break;
-        case WIFI_AUTH_WPA2_PSK: encType = "WPA2-PSK"; break;
-        case WIFI_AUTH_WPA_WPA2_PSK: encType = "WPA/WPA2-PSK"; break;
-        default: encType = "Unknown";
+    if (isSniffing || wifiSurvey.isRunning()) {
+      request->send(409, "application/json", "{\"error\":\"Promiscuous mode is busy\"}");
+      return;
+    }
+    // Каналы переключаются из задачи интерфейса, запускаем там же
+    scheduler.post([channels, dwell, home]() { startSurvey(channels, dwell, home); });
+    request->send(202, "application/json", "{\"status\":\"started\"}");
+  });
+  
+  server.on("/survey/stop", HTTP_POST, [](AsyncWebServerRequest *request){
+    scheduler.post(stopSurvey);
+    request->send(200, "application/json", "{\"success\":true}");
+  });
+  
+  server.on("/survey/clear", HTTP_POST, [](AsyncWebServerRequest *request){
+    wifiSurvey.clear();
+    request->send(200, "application/json", "{\"success\":true}");
+  });
+  
+  server.on("/survey/status", HTTP_GET, [](AsyncWebServerRequest *request){
+    StaticJsonDocument<1536> doc;
+    doc["running"] = wifiSurvey.isRunning();
+    doc["channel"] = wifiSurvey.getChannel();
+    doc["homeChannel"] = wifiSurvey.getHomeChannel();
+    doc["dwellMs"] = wifiSurvey.getDwellMs();
+    doc["hops"] = wifiSurvey.getHops();
+    doc["drops"] = wifiSurvey.getDrops();
+    doc["bssCount"] = wifiSurvey.size();
+    
+    JsonArray channels = doc.createNestedArray("channels");
+    for (uint8_t channel = 1; channel <= SURVEY_MAX_CHANNEL; channel++) {
+      SurveyChannelStats stats = wifiSurvey.channelStats(channel);
+      if (stats.dwellMs == 0 && stats.frames == 0) {
+        continue;
       }
-      netObj["encryption"] = encType;
-      netObj["channel"] = networks[i].channel;
+      JsonObject chObj = channels.createNestedObject();
+      chObj["channel"] = channel;
+      chObj["dwellMs"] = stats.dwellMs;
+      chObj["frames"] = stats.frames;
+      chObj["bytes"] = stats.bytes;
+      // Кадров в секунду за время на канале
+      chObj["fps"] = stats.dwellMs > 0 ? stats.frames * 1000.0f / stats.dwellMs : 0.0f;
+    }
+    sendJson(request, doc);
+  });
+  
+  // Таблица BSS: ?channel= отбирает один канал
+  server.on("/survey/results", HTTP_GET, [](AsyncWebServerRequest *request){
+    int channelFilter = 0;
+    if (request->hasParam("channel")) {
+      channelFilter = request->getParam("channel")->value().toInt();
     }
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    uint32_t now = millis();
+    JsonListWriter list(request, "bss", 64 + wifiSurvey.size() * 256);
+    wifiSurvey.forEach([&](const SurveyBSS& bss) {
+      if (channelFilter > 0 && bss.channel != channelFilter) {
+        return;
+      }
+      StaticJsonDocument<768> obj;
+      char mac[18];
+      formatMAC(bss.bssid, mac);
+      obj["bssid"] = mac;
+      obj["ssid"] = bss.ssid;
+      obj["channel"] = bss.channel;
+      obj["security"] = surveySecurityName(bss.security);
+      obj["beaconIntervalTU"] = bss.beaconInterval;
+      obj["rssi"] = bss.rssiLast;
+      obj["rssiMin"] = bss.rssiMin;
+      obj["rssiAvg"] = bss.rssiAvg();
+      obj["rssiMax"] = bss.rssiMax;
+      obj["beacons"] = bss.beacons;
+      obj["probeResponses"] = bss.probeResponses;
+      obj["dataFrames"] = bss.dataFrames;
+      obj["ageMs"] = now - bss.lastSeen;
+      obj["seenForMs"] = bss.lastSeen - bss.firstSeen;
+      if (bss.utilization != 255) {
+        obj["utilization"] = bss.utilization * 100 / 255;  // %
+      }
+      if (bss.stationCount != 0xFFFF) {
+        obj["stationCount"] = bss.stationCount;
+      }
+      JsonArray clients = obj.createNestedArray("clients");
+      for (uint8_t i = 0; i < bss.clientCount; i++) {
+        char client[18];
+        formatMAC(bss.clients[i], client);
+        clients.add(client);
+      }
+      list.add(obj);
+    });
+    
+    StaticJsonDocument<64> extra;
+    extra["running"] = wifiSurvey.isRunning();
+    list.send(&extra);
   });
-
+  
   // Маршрут для получения сохраненных сетей
   server.on("/wifi/saved", HTTP_GET, [](AsyncWebServerRequest *request){
-    DynamicJsonDocument doc(2048);
-    JsonArray networksArray = doc.createNestedArray("networks");
+    SettingsGuard guard;
+    JsonListWriter list(request, "networks", 32 + savedNetworks.size() * 48);
     
     for (const auto& network : savedNetworks) {
-      JsonObject netObj = networksArray.createNestedObject();
-      netObj["ssid"] = network.ssid;
+      StaticJsonDocument<96> netObj;
+      netObj["ssid"] = network.ssid.c_str();
+      list.add(netObj);
     }
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    list.send();
   });
   
   // Маршрут для подключения к сохраненной сети
@@ -1119,6 +2001,7 @@ void setupWebServer() {
     String ssid = request->getParam("ssid", true)->value();
     
     // Ищем сохраненную сеть
+    SettingsGuard guard;
     for (const auto& network : savedNetworks) {
       if (network.ssid == ssid) {
         WiFi.begin(network.ssid.c_str(), network.password.c_str());
@@ -1140,6 +2023,7 @@ void setupWebServer() {
     String ssid = request->getParam("ssid", true)->value();
     
     // Удаляем сеть из списка
+    SettingsGuard guard;
     for (auto it = savedNetworks.begin(); it != savedNetworks.end(); ++it) {
       if (it->ssid == ssid) {
         savedNetworks.erase(it);
@@ -1154,45 +2038,208 @@ void setupWebServer() {
   
   // Маршрут для управления режимом AP
   server.on("/ap", HTTP_GET, [](AsyncWebServerRequest *request){
-    DynamicJsonDocument doc(512);
+    StaticJsonDocument<256> doc;
+    SettingsGuard guard;
     doc["mode"] = apConfig.mode;
     doc["ssid"] = apConfig.ssid;
     doc["hidden"] = apConfig.hidden;
     doc["channel"] = apConfig.channel;
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    sendJson(request, doc);
   });
   
   // Маршрут для изменения настроек AP
   server.on("/ap/config", HTTP_POST, [](AsyncWebServerRequest *request){
-    if (request->hasParam("mode", true)) {
-      int modeValue = request->getParam("mode", true)->value().toInt();
-      if (modeValue >= AP_MODE_OFF && modeValue <= AP_MODE_HONEYPOT) {
-        apConfig.mode = (APMode)modeValue;
+    {
+      SettingsGuard guard;
+      if (request->hasParam("mode", true)) {
+        int modeValue = request->getParam("mode", true)->value().toInt();
+        if (modeValue >= AP_MODE_OFF && modeValue <= AP_MODE_HONEYPOT) {
+          apConfig.mode = (APMode)modeValue;
+        }
+      }
+      
+      if (request->hasParam("ssid", true)) {
+        apConfig.ssid = request->getParam("ssid", true)->value();
+      }
+      
+      if (request->hasParam("password", true)) {
+        apConfig.password = request->getParam("password", true)->value();
+      }
+      
+      if (request->hasParam("channel", true)) {
+        int channel = request->getParam("channel", true)->value().toInt();
+        if (channel >= 1 && channel <= 13) {
+          apConfig.channel = channel;
+        }
+      }
+      
+      // Параметры ретранслятора
+      if (request->hasParam("naptEntries", true)) {
+        apConfig.naptEntries = constrain(request->getParam("naptEntries", true)->value().toInt(),
+                                         REPEATER_MIN_NAPT_ENTRIES, REPEATER_MAX_NAPT_ENTRIES);
+      }
+      if (request->hasParam("mssClamp", true)) {
+        int mss = request->getParam("mssClamp", true)->value().toInt();
+        apConfig.mssClamp = mss <= 0 ? 0 : constrain(mss, REPEATER_MIN_MSS, 1460);
+      }
+      if (request->hasParam("maxClients", true)) {
+        apConfig.maxClients = constrain(request->getParam("maxClients", true)->value().toInt(),
+                                        1, ESP_WIFI_MAX_CONN_NUM);
       }
     }
     
-    if (request->hasParam("ssid", true)) {
-      apConfig.ssid = request->getParam("ssid", true)->value();
-    }
-    
-    if (request->hasParam("password", true)) {
-      apConfig.password = request->getParam("password", true)->value();
-    }
+    // Применяем новые настройки: AP и службы ловушки переключает задача интерфейса
+    scheduler.post(updateAccessPointMode);
     
-    if (request->hasParam("channel", true)) {
-      int channel = request->getParam("channel", true)->value().toInt();
-      if (channel >= 1 && channel <= 13) {
-        apConfig.channel = channel;
+    request->send(200, "text/plain", "AP settings updated");
+  });
+  
+  // Журнал ловушки постранично, от новых записей к старым.
+  // ?offset=&limit= - страница, ?archive=1 - из журнала на флеше
+  server.on("/ap/honeypot/logs", HTTP_GET, [](AsyncWebServerRequest *request){
+    size_t offset = request->hasParam("offset") ? request->getParam("offset")->value().toInt() : 0;
+    size_t limit = request->hasParam("limit") ? request->getParam("limit")->value().toInt() : 20;
+    limit = constrain(limit, (size_t)1, (size_t)HONEYPOT_PAGE_MAX);
+    bool archive = request->hasParam("archive") && request->getParam("archive")->value() == "1";
+    
+    std::unique_ptr<HoneypotConnection[]> page(new HoneypotConnection[limit]);
+    size_t count = archive ? honeypot.readArchive(offset, page.get(), limit)
+                           : honeypot.getConnections(offset, page.get(), limit);
+    
+    JsonListWriter list(request, "logs", 128 + count * (HONEYPOT_URL_LEN + HONEYPOT_DATA_LEN + 128));
+    for (size_t i = 0; i < count; i++) {
+      const HoneypotConnection& entry = page[i];
+      char ipStr[16];
+      formatIP(IPAddress(entry.clientIP), ipStr);
+      
+      StaticJsonDocument<512> obj;
+      obj["seq"] = entry.seq;
+      obj["ip"] = ipStr;
+      obj["port"] = entry.port;
+      obj["localPort"] = entry.localPort;
+      switch (entry.service) {
+        case HONEYPOT_SVC_HTTP:
+          obj["service"] = "http";
+          obj["method"] = httpMethodName(entry.method);
+          break;
+        case HONEYPOT_SVC_DNS: obj["service"] = "dns"; break;
+        default: obj["service"] = "tcp"; break;
+      }
+      obj["timestamp"] = entry.timestamp;
+      obj["url"] = entry.url;
+      obj["data"] = entry.data;
+      obj["truncated"] = entry.truncated != 0;
+      list.add(obj);
+    }
+    
+    StaticJsonDocument<128> extra;
+    extra["offset"] = offset;
+    extra["limit"] = limit;
+    extra["total"] = archive ? honeypot.getArchivedCount() : honeypot.getStoredCount();
+    extra["connections"] = honeypot.getConnectionCount();
+    list.send(&extra);
+  });
+  
+  // Службы ловушки: DNS захваченного портала и слушаемые TCP-порты
+  server.on("/ap/honeypot/config", HTTP_GET, [](AsyncWebServerRequest *request){
+    StaticJsonDocument<512> doc;
+    doc["dns"] = honeypotServices.dns;
+    doc["captureBytes"] = honeypotServices.captureBytes;
+    JsonArray ports = doc.createNestedArray("ports");
+    for (uint8_t i = 0; i < honeypotServices.portCount; i++) {
+      ports.add(honeypotServices.ports[i]);
+    }
+    doc["dnsRunning"] = honeypotDNS.isRunning();
+    doc["dnsQueries"] = honeypotDNS.getQueries();
+    doc["listening"] = honeypotListener.getPortCount();
+    doc["sessions"] = honeypotListener.getSessions();
+    doc["accepted"] = honeypotListener.getAccepted();
+    doc["rejected"] = honeypotListener.getRejected();
+    sendJson(request, doc);
+  });
+  
+  // ports=23,22,21 - список портов, dns=0|1, capture - сохраняемые байты сессии
+  server.on("/ap/honeypot/config", HTTP_POST, [](AsyncWebServerRequest *request){
+    HoneypotServiceConfig config = honeypotServices;
+    if (request->hasParam("dns", true)) {
+      config.dns = request->getParam("dns", true)->value() == "1";
+    }
+    if (request->hasParam("capture", true)) {
+      config.captureBytes = constrain(request->getParam("capture", true)->value().toInt(),
+                                      1, HONEYPOT_DATA_LEN - 1);
+    }
+    if (request->hasParam("ports", true)) {
+      String list = request->getParam("ports", true)->value();
+      config.portCount = 0;
+      int start = 0;
+      while (start < (int)list.length()) {
+        int comma = list.indexOf(',', start);
+        if (comma < 0) comma = list.length();
+        long port = list.substring(start, comma).toInt();
+        if (port <= 0 || port > 65535 || config.portCount >= HONEYPOT_MAX_PORTS) {
+          request->send(400, "application/json", "{\"error\":\"Invalid ports\"}");
+          return;
+        }
+        config.ports[config.portCount++] = port;
+        start = comma + 1;
       }
     }
     
-    // Применяем новые настройки
-    updateAccessPointMode();
-    
-    request->send(200, "text/plain", "AP settings updated");
+    honeypotServices = config;
+    saveHoneypotServices();
+    // Слушатели пересоздаются из задачи интерфейса, не из задачи веб-сервера
+    if (apConfig.mode == AP_MODE_HONEYPOT) {
+      scheduler.post(startHoneypotServices);
+    }
+    request->send(200, "application/json", "{\"success\":true}");
+  });
+  
+  // Очистка журнала ловушки; archive=1 - вместе с журналом на флеше
+  server.on("/ap/honeypot/logs/clear", HTTP_POST, [](AsyncWebServerRequest *request){
+    honeypot.clearConnections();
+    if (request->hasParam("archive", true) && request->getParam("archive", true)->value() == "1") {
+      honeypot.clearArchive();
+    }
+    request->send(200, "application/json", "{\"success\":true}");
+  });
+  
+  // Пересылка ретранслятора: NAPT, MSS и счетчики клиентов
+  server.on("/ap/repeater/stats", HTTP_GET, [](AsyncWebServerRequest *request){
+    DynamicJsonDocument doc(2048);
+    doc["active"] = RepeaterPath::isActive();
+    doc["mssClamp"] = RepeaterPath::getMSSClamp();
+    doc["clampedSyns"] = RepeaterPath::getClamped();
+    
+    RepeaterNaptUsage usage = RepeaterPath::getNaptUsage();
+    JsonObject napt = doc.createNestedObject("napt");
+    napt["entries"] = RepeaterPath::getNaptEntries();
+    napt["configuredEntries"] = apConfig.naptEntries;  // Вступит в силу после перезагрузки
+    napt["tracking"] = RepeaterPath::isTracking();      // false - таблица потоков не выделена
+    napt["tcp"] = usage.tcp;
+    napt["udp"] = usage.udp;
+    napt["icmp"] = usage.icmp;
+    napt["used"] = usage.tcp + usage.udp + usage.icmp;
+    napt["evictions"] = RepeaterPath::getEvictions();
+    
+    RepeaterClientStats clients[REPEATER_MAX_TRACKED_CLIENTS];
+    uint8_t count = RepeaterPath::getClients(clients, REPEATER_MAX_TRACKED_CLIENTS);
+    JsonArray clientsArray = doc.createNestedArray("clients");
+    for (uint8_t i = 0; i < count; i++) {
+      JsonObject obj = clientsArray.createNestedObject();
+      char mac[18];
+      formatMAC(clients[i].mac, mac);
+      obj["mac"] = mac;
+      obj["upPackets"] = clients[i].upPackets;
+      obj["upBytes"] = clients[i].upBytes;
+      obj["downPackets"] = clients[i].downPackets;
+      obj["downBytes"] = clients[i].downBytes;
+      obj["drops"] = clients[i].drops;
+    }
+    
+    doc["maxClients"] = apConfig.maxClients;
+    doc["freeHeap"] = ESP.getFreeHeap();
+    sendJson(request, doc);
   });
   
   // Маршрут для подключения к сети
@@ -1210,6 +2257,7 @@ void setupWebServer() {
     }
     
     // Сохраняем сеть
+    SettingsGuard guard;
     bool found = false;
     for (auto& network : savedNetworks) {
       if (network.ssid == ssid) {
@@ -1238,24 +2286,24 @@ void setupWebServer() {
   // Маршрут для управления GPIO (KVM)
   server.on("/kvm", HTTP_GET, [](AsyncWebServerRequest *request){
     // Формирование JSON с состоянием пинов
-    DynamicJsonDocument doc(2048);
-    JsonArray pinsArray = doc.createNestedArray("pins");
+    std::vector<EnhancedPinConfig> pins = kvmModule.getPins();
+    JsonListWriter list(request, "pins", 64 + pins.size() * 80);
     
-    const auto& pins = kvmModule.getPins();
     for (const auto& pin : pins) {
-      JsonObject pinObj = pinsArray.createNestedObject();
+      StaticJsonDocument<128> pinObj;
       pinObj["pin"] = pin.pin;
-      pinObj["name"] = pin.name;
+      pinObj["name"] = pin.name.c_str();
       pinObj["state"] = pin.state;
       pinObj["monitorMode"] = pin.monitorMode;
+      list.add(pinObj);
     }
     
-    doc["connectionCheck"] = (int)kvmModule.getCheckInterval();
-    doc["useDHCP"] = kvmModule.getUseDHCP();
-    
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    StaticJsonDocument<128> extra;
+    extra["connectionCheck"] = (int)kvmModule.getCheckInterval();
+    extra["useDHCP"] = kvmModule.getUseDHCP();
+    extra["edgeDebounceUs"] = pinEdges.getDebounceUs();
+    extra["edgeGlitchUs"] = pinEdges.getGlitchUs();
+    list.send(&extra);
   });
   
   // Маршрут для управления состоянием пина
@@ -1266,7 +2314,7 @@ void setupWebServer() {
     }
     
     int pinIndex = request->getParam("index", true)->value().toInt();
-    const auto& pins = kvmModule.getPins();
+    std::vector<EnhancedPinConfig> pins = kvmModule.getPins();
     
     // Проверяем, существует ли такой пин
     if (pinIndex >= 0 && pinIndex < pins.size()) {
@@ -1296,13 +2344,12 @@ void setupWebServer() {
   
   // API для получения доступных пинов
   server.on("/api/kvm/available-pins", HTTP_GET, [](AsyncWebServerRequest *request){
-    DynamicJsonDocument doc(2048);
-    JsonArray pinsArray = doc.createNestedArray("pins");
+    JsonListWriter list(request, "pins", 32 + AVAILABLE_PINS_COUNT * 128);
     
-    const auto& usedPins = kvmModule.getPins();
+    std::vector<EnhancedPinConfig> usedPins = kvmModule.getPins();
     
-    for (int i = 0; i < AVAILABLE_PINS_COUNT; i++) {
-      JsonObject pinObj = pinsArray.createNestedObject();
+    for (size_t i = 0; i < AVAILABLE_PINS_COUNT; i++) {
+      StaticJsonDocument<192> pinObj;
       pinObj["pin"] = AVAILABLE_PINS[i].pin;
       pinObj["name"] = AVAILABLE_PINS[i].name;
       pinObj["description"] = AVAILABLE_PINS[i].description;
@@ -1316,11 +2363,10 @@ void setupWebServer() {
         }
       }
       pinObj["inUse"] = inUse;
+      list.add(pinObj);
     }
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    list.send();
   });
   
   // API для управления через curl
@@ -1356,7 +2402,7 @@ void setupWebServer() {
       return;
     }
     
-    const auto& pins = kvmModule.getPins();
+    std::vector<EnhancedPinConfig> pins = kvmModule.getPins();
     
     if (pinIndex >= 0 && pinIndex < pins.size()) {
       if (hasState) {
@@ -1365,14 +2411,12 @@ void setupWebServer() {
         kvmModule.togglePin(pinIndex);
       }
       
-      DynamicJsonDocument doc(256);
+      StaticJsonDocument<128> doc;
       doc["success"] = true;
       doc["pin"] = pins[pinIndex].pin;
       doc["state"] = pins[pinIndex].state;
       
-      String response;
-      serializeJson(doc, response);
-      request->send(200, "application/json", response);
+      sendJson(request, doc);
     } else {
       request->send(404, "application/json", "{\"error\":\"Pin not found\"}");
     }
@@ -1386,7 +2430,7 @@ void setupWebServer() {
     }
     
     int pinIndex = request->getParam("index")->value().toInt();
-    const auto& pins = kvmModule.getPins();
+    std::vector<EnhancedPinConfig> pins = kvmModule.getPins();
     
     if (pinIndex >= 0 && pinIndex < pins.size()) {
       bool hasState = request->hasParam("state");
@@ -1399,14 +2443,12 @@ void setupWebServer() {
         kvmModule.togglePin(pinIndex);
       }
       
-      DynamicJsonDocument doc(256);
+      StaticJsonDocument<128> doc;
       doc["success"] = true;
       doc["pin"] = pins[pinIndex].pin;
       doc["state"] = pins[pinIndex].state;
       
-      String response;
-      serializeJson(doc, response);
-      request->send(200, "application/json", response);
+      sendJson(request, doc);
     } else {
       request->send(404, "application/json", "{\"error\":\"Pin not found\"}");
     }
@@ -1428,63 +2470,332 @@ void setupWebServer() {
       if (duration > 10000) duration = 10000;
     }
     
-    const auto& pins = kvmModule.getPins();
+    std::vector<EnhancedPinConfig> pins = kvmModule.getPins();
     
     if (pinIndex >= 0 && pinIndex < pins.size()) {
       kvmModule.pulsePin(pinIndex, duration);
       
-      DynamicJsonDocument doc(256);
+      StaticJsonDocument<128> doc;
       doc["success"] = true;
       doc["pin"] = pins[pinIndex].pin;
       doc["duration"] = duration;
       
-      String response;
-      serializeJson(doc, response);
-      request->send(200, "application/json", response);
+      sendJson(request, doc);
     } else {
       request->send(404, "application/json", "{\"error\":\"Pin not found\"}");
     }
   });
   
-  // Маршрут для добавления нового пина
-  server.on("/kvm/add", HTTP_POST, [](AsyncWebServerRequest *request){
-    if (!request->hasParam("pin", true) || !request->hasParam("name", true)) {
-      request->send(400, "text/plain", "Missing pin or name parameter");
+  // Сценарии KVM. Подмаршруты регистрируются раньше /api/kvm/sequence
+  server.on("/api/kvm/sequence/run", HTTP_POST, [](AsyncWebServerRequest *request){
+    // Сохраненный сценарий по имени или разовый из параметра steps
+    KVMSequence adhoc;
+    const KVMSequence* sequence = nullptr;
+    if (request->hasParam("steps", true)) {
+      String error;
+      if (!parseSequenceRequest(request, adhoc, error)) {
+        request->send(400, "application/json", "{\"error\":\"" + error + "\"}");
+        return;
+      }
+      sequence = &adhoc;
+    } else if (request->hasParam("name", true)) {
+      sequence = kvmModule.findSequence(request->getParam("name", true)->value());
+      if (!sequence) {
+        request->send(404, "application/json", "{\"error\":\"Sequence not found\"}");
+        return;
+      }
+    } else {
+      request->send(400, "application/json", "{\"error\":\"Missing name or steps parameter\"}");
       return;
     }
     
-    int pin = request->getParam("pin", true)->value().toInt();
-    String name = request->getParam("name", true)->value();
-    
-    // Добавляем новый пин
-    if (kvmModule.addPin(pin, name)) {
-      request->send(200, "text/plain", "Pin added successfully");
-    } else {
-      request->send(400, "text/plain", "Pin already configured");
+    if (!kvmModule.runSequence(*sequence)) {
+      request->send(409, "application/json", "{\"error\":\"Another sequence is running\"}");
+      return;
     }
+    
+    const auto& sequencer = kvmModule.getSequencer();
+    StaticJsonDocument<128> doc;
+    doc["success"] = true;
+    doc["name"] = sequencer.getCurrentName().c_str();
+    doc["totalUs"] = sequencer.getTotalUs();
+    sendJson(request, doc);
   });
   
-  // Маршрут для настройки интервала проверки соединения
-  server.on("/kvm/connectioncheck", HTTP_POST, [](AsyncWebServerRequest *request){
-    if (request->hasParam("interval", true)) {
-      int interval = request->getParam("interval", true)->value().toInt();
-      if (interval >= CHECK_OFF && interval <= CHECK_30MIN) {
-        kvmModule.setCheckInterval((ConnectionCheckInterval)interval);
-        request->send(200, "text/plain", "Connection check interval updated");
-        return;
-      }
-    }
-    request->send(400, "text/plain", "Invalid interval parameter");
+  server.on("/api/kvm/sequence/stop", HTTP_POST, [](AsyncWebServerRequest *request){
+    bool stopped = kvmModule.stopSequence();
+    StaticJsonDocument<64> doc;
+    doc["success"] = stopped;
+    sendJson(request, doc, stopped ? 200 : 409);
   });
   
-  // Маршрут для диагностики сети
-  server.on("/diagnostic", HTTP_GET, [](AsyncWebServerRequest *request){
-    performNetworkDiagnostics();
+  server.on("/api/kvm/sequence/delete", HTTP_POST, [](AsyncWebServerRequest *request){
+    if (!request->hasParam("name", true)) {
+      request->send(400, "application/json", "{\"error\":\"Missing name parameter\"}");
+      return;
+    }
+    if (!kvmModule.deleteSequence(request->getParam("name", true)->value())) {
+      request->send(404, "application/json", "{\"error\":\"Sequence not found\"}");
+      return;
+    }
+    request->send(200, "application/json", "{\"success\":true}");
+  });
+  
+  // Сохранение сценария: name, steps=[{"index":0,"hold":5000},{"wait":2000},...]
+  server.on("/api/kvm/sequence", HTTP_POST, [](AsyncWebServerRequest *request){
+    KVMSequence sequence;
+    String error;
+    if (!parseSequenceRequest(request, sequence, error)) {
+      request->send(400, "application/json", "{\"error\":\"" + error + "\"}");
+      return;
+    }
+    if (sequence.name.length() == 0) {
+      request->send(400, "application/json", "{\"error\":\"Missing name parameter\"}");
+      return;
+    }
+    if (!kvmModule.saveSequence(sequence)) {
+      request->send(507, "application/json", "{\"error\":\"Too many sequences\"}");
+      return;
+    }
+    request->send(200, "application/json", "{\"success\":true}");
+  });
+  
+  // Список сценариев и состояние воспроизведения
+  server.on("/api/kvm/sequence", HTTP_GET, [](AsyncWebServerRequest *request){
+    const auto& sequences = kvmModule.getSequences();
+    JsonListWriter list(request, "sequences", 256 + sequences.size() * 512);
+    
+    for (const auto& sequence : sequences) {
+      StaticJsonDocument<1536> seqObj;
+      seqObj["name"] = sequence.name.c_str();
+      JsonArray stepsArray = seqObj.createNestedArray("steps");
+      for (const auto& step : sequence.steps) {
+        sequenceStepToJson(step, stepsArray.createNestedObject());
+      }
+      list.add(seqObj);
+    }
+    
+    const auto& sequencer = kvmModule.getSequencer();
+    StaticJsonDocument<192> extra;
+    extra["running"] = sequencer.isRunning();
+    if (sequencer.isRunning()) {
+      extra["current"] = sequencer.getCurrentName().c_str();
+      extra["progress"] = sequencer.getProgress();
+      extra["length"] = sequencer.getLength();
+      extra["elapsedUs"] = sequencer.getElapsedUs();
+      extra["totalUs"] = sequencer.getTotalUs();
+    }
+    extra["maxLateUs"] = sequencer.getMaxLateUs();
+    extra["runs"] = sequencer.getRuns();
+    list.send(&extra);
+  });
+  
+  // Настройка фильтрации фронтов (регистрируется раньше /api/kvm/edges)
+  server.on("/api/kvm/edges/config", HTTP_POST, [](AsyncWebServerRequest *request){
+    uint32_t debounce = pinEdges.getDebounceUs();
+    uint32_t glitch = pinEdges.getGlitchUs();
+    if (request->hasParam("debounce", true)) {
+      debounce = constrain(request->getParam("debounce", true)->value().toInt(), 0, 1000000);
+    }
+    if (request->hasParam("glitch", true)) {
+      glitch = constrain(request->getParam("glitch", true)->value().toInt(), 0, 1000000);
+    }
+    kvmModule.setEdgeFilter(debounce, glitch);
     
-    const auto& networkInfo = deviceManager.getNetworkInfo();
-    const auto& sensorData = deviceManager.getSensorData();
+    StaticJsonDocument<96> doc;
+    doc["success"] = true;
+    doc["debounceUs"] = debounce;
+    doc["glitchUs"] = glitch;
+    sendJson(request, doc);
+  });
+  
+  // Фронты отслеживаемого пина: /api/kvm/edges?index=0&since=<seq>
+  server.on("/api/kvm/edges", HTTP_GET, [](AsyncWebServerRequest *request){
+    if (!request->hasParam("index")) {
+      request->send(400, "application/json", "{\"error\":\"Missing pin index parameter\"}");
+      return;
+    }
     
-    DynamicJsonDocument doc(1024);
+    int pinIndex = request->getParam("index")->value().toInt();
+    std::vector<EnhancedPinConfig> pins = kvmModule.getPins();
+    if (pinIndex < 0 || pinIndex >= pins.size()) {
+      request->send(404, "application/json", "{\"error\":\"Pin not found\"}");
+      return;
+    }
+    
+    int gpio = pins[pinIndex].pin;
+    if (!pinEdges.isAttached(gpio)) {
+      request->send(409, "application/json", "{\"error\":\"Pin monitoring is off\"}");
+      return;
+    }
+    
+    uint32_t since = 0;
+    if (request->hasParam("since")) {
+      since = strtoul(request->getParam("since")->value().c_str(), nullptr, 10);
+    }
+    
+    PinEdge edges[PIN_EDGE_RING_SIZE];
+    uint32_t first = 0;
+    uint32_t dropped = 0;
+    size_t count = pinEdges.read(gpio, since, edges, PIN_EDGE_RING_SIZE, &first, &dropped);
+    
+    JsonListWriter list(request, "edges", 192 + count * 72);
+    for (size_t i = 0; i < count; i++) {
+      StaticJsonDocument<128> edgeObj;
+      edgeObj["seq"] = first + i;
+      edgeObj["t"] = edges[i].timeUs;
+      edgeObj["level"] = edges[i].level;
+      if (edges[i].flags & PIN_EDGE_GLITCH) {
+        edgeObj["glitch"] = true;
+        edgeObj["width"] = edges[i].widthUs;
+      }
+      if (edges[i].flags & PIN_EDGE_SETTLED) {
+        edgeObj["settled"] = true;
+      }
+      list.add(edgeObj);
+    }
+    
+    uint32_t bounces = 0;
+    uint32_t glitches = 0;
+    pinEdges.getStats(gpio, bounces, glitches);
+    
+    StaticJsonDocument<192> extra;
+    extra["pin"] = gpio;
+    extra["next"] = first + count;
+    extra["dropped"] = dropped;
+    extra["bounces"] = bounces;
+    extra["glitches"] = glitches;
+    extra["now"] = (uint64_t)esp_timer_get_time();
+    list.send(&extra);
+  });
+  
+  // Логический анализатор на KVM пинах
+  server.on("/api/la/arm", HTTP_POST, [](AsyncWebServerRequest *request){
+    LAConfig config;
+    String error;
+    if (!parseLogicRequest(request, config, error)) {
+      request->send(400, "application/json", "{\"error\":\"" + error + "\"}");
+      return;
+    }
+    if (!logicAnalyzer.arm(config, error)) {
+      request->send(409, "application/json", "{\"error\":\"" + error + "\"}");
+      return;
+    }
+    
+    const LAConfig& armed = logicAnalyzer.getConfig();
+    StaticJsonDocument<128> doc;
+    doc["success"] = true;
+    doc["rate"] = armed.rate;
+    doc["samples"] = armed.samples;
+    doc["timeoutMs"] = armed.timeoutMs;
+    sendJson(request, doc);
+  });
+  
+  server.on("/api/la/cancel", HTTP_POST, [](AsyncWebServerRequest *request){
+    bool busy = logicAnalyzer.isBusy();
+    logicAnalyzer.cancel();
+    StaticJsonDocument<64> doc;
+    doc["success"] = busy;
+    sendJson(request, doc, busy ? 200 : 409);
+  });
+  
+  server.on("/api/la/status", HTTP_GET, [](AsyncWebServerRequest *request){
+    const LAConfig& config = logicAnalyzer.getConfig();
+    StaticJsonDocument<768> doc;
+    doc["state"] = laStateName(logicAnalyzer.getState());
+    doc["capacity"] = logicAnalyzer.getCapacity();
+    doc["psram"] = logicAnalyzer.isInPsram();
+    doc["maxRate"] = LA_MAX_RATE;
+    if (config.channels > 0) {
+      JsonArray channels = doc.createNestedArray("channels");
+      for (uint8_t ch = 0; ch < config.channels; ch++) {
+        JsonObject chObj = channels.createNestedObject();
+        chObj["gpio"] = config.gpio[ch];
+        chObj["name"] = config.names[ch].c_str();
+      }
+      doc["rate"] = config.rate;
+      doc["samples"] = config.samples;
+    }
+    if (logicAnalyzer.hasData()) {
+      doc["count"] = logicAnalyzer.getCount();
+      doc["triggered"] = logicAnalyzer.isTriggered();
+      doc["triggerIndex"] = logicAnalyzer.getTriggerIndex();
+      doc["actualRate"] = logicAnalyzer.getActualRate();
+      doc["overruns"] = logicAnalyzer.getOverruns();
+      doc["irqOff"] = logicAnalyzer.wasIrqOff();
+      if (logicAnalyzer.isTriggered()) {
+        doc["triggerDelayUs"] = logicAnalyzer.getTriggeredAtUs() - logicAnalyzer.getArmedAtUs();
+      }
+    }
+    sendJson(request, doc);
+  });
+  
+  // Данные захвата: format=vcd (по умолчанию) или bin (sigrok binary, 1 байт на выборку)
+  server.on("/api/la/data", HTTP_GET, [](AsyncWebServerRequest *request){
+    if (!logicAnalyzer.hasData()) {
+      request->send(logicAnalyzer.isBusy() ? 409 : 404, "application/json",
+                    "{\"error\":\"No capture available\"}");
+      return;
+    }
+    
+    bool vcd = !request->hasParam("format") || request->getParam("format")->value() != "bin";
+    std::shared_ptr<LogicStreamer> streamer = std::make_shared<LogicStreamer>(logicAnalyzer, vcd);
+    auto filler = [streamer](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      return streamer->fill(buffer, maxLen);
+    };
+    
+    AsyncWebServerResponse *response = vcd
+      ? request->beginChunkedResponse("text/plain", filler)
+      : request->beginResponse("application/octet-stream", logicAnalyzer.getCount(), filler);
+    response->addHeader("Content-Disposition", vcd ? "attachment; filename=\"capture.vcd\""
+                                                   : "attachment; filename=\"capture.bin\"");
+    response->addHeader("Cache-Control", "no-store");
+    request->send(response);
+  });
+  
+  // Маршрут для добавления нового пина
+  server.on("/kvm/add", HTTP_POST, [](AsyncWebServerRequest *request){
+    if (!request->hasParam("pin", true) || !request->hasParam("name", true)) {
+      request->send(400, "text/plain", "Missing pin or name parameter");
+      return;
+    }
+    
+    int pin = request->getParam("pin", true)->value().toInt();
+    String name = request->getParam("name", true)->value();
+    if (!isAvailablePin(pin)) {
+      request->send(400, "text/plain", "Pin is not available");
+      return;
+    }
+    
+    // Добавляем новый пин
+    if (kvmModule.addPin(pin, name)) {
+      request->send(200, "text/plain", "Pin added successfully");
+    } else {
+      request->send(400, "text/plain", "Pin already configured");
+    }
+  });
+  
+  // Маршрут для настройки интервала проверки соединения
+  server.on("/kvm/connectioncheck", HTTP_POST, [](AsyncWebServerRequest *request){
+    if (request->hasParam("interval", true)) {
+      int interval = request->getParam("interval", true)->value().toInt();
+      if (interval >= CHECK_OFF && interval <= CHECK_30MIN) {
+        kvmModule.setCheckInterval((ConnectionCheckInterval)interval);
+        request->send(200, "text/plain", "Connection check interval updated");
+        return;
+      }
+    }
+    request->send(400, "text/plain", "Invalid interval parameter");
+  });
+  
+  // Маршрут для диагностики сети
+  server.on("/diagnostic", HTTP_GET, [](AsyncWebServerRequest *request){
+    performNetworkDiagnostics();
+    
+    NetworkInfo networkInfo = deviceManager.getNetworkInfo();
+    SensorData sensorData = deviceManager.getSensorData();
+    
+    StaticJsonDocument<768> doc;
     doc["connected"] = networkInfo.connected;
     doc["ssid"] = networkInfo.ssid;
     doc["rssi"] = networkInfo.rssi;
@@ -1496,7 +2807,10 @@ void setupWebServer() {
     // Дополнительная информация о точке доступа
     if (apConfig.mode != AP_MODE_OFF) {
       doc["ap_mode"] = apConfig.mode;
-      doc["ap_ssid"] = apConfig.ssid;
+      {
+        SettingsGuard guard;
+        doc["ap_ssid"] = apConfig.ssid;
+      }
       doc["ap_ip"] = WiFi.softAPIP().toString();
       doc["ap_stations"] = WiFi.softAPgetStationNum();
     }
@@ -1504,9 +2818,7 @@ void setupWebServer() {
     // Информация об устройстве
     doc["battery"] = sensorData.batteryVoltage;
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    sendJson(request, doc);
   });
   
   // API для поиска устройства (Find Me)
@@ -1519,22 +2831,142 @@ void setupWebServer() {
   // Маршрут для перезагрузки устройства
   server.on("/device/reset", HTTP_POST, [](AsyncWebServerRequest *request){
     request->send(200, "text/plain", "Device will restart");
-    delay(1000);
-    ESP.restart();
+    // Перезагрузка из задачи интерфейса, когда ответ уже отправлен
+    scheduler.after(1000, []() {
+      configStore.commit();
+      honeypot.flush(true);
+      ESP.restart();
+    });
+  });
+  
+  // Экспорт всех настроек одним JSON-документом
+  server.on("/config/export", HTTP_GET, [](AsyncWebServerRequest *request){
+    DynamicJsonDocument doc(16384);
+    configurationToJson(doc.createNestedObject("config"));
+    deviceSettingsToJson(doc.createNestedObject("device"));
+    savedNetworksToJson(doc.createNestedObject("networks"));
+    kvmModule.exportConfig(doc.createNestedObject("kvm"));
+    
+    JsonObject storeObj = doc.createNestedObject("store");
+    storeObj["records"] = configStore.recordCount();
+    storeObj["commits"] = configStore.getCommits();
+    storeObj["coalesced"] = configStore.getCoalesced();
+    storeObj["lastCommitUs"] = configStore.getLastCommitUs();
+    sendJson(request, doc);
+  });
+  
+  // Импорт настроек: параметр config - документ в формате /config/export.
+  // Отсутствующие разделы не меняются, настройки AP применятся после перезагрузки
+  server.on("/config/import", HTTP_POST, [](AsyncWebServerRequest *request){
+    if (!request->hasParam("config", true)) {
+      request->send(400, "text/plain", "Missing config parameter");
+      return;
+    }
+    
+    DynamicJsonDocument doc(16384);
+    DeserializationError error = deserializeJson(doc, request->getParam("config", true)->value());
+    if (error) {
+      request->send(400, "text/plain", String("Invalid JSON: ") + error.c_str());
+      return;
+    }
+    
+    // Пины проверяются до применения любого раздела
+    if (doc.containsKey("kvm") && !KVMModule::pinsValid(doc["kvm"])) {
+      request->send(400, "text/plain", "Invalid KVM pin");
+      return;
+    }
+    
+    StaticJsonDocument<256> result;
+    JsonArray sections = result.createNestedArray("imported");
+    if (doc.containsKey("config")) {
+      configurationFromJson(doc["config"]);
+      saveConfiguration();
+      sections.add("config");
+    }
+    if (doc.containsKey("device")) {
+      deviceSettingsFromJson(doc["device"]);
+      globalDeviceSettings = deviceSettings;
+      // Экраном и питанием владеет задача интерфейса
+      uint8_t brightness = deviceSettings.brightness;
+      bool rotateDisplay = deviceSettings.rotateDisplay;
+      scheduler.post([brightness, rotateDisplay]() {
+        powerManager.setBrightness(brightness);
+        M5.Lcd.setRotation(rotateDisplay ? 1 : 3);
+        lcdRenderer.invalidate();
+      });
+      saveDeviceSettings();
+      sections.add("device");
+    }
+    if (doc.containsKey("networks")) {
+      savedNetworksFromJson(doc["networks"]);
+      saveSavedNetworks();
+      sections.add("networks");
+    }
+    if (doc.containsKey("kvm")) {
+      kvmModule.importConfig(doc["kvm"]);
+      sections.add("kvm");
+    }
+    
+    // Импорт - редкая операция, сохраняем сразу
+    result["success"] = configStore.commit();
+    sendJson(request, result);
+  });
+  
+  // Фазы последней загрузки (регистрируется раньше /device)
+  server.on("/device/boot", HTTP_GET, [](AsyncWebServerRequest *request){
+    StaticJsonDocument<1024> doc;
+    doc["usableMs"] = bootProfile.getUsableMs();
+    doc["totalMs"] = bootProfile.getTotalMs();
+    JsonArray phases = doc.createNestedArray("phases");
+    for (uint8_t i = 0; i < bootProfile.size(); i++) {
+      JsonObject phase = phases.createNestedObject();
+      phase["name"] = bootProfile.at(i).name;
+      phase["ms"] = bootProfile.at(i).atMs;
+    }
+    sendJson(request, doc);
+  });
+  
+  // История датчиков (регистрируется раньше /device):
+  // /device/history?resolution=1|60|600&since=<секунды с загрузки>
+  server.on("/device/history", HTTP_GET, [](AsyncWebServerRequest *request){
+    HistoryTier tier = HISTORY_TIER_MINUTE;
+    if (request->hasParam("resolution")) {
+      int resolution = request->getParam("resolution")->value().toInt();
+      if (resolution == 1) {
+        tier = HISTORY_TIER_RAW;
+      } else if (resolution == 600) {
+        tier = HISTORY_TIER_TEN_MINUTES;
+      } else if (resolution != 60) {
+        request->send(400, "application/json", "{\"error\":\"Resolution must be 1, 60 or 600\"}");
+        return;
+      }
+    }
+    uint32_t since = 0;
+    if (request->hasParam("since")) {
+      since = strtoul(request->getParam("since")->value().c_str(), nullptr, 10);
+    }
+    
+    uint32_t now = esp_timer_get_time() / 1000000;
+    std::shared_ptr<HistoryStreamer> streamer =
+      std::make_shared<HistoryStreamer>(deviceManager.getSensorHistory(), tier, since, now);
+    AsyncWebServerResponse *response = request->beginChunkedResponse("application/json",
+      [streamer](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        return streamer->fill(buffer, maxLen);
+      });
+    response->addHeader("Cache-Control", "no-store");
+    request->send(response);
   });
   
   // Маршрут для получения настроек устройства
   server.on("/device", HTTP_GET, [](AsyncWebServerRequest *request){
-    DynamicJsonDocument doc(512);
+    StaticJsonDocument<256> doc;
     doc["brightness"] = deviceSettings.brightness;
     doc["sleepTimeout"] = deviceSettings.sleepTimeout;
     doc["deviceId"] = deviceSettings.deviceId;
     doc["rotateDisplay"] = deviceSettings.rotateDisplay;
     doc["volume"] = deviceSettings.volume;
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    sendJson(request, doc);
   });
   
   // Маршрут для изменения настроек устройства
@@ -1544,7 +2976,8 @@ void setupWebServer() {
       if (brightness >= 0 && brightness <= 100) {
         deviceSettings.brightness = brightness;
         globalDeviceSettings.brightness = brightness;
-        M5.Lcd.setBrightness(brightness);
+        // Экраном и питанием владеет задача интерфейса
+        scheduler.post([brightness]() { powerManager.setBrightness(brightness); });
       }
     }
     
@@ -1564,8 +2997,11 @@ void setupWebServer() {
                           request->getParam("rotateDisplay", true)->value() == "1");
       if (deviceSettings.rotateDisplay != rotateDisplay) {
         deviceSettings.rotateDisplay = rotateDisplay;
-        M5.Lcd.setRotation(rotateDisplay ? 1 : 3);
-        drawMenu();
+        scheduler.post([rotateDisplay]() {
+          M5.Lcd.setRotation(rotateDisplay ? 1 : 3);
+          lcdRenderer.invalidate();
+          drawMenu();
+        });
       }
     }
     
@@ -1585,12 +3021,10 @@ void setupWebServer() {
   
   // Маршрут для получения настроек инвертирования пинов
   server.on("/settings/pin-inversion", HTTP_GET, [](AsyncWebServerRequest *request){
-    DynamicJsonDocument doc(256);
+    StaticJsonDocument<64> doc;
     doc["inverted"] = deviceSettings.invertPins;
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    sendJson(request, doc);
   });
   
   // Маршрут для изменения настроек инвертирования пинов
@@ -1610,16 +3044,15 @@ void setupWebServer() {
       // При изменении инверсии нет необходимости менять физическое состояние пинов
     }
     
-    DynamicJsonDocument doc(256);
+    StaticJsonDocument<64> doc;
     doc["success"] = true;
     doc["inverted"] = deviceSettings.invertPins;
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    sendJson(request, doc);
   });
   
-  // Маршрут для сетевых инструментов - Ping
+  // Маршрут для сетевых инструментов - Ping.
+  // Выполняется как задание, результат - /jobs/{id}
   server.on("/network/ping", HTTP_POST, [](AsyncWebServerRequest *request){
     if (!request->hasParam("host", true)) {
       request->send(400, "application/json", "{\"error\":\"Missing host parameter\"}");
@@ -1627,25 +3060,71 @@ void setupWebServer() {
     }
     
     String host = request->getParam("host", true)->value();
-    PingResult result = networkTools.ping(host);
+    int count = 4;
+    if (request->hasParam("count", true)) {
+      count = constrain(request->getParam("count", true)->value().toInt(), 1, 20);
+    }
+    
+    uint32_t jobId = jobScheduler.submit("ping", [host, count](Job& job){
+      job.setProgress(0, 1);
+      PingResult result = networkTools.ping(host, count);
+      
+      StaticJsonDocument<384> doc;
+      doc["success"] = result.success;
+      doc["host"] = result.target;
+      doc["ip"] = result.ip.toString();
+      doc["time"] = result.avg_time;
+      doc["loss"] = result.loss;
+      
+      if (!result.success && result.error.length() > 0) {
+        doc["error"] = result.error;
+      }
+      
+      String json;
+      serializeJson(doc, json);
+      job.setResult(json);
+      job.setProgress(1, 1);
+    });
+    sendJobAccepted(request, jobId);
+  });
+  
+  // Маршрут для сетевых инструментов - Запуск сканирования IP.
+  // Сканирование идет в отдельной задаче, прогресс - /network/sweep-status
+  auto sweepStartHandler = [](AsyncWebServerRequest *request){
+    if (!request->hasParam("range", true)) {
+      request->send(400, "application/json", "{\"error\":\"Missing range parameter\"}");
+      return;
+    }
+    
+    if (networkTools.getSweep().isRunning()) {
+      request->send(429, "application/json", "{\"status\":\"scanning\",\"message\":\"Scan already in progress\"}");
+      return;
+    }
     
-    DynamicJsonDocument doc(512);
-    doc["success"] = result.success;
-    doc["host"] = result.target;
-    doc["ip"] = result.ip.toString();
-    doc["time"] = result.avg_time;
-    doc["loss"] = result.loss;
+    SweepConfig config;
+    if (request->hasParam("window", true)) {
+      config.window = request->getParam("window", true)->value().toInt();
+    }
+    if (request->hasParam("timeout", true)) {
+      config.timeoutMs = request->getParam("timeout", true)->value().toInt();
+    }
+    if (request->hasParam("retries", true)) {
+      config.retries = request->getParam("retries", true)->value().toInt();
+    }
     
-    if (!result.success && result.error.length() > 0) {
-      doc["error"] = result.error;
+    String range = request->getParam("range", true)->value();
+    if (!networkTools.startSweep(range, config)) {
+      request->send(400, "application/json", "{\"error\":\"Invalid range\"}");
+      return;
     }
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
-  });
+    request->send(202, "application/json", "{\"status\":\"started\",\"message\":\"Scan started\",\"total\":" +
+                  String(networkTools.getSweep().getTotal()) + "}");
+  };
+  server.on("/network/sweep-start", HTTP_POST, sweepStartHandler);
   
-  // Маршрут для сетевых инструментов - Сканирование IP
+  // Маршрут для сетевых инструментов - Сканирование IP как задание.
+  // Результат в формате прежнего ответа /network/scan - /jobs/{id}
   server.on("/network/scan", HTTP_POST, [](AsyncWebServerRequest *request){
     if (!request->hasParam("range", true)) {
       request->send(400, "application/json", "{\"error\":\"Missing range parameter\"}");
@@ -1653,25 +3132,73 @@ void setupWebServer() {
     }
     
     String range = request->getParam("range", true)->value();
-    std::vector<ScanResult> results = networkTools.scanNetwork(range);
+    IPAddress startIP, endIP;
+    if (!networkTools.parseRange(range, startIP, endIP)) {
+      request->send(400, "application/json", "{\"error\":\"Invalid range\"}");
+      return;
+    }
     
-    DynamicJsonDocument doc(4096);
-    doc["success"] = true;
-    JsonArray hostsArray = doc.createNestedArray("hosts");
+    SweepConfig config;
+    if (request->hasParam("window", true)) {
+      config.window = request->getParam("window", true)->value().toInt();
+    }
+    
+    uint32_t jobId = jobScheduler.submit("scan", [startIP, endIP, config](Job& job){
+      runSweepJob(job, startIP, endIP, config);
+    });
+    sendJobAccepted(request, jobId);
+  });
+  
+  // Маршрут для проверки статуса сканирования IP
+  server.on("/network/sweep-status", HTTP_GET, [](AsyncWebServerRequest *request){
+    HostSweep& sweep = networkTools.getSweep();
+    
+    StaticJsonDocument<384> doc;
+    doc["status"] = sweep.getStateName();
+    doc["total"] = sweep.getTotal();
+    doc["completed"] = sweep.getCompleted();
+    doc["sent"] = sweep.getSent();
+    doc["found"] = sweep.getFoundCount();
+    doc["elapsed"] = sweep.getElapsed();
+    doc["window"] = sweep.getConfig().window;
+    if (sweep.getState() == SWEEP_ERROR) {
+      doc["error"] = sweep.getError();
+    }
     
-    for (const auto& result : results) {
-      JsonObject hostObj = hostsArray.createNestedObject();
-      hostObj["ip"] = result.ip.toString();
-      hostObj["active"] = result.active;
-      hostObj["time"] = result.response_time;
+    sendJson(request, doc);
+  });
+  
+  // Маршрут для получения найденных хостов (доступен и во время сканирования)
+  server.on("/network/sweep-results", HTTP_GET, [](AsyncWebServerRequest *request){
+    HostSweep& sweep = networkTools.getSweep();
+    std::vector<SweepHost> hosts = sweep.getResults();
+    
+    JsonListWriter list(request, "hosts", 64 + hosts.size() * 56);
+    
+    for (const auto& host : hosts) {
+      char ipStr[16];
+      formatIP(host.ip, ipStr);
+      StaticJsonDocument<96> hostObj;
+      hostObj["ip"] = ipStr;
+      hostObj["active"] = true;
+      hostObj["time"] = host.response_time;
+      list.add(hostObj);
     }
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    StaticJsonDocument<96> extra;
+    extra["success"] = true;
+    extra["status"] = sweep.getStateName();
+    list.send(&extra);
   });
   
-  // Маршрут для сетевых инструментов - Сканирование портов
+  // Маршрут для остановки сканирования IP
+  server.on("/network/sweep-cancel", HTTP_POST, [](AsyncWebServerRequest *request){
+    networkTools.getSweep().cancel();
+    request->send(200, "application/json", "{\"success\":true}");
+  });
+  
+  // Маршрут для сетевых инструментов - Сканирование портов как задание.
+  // Открытые порты также выдаются потоком через /network/portscan/events
   server.on("/network/portscan", HTTP_POST, [](AsyncWebServerRequest *request){
     if (!request->hasParam("ip", true) || 
         !request->hasParam("startPort", true) || 
@@ -1680,30 +3207,98 @@ void setupWebServer() {
       return;
     }
     
-    String ip = request->getParam("ip", true)->value();
+    if (networkTools.getPortScanner().isRunning()) {
+      request->send(429, "application/json", "{\"status\":\"scanning\",\"message\":\"Scan already in progress\"}");
+      return;
+    }
+    
+    String host = request->getParam("ip", true)->value();
     int startPort = request->getParam("startPort", true)->value().toInt();
     int endPort = request->getParam("endPort", true)->value().toInt();
     
-    std::vector<PortScanResult> results = networkTools.scanPorts(ip, startPort, endPort);
+    PortScanConfig config;
+    if (request->hasParam("window", true)) {
+      config.window = request->getParam("window", true)->value().toInt();
+    }
+    if (request->hasParam("timeout", true)) {
+      config.timeoutMs = request->getParam("timeout", true)->value().toInt();
+    }
     
-    DynamicJsonDocument doc(4096);
-    doc["success"] = true;
-    JsonArray portsArray = doc.createNestedArray("ports");
+    if (startPort > endPort || endPort < 1 || startPort > 65535) {
+      request->send(400, "application/json", "{\"success\":false,\"error\":\"Invalid port range\"}");
+      return;
+    }
     
-    for (const auto& result : results) {
-      if (result.open) {
-        JsonObject portObj = portsArray.createNestedObject();
-        portObj["port"] = result.port;
-        portObj["service"] = result.service;
+    uint32_t jobId = jobScheduler.submit("portscan", [host, startPort, endPort, config](Job& job){
+      // Разрешение имени выполняется в задании - оно может занять несколько секунд
+      IPAddress ip;
+      if (!networkTools.resolveHost(host, ip)) {
+        job.fail("Failed to resolve host");
+        return;
       }
+      runPortScanJob(job, ip, startPort, endPort, config);
+    });
+    sendJobAccepted(request, jobId);
+  });
+  
+  // Маршрут для проверки статуса сканирования портов
+  server.on("/network/portscan/status", HTTP_GET, [](AsyncWebServerRequest *request){
+    PortScanner& scanner = networkTools.getPortScanner();
+    
+    StaticJsonDocument<384> doc;
+    doc["status"] = scanner.getStateName();
+    doc["ip"] = scanner.getTarget().toString();
+    doc["total"] = scanner.getTotal();
+    doc["scanned"] = scanner.getScanned();
+    doc["open"] = scanner.getOpenCount();
+    doc["elapsed"] = scanner.getElapsed();
+    if (scanner.getState() == PORT_SCAN_ERROR) {
+      doc["error"] = scanner.getError();
+    }
+    
+    sendJson(request, doc);
+  });
+  
+  // Маршрут для получения открытых портов (для клиентов без SSE)
+  server.on("/network/portscan/results", HTTP_GET, [](AsyncWebServerRequest *request){
+    PortScanner& scanner = networkTools.getPortScanner();
+    std::vector<uint16_t> ports = scanner.getOpenPorts();
+    
+    JsonListWriter list(request, "ports", 64 + ports.size() * 40);
+    
+    for (uint16_t port : ports) {
+      StaticJsonDocument<96> portObj;
+      portObj["port"] = port;
+      portObj["service"] = NetworkTools::identifyService(port);
+      list.add(portObj);
     }
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    StaticJsonDocument<96> extra;
+    extra["success"] = true;
+    extra["status"] = scanner.getStateName();
+    list.send(&extra);
+  });
+  
+  // Маршрут для остановки сканирования портов
+  server.on("/network/portscan/cancel", HTTP_POST, [](AsyncWebServerRequest *request){
+    networkTools.getPortScanner().cancel();
+    request->send(200, "application/json", "{\"success\":true}");
+  });
+  
+  // При подключении к потоку отдаем уже найденные порты текущего сканирования
+  portScanEvents.onConnect([](AsyncEventSourceClient *client){
+    PortScanner& scanner = networkTools.getPortScanner();
+    std::vector<uint16_t> ports = scanner.getOpenPorts();
+    for (size_t i = 0; i < ports.size(); i++) {
+      client->send(formatPortEvent(ports[i]).c_str(), "port", i + 1);
+    }
   });
+  server.addHandler(&portScanEvents);
+  
+  // Телеметрия: подписка на темы вместо периодических опросов
+  telemetry.begin(server);
   
-  // Маршрут для сетевых инструментов - Сканирование одного IP
+  // Маршрут для сетевых инструментов - Сканирование одного IP как задание
   server.on("/network/scan-single", HTTP_POST, [](AsyncWebServerRequest *request){
     if (!request->hasParam("ip", true)) {
       request->send(400, "application/json", "{\"error\":\"Missing IP parameter\"}");
@@ -1711,16 +3306,82 @@ void setupWebServer() {
     }
     
     String ip = request->getParam("ip", true)->value();
-    PingResult result = networkTools.ping(ip, 1);
     
-    DynamicJsonDocument doc(256);
-    doc["success"] = result.success;
-    doc["active"] = result.success;
-    doc["time"] = result.avg_time;
+    uint32_t jobId = jobScheduler.submit("scan-single", [ip](Job& job){
+      job.setProgress(0, 1);
+      PingResult result = networkTools.ping(ip, 1);
+      
+      StaticJsonDocument<128> doc;
+      doc["success"] = result.success;
+      doc["active"] = result.success;
+      doc["time"] = result.avg_time;
+      
+      String json;
+      serializeJson(doc, json);
+      job.setResult(json);
+      job.setProgress(1, 1);
+    });
+    sendJobAccepted(request, jobId);
+  });
+  
+  // Маршрут для списка заданий и состояния задания: /jobs, /jobs/{id}
+  server.on("/jobs", HTTP_GET, [](AsyncWebServerRequest *request){
+    String path = request->url();
+    
+    if (path == "/jobs" || path == "/jobs/") {
+      uint32_t ids[JOB_MAX_JOBS];
+      size_t count = jobScheduler.listJobs(ids, JOB_MAX_JOBS);
+      
+      JsonListWriter list(request, "jobs", 64 + count * 64);
+      for (size_t i = 0; i < count; i++) {
+        JobInfo info;
+        if (jobScheduler.getInfo(ids[i], info)) {
+          StaticJsonDocument<96> jobObj;
+          jobObj["id"] = info.id;
+          jobObj["type"] = info.type;
+          jobObj["status"] = JobScheduler::stateName(info.state);
+          list.add(jobObj);
+        }
+      }
+      
+      StaticJsonDocument<32> extra;
+      extra["queued"] = jobScheduler.getQueued();
+      list.send(&extra);
+      return;
+    }
+    
+    JobInfo info;
+    if (!jobScheduler.getInfo(path.substring(6).toInt(), info)) {
+      request->send(404, "application/json", "{\"error\":\"Job not found\"}");
+      return;
+    }
+    
+    // Результат уже сериализован - документ хранит только ссылку на него
+    StaticJsonDocument<384> doc;
+    doc["id"] = info.id;
+    doc["type"] = info.type;
+    doc["status"] = JobScheduler::stateName(info.state);
+    doc["done"] = info.progressDone;
+    doc["total"] = info.progressTotal;
+    doc["elapsed"] = info.elapsed;
+    if (info.result.length() > 0) {
+      doc["result"] = serialized(info.result.c_str(), info.result.length());
+    }
+    if (info.error.length() > 0) {
+      doc["error"] = info.error;
+    }
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    sendJson(request, doc);
+  });
+  
+  // Маршрут для отмены задания: DELETE /jobs/{id}
+  server.on("/jobs", HTTP_DELETE, [](AsyncWebServerRequest *request){
+    uint32_t id = request->url().substring(6).toInt();
+    if (jobScheduler.cancel(id)) {
+      request->send(200, "application/json", "{\"success\":true}");
+    } else {
+      request->send(404, "application/json", "{\"error\":\"No active job with this id\"}");
+    }
   });
   
   // Маршрут для сетевых инструментов - Блокировка IP
@@ -1730,9 +3391,14 @@ void setupWebServer() {
       return;
     }
     
-    String ip = request->getParam("ip", true)->value();
+    IPAddress ip;
+    if (!ip.fromString(request->getParam("ip", true)->value())) {
+      request->send(400, "application/json", "{\"error\":\"Invalid IP address\"}");
+      return;
+    }
     
-    if (networkTools.blockIP(ip)) {
+    if (blocklist.blockIP((uint32_t)ip)) {
+      blocklist.save();
       request->send(200, "application/json", "{\"success\":true,\"message\":\"IP blocked\"}");
     } else {
       request->send(400, "application/json", "{\"error\":\"Failed to block IP\"}");
@@ -1746,9 +3412,14 @@ void setupWebServer() {
       return;
     }
     
-    String ip = request->getParam("ip", true)->value();
+    IPAddress ip;
+    if (!ip.fromString(request->getParam("ip", true)->value())) {
+      request->send(400, "application/json", "{\"error\":\"Invalid IP address\"}");
+      return;
+    }
     
-    if (networkTools.unblockIP(ip)) {
+    if (blocklist.unblockIP((uint32_t)ip)) {
+      blocklist.save();
       request->send(200, "application/json", "{\"success\":true,\"message\":\"IP unblocked\"}");
     } else {
       request->send(400, "application/json", "{\"error\":\"Failed to unblock IP\"}");
@@ -1757,46 +3428,43 @@ void setupWebServer() {
   
   // Маршрут для получения списка заблокированных IP
   server.on("/network/blocked", HTTP_GET, [](AsyncWebServerRequest *request){
-    const auto& blockedIPs = networkTools.getBlockedIPs();
+    std::vector<uint32_t> blockedIPs = blocklist.getIPs();
     
-    DynamicJsonDocument doc(2048);
-    JsonArray blockedArray = doc.createNestedArray("blocked");
+    JsonListWriter list(request, "blocked", 32 + blockedIPs.size() * 20);
     
-    for (const auto& ip : blockedIPs) {
-      blockedArray.add(ip);
+    for (uint32_t ip : blockedIPs) {
+      char ipStr[16];
+      formatIP(IPAddress(ip), ipStr);
+      StaticJsonDocument<32> item;
+      item.set(ipStr);
+      list.add(item);
     }
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    StaticJsonDocument<32> extra;
+    extra["dropped"] = APNetifHook::getDroppedByIP();
+    list.send(&extra);
   });
   
-  // API для работы с пользователями AP
+  // API для работы с пользователями AP.
+  // ?all=1 - включая недавно отключенных клиентов
   server.on("/ap/users", HTTP_GET, [](AsyncWebServerRequest *request){
-    updateAPClients();
+    bool includeDisconnected = request->hasParam("all") && request->getParam("all")->value() == "1";
     
-    DynamicJsonDocument doc(4096);
-    JsonArray usersArray = doc.createNestedArray("users");
+    size_t count = apClients.size();
+    JsonListWriter list(request, "users", 32 + count * 200);
     
-    for (const auto& client : apClients) {
-      JsonObject userObj = usersArray.createNestedObject();
-      userObj["ip"] = client.ip.toString();
-      
-      char macStr[18];
-      sprintf(macStr, "%02X:%02X:%02X:%02X:%02X:%02X",
-              client.mac[0], client.mac[1], client.mac[2],
-              client.mac[3], client.mac[4], client.mac[5]);
-      userObj["mac"] = macStr;
+    for (size_t i = 0; i < count; i++) {
+      APClient client;
+      if (!apClients.get(i, client) || (!client.connected && !includeDisconnected)) {
+        continue;
+      }
       
-      userObj["blocked"] = client.blocked;
-      userObj["totalBytes"] = client.totalBytes;
-      userObj["lastPacket"] = client.lastPacket;
-      userObj["lastSeen"] = client.lastSeen;
+      StaticJsonDocument<384> userObj;
+      apUserToJson(client, userObj);
+      list.add(userObj);
     }
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    list.send();
   });
   
   // API для блокировки/разблокировки пользователя AP
@@ -1815,45 +3483,16 @@ void setupWebServer() {
     }
     
     // Находим клиента по IP
-    for (auto& client : apClients) {
-      if (client.ip.toString() == ip) {
-        char macStr[18];
-        sprintf(macStr, "%02X:%02X:%02X:%02X:%02X:%02X",
-                client.mac[0], client.mac[1], client.mac[2],
-                client.mac[3], client.mac[4], client.mac[5]);
-        
-        if (blocked) {
-          // Блокируем
-          networkTools.blockIP(ip);
-          bool found = false;
-          for (const auto& blockedMAC : blockedMACs) {
-            if (blockedMAC == macStr) {
-              found = true;
-              break;
-            }
-          }
-          if (!found) {
-            blockedMACs.push_back(macStr);
-          }
-          client.blocked = true;
-        } else {
-          // Разблокируем
-          networkTools.unblockIP(ip);
-          for (auto it = blockedMACs.begin(); it != blockedMACs.end(); ++it) {
-            if (*it == macStr) {
-              blockedMACs.erase(it);
-              break;
-            }
-          }
-          client.blocked = false;
-        }
-        
-        request->send(200, "application/json", "{\"success\":true}");
-        return;
-      }
+    IPAddress clientIP;
+    int slot = clientIP.fromString(ip) ? apClients.findByIP(clientIP) : -1;
+    APClient client;
+    if (!apClients.get(slot, client)) {
+      request->send(404, "application/json", "{\"error\":\"User not found\"}");
+      return;
     }
     
-    request->send(404, "application/json", "{\"error\":\"User not found\"}");
+    setClientBlocked(slot, client, blocked);
+    request->send(200, "application/json", "{\"success\":true}");
   });
   
   // API для получения трафика пользователя
@@ -1866,32 +3505,50 @@ void setupWebServer() {
     String ip = request->getParam("ip")->value();
     
     // Находим клиента по IP
-    for (const auto& client : apClients) {
-      if (client.ip.toString() == ip) {
-        DynamicJsonDocument doc(1024);
-        doc["ip"] = client.ip.toString();
-        doc["totalBytes"] = client.totalBytes;
-        doc["lastPacket"] = client.lastPacket;
-        doc["lastSeen"] = client.lastSeen;
-        
-        // Если активен сниффинг для этого клиента, добавляем информацию
-        if (isSniffing && currentSniffingClient >= 0 && 
-            apClients[currentSniffingClient].ip == client.ip) {
-          doc["sniffing"] = true;
-          doc["sniffedPackets"] = client.totalBytes; // Обновляется в режиме реального времени
-          doc["lastPacketInfo"] = client.lastPacket;
-        } else {
-          doc["sniffing"] = false;
-        }
-        
-        String response;
-        serializeJson(doc, response);
-        request->send(200, "application/json", response);
-        return;
-      }
+    IPAddress clientIP;
+    APClient client;
+    if (!clientIP.fromString(ip) || !apClients.get(apClients.findByIP(clientIP), client)) {
+      request->send(404, "application/json", "{\"error\":\"User not found\"}");
+      return;
+    }
+    
+    char ipStr[16];
+    formatIP(client.ip, ipStr);
+    
+    StaticJsonDocument<768> doc;
+    doc["ip"] = ipStr;
+    doc["lastSeen"] = client.lastSeen;
+    
+    // Счетчики интерфейса AP ведутся всегда, без сниффинга
+    APTrafficSample traffic;
+    APTrafficMeter::get(client.mac, traffic);
+    doc["totalBytes"] = traffic.rxBytes + traffic.txBytes;
+    doc["rxBytes"] = traffic.rxBytes;
+    doc["rxPackets"] = traffic.rxPackets;
+    doc["txBytes"] = traffic.txBytes;
+    doc["txPackets"] = traffic.txPackets;
+    doc["txErrors"] = traffic.txErrors;
+    doc["rxRate"] = traffic.rxRate;
+    doc["txRate"] = traffic.txRate;
+    
+    // Если активен сниффинг для этого клиента, добавляем информацию
+    if (isSniffingClient(client)) {
+      // Строка с описанием пакета формируется только сейчас, при чтении
+      char packetInfo[100];
+      formatLastPacket(packetInfo, sizeof(packetInfo));
+      
+      const SniffStreamStats& stream = sniffFilter.stream(sniffFilter.streamOf(client.mac));
+      doc["sniffedBytes"] = stream.bytes.load();
+      doc["lastPacket"] = packetInfo;
+      doc["sniffing"] = true;
+      doc["sniffedPackets"] = stream.packets.load();
+      doc["lastPacketInfo"] = packetInfo;
+    } else {
+      doc["lastPacket"] = client.lastPacket;
+      doc["sniffing"] = false;
     }
     
-    request->send(404, "application/json", "{\"error\":\"User not found\"}");
+    sendJson(request, doc);
   });
   
   // API для запуска/остановки сниффинга
@@ -1909,20 +3566,25 @@ void setupWebServer() {
     }
     
     // Находим клиента по IP
-    int clientIndex = -1;
-    for (int i = 0; i < apClients.size(); i++) {
-      if (apClients[i].ip.toString() == ip) {
-        clientIndex = i;
-        break;
-      }
-    }
+    IPAddress clientIP;
+    int clientIndex = clientIP.fromString(ip) ? apClients.findByIP(clientIP) : -1;
     
     if (clientIndex >= 0) {
       if (start) {
-        startPacketSniffing(clientIndex);
+        APClient client;
+        SniffTarget rule;
+        if (!apClients.get(clientIndex, client) || !parseSniffTarget(request, client.mac, rule)) {
+          request->send(400, "application/json", "{\"error\":\"Invalid filter\"}");
+          return;
+        }
+        if (!startPacketSniffing(clientIndex, &rule)) {
+          request->send(409, "application/json", "{\"error\":\"Too many clients\"}");
+          return;
+        }
         request->send(200, "application/json", "{\"success\":true,\"message\":\"Sniffing started\"}");
       } else {
-        stopPacketSniffing();
+        // Снимается только этот клиент, остальные потоки продолжают идти
+        stopPacketSniffing(clientIndex);
         request->send(200, "application/json", "{\"success\":true,\"message\":\"Sniffing stopped\"}");
       }
     } else {
@@ -1930,38 +3592,179 @@ void setupWebServer() {
     }
   });
 
-  // API для получения буфера перехваченных пакетов
+  // Остановка сниффинга всех клиентов
+  server.on("/ap/users/sniff/stop", HTTP_POST, [](AsyncWebServerRequest *request){
+    stopPacketSniffing();
+    request->send(200, "application/json", "{\"success\":true,\"message\":\"Sniffing stopped\"}");
+  });
+  
+  // API для получения потоков сниффера: правило и счетчики каждого клиента
+  server.on("/ap/users/sniff/streams", HTTP_GET, [](AsyncWebServerRequest *request){
+    JsonListWriter list(request, "streams", 64 + SNIFF_FILTER_MAX_CLIENTS * 256);
+    
+    for (uint8_t i = 0; i < SNIFF_FILTER_MAX_CLIENTS; i++) {
+      if (!sniffFilter.isUsed(i)) continue;
+      const SniffTarget& target = sniffFilter.target(i);
+      const SniffStreamStats& stream = sniffFilter.stream(i);
+      
+      char macStr[18];
+      formatMAC(target.mac, macStr);
+      
+      StaticJsonDocument<256> obj;
+      obj["stream"] = i;
+      obj["mac"] = macStr;
+      APClient client;
+      if (apClients.get(apClients.find(target.mac), client)) {
+        char ipStr[16];
+        formatIP(client.ip, ipStr);
+        obj["ip"] = ipStr;
+      }
+      obj["uplink"] = (target.directions & SNIFF_DIR_UPLINK) != 0;
+      obj["downlink"] = (target.directions & SNIFF_DIR_DOWNLINK) != 0;
+      obj["classes"] = target.classes;
+      obj["packets"] = stream.packets.load();
+      obj["bytes"] = stream.bytes.load();
+      obj["upPackets"] = stream.uplink.load();
+      obj["downPackets"] = stream.downlink.load();
+      list.add(obj);
+    }
+    
+    StaticJsonDocument<64> extra;
+    extra["active"] = (bool)isSniffing;
+    extra["driverMask"] = sniffFilter.driverMask();
+    list.send(&extra);
+  });
+  
+  // API для получения буфера перехваченных пакетов. ?ip= - только поток клиента
   server.on("/ap/users/sniff/buffer", HTTP_GET, [](AsyncWebServerRequest *request){
-    DynamicJsonDocument doc(4096);
-    JsonArray packetsArray = doc.createNestedArray("packets");
+    int stream = -1;
+    if (request->hasParam("ip")) {
+      IPAddress clientIP;
+      APClient client;
+      if (!clientIP.fromString(request->getParam("ip")->value()) ||
+          !apClients.get(apClients.findByIP(clientIP), client) ||
+          (stream = sniffFilter.streamOf(client.mac)) < 0) {
+        request->send(404, "application/json", "{\"error\":\"Stream not found\"}");
+        return;
+      }
+    }
+    
+    // Снимаем копию буфера без блокировки писателя
+    SniffedPacket packets[MAX_PACKET_BUFFER];
+    size_t count = packetBuffer.snapshot(packets, MAX_PACKET_BUFFER);
+    
+    JsonListWriter list(request, "packets", 32 + count * 128);
+    
+    for (size_t i = 0; i < count; i++) {
+      if (stream >= 0 && packets[i].stream != stream) continue;
+      char srcMAC[18], dstMAC[18];
+      formatMAC(packets[i].sourceMAC, srcMAC);
+      formatMAC(packets[i].destMAC, dstMAC);
+      
+      StaticJsonDocument<192> packetObj;
+      packetObj["sourceMAC"] = srcMAC;
+      packetObj["destMAC"] = dstMAC;
+      packetObj["type"] = sniffFrameTypeName(packets[i].type);
+      packetObj["stream"] = packets[i].stream;
+      packetObj["size"] = packets[i].size;
+      packetObj["rssi"] = packets[i].rssi;
+      packetObj["timestamp"] = packets[i].timestamp;
+      list.add(packetObj);
+    }
+    
+    StaticJsonDocument<32> extra;
+    extra["total"] = packetBuffer.written();
+    list.send(&extra);
+  });
+
+  // API для выгрузки перехваченных кадров в формате PCAP (Wireshark).
+  // ?live=1 - не закрывать поток и отдавать новые кадры, пока идет сниффинг,
+  // ?ip= - только кадры одного клиента
+  server.on("/ap/users/sniff/pcap", HTTP_GET, [](AsyncWebServerRequest *request){
+    if (!captureRing.isAllocated()) {
+      request->send(404, "application/json", "{\"error\":\"No capture available\"}");
+      return;
+    }
+    
+    int stream = -1;
+    if (request->hasParam("ip")) {
+      IPAddress clientIP;
+      APClient client;
+      if (!clientIP.fromString(request->getParam("ip")->value()) ||
+          !apClients.get(apClients.findByIP(clientIP), client) ||
+          (stream = sniffFilter.streamOf(client.mac)) < 0) {
+        request->send(404, "application/json", "{\"error\":\"Stream not found\"}");
+        return;
+      }
+    }
+    
+    bool live = request->hasParam("live") && request->getParam("live")->value() == "1";
+    std::shared_ptr<PcapStreamer> streamer = std::make_shared<PcapStreamer>(captureRing, live, &isSniffing, stream);
+    
+    AsyncWebServerResponse *response = request->beginChunkedResponse("application/vnd.tcpdump.pcap",
+      [streamer](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        return streamer->fill(buffer, maxLen);
+      });
+    response->addHeader("Content-Disposition", "attachment; filename=\"capture.pcap\"");
+    response->addHeader("Cache-Control", "no-store");
+    request->send(response);
+  });
+  
+  // API для получения и изменения параметров буфера захвата
+  server.on("/ap/users/sniff/capture", HTTP_GET, [](AsyncWebServerRequest *request){
+    StaticJsonDocument<256> doc;
+    doc["depth"] = captureDepth;
+    doc["snaplen"] = captureSnaplen;
+    doc["allocated"] = captureRing.isAllocated();
+    doc["allocatedDepth"] = captureRing.getDepth();
+    doc["memory"] = captureRing.getMemoryUsage();
+    doc["psram"] = captureRing.isInPsram();
+    doc["written"] = captureRing.written();
+    
+    sendJson(request, doc);
+  });
+  
+  server.on("/ap/users/sniff/capture", HTTP_POST, [](AsyncWebServerRequest *request){
+    if (isSniffing) {
+      request->send(409, "application/json", "{\"error\":\"Stop sniffing first\"}");
+      return;
+    }
     
-    for (const auto& packet : packetBuffer) {
-      JsonObject packetObj = packetsArray.createNestedObject();
-      packetObj["sourceMAC"] = packet.sourceMAC;
-      packetObj["destMAC"] = packet.destMAC;
-      packetObj["type"] = packet.type;
-      packetObj["size"] = packet.size;
-      packetObj["rssi"] = packet.rssi;
-      packetObj["timestamp"] = packet.timestamp;
+    if (request->hasParam("depth", true)) {
+      captureDepth = constrain(request->getParam("depth", true)->value().toInt(),
+                               SNIFF_CAPTURE_MIN_DEPTH, SNIFF_CAPTURE_MAX_DEPTH);
+    }
+    if (request->hasParam("snaplen", true)) {
+      captureSnaplen = constrain(request->getParam("snaplen", true)->value().toInt(),
+                                 SNIFF_CAPTURE_MIN_SNAPLEN, SNIFF_CAPTURE_MAX_SNAPLEN);
     }
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    // Старый буфер освобождается, новый будет выделен при следующем запуске сниффинга
+    captureRing.release();
+    saveConfiguration();
+    
+    request->send(200, "application/json", "{\"success\":true}");
   });
 
   // API для получения списка всех заблокированных MAC
   server.on("/ap/blocked-macs", HTTP_GET, [](AsyncWebServerRequest *request){
-    DynamicJsonDocument doc(2048);
-    JsonArray blockedArray = doc.createNestedArray("blocked");
+    std::vector<uint64_t> blockedMACs = blocklist.getMACs();
+    
+    JsonListWriter list(request, "blocked", 32 + blockedMACs.size() * 24);
     
-    for (const auto& mac : blockedMACs) {
-      blockedArray.add(mac);
+    for (uint64_t key : blockedMACs) {
+      uint8_t mac[6];
+      char macStr[18];
+      keyToMAC(key, mac);
+      formatMAC(mac, macStr);
+      StaticJsonDocument<48> item;
+      item.set(macStr);
+      list.add(item);
     }
     
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    StaticJsonDocument<32> extra;
+    extra["dropped"] = APNetifHook::getDroppedByMAC();
+    list.send(&extra);
   });
 
   // API для блокировки/разблокировки по MAC адресу
@@ -1971,44 +3774,192 @@ void setupWebServer() {
       return;
     }
     
-    String mac = request->getParam("mac", true)->value();
+    uint8_t mac[6];
+    if (!parseMAC(request->getParam("mac", true)->value(), mac)) {
+      request->send(400, "application/json", "{\"error\":\"Invalid MAC address\"}");
+      return;
+    }
     bool block = true;
     
     if (request->hasParam("action", true)) {
       block = (request->getParam("action", true)->value() == "block");
     }
     
-    if (block) {
-      bool found = false;
-      for (const auto& blockedMAC : blockedMACs) {
-        if (blockedMAC == mac) {
-          found = true;
-          break;
-        }
-      }
-      if (!found) {
-        blockedMACs.push_back(mac);
-        saveBlockedMACs();
-      }
-    } else {
-      for (auto it = blockedMACs.begin(); it != blockedMACs.end(); ++it) {
-        if (*it == mac) {
-          blockedMACs.erase(it);
-          saveBlockedMACs();
-          break;
-        }
-      }
+    bool changed = block ? blocklist.blockMAC(mac) : blocklist.unblockMAC(mac);
+    if (changed) {
+      blocklist.save();
     }
     
     request->send(200, "application/json", "{\"success\":true}");
   });
   
+  // ИК-передатчик и его API
+  irController.begin();
+  
+  // Показатели производительности: куча, задачи, цикл, маршруты, WiFi
+  server.on("/api/perf", HTTP_GET, [](AsyncWebServerRequest *request){
+    DynamicJsonDocument doc(12288);
+    doc["uptime"] = (uint32_t)(esp_timer_get_time() / 1000);
+    perfMonitor.heapToJson(doc.createNestedObject("heap"));
+    perfMonitor.tasksToJson(doc.createNestedArray("tasks"));
+    
+    JsonObject loopObj = doc.createNestedObject("loop");
+    perfMonitor.loopToJson(loopObj);
+    loopObj["executed"] = scheduler.getExecuted();
+    loopObj["wakeups"] = scheduler.getWakeups();
+    loopObj["scheduled"] = scheduler.taskCount();
+    JsonObject netObj = doc.createNestedObject("net");
+    netObj["executed"] = netScheduler.getExecuted();
+    netObj["wakeups"] = netScheduler.getWakeups();
+    netObj["scheduled"] = netScheduler.taskCount();
+    
+    std::unique_ptr<PerfRouteStats[]> routes(new PerfRouteStats[PERF_MAX_ROUTES]);
+    uint32_t totalRequests = 0, unlisted = 0, unrouted = 0;
+    uint8_t routeCount = perfMonitor.snapshotRoutes(routes.get(), totalRequests, unlisted, unrouted);
+    JsonObject http = doc.createNestedObject("http");
+    http["requests"] = totalRequests;
+    http["unlisted"] = unlisted;
+    http["notFound"] = unrouted;
+    JsonArray routesArray = http.createNestedArray("routes");
+    for (uint8_t i = 0; i < routeCount; i++) {
+      const PerfRouteStats& route = routes[i];
+      JsonObject obj = routesArray.createNestedObject();
+      obj["path"] = (const char*)route.path;
+      obj["method"] = httpMethodName(route.method);
+      obj["count"] = route.count;
+      obj["avgUs"] = route.count > 0 ? (uint32_t)(route.totalUs / route.count) : 0;
+      obj["maxUs"] = route.maxUs;
+      obj["lastUs"] = route.lastUs;
+      obj["slow"] = route.slow;
+    }
+    
+    // WiFi: счетчики интерфейса AP (APTrafficMeter) и канал STA
+    JsonObject wifi = doc.createNestedObject("wifi");
+    wifi["mode"] = (int)WiFi.getMode();
+    wifi["channel"] = WiFi.channel();
+    if (WiFi.status() == WL_CONNECTED) {
+      wifi["rssi"] = WiFi.RSSI();
+    }
+    wifi["stations"] = WiFi.softAPgetStationNum();
+    APTrafficSample traffic;
+    APTrafficMeter::totals(traffic);
+    wifi["rxPackets"] = traffic.rxPackets;
+    wifi["rxBytes"] = traffic.rxBytes;
+    wifi["txPackets"] = traffic.txPackets;
+    wifi["txBytes"] = traffic.txBytes;
+    wifi["txErrors"] = traffic.txErrors;
+    wifi["rxRate"] = traffic.rxRate;
+    wifi["txRate"] = traffic.txRate;
+    
+    sendJson(request, doc);
+  });
+  
+  server.on("/api/perf/reset", HTTP_POST, [](AsyncWebServerRequest *request){
+    perfMonitor.reset();
+    request->send(200, "application/json", "{\"success\":true}");
+  });
+  
+  // Питание: настройки, состояние и оценка времени работы от батареи
+  server.on("/api/power", HTTP_GET, [](AsyncWebServerRequest *request){
+    SensorData sensorData = deviceManager.getSensorData();
+    PowerEstimate estimate;
+    powerManager.estimate(deviceManager.getSensorHistory(), sensorData.batteryPercentage, estimate);
+    
+    StaticJsonDocument<1024> doc;
+    powerManager.toJson(doc.to<JsonObject>(), telemetry.getClientCount());
+    doc["sleepTimeout"] = deviceSettings.sleepTimeout;
+    JsonObject battery = doc.createNestedObject("battery");
+    battery["voltage"] = sensorData.batteryVoltage;
+    battery["percent"] = estimate.percent;
+    battery["percentPerHour"] = estimate.percentPerHour;
+    battery["millivoltsPerHour"] = estimate.millivoltsPerHour;
+    battery["points"] = estimate.points;
+    if (estimate.runtimeMinutes >= 0) {
+      battery["runtimeMinutes"] = estimate.runtimeMinutes;
+    } else {
+      battery["runtimeMinutes"] = nullptr;
+    }
+    sendJson(request, doc);
+  });
+  
+  // lowPower=0|1, lightSleep=0|1, minMhz/maxMhz (80, 160 или 240), dimAfter - с,
+  // dimBrightness. Итог esp_pm_configure - state.pmResult в /api/power
+  server.on("/api/power/config", HTTP_POST, [](AsyncWebServerRequest *request){
+    PowerConfig config = powerManager.getConfig();
+    if (request->hasParam("lowPower", true)) {
+      config.lowPower = request->getParam("lowPower", true)->value() == "1";
+    }
+    if (request->hasParam("lightSleep", true)) {
+      config.lightSleep = request->getParam("lightSleep", true)->value() == "1";
+    }
+    if (request->hasParam("minMhz", true)) {
+      config.minMhz = request->getParam("minMhz", true)->value().toInt();
+    }
+    if (request->hasParam("maxMhz", true)) {
+      config.maxMhz = request->getParam("maxMhz", true)->value().toInt();
+    }
+    if (!isValidCpuMhz(config.minMhz) || !isValidCpuMhz(config.maxMhz) ||
+        config.minMhz > config.maxMhz) {
+      request->send(400, "text/plain", "minMhz and maxMhz must be 80, 160 or 240, minMhz <= maxMhz");
+      return;
+    }
+    if (request->hasParam("dimAfter", true)) {
+      config.dimAfter = constrain(request->getParam("dimAfter", true)->value().toInt(), 0, 65535);
+    }
+    if (request->hasParam("dimBrightness", true)) {
+      config.dimBrightness = constrain(request->getParam("dimBrightness", true)->value().toInt(), 0, 100);
+    }
+    // Частота и блокировки esp_pm меняются из задачи интерфейса
+    scheduler.post([config]() {
+      powerManager.configure(config);
+      savePowerConfig();
+      updatePower();
+    });
+    request->send(200, "application/json", "{\"success\":true}");
+  });
+  
+  // Замер обработчиков всех маршрутов и активность веб-клиентов. Ловушка
+  // ставит свой onNotFound и сама сообщает о запросах без маршрута
+  if (apConfig.mode != AP_MODE_HONEYPOT) {
+    server.onNotFound([](AsyncWebServerRequest *request){
+      perfMonitor.markUnrouted();
+      request->send(404);
+    });
+  }
+  perfMonitor.attach(server);
+  powerManager.attach(server);
+  
   // Запуск веб-сервера
   server.begin();
 }
 
 // Обработка нажатий кнопок
 void handleButtons() {
+  // Нажатие, разбудившее экран, только включает его: до отпускания всех
+  // кнопок остальная обработка пропускается
+  static bool wakeHold = false;
+  bool pressed = M5.BtnA.isPressed() || M5.BtnB.isPressed() || M5.BtnC.isPressed();
+  if (pressed && powerManager.wake(POWER_WAKE_BUTTON)) {
+    wakeHold = true;
+  }
+  if (wakeHold) {
+    if (!pressed) {
+      wakeHold = false;
+      buttonALastPress = buttonBLastPress = buttonCLastPress = 0;
+      buttonALongPress = buttonBLongPress = buttonCLongPress = false;
+    }
+    return;
+  }
+  
+  // Пока на экране сообщение, отпускание любой кнопки возвращает в меню.
+  // Нажатие не доходит до обработчиков ниже и не выполняет действие
+  if (screenHeld) {
+    if (M5.BtnA.wasReleased() || M5.BtnB.wasReleased() || M5.BtnC.wasReleased()) {
+      releaseScreen();
+    }
+    return;
+  }
+  
   // Проверка долгого нажатия на кнопку C (Power/Scroll Up)
   if (M5.BtnC.isPressed()) {
     if (buttonCLastPress == 0) {
@@ -2016,6 +3967,8 @@ void handleButtons() {
     } else if (!buttonCLongPress && millis() - buttonCLastPress > 3000) {
       // Долгое нажатие на C - выключение устройства
       buttonCLongPress = true;
+      configStore.commit();
+      honeypot.flush(true);
       M5.Power.powerOff();
     }
   } else {
@@ -2130,19 +4083,23 @@ int getMaxMenuItems() {
     
     case MENU_AP_USER_SNIFF:
       return 2; // Start/Stop и Back
-    case MENU_WIFI_SCAN:
-      return networks.size() > 0 ? networks.size() : 1;
+    case MENU_WIFI_SCAN: {
+      size_t count = scanNetworkCount();
+      return count > 0 ? count : 1;
+    }
     
-    case MENU_WIFI_SAVED:
+    case MENU_WIFI_SAVED: {
+      SettingsGuard guard;
       return savedNetworks.size() + 1; // +1 для кнопки возврата
+    }
     
     case MENU_KVM_OPTIONS: {
-      const auto& pins = kvmModule.getPins();
+      std::vector<EnhancedPinConfig> pins = kvmModule.getPins();
       return pins.size() + 3; // Пины + настройки
     }
     
     case MENU_KVM_MONITOR: {
-      const auto& pins = kvmModule.getPins();
+      std::vector<EnhancedPinConfig> pins = kvmModule.getPins();
       return pins.size() + 2; // Пины + инфо
     }
     
@@ -2159,77 +4116,86 @@ int getMaxMenuItems() {
 
 // Отрисовка меню
 void drawMenu() {
-  M5.Lcd.fillScreen(BLACK);
-  M5.Lcd.setCursor(0, 0);
-  M5.Lcd.setTextSize(1);
+  // Выключенный экран перерисовывается при пробуждении
+  if (screenHeld || powerManager.isDisplayOff()) {
+    return;
+  }
+  
+  LovyanGFX& gfx = lcdRenderer.target();
+  gfx.fillScreen(BLACK);
+  gfx.setCursor(0, 0);
+  gfx.setTextSize(1);
   
   // Отображаем заголовок и заряд батареи
   char batteryBuf[20];
-  const auto& sensorData = deviceManager.getSensorData();
+  SensorData sensorData = deviceManager.getSensorData();
   sprintf(batteryBuf, "Batt: %.2fV", sensorData.batteryVoltage);
   
   switch (currentSection) {
     case MENU_MAIN:
-      M5.Lcd.println("MAIN MENU");
+      gfx.println("MAIN MENU");
       break;
     case MENU_WIFI:
-      M5.Lcd.println("WI-FI");
+      gfx.println("WI-FI");
       break;
     case MENU_KVM:
-      M5.Lcd.println("KVM");
+      gfx.println("KVM");
       break;
     case MENU_AP_OPTIONS:
-      M5.Lcd.println("AP OPTIONS");
+      gfx.println("AP OPTIONS");
       break;
     case MENU_AP_STATUS:
-      M5.Lcd.println("AP STATUS");
+      gfx.println("AP STATUS");
       break;
     case MENU_AP_USERS:
-      M5.Lcd.println("AP USERS");
+      gfx.println("AP USERS");
       break;
     case MENU_AP_USER_MENU:
-      M5.Lcd.println("USER MENU");
-      if (selectedAPUser >= 0 && selectedAPUser < apClients.size()) {
-        M5.Lcd.print("IP: ");
-        M5.Lcd.println(apClients[selectedAPUser].ip.toString());
+      gfx.println("USER MENU");
+      {
+        APClient client;
+        if (apClients.get(selectedAPUser, client)) {
+          gfx.print("IP: ");
+          gfx.println(client.ip.toString());
+        }
       }
       break;
     case MENU_AP_USER_INFO:
-      M5.Lcd.println("USER INFO");
+      gfx.println("USER INFO");
       break;
     case MENU_AP_USER_SNIFF:
-      M5.Lcd.println("SNIFF");
+      gfx.println("SNIFF");
       break;
     case MENU_AP_MODE_SELECT:
-      M5.Lcd.println("AP MODE SELECT");
+      gfx.println("AP MODE SELECT");
       break;
     case MENU_WIFI_SCAN:
-      M5.Lcd.println("WiFi SCAN & DEBUG");
+      gfx.println("WiFi SCAN & DEBUG");
       break;
     case MENU_WIFI_SAVED:
-      M5.Lcd.println("SAVED NETWORKS");
+      gfx.println("SAVED NETWORKS");
       break;
     case MENU_KVM_OPTIONS:
-      M5.Lcd.println("KVM OPTIONS");
+      gfx.println("KVM OPTIONS");
       break;
     case MENU_KVM_MONITOR:
-      M5.Lcd.println("KVM MONITOR");
+      gfx.println("KVM MONITOR");
       break;
     case MENU_IR_CONTROL:
-      M5.Lcd.println("IR CONTROL");
+      gfx.println("IR CONTROL");
       break;
     case MENU_DEVICE_SETTINGS:
-      M5.Lcd.println("DEVICE SETTINGS");
+      gfx.println("DEVICE SETTINGS");
       break;
   }
   
-  M5.Lcd.setCursor(M5.Lcd.width() - 70, 0);
-  M5.Lcd.print(batteryBuf);
-  M5.Lcd.drawLine(0, 10, M5.Lcd.width(), 10, WHITE);
+  gfx.setCursor(gfx.width() - 70, 0);
+  gfx.print(batteryBuf);
+  gfx.drawLine(0, 10, gfx.width(), 10, WHITE);
   
   // Отображение элементов меню
   int y = 20;
-  int displayLines = (M5.Lcd.height() - 30) / 16;
+  int displayLines = (gfx.height() - 30) / 16;
   int maxItems = getMaxMenuItems();
   
   // Корректируем позицию прокрутки
@@ -2240,103 +4206,103 @@ void drawMenu() {
   switch (currentSection) {
     case MENU_MAIN: {
       for (int i = menuStartPosition; i < MAIN_MENU_ITEMS_COUNT && i < menuStartPosition + displayLines; i++) {
-        M5.Lcd.setCursor(5, y);
+        gfx.setCursor(5, y);
         if (i == selectedMenuItem) {
-          M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-          M5.Lcd.setTextColor(WHITE);
+          gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+          gfx.setTextColor(WHITE);
         }
-        M5.Lcd.print(mainMenuItems[i].title);
+        gfx.print(mainMenuItems[i].title);
         y += 16;
-        M5.Lcd.setTextColor(WHITE);
+        gfx.setTextColor(WHITE);
       }
       break;
     }
     
     case MENU_WIFI: {
       for (int i = menuStartPosition; i < WIFI_MENU_ITEMS_COUNT && i < menuStartPosition + displayLines; i++) {
-        M5.Lcd.setCursor(5, y);
+        gfx.setCursor(5, y);
         if (i == selectedMenuItem) {
-          M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-          M5.Lcd.setTextColor(WHITE);
+          gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+          gfx.setTextColor(WHITE);
         }
-        M5.Lcd.print(wifiMenuItems[i].title);
+        gfx.print(wifiMenuItems[i].title);
         y += 16;
-        M5.Lcd.setTextColor(WHITE);
+        gfx.setTextColor(WHITE);
       }
       break;
     }
     
     case MENU_KVM: {
       for (int i = menuStartPosition; i < KVM_MENU_ITEMS_COUNT && i < menuStartPosition + displayLines; i++) {
-        M5.Lcd.setCursor(5, y);
+        gfx.setCursor(5, y);
         if (i == selectedMenuItem) {
-          M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-          M5.Lcd.setTextColor(WHITE);
+          gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+          gfx.setTextColor(WHITE);
         }
-        M5.Lcd.print(kvmMenuItems[i].title);
+        gfx.print(kvmMenuItems[i].title);
         y += 16;
-        M5.Lcd.setTextColor(WHITE);
+        gfx.setTextColor(WHITE);
       }
       break;
     }
     
     case MENU_AP_OPTIONS: {
       for (int i = menuStartPosition; i < AP_OPTIONS_ITEMS_COUNT && i < menuStartPosition + displayLines; i++) {
-        M5.Lcd.setCursor(5, y);
+        gfx.setCursor(5, y);
         if (i == selectedMenuItem) {
-          M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-          M5.Lcd.setTextColor(WHITE);
+          gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+          gfx.setTextColor(WHITE);
         }
         
         if (i == 0) { // AP Mode
-          M5.Lcd.print(apOptionsItems[i]);
-          M5.Lcd.print(": ");
+          gfx.print(apOptionsItems[i]);
+          gfx.print(": ");
           switch (apConfig.mode) {
-            case AP_MODE_OFF: M5.Lcd.print("Off"); break;
-            case AP_MODE_NORMAL: M5.Lcd.print("Normal"); break;
-            case AP_MODE_REPEATER: M5.Lcd.print("Repeater"); break;
-            case AP_MODE_HIDDEN: M5.Lcd.print("Hidden"); break;
-            case AP_MODE_HONEYPOT: M5.Lcd.print("Honeypot"); break;
+            case AP_MODE_OFF: gfx.print("Off"); break;
+            case AP_MODE_NORMAL: gfx.print("Normal"); break;
+            case AP_MODE_REPEATER: gfx.print("Repeater"); break;
+            case AP_MODE_HIDDEN: gfx.print("Hidden"); break;
+            case AP_MODE_HONEYPOT: gfx.print("Honeypot"); break;
           }
         } else {
-          M5.Lcd.print(apOptionsItems[i]);
+          gfx.print(apOptionsItems[i]);
         }
         
         y += 16;
-        M5.Lcd.setTextColor(WHITE);
+        gfx.setTextColor(WHITE);
       }
       break;
     }
     
     case MENU_AP_STATUS: {
       // Отображаем информацию о статусе AP
-      M5.Lcd.setCursor(5, y);
-      M5.Lcd.print("Mode: ");
+      gfx.setCursor(5, y);
+      gfx.print("Mode: ");
       switch (apConfig.mode) {
-        case AP_MODE_OFF: M5.Lcd.print("Off"); break;
-        case AP_MODE_NORMAL: M5.Lcd.print("Normal"); break;
-        case AP_MODE_REPEATER: M5.Lcd.print("Repeater"); break;
-        case AP_MODE_HIDDEN: M5.Lcd.print("Hidden"); break;
-        case AP_MODE_HONEYPOT: M5.Lcd.print("Honeypot"); break;
+        case AP_MODE_OFF: gfx.print("Off"); break;
+        case AP_MODE_NORMAL: gfx.print("Normal"); break;
+        case AP_MODE_REPEATER: gfx.print("Repeater"); break;
+        case AP_MODE_HIDDEN: gfx.print("Hidden"); break;
+        case AP_MODE_HONEYPOT: gfx.print("Honeypot"); break;
       }
       y += 16;
       
       if (apConfig.mode != AP_MODE_OFF) {
-        M5.Lcd.setCursor(5, y);
-        M5.Lcd.print("AP IP: ");
-        M5.Lcd.print(WiFi.softAPIP().toString());
+        gfx.setCursor(5, y);
+        gfx.print("AP IP: ");
+        gfx.print(WiFi.softAPIP().toString());
         y += 16;
         
-        M5.Lcd.setCursor(5, y);
-        M5.Lcd.print("Clients: ");
-        M5.Lcd.print(WiFi.softAPgetStationNum());
+        gfx.setCursor(5, y);
+        gfx.print("Clients: ");
+        gfx.print(WiFi.softAPgetStationNum());
         y += 16;
       }
       
       if (WiFi.status() == WL_CONNECTED) {
-        M5.Lcd.setCursor(5, y);
-        M5.Lcd.print("Ext IP: ");
-        M5.Lcd.print(WiFi.localIP().toString());
+        gfx.setCursor(5, y);
+        gfx.print("Ext IP: ");
+        gfx.print(WiFi.localIP().toString());
         y += 16;
       }
       
@@ -2344,14 +4310,14 @@ void drawMenu() {
       
       // Отображаем пункты меню
       for (int i = menuStartPosition; i < AP_STATUS_MENU_ITEMS_COUNT && i < menuStartPosition + displayLines; i++) {
-        M5.Lcd.setCursor(5, y);
+        gfx.setCursor(5, y);
         if (i == selectedMenuItem) {
-          M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-          M5.Lcd.setTextColor(WHITE);
+          gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+          gfx.setTextColor(WHITE);
         }
-        M5.Lcd.print(apStatusMenuItems[i].title);
+        gfx.print(apStatusMenuItems[i].title);
         y += 16;
-        M5.Lcd.setTextColor(WHITE);
+        gfx.setTextColor(WHITE);
       }
       break;
     }
@@ -2359,317 +4325,336 @@ void drawMenu() {
     case MENU_AP_USERS: {
       // Отображаем список IP-адресов подключенных клиентов
       for (int i = menuStartPosition; i < apClients.size() && i < menuStartPosition + displayLines; i++) {
-        M5.Lcd.setCursor(5, y);
+        gfx.setCursor(5, y);
         if (i == selectedMenuItem) {
-          M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-          M5.Lcd.setTextColor(WHITE);
+          gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+          gfx.setTextColor(WHITE);
         }
         
-        M5.Lcd.print(apClients[i].ip.toString());
-        if (apClients[i].blocked) {
-          M5.Lcd.print(" [BLK]");
+        APClient client;
+        apClients.get(i, client);
+        gfx.print(client.ip.toString());
+        if (client.blocked) {
+          gfx.print(" [BLK]");
+        } else if (!client.connected) {
+          gfx.print(" [OFF]");
         }
         
         y += 16;
-        M5.Lcd.setTextColor(WHITE);
+        gfx.setTextColor(WHITE);
       }
       
       // Кнопка возврата
       if ((apClients.size() == selectedMenuItem) || (apClients.size() == 0 && selectedMenuItem == 0)) {
-        M5.Lcd.setCursor(5, y);
-        M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-        M5.Lcd.setTextColor(WHITE);
+        gfx.setCursor(5, y);
+        gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+        gfx.setTextColor(WHITE);
       }
-      M5.Lcd.setCursor(5, y);
-      M5.Lcd.print("Back to AP Status");
-      M5.Lcd.setTextColor(WHITE);
+      gfx.setCursor(5, y);
+      gfx.print("Back to AP Status");
+      gfx.setTextColor(WHITE);
       break;
     }
     
     case MENU_AP_USER_MENU: {
       for (int i = menuStartPosition; i < AP_USER_MENU_OPTIONS_COUNT && i < menuStartPosition + displayLines; i++) {
-        M5.Lcd.setCursor(5, y);
+        gfx.setCursor(5, y);
         if (i == selectedMenuItem) {
-          M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-          M5.Lcd.setTextColor(WHITE);
+          gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+          gfx.setTextColor(WHITE);
         }
         
-        M5.Lcd.print(apUserMenuOptions[i]);
+        gfx.print(apUserMenuOptions[i]);
         
         // Добавляем индикатор состояния для Block/Unblock
-        if (i == 2 && selectedAPUser >= 0 && selectedAPUser < apClients.size()) {
-          M5.Lcd.print(apClients[selectedAPUser].blocked ? " [BLOCKED]" : " [ACTIVE]");
+        APClient client;
+        if (i == 2 && apClients.get(selectedAPUser, client)) {
+          gfx.print(client.blocked ? " [BLOCKED]" : " [ACTIVE]");
         }
         
         y += 16;
-        M5.Lcd.setTextColor(WHITE);
+        gfx.setTextColor(WHITE);
       }
       break;
     }
     
     case MENU_AP_USER_INFO: {
-      if (selectedAPUser >= 0 && selectedAPUser < apClients.size()) {
-        const auto& client = apClients[selectedAPUser];
+      APClient client;
+      if (apClients.get(selectedAPUser, client)) {
         
-        M5.Lcd.setCursor(5, y);
-        M5.Lcd.print("IP: ");
-        M5.Lcd.println(client.ip.toString());
+        gfx.setCursor(5, y);
+        gfx.print("IP: ");
+        gfx.println(client.ip.toString());
         y += 16;
         
-        M5.Lcd.setCursor(5, y);
+        gfx.setCursor(5, y);
         char macStr[18];
-        sprintf(macStr, "%02X:%02X:%02X:%02X:%02X:%02X",
-                client.mac[0], client.mac[1], client.mac[2],
-                client.mac[3], client.mac[4], client.mac[5]);
-        M5.Lcd.print("MAC: ");
-        M5.Lcd.println(macStr);
+        formatMAC(client.mac, macStr);
+        gfx.print("MAC: ");
+        gfx.println(macStr);
         y += 16;
         
-        M5.Lcd.setCursor(5, y);
-        M5.Lcd.print("Total: ");
-        M5.Lcd.print(client.totalBytes);
-        M5.Lcd.println(" bytes");
+        gfx.setCursor(5, y);
+        APTrafficSample traffic;
+        APTrafficMeter::get(client.mac, traffic);
+        gfx.print("Total: ");
+        gfx.print(traffic.rxBytes + traffic.txBytes);
+        gfx.print(" B, ");
+        gfx.print((uint32_t)(traffic.rxRate + traffic.txRate));
+        gfx.println(" B/s");
         y += 16;
         
-        M5.Lcd.setCursor(5, y);
-        M5.Lcd.print("Status: ");
-        M5.Lcd.println(client.blocked ? "BLOCKED" : "ACTIVE");
+        gfx.setCursor(5, y);
+        gfx.print("Status: ");
+        gfx.println(client.blocked ? "BLOCKED" : (client.connected ? "ACTIVE" : "OFFLINE"));
         y += 16;
         
-        M5.Lcd.setCursor(5, y);
-        M5.Lcd.print("Last seen: ");
-        M5.Lcd.print((millis() - client.lastSeen) / 1000);
-        M5.Lcd.println("s ago");
+        gfx.setCursor(5, y);
+        gfx.print("Last seen: ");
+        gfx.print((millis() - client.lastSeen) / 1000);
+        gfx.println("s ago");
         y += 16;
       }
       
       // Кнопка возврата
       y += 8;
-      M5.Lcd.setCursor(5, y);
+      gfx.setCursor(5, y);
       if (selectedMenuItem == 0) {
-        M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-        M5.Lcd.setTextColor(WHITE);
+        gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+        gfx.setTextColor(WHITE);
       }
-      M5.Lcd.print("Back to User Menu");
-      M5.Lcd.setTextColor(WHITE);
+      gfx.print("Back to User Menu");
+      gfx.setTextColor(WHITE);
       break;
     }
 
     
     case MENU_AP_USER_SNIFF: {
-      // Отображаем статус сниффинга
-      M5.Lcd.setCursor(5, y);
-      M5.Lcd.print("Status: ");
-      M5.Lcd.println(isSniffing ? "ACTIVE" : "OFF");
+      // Отображаем статус сниффинга выбранного клиента
+      APClient sniffClient;
+      bool clientSniffing = apClients.get(selectedAPUser, sniffClient) && isSniffingClient(sniffClient);
+      gfx.setCursor(5, y);
+      gfx.print("Status: ");
+      gfx.println(clientSniffing ? "ACTIVE" : "OFF");
       y += 16;
       
-      if (isSniffing && selectedAPUser >= 0 && selectedAPUser < apClients.size()) {
-        M5.Lcd.setCursor(5, y);
-        M5.Lcd.print("Packets: ");
-        M5.Lcd.println(packetBuffer.size());
+      if (clientSniffing) {
+        int stream = sniffFilter.streamOf(sniffClient.mac);
+        gfx.setCursor(5, y);
+        gfx.print("Packets: ");
+        gfx.println(sniffFilter.stream(stream).packets.load());
         y += 16;
         
-        // Отображаем последние пакеты
-        int startIdx = max(0, (int)packetBuffer.size() - 5);
-        for (int i = startIdx; i < packetBuffer.size(); i++) {
-          M5.Lcd.setCursor(5, y);
+        // Отображаем последние пакеты этого клиента
+        SniffedPacket recent[16];
+        size_t recentCount = packetBuffer.snapshot(recent, 16);
+        for (size_t i = 0; i < recentCount; i++) {
+          if (recent[i].stream != stream) continue;
+          gfx.setCursor(5, y);
           char packetInfo[64];
           snprintf(packetInfo, sizeof(packetInfo), "%s %dB", 
-                   packetBuffer[i].type.c_str(), 
-                   packetBuffer[i].size);
-          M5.Lcd.println(packetInfo);
+                   sniffFrameTypeName(recent[i].type), 
+                   recent[i].size);
+          gfx.println(packetInfo);
           y += 16;
           
-          if (y > M5.Lcd.height() - 40) break;
+          if (y > gfx.height() - 40) break;
         }
       }
       
       // Опции управления
-      y = M5.Lcd.height() - 36;
-      M5.Lcd.setCursor(5, y);
+      y = gfx.height() - 36;
+      gfx.setCursor(5, y);
       if (selectedMenuItem == 0) {
-        M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-        M5.Lcd.setTextColor(WHITE);
+        gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+        gfx.setTextColor(WHITE);
       }
-      M5.Lcd.print(isSniffing ? "Stop Sniffing" : "Start Sniffing");
-      M5.Lcd.setTextColor(WHITE);
+      gfx.print(clientSniffing ? "Stop Sniffing" : "Start Sniffing");
+      gfx.setTextColor(WHITE);
       
       y += 16;
-      M5.Lcd.setCursor(5, y);
+      gfx.setCursor(5, y);
       if (selectedMenuItem == 1) {
-        M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-        M5.Lcd.setTextColor(WHITE);
+        gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+        gfx.setTextColor(WHITE);
       }
-      M5.Lcd.print("Back to User Menu");
-      M5.Lcd.setTextColor(WHITE);
+      gfx.print("Back to User Menu");
+      gfx.setTextColor(WHITE);
       break;
     }
     
     case MENU_AP_MODE_SELECT: {
       for (int i = menuStartPosition; i < AP_MODE_ITEMS_COUNT && i < menuStartPosition + displayLines; i++) {
-        M5.Lcd.setCursor(5, y);
+        gfx.setCursor(5, y);
         if (i == selectedMenuItem) {
-          M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-          M5.Lcd.setTextColor(WHITE);
+          gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+          gfx.setTextColor(WHITE);
         }
         
         if (i == (int)apConfig.mode) {
-          M5.Lcd.print("> ");
+          gfx.print("> ");
         } else {
-          M5.Lcd.print("  ");
+          gfx.print("  ");
         }
         
-        M5.Lcd.print(apModeItems[i]);
+        gfx.print(apModeItems[i]);
         y += 16;
-        M5.Lcd.setTextColor(WHITE);
+        gfx.setTextColor(WHITE);
       }
       break;
     }
     
     case MENU_WIFI_SCAN: {
-      if (networks.size() > 0) {
-        for (int i = menuStartPosition; i < networks.size() && i < menuStartPosition + displayLines; i++) {
-          M5.Lcd.setCursor(5, y);
+      int count = scanNetworkCount();
+      WiFiResult network;
+      if (count > 0) {
+        for (int i = menuStartPosition; i < count && i < menuStartPosition + displayLines; i++) {
+          // Список мог смениться между чтениями - тогда строк меньше
+          if (!getScanNetwork(i, network)) {
+            break;
+          }
+          gfx.setCursor(5, y);
           if (i == selectedMenuItem) {
-            M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-            M5.Lcd.setTextColor(WHITE);
+            gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+            gfx.setTextColor(WHITE);
           }
           
-          String networkInfo = networks[i].ssid;
+          String networkInfo = network.ssid;
           if (networkInfo.length() > 10) {
             networkInfo = networkInfo.substring(0, 10) + "...";
           }
-          networkInfo += " " + String(networks[i].rssi) + "dBm";
-          M5.Lcd.print(networkInfo);
+          networkInfo += " " + String(network.rssi) + "dBm";
+          gfx.print(networkInfo);
           
           y += 16;
-          M5.Lcd.setTextColor(WHITE);
+          gfx.setTextColor(WHITE);
         }
       } else if (isScanningWifi) {
-        M5.Lcd.setCursor(5, y);
-        M5.Lcd.print("Scanning...");
+        gfx.setCursor(5, y);
+        gfx.print("Scanning...");
       } else {
-        M5.Lcd.setCursor(5, y);
-        M5.Lcd.print("Press A to scan WiFi");
+        gfx.setCursor(5, y);
+        gfx.print("Press A to scan WiFi");
       }
       break;
     }
     
     case MENU_WIFI_SAVED: {
+      SettingsGuard guard;
       if (savedNetworks.size() > 0) {
         for (int i = menuStartPosition; i < savedNetworks.size() && i < menuStartPosition + displayLines; i++) {
-          M5.Lcd.setCursor(5, y);
+          gfx.setCursor(5, y);
           if (i == selectedMenuItem) {
-            M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-            M5.Lcd.setTextColor(WHITE);
+            gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+            gfx.setTextColor(WHITE);
           }
           
-          M5.Lcd.print(savedNetworks[i].ssid);
+          gfx.print(savedNetworks[i].ssid);
           y += 16;
-          M5.Lcd.setTextColor(WHITE);
+          gfx.setTextColor(WHITE);
         }
       } else {
-        M5.Lcd.setCursor(5, y);
-        M5.Lcd.print("No saved networks");
+        gfx.setCursor(5, y);
+        gfx.print("No saved networks");
         y += 16;
       }
       
       // Кнопка возврата
       if (savedNetworks.size() <= menuStartPosition + displayLines - 1) {
-        M5.Lcd.setCursor(5, y);
+        gfx.setCursor(5, y);
         if (savedNetworks.size() == selectedMenuItem) {
-          M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-          M5.Lcd.setTextColor(WHITE);
+          gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+          gfx.setTextColor(WHITE);
         }
-        M5.Lcd.print("Back to Main Menu");
-        M5.Lcd.setTextColor(WHITE);
+        gfx.print("Back to Main Menu");
+        gfx.setTextColor(WHITE);
       }
       break;
     }
     
     case MENU_KVM_MONITOR: {
-      const auto& networkInfo = deviceManager.getNetworkInfo();
+      NetworkInfo networkInfo = deviceManager.getNetworkInfo();
       
       // Отображаем информацию о сети
-      M5.Lcd.setCursor(5, y);
+      gfx.setCursor(5, y);
       if (networkInfo.connected) {
-        M5.Lcd.print("WiFi: ");
-        M5.Lcd.print(networkInfo.ssid);
+        gfx.print("WiFi: ");
+        gfx.print(networkInfo.ssid);
         y += 16;
-        M5.Lcd.setCursor(5, y);
-        M5.Lcd.print("IP: ");
-        M5.Lcd.print(networkInfo.localIP);
+        gfx.setCursor(5, y);
+        gfx.print("IP: ");
+        gfx.print(networkInfo.localIP);
       } else {
-        M5.Lcd.print("WiFi: Not Connected");
+        gfx.print("WiFi: Not Connected");
       }
       
       y += 16;
-      M5.Lcd.setCursor(5, y);
-      M5.Lcd.print("KVM Pins:");
+      gfx.setCursor(5, y);
+      gfx.print("KVM Pins:");
       y += 16;
       
       // Отображаем состояние пинов
-      const auto& kvmPins = kvmModule.getPins();
-      for (int i = 0; i < kvmPins.size() && y < M5.Lcd.height() - 16; i++) {
-        M5.Lcd.setCursor(5, y);
+      std::vector<EnhancedPinConfig> kvmPins = kvmModule.getPins();
+      for (int i = 0; i < kvmPins.size() && y < gfx.height() - 16; i++) {
+        gfx.setCursor(5, y);
         if (i == selectedMenuItem - 2) {
-          M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-          M5.Lcd.setTextColor(WHITE);
+          gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+          gfx.setTextColor(WHITE);
         }
         
-        M5.Lcd.print(kvmPins[i].name);
-        M5.Lcd.print(": ");
+        gfx.print(kvmPins[i].name);
+        gfx.print(": ");
         // Визуальная инверсия отображения при включенной инверсии
         if (globalDeviceSettings.invertPins) {
-          M5.Lcd.print(kvmPins[i].state ? "OFF" : "ON");
+          gfx.print(kvmPins[i].state ? "OFF" : "ON");
         } else {
-          M5.Lcd.print(kvmPins[i].state ? "ON" : "OFF");
+          gfx.print(kvmPins[i].state ? "ON" : "OFF");
         }
         y += 16;
-        M5.Lcd.setTextColor(WHITE);
+        gfx.setTextColor(WHITE);
       }
       break;
     }
     
     case MENU_KVM_OPTIONS: {
-      const auto& pins = kvmModule.getPins();
+      std::vector<EnhancedPinConfig> pins = kvmModule.getPins();
       
       // Отображаем пины для настройки
       for (int i = menuStartPosition; i < pins.size() && i < menuStartPosition + displayLines; i++) {
-        M5.Lcd.setCursor(5, y);
+        gfx.setCursor(5, y);
         if (i == selectedMenuItem) {
-          M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-          M5.Lcd.setTextColor(WHITE);
+          gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+          gfx.setTextColor(WHITE);
         }
         
         // Отображаем имя пина
-        M5.Lcd.print(pins[i].name);
-        M5.Lcd.print(" (");
-        M5.Lcd.print(pins[i].pin);
-        M5.Lcd.print(")");
+        gfx.print(pins[i].name);
+        gfx.print(" (");
+        gfx.print(pins[i].pin);
+        gfx.print(")");
         
         // Отображаем состояние
-        M5.Lcd.print(" ");
+        gfx.print(" ");
         if (globalDeviceSettings.invertPins) {
-          M5.Lcd.print(pins[i].state ? "OFF" : "ON");
+          gfx.print(pins[i].state ? "OFF" : "ON");
         } else {
-          M5.Lcd.print(pins[i].state ? "ON" : "OFF");
+          gfx.print(pins[i].state ? "ON" : "OFF");
         }
         
         // Добавляем кнопку импульса
-        M5.Lcd.setCursor(M5.Lcd.width() - 40, y);
-        M5.Lcd.print("[P]");
+        gfx.setCursor(gfx.width() - 40, y);
+        gfx.print("[P]");
         
         y += 16;
         
         // Отображаем настройку длительности импульса
-        M5.Lcd.setCursor(20, y);
-        M5.Lcd.setTextSize(1);
-        M5.Lcd.print("Pulse: 500ms");
+        gfx.setCursor(20, y);
+        gfx.setTextSize(1);
+        gfx.print("Pulse: 500ms");
         y += 16;
         
-        M5.Lcd.setTextColor(WHITE);
-        M5.Lcd.setTextSize(1);
+        gfx.setTextColor(WHITE);
+        gfx.setTextSize(1);
       }
       
       // Отображаем дополнительные пункты меню
@@ -2677,128 +4662,167 @@ void drawMenu() {
       
       // Connection Check
       if (extraItemsStart <= menuStartPosition + displayLines) {
-        M5.Lcd.setCursor(5, y);
+        gfx.setCursor(5, y);
         if (extraItemsStart == selectedMenuItem) {
-          M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-          M5.Lcd.setTextColor(WHITE);
+          gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+          gfx.setTextColor(WHITE);
         }
         
-        M5.Lcd.print("Connection Check: ");
+        gfx.print("Connection Check: ");
         switch (kvmModule.getCheckInterval()) {
-          case CHECK_OFF:    M5.Lcd.print("OFF"); break;
-          case CHECK_10SEC:  M5.Lcd.print("10s"); break;
-          case CHECK_30SEC:  M5.Lcd.print("30s"); break;
-          case CHECK_1MIN:   M5.Lcd.print("1m"); break;
-          case CHECK_5MIN:   M5.Lcd.print("5m"); break;
-          case CHECK_30MIN:  M5.Lcd.print("30m"); break;
+          case CHECK_OFF:    gfx.print("OFF"); break;
+          case CHECK_10SEC:  gfx.print("10s"); break;
+          case CHECK_30SEC:  gfx.print("30s"); break;
+          case CHECK_1MIN:   gfx.print("1m"); break;
+          case CHECK_5MIN:   gfx.print("5m"); break;
+          case CHECK_30MIN:  gfx.print("30m"); break;
         }
         y += 16;
-        M5.Lcd.setTextColor(WHITE);
+        gfx.setTextColor(WHITE);
       }
       
       // DHCP
       if (extraItemsStart + 1 <= menuStartPosition + displayLines) {
-        M5.Lcd.setCursor(5, y);
+        gfx.setCursor(5, y);
         if (extraItemsStart + 1 == selectedMenuItem) {
-          M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-          M5.Lcd.setTextColor(WHITE);
+          gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+          gfx.setTextColor(WHITE);
         }
         
-        M5.Lcd.print("Use DHCP: ");
-        M5.Lcd.print(kvmModule.getUseDHCP() ? "YES" : "NO");
+        gfx.print("Use DHCP: ");
+        gfx.print(kvmModule.getUseDHCP() ? "YES" : "NO");
         y += 16;
-        M5.Lcd.setTextColor(WHITE);
+        gfx.setTextColor(WHITE);
       }
       
       // Back to Main Menu
       if (extraItemsStart + 2 <= menuStartPosition + displayLines) {
-        M5.Lcd.setCursor(5, y);
+        gfx.setCursor(5, y);
         if (extraItemsStart + 2 == selectedMenuItem) {
-          M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-          M5.Lcd.setTextColor(WHITE);
+          gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+          gfx.setTextColor(WHITE);
         }
         
-        M5.Lcd.print("Back to Main Menu");
-        M5.Lcd.setTextColor(WHITE);
+        gfx.print("Back to Main Menu");
+        gfx.setTextColor(WHITE);
       }
       break;
     }
     
     case MENU_IR_CONTROL: {
-      M5.Lcd.setCursor(5, y);
-      M5.Lcd.print("IR Control - Coming Soon");
+      gfx.setCursor(5, y);
+      gfx.print("IR Control - Coming Soon");
       y += 16;
-      M5.Lcd.setCursor(5, y);
-      M5.Lcd.print("This feature is not");
+      gfx.setCursor(5, y);
+      gfx.print("This feature is not");
       y += 16;
-      M5.Lcd.setCursor(5, y);
-      M5.Lcd.print("implemented yet.");
+      gfx.setCursor(5, y);
+      gfx.print("implemented yet.");
       y += 32;
-      M5.Lcd.setCursor(5, y);
-      M5.Lcd.print("Press A to return");
+      gfx.setCursor(5, y);
+      gfx.print("Press A to return");
       break;
     }
     
     case MENU_DEVICE_SETTINGS: {
       for (int i = menuStartPosition; i < DEVICE_SETTINGS_ITEMS_COUNT && i < menuStartPosition + displayLines; i++) {
-        M5.Lcd.setCursor(5, y);
+        gfx.setCursor(5, y);
         if (i == selectedMenuItem) {
-          M5.Lcd.fillRect(0, y-1, M5.Lcd.width(), 12, BLUE);
-          M5.Lcd.setTextColor(WHITE);
+          gfx.fillRect(0, y-1, gfx.width(), 12, BLUE);
+          gfx.setTextColor(WHITE);
         }
         
-        M5.Lcd.print(deviceSettingsItems[i]);
+        gfx.print(deviceSettingsItems[i]);
         
         switch (i) {
           case 0: // Brightness
-            M5.Lcd.print(": ");
-            M5.Lcd.print(deviceSettings.brightness);
-            M5.Lcd.print("%");
+            gfx.print(": ");
+            gfx.print(deviceSettings.brightness);
+            gfx.print("%");
             break;
           case 1: // Sleep Timeout
-            M5.Lcd.print(": ");
+            gfx.print(": ");
             if (deviceSettings.sleepTimeout == 0) {
-              M5.Lcd.print("Off");
+              gfx.print("Off");
             } else {
-              M5.Lcd.print(deviceSettings.sleepTimeout);
-              M5.Lcd.print("s");
+              gfx.print(deviceSettings.sleepTimeout);
+              gfx.print("s");
             }
             break;
           case 2: // Device ID
-            M5.Lcd.print(": ");
+            gfx.print(": ");
             if (deviceSettings.deviceId.length() > 8) {
-              M5.Lcd.print(deviceSettings.deviceId.substring(0, 8));
-              M5.Lcd.print("...");
+              gfx.print(deviceSettings.deviceId.substring(0, 8));
+              gfx.print("...");
             } else {
-              M5.Lcd.print(deviceSettings.deviceId);
+              gfx.print(deviceSettings.deviceId);
             }
             break;
           case 3: // Display Rotation
-            M5.Lcd.print(": ");
-            M5.Lcd.print(deviceSettings.rotateDisplay ? "On" : "Off");
+            gfx.print(": ");
+            gfx.print(deviceSettings.rotateDisplay ? "On" : "Off");
             break;
           case 4: // Volume
-            M5.Lcd.print(": ");
-            M5.Lcd.print(deviceSettings.volume);
-            M5.Lcd.print("%");
+            gfx.print(": ");
+            gfx.print(deviceSettings.volume);
+            gfx.print("%");
             break;
           case 5: // Invert KVM Pins
-            M5.Lcd.print(": ");
-            M5.Lcd.print(deviceSettings.invertPins ? "Yes" : "No");
+            gfx.print(": ");
+            gfx.print(deviceSettings.invertPins ? "Yes" : "No");
             break;
         }
         
         y += 16;
-        M5.Lcd.setTextColor(WHITE);
+        gfx.setTextColor(WHITE);
       }
       break;
     }
   }
   
   // Отображение подсказок для кнопок
-  M5.Lcd.drawLine(0, M5.Lcd.height() - 15, M5.Lcd.width(), M5.Lcd.height() - 15, WHITE);
-  M5.Lcd.setCursor(5, M5.Lcd.height() - 12);
-  M5.Lcd.print("A:Select B:Down C:Up");
+  gfx.drawLine(0, gfx.height() - 15, gfx.width(), gfx.height() - 15, WHITE);
+  gfx.setCursor(5, gfx.height() - 12);
+  gfx.print("A:Select B:Down C:Up");
+  lcdRenderer.present();
+}
+
+// Название HTTP-метода для журнала
+const char* httpMethodName(uint8_t method) {
+  switch (method) {
+    case HTTP_GET: return "GET";
+    case HTTP_POST: return "POST";
+    case HTTP_DELETE: return "DELETE";
+    case HTTP_PUT: return "PUT";
+    case HTTP_PATCH: return "PATCH";
+    case HTTP_HEAD: return "HEAD";
+    case HTTP_OPTIONS: return "OPTIONS";
+    default: return "UNKNOWN";
+  }
+}
+
+// Экран активности ловушки
+void drawHoneypotActivity() {
+  if (powerManager.isDisplayOff()) {
+    return;
+  }
+  LovyanGFX& gfx = lcdRenderer.target();
+  gfx.fillScreen(BLACK);
+  gfx.setCursor(0, 0);
+  gfx.setTextSize(1);
+  gfx.setTextColor(WHITE);
+  gfx.println("Honeypot Activity");
+  gfx.println("-----------------");
+  HoneypotConnection last;
+  if (honeypot.getLast(last)) {
+    gfx.print("Client: ");
+    gfx.println(IPAddress(last.clientIP).toString());
+    gfx.print("URL: ");
+    gfx.println(last.url);
+  }
+  gfx.print("Total connections: ");
+  gfx.println(honeypot.getConnectionCount());
+  lcdRenderer.present();
 }
 
 // Обработка выбора пункта меню
@@ -2841,18 +4865,22 @@ void handleMenuAction() {
         menuStartPosition = 0;
       } else if (selectedMenuItem == 1) {
         // Настройка SSID и пароля
+        lcdRenderer.invalidate();
         M5.Lcd.fillScreen(BLACK);
         M5.Lcd.setCursor(0, 0);
         M5.Lcd.println("AP Settings");
         M5.Lcd.println("-----------------");
-        M5.Lcd.print("SSID: ");
-        M5.Lcd.println(apConfig.ssid);
-        M5.Lcd.print("Pass: ");
-        M5.Lcd.println(apConfig.password);
+        {
+          SettingsGuard guard;
+          M5.Lcd.print("SSID: ");
+          M5.Lcd.println(apConfig.ssid);
+          M5.Lcd.print("Pass: ");
+          M5.Lcd.println(apConfig.password);
+        }
         M5.Lcd.println("\nUse web interface to change");
         M5.Lcd.println("these settings");
         
-        delay(3000);
+        holdScreen(3000);
       } else if (selectedMenuItem == 2) {
         // Возврат в главное меню
         currentSection = MENU_MAIN;
@@ -2907,33 +4935,12 @@ void handleMenuAction() {
           break;
           
         case 2: // Block/Unblock
-          if (selectedAPUser >= 0 && selectedAPUser < apClients.size()) {
+          {
             // Переключаем блокировку
-            char macStr[18];
-            sprintf(macStr, "%02X:%02X:%02X:%02X:%02X:%02X",
-                    apClients[selectedAPUser].mac[0],
-                    apClients[selectedAPUser].mac[1],
-                    apClients[selectedAPUser].mac[2],
-                    apClients[selectedAPUser].mac[3],
-                    apClients[selectedAPUser].mac[4],
-                    apClients[selectedAPUser].mac[5]);
-            
-            if (apClients[selectedAPUser].blocked) {
-              // Разблокируем
-              networkTools.unblockIP(apClients[selectedAPUser].ip.toString());
-              for (auto it = blockedMACs.begin(); it != blockedMACs.end(); ++it) {
-                if (*it == macStr) {
-                  blockedMACs.erase(it);
-                  break;
-                }
-              }
-            } else {
-              // Блокируем
-              networkTools.blockIP(apClients[selectedAPUser].ip.toString());
-              blockedMACs.push_back(macStr);
+            APClient client;
+            if (apClients.get(selectedAPUser, client)) {
+              setClientBlocked(selectedAPUser, client, !client.blocked);
             }
-            apClients[selectedAPUser].blocked = !apClients[selectedAPUser].blocked;
-            saveBlockedMACs();
           }
           break;
           
@@ -2947,9 +4954,10 @@ void handleMenuAction() {
 
     case MENU_AP_USER_SNIFF:
         if (selectedMenuItem == 0) {
-          // Start/Stop Sniffing
-          if (isSniffing) {
-            stopPacketSniffing();
+          // Start/Stop Sniffing выбранного клиента
+          APClient client;
+          if (apClients.get(selectedAPUser, client) && isSniffingClient(client)) {
+            stopPacketSniffing(selectedAPUser);
           } else {
             startPacketSniffing(selectedAPUser);
           }
@@ -2958,7 +4966,7 @@ void handleMenuAction() {
           currentSection = MENU_AP_USER_MENU;
           selectedMenuItem = 1;
           if (isSniffing) {
-            stopPacketSniffing();
+            stopPacketSniffing(selectedAPUser);
           }
         }
       break;
@@ -2990,25 +4998,27 @@ void handleMenuAction() {
     
     case MENU_WIFI_SCAN:
       if (!isScanningWifi) {
-        if (networks.size() > 0 && selectedMenuItem >= 0 && selectedMenuItem < networks.size()) {
+        WiFiResult network;
+        if (selectedMenuItem >= 0 && getScanNetwork(selectedMenuItem, network)) {
           // Показываем подробную информацию о выбранной сети
+          lcdRenderer.invalidate();
           M5.Lcd.fillScreen(BLACK);
           M5.Lcd.setCursor(0, 0);
           M5.Lcd.println("Network Details");
           M5.Lcd.println("-----------------");
           
           M5.Lcd.print("SSID: ");
-          M5.Lcd.println(networks[selectedMenuItem].ssid);
+          M5.Lcd.println(network.ssid);
           
           M5.Lcd.print("Signal: ");
-          M5.Lcd.print(networks[selectedMenuItem].rssi);
+          M5.Lcd.print(network.rssi);
           M5.Lcd.println(" dBm");
           
           M5.Lcd.print("Channel: ");
-          M5.Lcd.println(networks[selectedMenuItem].channel);
+          M5.Lcd.println(network.channel);
           
           M5.Lcd.print("Security: ");
-          switch (networks[selectedMenuItem].encryptionType) {
+          switch (network.encryptionType) {
             case WIFI_AUTH_OPEN:
               M5.Lcd.println("Open");
               break;
@@ -3029,15 +5039,7 @@ void handleMenuAction() {
           }
           
           M5.Lcd.println("\nPress any button to return");
-          
-          // Ждем нажатия любой кнопки для возврата
-          while (true) {
-            M5.update();
-            if (M5.BtnA.wasPressed() || M5.BtnB.wasPressed() || M5.BtnC.wasPressed()) {
-              break;
-            }
-            delay(50);
-          }
+          holdScreen(0);
         } else {
           // Запускаем сканирование
           scanWiFiNetworks();
@@ -3058,7 +5060,7 @@ void handleMenuAction() {
       break;
     
     case MENU_KVM_OPTIONS: {
-      const auto& pins = kvmModule.getPins();
+      std::vector<EnhancedPinConfig> pins = kvmModule.getPins();
       if (selectedMenuItem >= 0 && selectedMenuItem < pins.size()) {
         // Проверяем, нажат ли импульс
         auto touchPoint = M5.Touch.getTouchPointRaw();
@@ -3086,7 +5088,7 @@ void handleMenuAction() {
     }
     
     case MENU_KVM_MONITOR: {
-      const auto& kvmPins = kvmModule.getPins();
+      std::vector<EnhancedPinConfig> kvmPins = kvmModule.getPins();
       if (selectedMenuItem >= 2 && selectedMenuItem < 2 + kvmPins.size()) {
         // Переключаем пин
         kvmModule.togglePin(selectedMenuItem - 2);
@@ -3106,7 +5108,7 @@ void handleMenuAction() {
         // Brightness
         deviceSettings.brightness = (deviceSettings.brightness + 20) % 120;
         if (deviceSettings.brightness > 100) deviceSettings.brightness = 20;
-        M5.Lcd.setBrightness(deviceSettings.brightness);
+        powerManager.setBrightness(deviceSettings.brightness);
         saveDeviceSettings();
       } else if (selectedMenuItem == 1) {
         // Sleep Timeout
@@ -3125,6 +5127,7 @@ void handleMenuAction() {
         saveDeviceSettings();
       } else if (selectedMenuItem == 2) {
         // Device ID
+        lcdRenderer.invalidate();
         M5.Lcd.fillScreen(BLACK);
         M5.Lcd.setCursor(0, 0);
         M5.Lcd.println("Device ID");
@@ -3133,11 +5136,12 @@ void handleMenuAction() {
         M5.Lcd.println("\nUse web interface to change");
         M5.Lcd.println("Device ID");
         
-        delay(3000);
+        holdScreen(3000);
       } else if (selectedMenuItem == 3) {
         // Display Rotation
         deviceSettings.rotateDisplay = !deviceSettings.rotateDisplay;
         M5.Lcd.setRotation(deviceSettings.rotateDisplay ? 1 : 3);
+        lcdRenderer.invalidate();
         saveDeviceSettings();
       } else if (selectedMenuItem == 4) {
         // Volume
@@ -3150,8 +5154,7 @@ void handleMenuAction() {
           uint8_t targetVolume = map(deviceSettings.volume, 0, 100, 0, 255);
           M5.Speaker.setVolume(targetVolume);
           M5.Speaker.tone(1000, 100);
-          delay(100);
-          M5.Speaker.stop();
+          scheduler.after(100, []() { M5.Speaker.stop(); });
         }
       } else if (selectedMenuItem == 5) {
         // Invert KVM Pins
@@ -3174,13 +5177,16 @@ void handleMenuAction() {
 
 // Сканирование WiFi сетей
 void scanWiFiNetworks() {
+  lcdRenderer.invalidate();
   M5.Lcd.fillScreen(BLACK);
   M5.Lcd.setCursor(0, 0);
   M5.Lcd.println("Scanning WiFi...");
   
-  networks.clear();
+  clearScanNetworks();
+  scanCache.clear();
   isScanningWifi = true;
   scanResultsReady = false;
+  scanFailed = false;
   
   WiFi.scanNetworks(true, false, false, 300); // Асинхронное сканирование
 }
@@ -3190,110 +5196,113 @@ void performNetworkDiagnostics() {
   deviceManager.updateNetworkInfo();
 }
 
-// Сохранение конфигурации в LittleFS
-void saveConfiguration() {
-  DynamicJsonDocument doc(4096);
-  
-  // Сохраняем настройки WiFi
+// Настройки AP и буфера захвата в формате JSON (экспорт и миграция config.json)
+void configurationToJson(JsonObject doc) {
+  SettingsGuard guard;
   JsonObject apObj = doc.createNestedObject("ap");
   apObj["mode"] = apConfig.mode;
   apObj["ssid"] = apConfig.ssid;
   apObj["password"] = apConfig.password;
   apObj["hidden"] = apConfig.hidden;
   apObj["channel"] = apConfig.channel;
+  apObj["naptEntries"] = apConfig.naptEntries;
+  apObj["mssClamp"] = apConfig.mssClamp;
+  apObj["maxClients"] = apConfig.maxClients;
   
-  // Открываем файл для записи
-  File configFile = LittleFS.open("/config.json", "w");
-  if (!configFile) {
-    return;
-  }
-  
-  // Записываем JSON в файл
-  serializeJson(doc, configFile);
-  configFile.close();
+  JsonObject sniffObj = doc.createNestedObject("sniff");
+  sniffObj["depth"] = captureDepth;
+  sniffObj["snaplen"] = captureSnaplen;
 }
 
-// Загрузка конфигурации из LittleFS
-void loadConfiguration() {
-  // Проверяем, существует ли файл конфигурации
-  if (!LittleFS.exists("/config.json")) {
-    return;
-  }
-  
-  // Открываем файл для чтения
-  File configFile = LittleFS.open("/config.json", "r");
-  if (!configFile) {
-    return;
-  }
-  
-  // Разбираем JSON
-  DynamicJsonDocument doc(4096);
-  DeserializationError error = deserializeJson(doc, configFile);
-  configFile.close();
-  
-  if (error) {
-    return;
-  }
-  
-  // Загружаем настройки AP
+void configurationFromJson(JsonObjectConst doc) {
+  SettingsGuard guard;
   if (doc.containsKey("ap")) {
-    JsonObject apObj = doc["ap"];
+    JsonObjectConst apObj = doc["ap"];
     apConfig.mode = (APMode)apObj["mode"].as<int>();
     apConfig.ssid = apObj["ssid"].as<String>();
     apConfig.password = apObj["password"].as<String>();
     apConfig.hidden = apObj["hidden"].as<bool>();
     apConfig.channel = apObj["channel"].as<int>();
+    apConfig.naptEntries = apObj["naptEntries"] | REPEATER_DEFAULT_NAPT_ENTRIES;
+    apConfig.mssClamp = apObj["mssClamp"] | REPEATER_DEFAULT_MSS;
+    apConfig.maxClients = apObj["maxClients"] | REPEATER_DEFAULT_MAX_CLIENTS;
+  }
+  
+  if (doc.containsKey("sniff")) {
+    JsonObjectConst sniffObj = doc["sniff"];
+    captureDepth = sniffObj["depth"] | SNIFF_CAPTURE_DEFAULT_DEPTH;
+    captureSnaplen = sniffObj["snaplen"] | SNIFF_CAPTURE_DEFAULT_SNAPLEN;
   }
 }
 
-// Сохранение настроек устройства в LittleFS
-void saveDeviceSettings() {
-  DynamicJsonDocument doc(1024);
+// Сохранение конфигурации в хранилище настроек
+void saveConfiguration() {
+  ConfigWriter out;
+  SettingsGuard guard;
+  out.putU8(apConfig.mode);
+  out.putString(apConfig.ssid);
+  out.putString(apConfig.password);
+  out.putBool(apConfig.hidden);
+  out.putU8(apConfig.channel);
+  out.putU32(captureDepth);
+  out.putU16(captureSnaplen);
+  out.putU16(apConfig.naptEntries);
+  out.putU16(apConfig.mssClamp);
+  out.putU8(apConfig.maxClients);
+  configStore.put(CFG_KEY_NETWORK, CFG_NETWORK_VERSION, out.bytes());
+}
+
+// Загрузка конфигурации из хранилища настроек
+void loadConfiguration() {
+  std::vector<uint8_t> data;
+  // Версия 1 - без настроек ретранслятора
+  bool current = configStore.get(CFG_KEY_NETWORK, CFG_NETWORK_VERSION, data);
+  if (!current && !configStore.get(CFG_KEY_NETWORK, 1, data)) {
+    DynamicJsonDocument doc(4096);
+    if (configStore.readLegacy("/config.json", doc)) {
+      configurationFromJson(doc.as<JsonObjectConst>());
+      saveConfiguration();
+      configStore.retireLegacy("/config.json");
+    }
+    return;
+  }
   
-  // Сохраняем настройки устройства
+  ConfigReader in(data);
+  APConfig loaded;
+  loaded.mode = (APMode)in.getU8();
+  loaded.ssid = in.getString();
+  loaded.password = in.getString();
+  loaded.hidden = in.getBool();
+  loaded.channel = in.getU8();
+  uint32_t depth = in.getU32();
+  uint16_t snaplen = in.getU16();
+  loaded.naptEntries = REPEATER_DEFAULT_NAPT_ENTRIES;
+  loaded.mssClamp = REPEATER_DEFAULT_MSS;
+  loaded.maxClients = REPEATER_DEFAULT_MAX_CLIENTS;
+  if (current) {
+    loaded.naptEntries = in.getU16();
+    loaded.mssClamp = in.getU16();
+    loaded.maxClients = in.getU8();
+  }
+  if (in.ok()) {
+    SettingsGuard guard;
+    apConfig = loaded;
+    captureDepth = depth;
+    captureSnaplen = snaplen;
+  }
+}
+
+// Настройки устройства в формате JSON
+void deviceSettingsToJson(JsonObject doc) {
   doc["brightness"] = deviceSettings.brightness;
   doc["sleepTimeout"] = deviceSettings.sleepTimeout;
   doc["deviceId"] = deviceSettings.deviceId;
   doc["rotateDisplay"] = deviceSettings.rotateDisplay;
   doc["volume"] = deviceSettings.volume;
   doc["invertPins"] = deviceSettings.invertPins;
-  
-  // Открываем файл для записи
-  File configFile = LittleFS.open("/device_settings.json", "w");
-  if (!configFile) {
-    return;
-  }
-  
-  // Записываем JSON в файл
-  serializeJson(doc, configFile);
-  configFile.close();
 }
 
-// Загрузка настроек устройства из LittleFS
-void loadDeviceSettings() {
-  // Проверяем, существует ли файл конфигурации
-  if (!LittleFS.exists("/device_settings.json")) {
-    // Если файла нет, создаем его с настройками по умолчанию
-    saveDeviceSettings();
-    return;
-  }
-  
-  // Открываем файл для чтения
-  File configFile = LittleFS.open("/device_settings.json", "r");
-  if (!configFile) {
-    return;
-  }
-  
-  // Разбираем JSON
-  DynamicJsonDocument doc(1024);
-  DeserializationError error = deserializeJson(doc, configFile);
-  configFile.close();
-  
-  if (error) {
-    return;
-  }
-  
-  // Загружаем настройки устройства
+void deviceSettingsFromJson(JsonObjectConst doc) {
   if (doc.containsKey("brightness")) {
     deviceSettings.brightness = doc["brightness"];
   }
@@ -3312,304 +5321,1342 @@ void loadDeviceSettings() {
   if (doc.containsKey("invertPins")) {
     deviceSettings.invertPins = doc["invertPins"];
   }
+}
+
+// Сохранение настроек устройства
+void saveDeviceSettings() {
+  ConfigWriter out;
+  out.putU8(deviceSettings.brightness);
+  out.putU16(deviceSettings.sleepTimeout);
+  out.putString(deviceSettings.deviceId);
+  out.putBool(deviceSettings.rotateDisplay);
+  out.putU8(deviceSettings.volume);
+  out.putBool(deviceSettings.invertPins);
+  configStore.put(CFG_KEY_DEVICE, CFG_DEVICE_VERSION, out.bytes());
+}
+
+// Загрузка настроек устройства
+void loadDeviceSettings() {
+  std::vector<uint8_t> data;
+  if (configStore.get(CFG_KEY_DEVICE, CFG_DEVICE_VERSION, data)) {
+    ConfigReader in(data);
+    DeviceSettings loaded;
+    loaded.brightness = in.getU8();
+    loaded.sleepTimeout = in.getU16();
+    loaded.deviceId = in.getString();
+    loaded.rotateDisplay = in.getBool();
+    loaded.volume = in.getU8();
+    loaded.invertPins = in.getBool();
+    if (in.ok()) {
+      deviceSettings = loaded;
+    }
+  } else {
+    DynamicJsonDocument doc(1024);
+    if (configStore.readLegacy("/device_settings.json", doc)) {
+      deviceSettingsFromJson(doc.as<JsonObjectConst>());
+      saveDeviceSettings();
+      configStore.retireLegacy("/device_settings.json");
+    } else {
+      // Записи нет - сохраняем настройки по умолчанию
+      saveDeviceSettings();
+    }
+  }
   
   // Синхронизируем глобальные настройки
   globalDeviceSettings = deviceSettings;
 }
 
-// Сохранение списка сохраненных сетей
-void saveSavedNetworks() {
-  DynamicJsonDocument doc(4096);
-  
+// Сохраненные сети в формате JSON
+void savedNetworksToJson(JsonObject doc) {
+  SettingsGuard guard;
   JsonArray networksArray = doc.createNestedArray("networks");
   for (const auto& network : savedNetworks) {
     JsonObject netObj = networksArray.createNestedObject();
     netObj["ssid"] = network.ssid;
     netObj["password"] = network.password;
   }
-  
-  File configFile = LittleFS.open("/saved_networks.json", "w");
-  if (!configFile) {
-    return;
+}
+
+void savedNetworksFromJson(JsonObjectConst doc) {
+  SettingsGuard guard;
+  savedNetworks.clear();
+  for (JsonObjectConst netObj : doc["networks"].as<JsonArrayConst>()) {
+    SavedNetwork network;
+    network.ssid = netObj["ssid"].as<String>();
+    network.password = netObj["password"].as<String>();
+    savedNetworks.push_back(network);
   }
-  
-  serializeJson(doc, configFile);
-  configFile.close();
+}
+
+// Сохранение списка сохраненных сетей
+void saveSavedNetworks() {
+  ConfigWriter out;
+  SettingsGuard guard;
+  out.putU8(savedNetworks.size());
+  for (const auto& network : savedNetworks) {
+    out.putString(network.ssid);
+    out.putString(network.password);
+  }
+  configStore.put(CFG_KEY_NETWORKS, CFG_NETWORKS_VERSION, out.bytes());
 }
 
 // Загрузка списка сохраненных сетей
 void loadSavedNetworks() {
-  if (!LittleFS.exists("/saved_networks.json")) {
+  std::vector<uint8_t> data;
+  if (!configStore.get(CFG_KEY_NETWORKS, CFG_NETWORKS_VERSION, data)) {
+    DynamicJsonDocument doc(4096);
+    if (configStore.readLegacy("/saved_networks.json", doc)) {
+      savedNetworksFromJson(doc.as<JsonObjectConst>());
+      saveSavedNetworks();
+      configStore.retireLegacy("/saved_networks.json");
+    }
     return;
   }
   
-  File configFile = LittleFS.open("/saved_networks.json", "r");
-  if (!configFile) {
-    return;
+  ConfigReader in(data);
+  std::vector<SavedNetwork> loaded(in.getU8());
+  for (auto& network : loaded) {
+    network.ssid = in.getString();
+    network.password = in.getString();
   }
-  
-  DynamicJsonDocument doc(4096);
-  DeserializationError error = deserializeJson(doc, configFile);
-  configFile.close();
-  
-  if (error) {
-    return;
+  if (in.ok()) {
+    SettingsGuard guard;
+    savedNetworks = loaded;
   }
-  
-  savedNetworks.clear();
-  
-  if (doc.containsKey("networks")) {
-    JsonArray networksArray = doc["networks"];
-    for (JsonObject netObj : networksArray) {
-      SavedNetwork network;
-      network.ssid = netObj["ssid"].as<String>();
-      network.password = netObj["password"].as<String>();
-      savedNetworks.push_back(network);
-    }
+}
+
+// Элемент списка /ap/users
+void apUserToJson(const APClient& client, JsonDocument& userObj) {
+  char ipStr[16];
+  char macStr[18];
+  formatIP(client.ip, ipStr);
+  formatMAC(client.mac, macStr);
+  
+  userObj["ip"] = ipStr;
+  userObj["mac"] = macStr;
+  
+  userObj["connected"] = client.connected;
+  userObj["blocked"] = client.blocked;
+  APTrafficSample traffic;
+  APTrafficMeter::get(client.mac, traffic);
+  userObj["totalBytes"] = traffic.rxBytes + traffic.txBytes;
+  userObj["rxBytes"] = traffic.rxBytes;
+  userObj["txBytes"] = traffic.txBytes;
+  userObj["rxRate"] = (uint32_t)traffic.rxRate;
+  userObj["txRate"] = (uint32_t)traffic.txRate;
+  userObj["lastPacket"] = client.lastPacket.c_str();
+  userObj["lastSeen"] = client.lastSeen;
+  userObj["connectedAt"] = client.connectedAt;
+}
+
+// Элемент списка /scan-results
+void scanResultToJson(const WiFiResult& network, JsonDocument& netObj) {
+  netObj["ssid"] = network.ssid.c_str();
+  netObj["rssi"] = network.rssi;
+  
+  const char* encType;
+  switch (network.encryptionType) {
+    case WIFI_AUTH_OPEN: encType = "Open"; break;
+    case WIFI_AUTH_WEP: encType = "WEP"; break;
+    case WIFI_AUTH_WPA_PSK: encType = "WPA-PSK"; break;
+    case WIFI_AUTH_WPA2_PSK: encType = "WPA2-PSK"; break;
+    case WIFI_AUTH_WPA_WPA2_PSK: encType = "WPA/WPA2-PSK"; break;
+    default: encType = "Unknown";
   }
+  netObj["encryption"] = encType;
+  netObj["channel"] = network.channel;
 }
 
-// Функция получения информации о подключенных клиентах
-void updateAPClients() {
-  apClients.clear();
-  
-  wifi_sta_list_t stationList;
-  tcpip_adapter_sta_list_t adapterList;
+// Параметры /scan-results. Без параметров - весь список в порядке драйвера
+bool parseScanQuery(AsyncWebServerRequest *request, ScanQuery& query) {
+  query = defaultScanQuery();
   
-  if (WiFi.softAPgetStationNum() == 0) {
-    return;
+  if (request->hasParam("page")) {
+    query.page = request->getParam("page")->value().toInt();
+    query.size = SCAN_PAGE_DEFAULT;
+  }
+  if (request->hasParam("size")) {
+    query.size = constrain(request->getParam("size")->value().toInt(), 0, SCAN_PAGE_MAX);
   }
   
-  esp_wifi_ap_get_sta_list(&stationList);
-  tcpip_adapter_get_sta_list(&stationList, &adapterList);
+  if (request->hasParam("sort")) {
+    String sort = request->getParam("sort")->value();
+    if (sort == "rssi") query.sort = SCAN_SORT_RSSI;
+    else if (sort == "channel") query.sort = SCAN_SORT_CHANNEL;
+    else if (sort == "ssid") query.sort = SCAN_SORT_SSID;
+    else if (sort == "encryption") query.sort = SCAN_SORT_ENCRYPTION;
+    else if (sort != "none") return false;
+    // Сильные сети первыми, остальное - по возрастанию
+    query.descending = query.sort == SCAN_SORT_RSSI;
+  }
+  if (request->hasParam("order")) {
+    String order = request->getParam("order")->value();
+    if (order == "desc") query.descending = true;
+    else if (order == "asc") query.descending = false;
+    else return false;
+  }
   
-  for (int i = 0; i < adapterList.num; i++) {
-    APClient client;
-    client.ip = IPAddress(adapterList.sta[i].ip.addr);
-    memcpy(client.mac, adapterList.sta[i].mac, 6);
-    client.lastSeen = millis();
-    client.totalBytes = 0;
-    client.lastPacket = "";
-    
-    // Проверяем, заблокирован ли MAC
-    char macStr[18];
-    sprintf(macStr, "%02X:%02X:%02X:%02X:%02X:%02X",
-            client.mac[0], client.mac[1], client.mac[2],
-            client.mac[3], client.mac[4], client.mac[5]);
-    
-    client.blocked = false;
-    for (const auto& blockedMAC : blockedMACs) {
-      if (blockedMAC == macStr) {
-        client.blocked = true;
-        break;
-      }
+  if (request->hasParam("minRssi")) {
+    query.minRssi = constrain(request->getParam("minRssi")->value().toInt(), SCAN_MIN_RSSI_ANY, 0);
+  }
+  if (request->hasParam("channel")) {
+    String list = request->getParam("channel")->value();
+    int from = 0;
+    while (from < (int)list.length()) {
+      int comma = list.indexOf(',', from);
+      if (comma < 0) comma = list.length();
+      int channel = list.substring(from, comma).toInt();
+      if (channel < 1 || channel > 14) return false;
+      query.channels |= 1u << channel;
+      from = comma + 1;
     }
-    
-    // Проверяем, заблокирован ли IP
-    if (client.blocked) {
-      // Используем более низкоуровневый API ESP-IDF
-      wifi_sta_list_t wifi_sta_list;
-      tcpip_adapter_sta_list_t adapter_sta_list;
-      
-      esp_wifi_ap_get_sta_list(&wifi_sta_list);
-      tcpip_adapter_get_sta_list(&wifi_sta_list, &adapter_sta_list);
-      
-      // Находим AID для конкретного MAC-адреса
-      for (int j = 0; j < adapter_sta_list.num; j++) {
-        if (memcmp(adapter_sta_list.sta[j].mac, adapterList.sta[i].mac, 6) == 0) {
-          // Используем правильный AID для деавторизации
-          for (int k = 0; k < wifi_sta_list.num; k++) {
-            if (memcmp(wifi_sta_list.sta[k].mac, adapterList.sta[i].mac, 6) == 0) {
-              // В структуре wifi_sta_list нужно найти поле aid
-              // Если его нет, используем индекс + 1 как AID
-              esp_wifi_deauth_sta(k + 1);
-              break;
-            }
-          }
-          break;
-        }
+  }
+  if (request->hasParam("enc")) {
+    String list = request->getParam("enc")->value();
+    int from = 0;
+    while (from < (int)list.length()) {
+      int comma = list.indexOf(',', from);
+      if (comma < 0) comma = list.length();
+      int mode = scanEncryptionFromKey(list.substring(from, comma));
+      if (mode < 0) return false;
+      query.encryptions |= 1u << mode;
+      from = comma + 1;
+    }
+  }
+  return true;
+}
+
+// Сверка таблицы клиентов с драйвером WiFi (события могли быть пропущены)
+void updateAPClients() {
+  apClients.sync([](const uint8_t* mac) { return isMACBlocked(mac); });
+}
+
+// Изменение блокировки клиента: списки блокировки, таблица и отключение станции
+void setClientBlocked(int slot, const APClient& client, bool blocked) {
+  if (blocked) {
+    if ((uint32_t)client.ip != 0) {
+      blocklist.blockIP((uint32_t)client.ip);
+    }
+    blocklist.blockMAC(client.mac);
+    
+    // Заблокированная станция отключается сразу, повторное подключение
+    // отклоняется в onStationConnected. AID 0 отключил бы все станции,
+    // поэтому неизвестный AID уточняется у драйвера, а без него - пропуск
+    if (client.connected) {
+      uint16_t aid = client.aid ? client.aid : APClientTable::stationAID(client.mac);
+      if (aid != 0) {
+        esp_wifi_deauth_sta(aid);
       }
     }
-    
-    apClients.push_back(client);
+  } else {
+    blocklist.unblockIP((uint32_t)client.ip);
+    blocklist.unblockMAC(client.mac);
   }
+  
+  apClients.setBlocked(slot, blocked);
+  blocklist.save();
 }
 
 // Функция проверки MAC-адреса на блокировку
 bool isMACBlocked(const uint8_t* mac) {
-  char macStr[18];
-  sprintf(macStr, "%02X:%02X:%02X:%02X:%02X:%02X",
-          mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-  
-  for (const auto& blockedMAC : blockedMACs) {
-    if (blockedMAC == macStr) {
-      return true;
-    }
-  }
-  return false;
+  return blocklist.isMACBlocked(mac);
 }
 
-// Запуск сниффинга пакетов для пользователя
-void startPacketSniffing(int clientIndex) {
-  if (clientIndex >= 0 && clientIndex < apClients.size()) {
-    isSniffing = true;
-    
-    // Настраиваем WiFi для сниффинга
-    esp_wifi_set_promiscuous(false);
-    esp_wifi_set_promiscuous_rx_cb(&promiscuous_rx_callback);
-    esp_wifi_set_promiscuous(true);
-    
-    // Устанавливаем фильтр для конкретного пользователя
-    currentSniffingClient = clientIndex;
-    currentSniffingMAC = apClients[clientIndex].mac;
-    
-    apClients[clientIndex].lastPacket = "Сниффинг активен...";
+// Включение promiscuous-режима под текущий фильтр: драйвер пропускает
+// к колбэку только классы кадров, нужные хотя бы одному клиенту
+void applySniffFilter() {
+  isSniffing = false;
+  esp_wifi_set_promiscuous(false);
+  if (sniffFilter.size() == 0) {
+    return;
   }
+  
+  wifi_promiscuous_filter_t filter = {sniffFilter.driverMask()};
+  esp_wifi_set_promiscuous_filter(&filter);
+  isSniffing = true;
+  esp_wifi_set_promiscuous_rx_cb(&promiscuous_rx_callback);
+  esp_wifi_set_promiscuous(true);
 }
 
-// Остановка сниффинга пакетов
-void stopPacketSniffing() {
+// Добавление клиента к сниффингу (или замена его правила).
+// Остальные клиенты продолжают сниффиться, буферы очищаются только при
+// первом запуске. false - фильтр заполнен
+bool startPacketSniffing(int clientIndex, const SniffTarget* rule) {
+  APClient client;
+  if (!apClients.get(clientIndex, client)) {
+    return false;
+  }
+  
+  // Обзор эфира занимает тот же promiscuous-режим
+  if (wifiSurvey.isRunning()) {
+    stopSurvey();
+  }
+  
+  bool wasSniffing = isSniffing;
+  
+  // Останавливаем колбэк, пока меняем фильтр.
+  // MAC копируется в фильтр: колбэк не обращается к таблице клиентов
   isSniffing = false;
-  currentSniffingClient = -1;
   esp_wifi_set_promiscuous(false);
+  
+  SniffTarget target = rule ? *rule : makeSniffTarget(client.mac);
+  if (!sniffFilter.set(target)) {
+    applySniffFilter();
+    return false;
+  }
+  
+  if (!wasSniffing) {
+    packetBuffer.clear();
+    // Буфер захвата выделяется при первом запуске, чтобы не занимать память заранее
+    captureRing.allocate(captureDepth, captureSnaplen);
+  }
+  
+  apClients.setLastPacket(clientIndex, "Сниффинг активен...");
+  applySniffFilter();
+  return true;
 }
 
-// Колбэк для обработки перехваченных пакетов
-void promiscuous_rx_callback(void* buf, wifi_promiscuous_pkt_type_t type) {
-  if (!isSniffing || currentSniffingClient < 0) return;
-  
-  wifi_promiscuous_pkt_t* pkt = (wifi_promiscuous_pkt_t*)buf;
-  wifi_pkt_rx_ctrl_t ctrl = pkt->rx_ctrl;
+// Остановка сниффинга клиента; -1 - всех клиентов
+void stopPacketSniffing(int clientIndex) {
+  APClient client;
+  if (clientIndex >= 0 && apClients.get(clientIndex, client)) {
+    sniffFilter.remove(client.mac);
+  } else {
+    sniffFilter.clear();
+  }
+  applySniffFilter();
+}
+
+// Правило сниффинга из параметров запроса:
+// dir=up|down|both, types=mgmt,ctrl,data, mgmtSubtypes/ctrlSubtypes/dataSubtypes - маски
+bool parseSniffTarget(AsyncWebServerRequest *request, const uint8_t* mac, SniffTarget& target) {
+  target = makeSniffTarget(mac);
+  
+  if (request->hasParam("dir", true)) {
+    String dir = request->getParam("dir", true)->value();
+    if (dir == "up") target.directions = SNIFF_DIR_UPLINK;
+    else if (dir == "down") target.directions = SNIFF_DIR_DOWNLINK;
+    else if (dir == "both") target.directions = SNIFF_DIR_BOTH;
+    else return false;
+  }
   
-  // Извлекаем MAC адреса
-  uint8_t* payload = pkt->payload;
-  uint8_t* dest_mac = payload + 4;  // Destination MAC
-  uint8_t* source_mac = payload + 10; // Source MAC
+  if (request->hasParam("types", true)) {
+    String types = request->getParam("types", true)->value();
+    target.classes = 0;
+    if (types.indexOf("mgmt") >= 0) target.classes |= SNIFF_CLASS_MGMT;
+    if (types.indexOf("ctrl") >= 0) target.classes |= SNIFF_CLASS_CTRL;
+    if (types.indexOf("data") >= 0) target.classes |= SNIFF_CLASS_DATA;
+    if (target.classes == 0) return false;
+  }
   
-  // Проверяем, соответствует ли MAC адрес нашему клиенту
-  bool match = true;
-  for (int i = 0; i < 6; i++) {
-    if (source_mac[i] != currentSniffingMAC[i]) {
-      match = false;
-      break;
+  static const char* subtypeParams[3] = {"mgmtSubtypes", "ctrlSubtypes", "dataSubtypes"};
+  for (uint8_t cls = 0; cls < 3; cls++) {
+    if (request->hasParam(subtypeParams[cls], true)) {
+      target.subtypes[cls] = strtoul(request->getParam(subtypeParams[cls], true)->value().c_str(), nullptr, 0);
     }
   }
+  return true;
+}
+
+// Запуск обзора эфира. Promiscuous-режим один на двоих со сниффером,
+// поэтому во время сниффинга обзор не запускается
+bool startSurvey(const std::vector<uint8_t>& channels, uint32_t dwell, uint32_t home) {
+  if (isSniffing || wifiSurvey.isRunning()) {
+    return false;
+  }
   
-  if (match) {
-    // Обновляем информацию о трафике
-    apClients[currentSniffingClient].totalBytes += ctrl.sig_len;
-    
-    // Создаем запись о пакете
-    SniffedPacket packet;
-    
-    char srcMAC[18], dstMAC[18];
-    sprintf(srcMAC, "%02X:%02X:%02X:%02X:%02X:%02X",
-            source_mac[0], source_mac[1], source_mac[2],
-            source_mac[3], source_mac[4], source_mac[5]);
-    sprintf(dstMAC, "%02X:%02X:%02X:%02X:%02X:%02X",
-            dest_mac[0], dest_mac[1], dest_mac[2],
-            dest_mac[3], dest_mac[4], dest_mac[5]);
-    
-    packet.sourceMAC = String(srcMAC);
-    packet.destMAC = String(dstMAC);
-    packet.type = type == WIFI_PKT_MGMT ? "MGMT" : type == WIFI_PKT_DATA ? "DATA" : "CTRL";
-    packet.size = ctrl.sig_len;
-    packet.rssi = ctrl.rssi;
-    packet.timestamp = millis();
-    
-    // Добавляем в буфер
-    if (packetBuffer.size() >= MAX_PACKET_BUFFER) {
-      packetBuffer.erase(packetBuffer.begin());  // Удаляем самый старый
-    }
-    packetBuffer.push_back(packet);
-    
-    // Обновляем информацию для отображения
-    char packetInfo[100];
-    snprintf(packetInfo, sizeof(packetInfo), "To:%s Type:%s Size:%d", 
-             dstMAC, packet.type.c_str(), ctrl.sig_len);
-    
-    apClients[currentSniffingClient].lastPacket = String(packetInfo);
-    apClients[currentSniffingClient].lastSeen = millis();
+  // Свой канал, если есть связь: на него обзор возвращается между чужими
+  bool linked = WiFi.status() == WL_CONNECTED ||
+                WiFi.getMode() == WIFI_AP || WiFi.getMode() == WIFI_AP_STA;
+  uint8_t homeChannel = linked ? WiFi.channel() : 0;
+  if (!wifiSurvey.start(channels, dwell, home, homeChannel)) {
+    return false;
+  }
+  
+  surveyDrainTask = scheduler.every(50, []() { wifiSurvey.drain(); });
+  surveyHop();
+  return true;
+}
+
+void stopSurvey() {
+  scheduler.cancel(surveyHopTask);
+  scheduler.cancel(surveyDrainTask);
+  surveyHopTask = 0;
+  surveyDrainTask = 0;
+  wifiSurvey.stop();
+}
+
+// Смена канала: время на канале задает сам обзор
+void surveyHop() {
+  uint32_t next = wifiSurvey.hop();
+  surveyHopTask = next > 0 ? scheduler.after(next, surveyHop) : 0;
+}
+
+// Колбэк для обработки перехваченных пакетов.
+// Выполняется в задаче WiFi-драйвера, поэтому здесь нет выделений памяти,
+// форматирования строк и обращений к apClients - только запись в кольцевой буфер
+void promiscuous_rx_callback(void* buf, wifi_promiscuous_pkt_type_t type) {
+  if (!isSniffing) return;
+  
+  const wifi_promiscuous_pkt_t* pkt = (const wifi_promiscuous_pkt_t*)buf;
+  const wifi_pkt_rx_ctrl_t& ctrl = pkt->rx_ctrl;
+  
+  // Направление, тип и подтип проверяются скомпилированным фильтром
+  const uint8_t* payload = pkt->payload;
+  bool uplink = false;
+  int stream = sniffFilter.match(payload, ctrl.sig_len, &uplink);
+  if (stream < 0) return;
+  
+  SniffedPacket packet;
+  memcpy(packet.destMAC, payload + 4, 6);
+  // У ACK и CTS нет адреса передатчика
+  if (ctrl.sig_len >= 16) {
+    memcpy(packet.sourceMAC, payload + 10, 6);
+  } else {
+    memset(packet.sourceMAC, 0, 6);
+  }
+  packet.stream = stream;
+  switch (type) {
+    case WIFI_PKT_MGMT: packet.type = SNIFF_FRAME_MGMT; break;
+    case WIFI_PKT_CTRL: packet.type = SNIFF_FRAME_CTRL; break;
+    case WIFI_PKT_DATA: packet.type = SNIFF_FRAME_DATA; break;
+    default:            packet.type = SNIFF_FRAME_MISC; break;
+  }
+  packet.size = ctrl.sig_len;
+  packet.rssi = ctrl.rssi;
+  packet.timestamp = millis();
+  
+  packetBuffer.push(packet);
+  captureRing.push(pkt, type, stream);
+  sniffFilter.account(stream, ctrl.sig_len, uplink);
+}
+
+// Проверка, ведется ли сейчас сниффинг указанного клиента
+bool isSniffingClient(const APClient& client) {
+  return isSniffing && sniffFilter.contains(client.mac);
+}
+
+// Описание последнего перехваченного пакета (формируется при чтении)
+void formatLastPacket(char* out, size_t size) {
+  SniffedPacket packet;
+  if (!packetBuffer.latest(packet)) {
+    snprintf(out, size, "No packets");
+    return;
   }
+  
+  char dstMAC[18];
+  formatMAC(packet.destMAC, dstMAC);
+  snprintf(out, size, "To:%s Type:%s Size:%d",
+           dstMAC, sniffFrameTypeName(packet.type), packet.size);
 }
 
-// Функция смены IP адреса (реальная реализация)
+// Функция смены IP адреса (реальная реализация).
+// Выполняется по шагам в задачах планировщика, не блокируя цикл
 void shuffleIP() {
-  if (WiFi.status() == WL_CONNECTED) {
-    // Сохраняем текущие учетные данные
-    String currentSSID = WiFi.SSID();
-    String currentPassword = "";
-    
-    // Находим пароль в сохраненных сетях
+  if (WiFi.status() != WL_CONNECTED || shuffleInProgress) {
+    return;
+  }
+  
+  // Сохраняем текущие учетные данные
+  String currentSSID = WiFi.SSID();
+  String currentPassword = "";
+  
+  // Находим пароль в сохраненных сетях
+  {
+    SettingsGuard guard;
     for (const auto& network : savedNetworks) {
       if (network.ssid == currentSSID) {
         currentPassword = network.password;
         break;
       }
     }
-    
-    // Отключаемся от сети
-    WiFi.disconnect(true);
-    delay(1000);
-    
-    // Настраиваем новый MAC адрес
-    uint8_t newMAC[6];
-    esp_read_mac(newMAC, ESP_MAC_WIFI_STA);
-    
-    // Изменяем последний байт MAC адреса
-    newMAC[5] = random(0, 255);
-    
-    // Применяем новый MAC адрес
-    esp_wifi_set_mac(WIFI_IF_STA, newMAC);
-    
-    // Подключаемся заново с новым MAC адресом
-    WiFi.begin(currentSSID.c_str(), currentPassword.c_str());
-    
-    // Показываем уведомление
-    M5.Lcd.fillScreen(BLACK);
-    M5.Lcd.setCursor(0, 0);
-    M5.Lcd.println("Shuffling IP...");
-    M5.Lcd.println("New MAC: ");
-    
+  }
+  
+  // Отключаемся от сети
+  WiFi.disconnect(true);
+  
+  // Показываем уведомление
+  lcdRenderer.invalidate();
+  M5.Lcd.fillScreen(BLACK);
+  M5.Lcd.setCursor(0, 0);
+  M5.Lcd.println("Shuffling IP...");
+  holdScreen(0);
+  
+  shuffleInProgress = true;
+  scheduler.after(1000, [currentSSID, currentPassword]() {
+    shuffleReconnect(currentSSID, currentPassword);
+  });
+}
+
+// Подключение с новым MAC адресом
+void shuffleReconnect(const String& ssid, const String& password) {
+  // Настраиваем новый MAC адрес
+  uint8_t newMAC[6];
+  esp_read_mac(newMAC, ESP_MAC_WIFI_STA);
+  
+  // Изменяем последний байт MAC адреса
+  newMAC[5] = random(0, 255);
+  
+  // Применяем новый MAC адрес
+  esp_wifi_set_mac(WIFI_IF_STA, newMAC);
+  
+  // Подключаемся заново с новым MAC адресом
+  WiFi.begin(ssid.c_str(), password.c_str());
+  
+  if (screenHeld) {
     char macStr[18];
-    sprintf(macStr, "%02X:%02X:%02X:%02X:%02X:%02X",
-            newMAC[0], newMAC[1], newMAC[2],
-            newMAC[3], newMAC[4], newMAC[5]);
+    formatMAC(newMAC, macStr);
+    M5.Lcd.println("New MAC: ");
     M5.Lcd.println(macStr);
     M5.Lcd.println("Please wait...");
-    
-    // Ждем подключения
-    int timeout = 0;
-    while (WiFi.status() != WL_CONNECTED && timeout < 20) {
-      delay(500);
-      M5.Lcd.print(".");
-      timeout++;
-    }
-    
-    if (WiFi.status() == WL_CONNECTED) {
-      M5.Lcd.println();
+  }
+  
+  // Ждем подключения
+  watchConnection([](bool connected) {
+    shuffleInProgress = false;
+    lcdRenderer.invalidate();
+    M5.Lcd.fillScreen(BLACK);
+    M5.Lcd.setCursor(0, 0);
+    M5.Lcd.println("Shuffling IP...");
+    if (connected) {
       M5.Lcd.println("New IP: ");
       M5.Lcd.println(WiFi.localIP());
     } else {
-      M5.Lcd.println();
       M5.Lcd.println("Connection failed!");
     }
-    
-    delay(3000);
-  }
+    holdScreen(3000);
+  });
 }
 
-// Обработчик подключения станции (реальная реализация)
+// Обработчик подключения станции.
+// Выполняется в задаче событий Arduino: только обновление таблицы клиентов
 void onStationConnected(WiFiEvent_t event, WiFiEventInfo_t info) {
   auto& sta = info.wifi_ap_staconnected;
-  Serial.printf("Station connected: %02X:%02X:%02X:%02X:%02X:%02X\n",
+  Serial.printf("Station connected: %02X:%02X:%02X:%02X:%02X:%02X (aid %d)\n",
                 sta.mac[0], sta.mac[1], sta.mac[2],
-                sta.mac[3], sta.mac[4], sta.mac[5]);
+                sta.mac[3], sta.mac[4], sta.mac[5], sta.aid);
+
+  bool blocked = isMACBlocked(sta.mac);
+  apClients.onConnected(sta.mac, sta.aid, blocked);
+  scheduler.post([]() { powerManager.wake(POWER_WAKE_STATION); });
 
-  if (isMACBlocked(sta.mac)) {
+  if (blocked) {
     Serial.println("Blocked MAC detected, disconnecting...");
-    // В ESP32 Arduino нет прямого способа отключить конкретного клиента
-    // Можно использовать альтернативный подход
-    esp_wifi_disconnect();
+    esp_wifi_deauth_sta(sta.aid);
+  }
+}
+
+// Обработчик отключения станции
+void onStationDisconnected(WiFiEvent_t event, WiFiEventInfo_t info) {
+  apClients.onDisconnected(info.wifi_ap_stadisconnected.mac);
+}
+
+// Обработчик выдачи IP станции DHCP-сервером
+void onStationIPAssigned(WiFiEvent_t event, WiFiEventInfo_t info) {
+  apClients.onIPAssigned(IPAddress(info.wifi_ap_staipassigned.ip.addr));
+}
+
+// Данные события SSE об открытом порте
+String formatPortEvent(uint16_t port) {
+  return "{\"port\":" + String(port) + ",\"service\":\"" + NetworkTools::identifyService(port) + "\"}";
+}
+
+// Отправка новых открытых портов и прогресса сканирования через SSE
+void streamPortScanEvents() {
+  static uint32_t streamedScanId = 0;
+  static size_t streamedPorts = 0;
+  static bool finishedSent = true;
+  static unsigned long lastProgress = 0;
+  
+  PortScanner& scanner = networkTools.getPortScanner();
+  
+  // Новое сканирование - начинаем отсчет заново
+  if (scanner.getScanId() != streamedScanId) {
+    streamedScanId = scanner.getScanId();
+    streamedPorts = 0;
+    finishedSent = false;
   }
+  
+  if (finishedSent) {
+    return;
+  }
+  
+  bool running = scanner.isRunning();
+  
+  std::vector<uint16_t> ports = scanner.getOpenPorts(streamedPorts);
+  for (uint16_t port : ports) {
+    streamedPorts++;
+    portScanEvents.send(formatPortEvent(port).c_str(), "port", streamedPorts);
+  }
+  
+  if (running && millis() - lastProgress < 500) {
+    return;
+  }
+  lastProgress = millis();
+  
+  String progress = "{\"status\":\"" + String(scanner.getStateName()) + "\"" +
+                    ",\"scanned\":" + String(scanner.getScanned()) +
+                    ",\"total\":" + String(scanner.getTotal()) +
+                    ",\"open\":" + String(streamedPorts) +
+                    ",\"elapsed\":" + String(scanner.getElapsed()) + "}";
+  portScanEvents.send(progress.c_str(), running ? "progress" : "done");
+  
+  if (!running) {
+    finishedSent = true;
+  }
+}
+
+// Рассылка изменений подписчикам телеметрии (вызывается из сетевой задачи)
+void publishTelemetry() {
+  if (!telemetry.due()) {
+    return;
+  }
+  
+  uint32_t topics = telemetry.topicMask();
+  if (topics & (1UL << TOPIC_CLIENTS)) publishClientsTopic(telemetry.consumeResync(TOPIC_CLIENTS));
+  if (topics & (1UL << TOPIC_TRAFFIC)) publishTrafficTopic(telemetry.consumeResync(TOPIC_TRAFFIC));
+  if (topics & (1UL << TOPIC_SNIFF)) publishSniffTopic(telemetry.consumeResync(TOPIC_SNIFF));
+  if (topics & (1UL << TOPIC_PINS)) publishPinsTopic(telemetry.consumeResync(TOPIC_PINS));
+  if (topics & (1UL << TOPIC_SENSORS)) publishSensorsTopic(telemetry.consumeResync(TOPIC_SENSORS));
+  if (topics & (1UL << TOPIC_STATUS)) publishStatusTopic(telemetry.consumeResync(TOPIC_STATUS));
+  if (topics & (1UL << TOPIC_EDGES)) publishEdgesTopic(telemetry.consumeResync(TOPIC_EDGES));
+}
+
+// Подключение и отключение клиентов AP.
+// full - полный список подключенных клиентов вместо изменений
+void publishClientsTopic(bool full) {
+  static uint64_t lastKey[AP_CLIENT_TABLE_CAPACITY] = {0};
+  static uint32_t lastIP[AP_CLIENT_TABLE_CAPACITY] = {0};
+  static bool lastConnected[AP_CLIENT_TABLE_CAPACITY] = {false};
+  
+  StaticJsonDocument<2048> doc;
+  doc["t"] = "clients";
+  doc["full"] = full;
+  JsonArray joined = doc.createNestedArray("join");
+  JsonArray left = doc.createNestedArray("leave");
+  bool changed = full;
+  
+  size_t count = apClients.size();
+  for (size_t i = 0; i < AP_CLIENT_TABLE_CAPACITY; i++) {
+    APClient client;
+    bool valid = i < count && apClients.get(i, client);
+    uint64_t key = valid ? macToKey(client.mac) : 0;
+    bool connected = valid && client.connected;
+    uint32_t ip = valid ? (uint32_t)client.ip : 0;
+    
+    // Слот переиспользован под другой MAC - прежний клиент ушел
+    if (lastConnected[i] && (!connected || lastKey[i] != key) && !full) {
+      uint8_t mac[6];
+      char macStr[18];
+      keyToMAC(lastKey[i], mac);
+      formatMAC(mac, macStr);
+      left.add(macStr);
+      changed = true;
+    }
+    
+    bool isNew = connected && (!lastConnected[i] || lastKey[i] != key || lastIP[i] != ip);
+    if (connected && (full || isNew)) {
+      char macStr[18];
+      formatMAC(client.mac, macStr);
+      JsonObject obj = joined.createNestedObject();
+      obj["mac"] = macStr;
+      obj["ip"] = client.ip.toString();
+      obj["blocked"] = client.blocked;
+      changed = true;
+    }
+    
+    lastKey[i] = key;
+    lastIP[i] = ip;
+    lastConnected[i] = connected;
+  }
+  
+  if (changed) {
+    telemetry.publish(TOPIC_CLIENTS, doc);
+  }
+}
+
+// Счетчики трафика клиентов (только изменившиеся)
+void publishTrafficTopic(bool full) {
+  static uint64_t lastKey[AP_CLIENT_TABLE_CAPACITY] = {0};
+  static uint32_t lastBytes[AP_CLIENT_TABLE_CAPACITY] = {0};
+  
+  StaticJsonDocument<1536> doc;
+  doc["t"] = "traffic";
+  JsonArray clientsArray = doc.createNestedArray("clients");
+  
+  size_t count = apClients.size();
+  for (size_t i = 0; i < count; i++) {
+    APClient client;
+    if (!apClients.get(i, client) || !client.connected) {
+      continue;
+    }
+    
+    uint64_t key = macToKey(client.mac);
+    APTrafficSample traffic;
+    APTrafficMeter::get(client.mac, traffic);
+    uint32_t bytes = traffic.rxBytes + traffic.txBytes;
+    bool sniffing = isSniffingClient(client);
+    if (!full && lastKey[i] == key && lastBytes[i] == bytes) {
+      continue;
+    }
+    lastKey[i] = key;
+    lastBytes[i] = bytes;
+    
+    char macStr[18];
+    formatMAC(client.mac, macStr);
+    JsonObject obj = clientsArray.createNestedObject();
+    obj["mac"] = macStr;
+    obj["ip"] = client.ip.toString();
+    obj["bytes"] = bytes;
+    obj["rxRate"] = (uint32_t)traffic.rxRate;
+    obj["txRate"] = (uint32_t)traffic.txRate;
+    obj["sniffing"] = sniffing;
+  }
+  
+  if (clientsArray.size() > 0) {
+    telemetry.publish(TOPIC_TRAFFIC, doc);
+  }
+}
+
+// Новые перехваченные пакеты с момента прошлой рассылки
+void publishSniffTopic(bool full) {
+  static uint32_t nextSeq = 0;
+  const size_t maxPackets = 16;
+  
+  uint32_t end = packetBuffer.written();
+  // Буфер очищен при новом запуске сниффинга
+  if (end < nextSeq) {
+    nextSeq = 0;
+  }
+  if (end == nextSeq && !full) {
+    return;
+  }
+  // Отстающему подписчику отдаем только последние пакеты
+  if (end - nextSeq > maxPackets) {
+    nextSeq = end - maxPackets;
+  }
+  
+  StaticJsonDocument<2048> doc;
+  doc["t"] = "sniff";
+  doc["active"] = (bool)isSniffing;
+  doc["total"] = end;
+  JsonArray packetsArray = doc.createNestedArray("packets");
+  
+  for (; nextSeq != end; nextSeq++) {
+    SniffedPacket packet;
+    if (!packetBuffer.read(nextSeq, packet)) {
+      continue;  // Перезаписан во время чтения
+    }
+    char srcMAC[18], dstMAC[18];
+    formatMAC(packet.sourceMAC, srcMAC);
+    formatMAC(packet.destMAC, dstMAC);
+    
+    JsonObject obj = packetsArray.createNestedObject();
+    obj["src"] = srcMAC;
+    obj["dst"] = dstMAC;
+    obj["type"] = sniffFrameTypeName(packet.type);
+    obj["size"] = packet.size;
+    obj["rssi"] = packet.rssi;
+    obj["ts"] = packet.timestamp;
+  }
+  
+  telemetry.publish(TOPIC_SNIFF, doc);
+}
+
+// Изменения состояния пинов KVM
+void publishPinsTopic(bool full) {
+  static uint32_t lastStates = 0;
+  static size_t lastCount = 0;
+  
+  std::vector<EnhancedPinConfig> pins = kvmModule.getPins();
+  uint32_t states = 0;
+  for (size_t i = 0; i < pins.size() && i < 32; i++) {
+    if (pins[i].state) states |= 1UL << i;
+  }
+  
+  if (!full && states == lastStates && pins.size() == lastCount) {
+    return;
+  }
+  
+  StaticJsonDocument<1024> doc;
+  doc["t"] = "pins";
+  JsonArray pinsArray = doc.createNestedArray("pins");
+  for (size_t i = 0; i < pins.size() && i < 32; i++) {
+    bool state = pins[i].state;
+    if (!full && pins.size() == lastCount && ((lastStates >> i) & 1) == state) {
+      continue;
+    }
+    JsonObject obj = pinsArray.createNestedObject();
+    obj["index"] = i;
+    obj["pin"] = pins[i].pin;
+    obj["name"] = pins[i].name;
+    obj["state"] = state;
+  }
+  
+  lastStates = states;
+  lastCount = pins.size();
+  telemetry.publish(TOPIC_PINS, doc);
+}
+
+// Показания сенсоров (при обновлении DeviceManager)
+void publishSensorsTopic(bool full) {
+  static unsigned long lastTimestamp = 0;
+  
+  SensorData sensorData = deviceManager.getSensorData();
+  if (!full && sensorData.timestamp == lastTimestamp) {
+    return;
+  }
+  lastTimestamp = sensorData.timestamp;
+  
+  StaticJsonDocument<256> doc;
+  doc["t"] = "sensors";
+  doc["battery"] = sensorData.batteryVoltage;
+  doc["batteryPercent"] = sensorData.batteryPercentage;
+  doc["temperature"] = sensorData.temperature;
+  doc["gyroX"] = sensorData.gyroX;
+  doc["gyroY"] = sensorData.gyroY;
+  doc["gyroZ"] = sensorData.gyroZ;
+  doc["timestamp"] = sensorData.timestamp;
+  telemetry.publish(TOPIC_SENSORS, doc);
+}
+
+// Состояние WiFi и точки доступа (поля совпадают с /diagnostic)
+void publishStatusTopic(bool full) {
+  static bool lastConnected = false;
+  static int32_t lastRSSI = 0;
+  static int lastMode = -1;
+  static int lastStations = -1;
+  static float lastBattery = 0;
+  
+  NetworkInfo networkInfo = deviceManager.getNetworkInfo();
+  SensorData sensorData = deviceManager.getSensorData();
+  int stations = apConfig.mode != AP_MODE_OFF ? WiFi.softAPgetStationNum() : 0;
+  
+  // RSSI и напряжение колеблются - рассылаем только заметные изменения
+  bool changed = full || networkInfo.connected != lastConnected ||
+                 abs(networkInfo.rssi - lastRSSI) >= 3 ||
+                 (int)apConfig.mode != lastMode || stations != lastStations ||
+                 fabsf(sensorData.batteryVoltage - lastBattery) >= 0.05f;
+  if (!changed) {
+    return;
+  }
+  lastConnected = networkInfo.connected;
+  lastRSSI = networkInfo.rssi;
+  lastMode = apConfig.mode;
+  lastStations = stations;
+  lastBattery = sensorData.batteryVoltage;
+  
+  StaticJsonDocument<512> doc;
+  doc["t"] = "status";
+  doc["connected"] = networkInfo.connected;
+  doc["ssid"] = networkInfo.ssid;
+  doc["rssi"] = networkInfo.rssi;
+  doc["ip"] = networkInfo.localIP;
+  if (apConfig.mode != AP_MODE_OFF) {
+    SettingsGuard guard;
+    doc["ap_mode"] = apConfig.mode;
+    doc["ap_ssid"] = apConfig.ssid;
+    doc["ap_ip"] = WiFi.softAPIP().toString();
+    doc["ap_stations"] = stations;
+  }
+  doc["battery"] = sensorData.batteryVoltage;
+  doc["scanning"] = isScanningWifi;
+  telemetry.publish(TOPIC_STATUS, doc);
+}
+
+// Новые фронты отслеживаемых пинов. При полной рассылке история не
+// отправляется: ее можно забрать через /api/kvm/edges
+void publishEdgesTopic(bool full) {
+  static uint32_t sentSeq[PIN_EDGE_MAX_GPIO] = {0};
+  const size_t maxEdges = 20;  // Чтобы сообщение уместилось в буфер рассылки
+  
+  StaticJsonDocument<2048> doc;
+  doc["t"] = "edges";
+  JsonArray edgesArray = doc.createNestedArray("edges");
+  
+  size_t total = 0;
+  for (const auto& pin : kvmModule.getPins()) {
+    if (pin.pin < 0 || pin.pin >= PIN_EDGE_MAX_GPIO || !pinEdges.isAttached(pin.pin)) {
+      continue;
+    }
+    uint32_t head = pinEdges.head(pin.pin);
+    if (full || sentSeq[pin.pin] > head) {
+      sentSeq[pin.pin] = head;
+      continue;
+    }
+    
+    PinEdge edges[maxEdges];
+    uint32_t first = 0;
+    size_t count = pinEdges.read(pin.pin, sentSeq[pin.pin], edges, maxEdges - total, &first);
+    for (size_t i = 0; i < count; i++) {
+      JsonObject obj = edgesArray.createNestedObject();
+      obj["pin"] = pin.pin;
+      obj["seq"] = first + i;
+      obj["t"] = edges[i].timeUs;
+      obj["level"] = edges[i].level;
+      if (edges[i].flags & PIN_EDGE_GLITCH) {
+        obj["width"] = edges[i].widthUs;
+      }
+    }
+    sentSeq[pin.pin] = first + count;
+    total += count;
+    if (total >= maxEdges) {
+      break;
+    }
+  }
+  
+  if (total > 0) {
+    telemetry.publish(TOPIC_EDGES, doc);
+  }
+}
+
+// Сценарий из параметров запроса: name и steps (JSON-массив шагов).
+// Шаги могут ссылаться только на пины KVM
+bool parseSequenceRequest(AsyncWebServerRequest *request, KVMSequence& sequence, String& error) {
+  if (request->hasParam("name", true)) {
+    sequence.name = request->getParam("name", true)->value();
+    if (sequence.name.length() > 32) {
+      error = "Name is too long";
+      return false;
+    }
+  } else {
+    sequence.name = "adhoc";
+  }
+  
+  if (!request->hasParam("steps", true)) {
+    error = "Missing steps parameter";
+    return false;
+  }
+  
+  DynamicJsonDocument doc(3072);
+  if (deserializeJson(doc, request->getParam("steps", true)->value())) {
+    error = "Invalid steps JSON";
+    return false;
+  }
+  
+  JsonArrayConst steps = doc.as<JsonArrayConst>();
+  if (steps.size() == 0 || steps.size() > KVM_MAX_SEQUENCE_STEPS) {
+    error = "Steps must be a non-empty array of at most " + String(KVM_MAX_SEQUENCE_STEPS);
+    return false;
+  }
+  
+  std::vector<EnhancedPinConfig> pins = kvmModule.getPins();
+  auto resolveIndex = [&pins](int index) {
+    return (index >= 0 && index < (int)pins.size()) ? pins[index].pin : -1;
+  };
+  
+  for (JsonObjectConst stepObj : steps) {
+    KVMSequenceStep step;
+    if (!parseSequenceStep(stepObj, resolveIndex, step)) {
+      error = "Invalid step";
+      return false;
+    }
+    if (step.type != KVM_STEP_WAIT && kvmModule.findPin(step.gpio) < 0) {
+      error = "Step references a pin not configured in KVM";
+      return false;
+    }
+    sequence.steps.push_back(step);
+  }
+  return true;
+}
+
+// Параметры захвата из запроса: pins=0,2,3 (индексы KVM, по умолчанию все),
+// rate, samples, pretrigger (%), trigger=none|rising|falling|high|low|pattern,
+// triggerPin (индекс в pins), mask/value для pattern, timeout (мс)
+bool parseLogicRequest(AsyncWebServerRequest *request, LAConfig& config, String& error) {
+  std::vector<EnhancedPinConfig> pins = kvmModule.getPins();
+  config.channels = 0;
+  
+  if (request->hasParam("pins", true)) {
+    String list = request->getParam("pins", true)->value();
+    int from = 0;
+    while (from <= (int)list.length()) {
+      int comma = list.indexOf(',', from);
+      if (comma < 0) comma = list.length();
+      String item = list.substring(from, comma);
+      item.trim();
+      from = comma + 1;
+      if (item.length() == 0) {
+        continue;
+      }
+      int index = item.toInt();
+      if (index < 0 || index >= (int)pins.size()) {
+        error = "Pin not found";
+        return false;
+      }
+      if (config.channels >= LA_MAX_CHANNELS) {
+        error = "At most " + String(LA_MAX_CHANNELS) + " channels";
+        return false;
+      }
+      config.gpio[config.channels] = pins[index].pin;
+      config.names[config.channels] = pins[index].name;
+      config.channels++;
+    }
+  } else {
+    for (size_t i = 0; i < pins.size() && config.channels < LA_MAX_CHANNELS; i++) {
+      config.gpio[config.channels] = pins[i].pin;
+      config.names[config.channels] = pins[i].name;
+      config.channels++;
+    }
+  }
+  if (config.channels == 0) {
+    error = "No KVM pins to capture";
+    return false;
+  }
+  
+  config.rate = request->hasParam("rate", true)
+    ? strtoul(request->getParam("rate", true)->value().c_str(), nullptr, 10) : LA_DEFAULT_RATE;
+  config.samples = request->hasParam("samples", true)
+    ? strtoul(request->getParam("samples", true)->value().c_str(), nullptr, 10) : LA_HEAP_SAMPLES;
+  config.pretrigger = request->hasParam("pretrigger", true)
+    ? constrain(request->getParam("pretrigger", true)->value().toInt(), 0, 99) : 10;
+  config.timeoutMs = request->hasParam("timeout", true)
+    ? strtoul(request->getParam("timeout", true)->value().c_str(), nullptr, 10) : LA_MAX_TRIGGER_WAIT_MS;
+  
+  config.trigger = LA_TRIGGER_NONE;
+  if (request->hasParam("trigger", true) &&
+      !parseTriggerType(request->getParam("trigger", true)->value(), config.trigger)) {
+    error = "Unknown trigger type";
+    return false;
+  }
+  config.triggerChannel = request->hasParam("triggerPin", true)
+    ? constrain(request->getParam("triggerPin", true)->value().toInt(), 0, 255) : 0;
+  config.patternMask = request->hasParam("mask", true)
+    ? strtoul(request->getParam("mask", true)->value().c_str(), nullptr, 0) : 0;
+  config.patternValue = request->hasParam("value", true)
+    ? strtoul(request->getParam("value", true)->value().c_str(), nullptr, 0) : 0;
+  return true;
+}
+
+// Ответ на постановку задания в очередь
+void sendJobAccepted(AsyncWebServerRequest *request, uint32_t jobId) {
+  if (jobId == 0) {
+    request->send(503, "application/json", "{\"error\":\"Job queue is full\"}");
+    return;
+  }
+  
+  AsyncWebServerResponse *response = request->beginResponse(202, "application/json",
+    "{\"jobId\":" + String(jobId) + ",\"status\":\"queued\",\"poll\":\"/jobs/" + String(jobId) + "\"}");
+  response->addHeader("Location", "/jobs/" + String(jobId));
+  request->send(response);
+}
+
+// Сканирование сети в задании: движок работает в своей задаче,
+// задание следит за прогрессом и передает ему запрос отмены
+void runSweepJob(Job& job, IPAddress startIP, IPAddress endIP, SweepConfig config) {
+  HostSweep& sweep = networkTools.getSweep();
+  if (!sweep.start(startIP, endIP, config)) {
+    job.fail("Scan already in progress");
+    return;
+  }
+  
+  while (sweep.isRunning()) {
+    job.setProgress(sweep.getCompleted(), sweep.getTotal());
+    if (job.isCancelRequested()) {
+      sweep.cancel();
+    }
+    vTaskDelay(pdMS_TO_TICKS(50));
+  }
+  job.setProgress(sweep.getCompleted(), sweep.getTotal());
+  
+  if (sweep.getState() == SWEEP_ERROR) {
+    job.fail(sweep.getError());
+    return;
+  }
+  
+  std::vector<SweepHost> hosts = sweep.getResults();
+  DynamicJsonDocument doc(256 + hosts.size() * 96);
+  doc["success"] = true;
+  JsonArray hostsArray = doc.createNestedArray("hosts");
+  
+  for (const auto& host : hosts) {
+    JsonObject hostObj = hostsArray.createNestedObject();
+    hostObj["ip"] = host.ip.toString();
+    hostObj["active"] = true;
+    hostObj["time"] = host.response_time;
+  }
+  
+  String json;
+  serializeJson(doc, json);
+  job.setResult(json);
+}
+
+// Сканирование портов в задании (см. runSweepJob)
+void runPortScanJob(Job& job, IPAddress ip, int startPort, int endPort, PortScanConfig config) {
+  PortScanner& scanner = networkTools.getPortScanner();
+  if (!scanner.start(ip, startPort, endPort, config)) {
+    job.fail("Scan already in progress");
+    return;
+  }
+  
+  while (scanner.isRunning()) {
+    job.setProgress(scanner.getScanned(), scanner.getTotal());
+    if (job.isCancelRequested()) {
+      scanner.cancel();
+    }
+    vTaskDelay(pdMS_TO_TICKS(50));
+  }
+  job.setProgress(scanner.getScanned(), scanner.getTotal());
+  
+  if (scanner.getState() == PORT_SCAN_ERROR) {
+    job.fail(scanner.getError());
+    return;
+  }
+  
+  std::vector<uint16_t> ports = scanner.getOpenPorts();
+  DynamicJsonDocument doc(256 + ports.size() * 64);
+  doc["success"] = true;
+  doc["ip"] = ip.toString();
+  JsonArray portsArray = doc.createNestedArray("ports");
+  
+  for (uint16_t port : ports) {
+    JsonObject portObj = portsArray.createNestedObject();
+    portObj["port"] = port;
+    portObj["service"] = NetworkTools::identifyService(port);
+  }
+  
+  String json;
+  serializeJson(doc, json);
+  job.setResult(json);
+}
+
+#ifdef BENCH_BUILD
+// ======== МИКРОБЕНЧМАРКИ (env:bench) ========
+//
+// Запускаются один раз после загрузки сервисов. Замеры не трогают
+// сохраненные настройки и возвращают состояние, которое меняют (фильтр
+// сниффера, раздел меню); таблица клиентов и списки блокировки - свои.
+
+BenchRunner bench;
+APClientTable benchClients;
+Blocklist benchBlocklist;
+
+// Синтетический MAC станции i (локально администрируемый)
+static void benchMAC(uint32_t i, uint8_t* mac) {
+  mac[0] = 0x02;
+  mac[1] = 0xBE;
+  mac[2] = 0x4C;
+  mac[3] = i >> 16;
+  mac[4] = i >> 8;
+  mac[5] = i;
+}
+
+// Кадр данных addr2 -> addr1 в формате колбэка promiscuous-режима
+static void benchFrame(std::vector<uint8_t>& buf, const uint8_t* addr1, const uint8_t* addr2, uint16_t len) {
+  buf.assign(sizeof(wifi_promiscuous_pkt_t) + len, 0);
+  wifi_promiscuous_pkt_t* pkt = (wifi_promiscuous_pkt_t*)buf.data();
+  pkt->rx_ctrl.sig_len = len;
+  pkt->rx_ctrl.rssi = -50;
+  pkt->rx_ctrl.channel = 6;
+  pkt->payload[0] = 0x08;  // Type = Data
+  memcpy(pkt->payload + 4, addr1, 6);
+  memcpy(pkt->payload + 10, addr2, 6);
+}
+
+// Колбэк сниффера: 100 кадров на запуск, targets клиентов в фильтре
+static void benchSniffer() {
+  if (isSniffing) {
+    Serial.println(BENCH_LINE_PREFIX "{\"event\":\"skip\",\"name\":\"sniffer\",\"reason\":\"sniffing\"}");
+    return;
+  }
+  
+  uint8_t ap[6], target[6], foreign[6];
+  benchMAC(0xFFFF, ap);
+  benchMAC(0, target);
+  benchMAC(0x8000, foreign);
+  std::vector<uint8_t> matched, rejected;
+  benchFrame(matched, ap, target, 512);
+  benchFrame(rejected, ap, foreign, 512);
+  
+  const uint8_t targetCounts[] = {1, SNIFF_FILTER_MAX_CLIENTS};
+  for (uint8_t targets : targetCounts) {
+    sniffFilter.clear();
+    for (uint8_t i = 0; i < targets; i++) {
+      uint8_t mac[6];
+      benchMAC(i, mac);
+      sniffFilter.set(makeSniffTarget(mac));
+    }
+    // Колбэк вызывается напрямую: promiscuous-режим не включается
+    isSniffing = true;
+    bench.run("sniffer_match_100frames", targets, [&]() {
+      for (int i = 0; i < 100; i++) {
+        promiscuous_rx_callback(matched.data(), WIFI_PKT_DATA);
+      }
+    });
+    bench.run("sniffer_reject_100frames", targets, [&]() {
+      for (int i = 0; i < 100; i++) {
+        promiscuous_rx_callback(rejected.data(), WIFI_PKT_DATA);
+      }
+    });
+    isSniffing = false;
+  }
+  
+  sniffFilter.clear();
+  packetBuffer.clear();
+}
+
+// Сверка таблицы клиентов с драйвером для n станций в таблице
+static void benchClientSync() {
+  const uint8_t sizes[] = {1, 4, 8, AP_CLIENT_TABLE_CAPACITY};
+  for (uint8_t n : sizes) {
+    bench.run("ap_clients_sync", n, []() {
+      benchClients.sync([](const uint8_t* mac) { return benchBlocklist.isMACBlocked(mac); });
+    }, 100, [n]() {
+      // Сверка отмечает отсутствующие у драйвера станции - заполняем заново
+      benchClients.clear();
+      for (uint8_t i = 0; i < n; i++) {
+        uint8_t mac[6];
+        benchMAC(i, mac);
+        benchClients.onConnected(mac, i + 1, false);
+      }
+    });
+  }
+  bench.run("update_ap_clients", apClients.size(), updateAPClients, 100);
+}
+
+// Сериализация элементов /ap/users и /scan-results
+static void benchJson() {
+  const uint8_t userCounts[] = {4, AP_CLIENT_TABLE_CAPACITY};
+  for (uint8_t n : userCounts) {
+    std::vector<APClient> clients(n);
+    for (uint8_t i = 0; i < n; i++) {
+      benchMAC(i, clients[i].mac);
+      clients[i].ip = IPAddress(192, 168, 4, 100 + i);
+      clients[i].aid = i + 1;
+      clients[i].connected = true;
+      clients[i].blocked = false;
+      clients[i].lastPacket = "DATA 512B -50dBm";
+      clients[i].lastSeen = millis();
+      clients[i].connectedAt = millis();
+    }
+    bench.run("json_ap_users", n, [&clients]() {
+      BenchNullPrint sink;
+      for (const auto& client : clients) {
+        StaticJsonDocument<384> userObj;
+        apUserToJson(client, userObj);
+        serializeJson(userObj, sink);
+      }
+    });
+  }
+  
+  const uint8_t networkCounts[] = {10, 40};
+  for (uint8_t n : networkCounts) {
+    std::vector<WiFiResult> results(n);
+    for (uint8_t i = 0; i < n; i++) {
+      results[i].ssid = "BenchNetwork-" + String(i);
+      results[i].rssi = -40 - i;
+      results[i].encryptionType = WIFI_AUTH_WPA2_PSK;
+      results[i].channel = 1 + i % 13;
+    }
+    bench.run("json_scan_results", n, [&results]() {
+      BenchNullPrint sink;
+      for (const auto& network : results) {
+        StaticJsonDocument<192> netObj;
+        scanResultToJson(network, netObj);
+        serializeJson(netObj, sink);
+      }
+    });
+    
+    // Кэш ответов: сборка страницы из готовых элементов и повторный запрос
+    ScanResultsCache cache;
+    cache.publish(results, scanResultToJson);
+    ScanQuery page = defaultScanQuery();
+    page.size = SCAN_PAGE_DEFAULT;
+    page.sort = SCAN_SORT_SSID;
+    // Новый снимок перед каждым запуском сбрасывает кэш, замеряется только сборка
+    bench.run("scan_cache_build_page", n, [&cache, &page]() { cache.body(page); },
+              BENCH_DEFAULT_ITERATIONS,
+              [&cache, &results]() { cache.publish(results, scanResultToJson); });
+    cache.body(page);
+    bench.run("scan_cache_hit", n, [&cache, &page]() { cache.body(page); });
+  }
+}
+
+// Поиск в списках блокировки: 100 запросов на запуск, попадания и промахи
+static void benchBlocklistLookups() {
+  const uint16_t sizes[] = {16, 1024};
+  uint16_t filled = 0;
+  for (uint16_t n : sizes) {
+    for (; filled < n; filled++) {
+      uint8_t mac[6];
+      benchMAC(filled, mac);
+      benchBlocklist.blockMAC(mac);
+      benchBlocklist.blockIP((uint32_t)IPAddress(10, 0, filled >> 8, filled));
+    }
+    bench.run("blocklist_mac_100lookups", n, [n]() {
+      uint8_t mac[6];
+      for (uint16_t i = 0; i < 100; i++) {
+        benchMAC((i * 37) % (2 * n), mac);  // Половина - промахи
+        benchBlocklist.isMACBlocked(mac);
+      }
+    });
+    bench.run("blocklist_ip_100lookups", n, [n]() {
+      for (uint16_t i = 0; i < 100; i++) {
+        uint16_t k = (i * 37) % (2 * n);
+        benchBlocklist.isIPBlocked((uint32_t)IPAddress(10, 0, k >> 8, k));
+      }
+    });
+  }
+}
+
+// Отрисовка разделов меню
+static void benchDrawMenu() {
+  MenuSection savedSection = currentSection;
+  int savedItem = selectedMenuItem;
+  int savedStart = menuStartPosition;
+  
+  const struct {
+    MenuSection section;
+    const char* name;
+  } sections[] = {
+    {MENU_MAIN, "draw_menu_main"},
+    {MENU_WIFI, "draw_menu_wifi"},
+    {MENU_AP_STATUS, "draw_menu_ap_status"},
+    {MENU_AP_USERS, "draw_menu_ap_users"},
+    {MENU_DEVICE_SETTINGS, "draw_menu_device_settings"},
+  };
+  for (const auto& entry : sections) {
+    currentSection = entry.section;
+    selectedMenuItem = 0;
+    menuStartPosition = 0;
+    bench.run(entry.name, 1, drawMenu, 50);
+  }
+  
+  currentSection = savedSection;
+  selectedMenuItem = savedItem;
+  menuStartPosition = savedStart;
+  drawMenu();
+}
+
+// Загрузка настроек: разбор записей хранилища и чтение файла с флеша
+static void benchConfigLoad() {
+  bench.run("config_load_network", 1, loadConfiguration, 50);
+  bench.run("config_load_device", 1, loadDeviceSettings, 50);
+  bench.run("config_load_networks", savedNetworks.size(), loadSavedNetworks, 50);
+  
+  File probe = LittleFS.open(CONFIG_STORE_FILE, "r");
+  size_t fileSize = probe ? probe.size() : 0;
+  if (probe) {
+    probe.close();
+  }
+  std::vector<uint8_t> buffer(fileSize);
+  bench.run("config_file_read", fileSize, [&buffer]() {
+    File file = LittleFS.open(CONFIG_STORE_FILE, "r");
+    if (file) {
+      file.read(buffer.data(), buffer.size());
+      file.close();
+    }
+  }, 20);
+}
+
+void runBenchmarks() {
+  bench.begin(__DATE__ " " __TIME__);
+  benchSniffer();
+  benchClientSync();
+  benchJson();
+  benchBlocklistLookups();
+  benchDrawMenu();
+  benchConfigLoad();
+  bench.end();
 }
+#endif // BENCH_BUILD
@@ -0,0 +1,83 @@
+"""Разбор результатов микробенчмарков (env:bench).
+
+Прошивка печатает в Serial строки вида
+    BENCH {"name":"sniffer_match_100frames","n":1,"iters":200,"p50":312,...}
+Скрипт выбирает их из лога монитора и:
+  - без --baseline печатает сводку в JSON (ее можно сохранить как базовую);
+  - с --baseline сравнивает медианы с базовым прогоном и завершается с
+    кодом 1, если какой-то замер стал медленнее порога.
+
+    pio run -e bench -t upload && pio device monitor | tee bench.log
+    python tools/bench_report.py bench.log > baseline.json
+    python tools/bench_report.py bench.log --baseline baseline.json --threshold 10
+"""
+
+import argparse
+import json
+import sys
+
+PREFIX = "BENCH "
+
+
+def parse(path):
+    results = {}
+    meta = {}
+    with open(path, encoding="utf-8", errors="replace") as f:
+        for line in f:
+            pos = line.find(PREFIX)
+            if pos < 0:
+                continue
+            try:
+                record = json.loads(line[pos + len(PREFIX):])
+            except ValueError:
+                continue  # Строка перемешалась с другим выводом
+            if "event" in record:
+                meta[record["event"]] = record
+            elif "name" in record:
+                results["%s/%d" % (record["name"], record.get("n", 0))] = record
+    return meta, results
+
+
+def compare(results, baseline, threshold):
+    regressions = []
+    for key, base in sorted(baseline.items()):
+        current = results.get(key)
+        if current is None:
+            print("%-40s missing" % key)
+            continue
+        before, after = base["p50"], current["p50"]
+        change = (after - before) * 100.0 / before if before else 0.0
+        mark = ""
+        # Разница в пару микросекунд - шум таймера, а не регрессия
+        if change > threshold and after - before > 2:
+            mark = "  REGRESSION"
+            regressions.append(key)
+        print("%-40s %8d -> %8d us  %+6.1f%%%s" % (key, before, after, change, mark))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Bench results from the serial log")
+    parser.add_argument("log")
+    parser.add_argument("--baseline", help="JSON summary of a previous run")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed p50 slowdown, percent")
+    args = parser.parse_args()
+
+    meta, results = parse(args.log)
+    if "done" not in meta:
+        print("warning: no completion line, run may be incomplete", file=sys.stderr)
+
+    if not args.baseline:
+        json.dump({"meta": meta, "results": results}, sys.stdout, indent=1, sort_keys=True)
+        print()
+        return 0
+
+    with open(args.baseline, encoding="utf-8") as f:
+        baseline = json.load(f)["results"]
+    regressions = compare(results, baseline, args.threshold)
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
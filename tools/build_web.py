@@ -0,0 +1,128 @@
+"""Сборка веб-интерфейса для LittleFS.
+
+Исходники лежат в web/, результат записывается в data/:
+  - каждый файл минифицируется (консервативно, без изменения семантики),
+    сжимается gzip и сохраняется как <имя>.gz;
+  - в index.html ссылки на ресурсы заменяются на /<имя>?v=<etag>, поэтому
+    ресурсы кешируются браузером как неизменяемые, а сама страница
+    перепроверяется по ETag;
+  - web_manifest.json описывает ресурсы для сервера (URI, файл, тип, ETag).
+
+Запускается PlatformIO перед сборкой (extra_scripts = pre:tools/build_web.py)
+или вручную: python tools/build_web.py
+"""
+
+import gzip
+import hashlib
+import json
+import os
+import re
+
+# Ресурсы: исходный файл, URI, MIME-тип, неизменяемый ли ресурс
+ASSETS = [
+    ("app.css", "/app.css", "text/css", True),
+    ("app.js", "/app.js", "application/javascript", True),
+    ("index.html", "/", "text/html", False),
+]
+
+MANIFEST_NAME = "web_manifest.json"
+
+
+def minify_css(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    lines = [line.strip() for line in text.splitlines()]
+    text = "\n".join(line for line in lines if line)
+    return re.sub(r"\s*([{};,])\s*", r"\1", text)
+
+
+def minify_js(text):
+    # Убираем отступы, пустые строки и строчные комментарии, но не трогаем
+    # содержимое многострочных шаблонных строк и не склеиваем строки (ASI)
+    out = []
+    in_template = False
+    for line in text.splitlines():
+        if in_template:
+            out.append(line)
+        else:
+            stripped = line.strip()
+            if stripped and not stripped.startswith("//"):
+                out.append(stripped)
+        if len(re.findall(r"(?<!\\)`", line)) % 2 == 1:
+            in_template = not in_template
+    return "\n".join(out)
+
+
+def minify_html(text):
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    lines = [line.strip() for line in text.splitlines()]
+    return "\n".join(line for line in lines if line)
+
+
+MINIFIERS = {
+    "text/css": minify_css,
+    "application/javascript": minify_js,
+    "text/html": minify_html,
+}
+
+
+def etag_for(data):
+    return hashlib.sha1(data).hexdigest()[:16]
+
+
+def build(project_dir):
+    src_dir = os.path.join(project_dir, "web")
+    out_dir = os.path.join(project_dir, "data")
+    os.makedirs(out_dir, exist_ok=True)
+
+    manifest = []
+    versions = {}
+    total_src = 0
+    total_gz = 0
+
+    for name, uri, mime, immutable in ASSETS:
+        with open(os.path.join(src_dir, name), encoding="utf-8") as f:
+            source = f.read()
+        total_src += len(source.encode("utf-8"))
+
+        text = MINIFIERS[mime](source)
+        if name == "index.html":
+            # Ссылки на ресурсы с версией, чтобы сбрасывать кеш браузера
+            for asset, version in versions.items():
+                text = text.replace('"%s"' % asset, '"/%s?v=%s"' % (asset, version))
+
+        # mtime=0 - одинаковый результат для одинаковых исходников
+        data = gzip.compress(text.encode("utf-8"), compresslevel=9, mtime=0)
+        etag = etag_for(data)
+        versions[name] = etag
+        total_gz += len(data)
+
+        gz_name = name + ".gz"
+        gz_path = os.path.join(out_dir, gz_name)
+        old = None
+        if os.path.exists(gz_path):
+            with open(gz_path, "rb") as f:
+                old = f.read()
+        if old != data:
+            with open(gz_path, "wb") as f:
+                f.write(data)
+
+        manifest.append({
+            "uri": uri,
+            "file": "/" + gz_name,
+            "type": mime,
+            "etag": etag,
+            "immutable": immutable,
+        })
+
+    with open(os.path.join(out_dir, MANIFEST_NAME), "w", encoding="utf-8") as f:
+        json.dump({"assets": manifest}, f, indent=1)
+
+    print("Web UI: %d bytes -> %d bytes gzip" % (total_src, total_gz))
+
+
+try:
+    Import("env")  # noqa: F821 - определено PlatformIO
+    build(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        build(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
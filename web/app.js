@@ -0,0 +1,1923 @@
+// Глобальные переменные
+let currentMode = '';
+let isAPModeActive = false;
+let isPinInverted = false;
+let currentUserIP = null;
+let sniffWatch = null;  // Подписки телеметрии активного сниффинга
+
+// Канал телеметрии (WebSocket /ws): подписка на темы вместо опросов.
+// При обрыве соединение восстанавливается, подписки отправляются заново
+const telemetry = {
+    socket: null,
+    handlers: {},
+    retryDelay: 1000,
+
+    connect() {
+        const socket = new WebSocket(`ws://${location.host}/ws`);
+        this.socket = socket;
+        socket.onopen = () => {
+            this.retryDelay = 1000;
+            const topics = Object.keys(this.handlers).filter(t => this.handlers[t].length);
+            if (topics.length) {
+                socket.send(JSON.stringify({ sub: topics }));
+            }
+        };
+        socket.onmessage = (event) => {
+            let message;
+            try {
+                message = JSON.parse(event.data);
+            } catch (e) {
+                return;
+            }
+            (this.handlers[message.t] || []).forEach(handler => handler(message));
+        };
+        socket.onclose = () => {
+            this.socket = null;
+            setTimeout(() => this.connect(), this.retryDelay);
+            this.retryDelay = Math.min(this.retryDelay * 2, 30000);
+        };
+    },
+
+    isConnected() {
+        return this.socket !== null && this.socket.readyState === WebSocket.OPEN;
+    },
+
+    send(message) {
+        if (this.isConnected()) {
+            this.socket.send(JSON.stringify(message));
+        }
+    },
+
+    subscribe(topic, handler) {
+        if (!this.handlers[topic]) {
+            this.handlers[topic] = [];
+        }
+        this.handlers[topic].push(handler);
+        this.send({ sub: [topic] });
+    },
+
+    unsubscribe(topic, handler) {
+        const list = (this.handlers[topic] || []).filter(h => h !== handler);
+        this.handlers[topic] = list;
+        if (!list.length) {
+            this.send({ unsub: [topic] });
+        }
+    }
+};
+
+// Функция для загрузки доступных пинов
+function loadAvailablePins() {
+    fetch('/api/kvm/available-pins')
+        .then(response => response.json())
+        .then(data => {
+            const pinSelect = document.getElementById('pin-select');
+            // Очищаем текущий список
+            while (pinSelect.options.length > 1) {
+                pinSelect.remove(1);
+            }
+            
+            data.pins.forEach(pin => {
+                const option = document.createElement('option');
+                option.value = pin.pin;
+                option.textContent = `${pin.name} - ${pin.description}`;
+                option.disabled = pin.inUse; // Отключаем уже используемые пины
+                if (pin.inUse) {
+                    option.textContent += ' (В использовании)';
+                }
+                pinSelect.appendChild(option);
+            });
+        })
+        .catch(error => {
+            console.error('Ошибка при загрузке доступных пинов:', error);
+            showNotification('Ошибка при загрузке списка пинов', 'error');
+        });
+}
+
+// Инициализация при загрузке страницы
+document.addEventListener('DOMContentLoaded', function() {
+    // Применяем сохраненную тему
+    applyTheme();
+    
+    refreshStatus();
+    loadKVMPins();
+    loadAvailablePins(); // Добавляем загрузку доступных пинов
+    loadAPSettings();
+    loadDeviceSettings();
+    loadSavedNetworks();
+    loadAPUsers();
+    
+    // Настройка обработчика для темы
+    document.getElementById('theme-toggle').addEventListener('click', function() {
+        toggleTheme();
+    });
+    
+    // Настройка обработчиков для ползунков
+    document.getElementById('brightness').addEventListener('input', function() {
+        document.getElementById('brightness-value').textContent = this.value + '%';
+    });
+    
+    document.getElementById('volume').addEventListener('input', function() {
+        document.getElementById('volume-value').textContent = this.value + '%';
+    });
+    
+    // Настройка обработчиков форм
+    document.getElementById('connect-form').addEventListener('submit', function(e) {
+        e.preventDefault();
+        connectToNetwork();
+    });
+    
+    document.getElementById('add-pin-form').addEventListener('submit', function(e) {
+        e.preventDefault();
+        addNewPin();
+    });
+    
+    document.getElementById('ap-form').addEventListener('submit', function(e) {
+        e.preventDefault();
+        updateAPSettings();
+    });
+    
+    document.getElementById('connection-check-form').addEventListener('submit', function(e) {
+        e.preventDefault();
+        updateConnectionCheck();
+    });
+    
+    document.getElementById('ping-form').addEventListener('submit', function(e) {
+        e.preventDefault();
+        pingHost();
+    });
+    
+    document.getElementById('ip-scan-form').addEventListener('submit', function(e) {
+        e.preventDefault();
+        scanIPRange();
+    });
+    
+    document.getElementById('port-scan-form').addEventListener('submit', function(e) {
+        e.preventDefault();
+        scanPorts();
+    });
+    
+    document.getElementById('ip-block-form').addEventListener('submit', function(e) {
+        e.preventDefault();
+        blockIP();
+    });
+    
+    document.getElementById('device-settings-form').addEventListener('submit', function(e) {
+        e.preventDefault();
+        saveDeviceSettings();
+    });
+    
+    // Обработчик выбора режима AP
+    document.getElementById('ap-mode').addEventListener('change', function(e) {
+        const honeypotSection = document.getElementById('honeypot-section');
+        if (e.target.value === '4') { // Honeypot mode
+            honeypotSection.style.display = 'block';
+        } else {
+            honeypotSection.style.display = 'none';
+        }
+    });
+    
+    // Загружаем статус инвертирования пинов
+    fetch('/settings/pin-inversion')
+        .then(response => response.json())
+        .then(data => {
+            isPinInverted = data.inverted;
+            document.getElementById('invert-pins').checked = isPinInverted;
+        })
+        .catch(error => {
+            console.error('Ошибка при загрузке настроек инвертирования пинов:', error);
+        });
+    
+    // Статус приходит через телеметрию; опрос - только без WebSocket
+    telemetry.connect();
+    telemetry.subscribe('status', renderStatus);
+    setInterval(() => {
+        if (!telemetry.isConnected()) {
+            refreshStatus();
+        }
+    }, 30000);
+});
+
+// Функция переключения темы
+function toggleTheme() {
+    const theme = document.body.getAttribute('data-theme') === 'dark' ? 'light' : 'dark';
+    document.body.setAttribute('data-theme', theme);
+    localStorage.setItem('theme', theme);
+    
+    // Обновляем иконку и текст кнопки
+    const themeIcon = document.getElementById('theme-icon');
+    const themeText = document.getElementById('theme-text');
+    
+    if (theme === 'dark') {
+        themeIcon.textContent = '☀️';
+        themeText.textContent = 'Светлая тема';
+    } else {
+        themeIcon.textContent = '🌙';
+        themeText.textContent = 'Темная тема';
+    }
+}
+
+// Функция применения темы
+function applyTheme() {
+    const savedTheme = localStorage.getItem('theme') || 'light';
+    document.body.setAttribute('data-theme', savedTheme);
+    
+    // Обновляем иконку и текст кнопки
+    const themeIcon = document.getElementById('theme-icon');
+    const themeText = document.getElementById('theme-text');
+    
+    if (savedTheme === 'dark') {
+        themeIcon.textContent = '☀️';
+        themeText.textContent = 'Светлая тема';
+    } else {
+        themeIcon.textContent = '🌙';
+        themeText.textContent = 'Темная тема';
+    }
+}
+
+// Функция для отправки импульса на пин
+function sendPulseToPin(pinIndex, duration) {
+    if (!duration) {
+        duration = document.querySelector(`#pin-pulse-duration-${pinIndex}`).value;
+    }
+    
+    fetch('/api/kvm/pulse', {
+        method: 'POST',
+        headers: {
+            'Content-Type': 'application/x-www-form-urlencoded',
+        },
+        body: `index=${pinIndex}&duration=${duration}`
+    })
+    .then(response => response.json())
+    .then(data => {
+        if (data.success) {
+            showNotification(`Импульс отправлен на пин (длительность: ${duration} мс)`, 'success');
+        } else {
+            showNotification(`Ошибка отправки импульса: ${data.message || 'Неизвестная ошибка'}`, 'error');
+        }
+    })
+    .catch(error => {
+        console.error('Ошибка при отправке импульса на пин:', error);
+        showNotification('Ошибка при отправке импульса на пин', 'error');
+    });
+}
+
+// Функция переключения режима инвертирования пинов
+function togglePinInversion() {
+    const inverted = document.getElementById('invert-pins').checked;
+    
+    fetch('/settings/pin-inversion', {
+        method: 'POST',
+        headers: {
+            'Content-Type': 'application/x-www-form-urlencoded',
+        },
+        body: `inverted=${inverted ? 1 : 0}`
+    })
+    .then(response => response.json())
+    .then(data => {
+        if (data.success) {
+            isPinInverted = inverted;
+            showNotification(`Режим инвертирования пинов ${inverted ? 'включен' : 'выключен'}`, 'success');
+            loadKVMPins(); // Перезагружаем пины для обновления отображения
+        } else {
+            showNotification('Ошибка изменения режима инвертирования', 'error');
+            // Возвращаем состояние чекбокса
+            document.getElementById('invert-pins').checked = isPinInverted;
+        }
+    })
+    .catch(error => {
+        console.error('Ошибка при изменении режима инвертирования пинов:', error);
+        showNotification('Ошибка при изменении режима инвертирования пинов', 'error');
+        // Возвращаем состояние чекбокса
+        document.getElementById('invert-pins').checked = isPinInverted;
+    });
+}
+
+// Функция загрузки сохраненных сетей
+function loadSavedNetworks() {
+    const savedNetworksList = document.getElementById('saved-networks-list');
+    savedNetworksList.innerHTML = '<p class="text-center">Загрузка сохраненных сетей...</p>';
+    
+    fetch('/wifi/saved')
+        .then(response => response.json())
+        .then(data => {
+            if (data.networks && data.networks.length > 0) {
+                let html = '<table>';
+                html += '<thead><tr><th>SSID</th><th>Действия</th></tr></thead><tbody>';
+                
+                data.networks.forEach(network => {
+                    html += `<tr>
+                        <td>${network.ssid}</td>
+                        <td>
+                            <button onclick="connectToSavedNetwork('${network.ssid}')" class="success">Подключиться</button>
+                            <button onclick="deleteSavedNetwork('${network.ssid}')" class="danger">Удалить</button>
+                        </td>
+                    </tr>`;
+                });
+                
+                html += '</tbody></table>';
+                savedNetworksList.innerHTML = html;
+            } else {
+                savedNetworksList.innerHTML = '<p class="text-center">Нет сохраненных сетей</p>';
+            }
+        })
+        .catch(error => {
+            console.error('Ошибка при загрузке сохраненных сетей:', error);
+            savedNetworksList.innerHTML = '<p class="text-center">Ошибка при загрузке сохраненных сетей</p>';
+            showNotification('Ошибка при загрузке сохраненных сетей', 'error');
+        });
+}
+
+// Функция подключения к сохраненной сети
+function connectToSavedNetwork(ssid) {
+    showNotification(`Подключение к сети ${ssid}...`, 'info');
+    
+    fetch('/wifi/connect', {
+        method: 'POST',
+        headers: {
+            'Content-Type': 'application/x-www-form-urlencoded',
+        },
+        body: `ssid=${encodeURIComponent(ssid)}`
+    })
+    .then(response => response.text())
+    .then(result => {
+        showNotification(`Подключение к сети ${ssid} инициировано`, 'success');
+        
+        // Ждем некоторое время и обновляем статус
+        setTimeout(refreshStatus, 5000);
+    })
+    .catch(error => {
+        console.error('Ошибка при подключении к сохраненной сети:', error);
+        showNotification('Ошибка при подключении к сохраненной сети', 'error');
+    });
+}
+
+// Функция удаления сохраненной сети
+function deleteSavedNetwork(ssid) {
+    if (confirm(`Вы уверены, что хотите удалить сеть "${ssid}"?`)) {
+        fetch('/wifi/delete', {
+            method: 'POST',
+            headers: {
+                'Content-Type': 'application/x-www-form-urlencoded',
+            },
+            body: `ssid=${encodeURIComponent(ssid)}`
+        })
+        .then(response => response.json())
+        .then(data => {
+            if (data.success) {
+                showNotification(`Сеть ${ssid} удалена`, 'success');
+                loadSavedNetworks();
+            } else {
+                showNotification(`Ошибка удаления сети: ${data.message || 'Неизвестная ошибка'}`, 'error');
+            }
+        })
+        .catch(error => {
+            console.error('Ошибка при удалении сохраненной сети:', error);
+            showNotification('Ошибка при удалении сохраненной сети', 'error');
+        });
+    }
+}
+
+// Функция для показа уведомлений
+function showNotification(message, type = 'info') {
+    const notificationArea = document.getElementById('notification-area');
+    const notification = document.createElement('div');
+    notification.className = `notification ${type}`;
+    notification.textContent = message;
+    
+    notificationArea.appendChild(notification);
+    
+    // Удаляем уведомление через 5 секунд
+    setTimeout(() => {
+        notification.classList.add('fade-out');
+        setTimeout(() => {
+            notification.remove();
+        }, 300);
+    }, 5000);
+}
+
+// Функция для открытия вкладки
+function openTab(evt, tabName) {
+    var i, tabcontent, tablinks;
+    
+    // Скрываем все вкладки
+    tabcontent = document.getElementsByClassName("tabcontent");
+    for (i = 0; i < tabcontent.length; i++) {
+        tabcontent[i].style.display = "none";
+    }
+    
+    // Убираем активный класс у всех кнопок
+    tablinks = document.getElementsByClassName("tablinks");
+    for (i = 0; i < tablinks.length; i++) {
+        tablinks[i].className = tablinks[i].className.replace(" active", "");
+    }
+    
+    // Показываем выбранную вкладку и делаем кнопку активной
+    document.getElementById(tabName).style.display = "block";
+    evt.currentTarget.className += " active";
+    
+    // Обновляем данные на вкладках при переключении
+    if (tabName === 'status') {
+        refreshStatus();
+    } else if (tabName === 'kvm') {
+        loadKVMPins();
+        loadAvailablePins();
+    } else if (tabName === 'ap') {
+        loadAPSettings();
+        loadAPUsers();
+    } else if (tabName === 'device') {
+        loadDeviceSettings();
+        loadDeviceInfo();
+    } else if (tabName === 'network') {
+        checkNetworkTools();
+    } else if (tabName === 'wifi') {
+        loadSavedNetworks();
+    }
+}
+
+// Функция для обновления статуса
+function refreshStatus() {
+    fetch('/diagnostic')
+        .then(response => {
+            if (!response.ok) {
+                throw new Error('Ошибка сети');
+            }
+            return response.json();
+        })
+        .then(renderStatus)
+        .catch(error => {
+            console.error('Ошибка при обновлении статуса:', error);
+            showNotification('Ошибка при обновлении статуса: ' + error.message, 'error');
+        });
+}
+
+// Отображение статуса (ответ /diagnostic или тема status телеметрии)
+function renderStatus(data) {
+    // Обновляем информацию о статусе WiFi
+    const wifiStatus = document.getElementById('wifi-status');
+    const wifiDetails = document.getElementById('wifi-details');
+    const ipAddress = document.getElementById('ip-address');
+    const signalStrength = document.getElementById('signal-strength-text');
+    const signalIndicator = document.getElementById('signal-strength-indicator');
+    const operationMode = document.getElementById('operation-mode');
+    const batteryLevel = document.getElementById('battery-level');
+    const wifiIndicator = document.getElementById('wifi-indicator').querySelector('.indicator');
+    
+    if (data.connected) {
+        wifiStatus.classList.remove('offline');
+        wifiIndicator.classList.remove('offline');
+        wifiIndicator.classList.add('online');
+        
+        wifiDetails.innerHTML = `Подключено к сети: <strong>${data.ssid}</strong><br>Уровень сигнала: ${data.rssi} dBm`;
+        ipAddress.textContent = data.ip;
+        signalStrength.textContent = `${data.rssi} dBm`;
+        
+        // Обновляем индикатор сигнала
+        signalIndicator.className = 'signal-strength';
+        if (data.rssi > -50) {
+            signalIndicator.classList.add('signal-excellent');
+        } else if (data.rssi > -70) {
+            signalIndicator.classList.add('signal-good');
+        } else if (data.rssi > -80) {
+            signalIndicator.classList.add('signal-fair');
+        } else {
+            signalIndicator.classList.add('signal-weak');
+        }
+        
+        operationMode.textContent = 'Клиент';
+        operationMode.className = 'badge success';
+        currentMode = 'client';
+    } else {
+        wifiStatus.classList.add('offline');
+        wifiIndicator.classList.remove('online');
+        wifiIndicator.classList.add('offline');
+        
+        wifiDetails.innerHTML = '<strong>Не подключено к WiFi</strong>';
+        ipAddress.textContent = '-';
+        signalStrength.textContent = '-';
+        signalIndicator.className = 'signal-strength';
+        operationMode.textContent = 'Неизвестно';
+        operationMode.className = '';
+        currentMode = 'unknown';
+    }
+    
+    // Обновляем информацию о точке доступа
+    const apStatus = document.getElementById('ap-status');
+    const apDetails = document.getElementById('ap-details');
+    const apIndicator = document.getElementById('ap-indicator').querySelector('.indicator');
+    
+    if (data.ap_mode !== undefined && data.ap_mode > 0) {
+        apStatus.classList.remove('offline');
+        apIndicator.classList.remove('offline');
+        apIndicator.classList.add('online');
+        
+        let apModeName = 'Неизвестно';
+        switch(data.ap_mode) {
+            case 1: apModeName = 'Обычный'; break;
+            case 2: apModeName = 'Ретранслятор'; break;
+            case 3: apModeName = 'Скрытый'; break;
+            case 4: apModeName = 'Honeypot'; break;
+        }
+        
+        apDetails.innerHTML = `
+            Режим: <strong>${apModeName}</strong><br>
+            SSID: <strong>${data.ap_ssid}</strong><br>
+            IP: ${data.ap_ip}<br>
+            Подключено клиентов: ${data.ap_stations}
+        `;
+        
+        isAPModeActive = true;
+        
+        // Если мы в режиме AP, обновляем кнопку блокировки IP
+        document.getElementById('ip-block-section').style.display = 'block';
+        loadBlockedIPs();
+    } else {
+        apStatus.classList.add('offline');
+        apIndicator.classList.remove('online');
+        apIndicator.classList.add('offline');
+        
+        apDetails.innerHTML = '<strong>Точка доступа выключена</strong>';
+        isAPModeActive = false;
+        
+        // Скрываем секцию блокировки IP, если AP не активен
+        document.getElementById('ip-block-section').style.display = 'none';
+    }
+    
+    // Обновляем информацию о батарее
+    if (data.battery) {
+        const batteryVoltage = data.battery.toFixed(2);
+        batteryLevel.textContent = `${batteryVoltage}V`;
+        document.getElementById('battery-indicator').textContent = `Батарея: ${batteryVoltage}V`;
+        
+        // Расчет примерного процента заряда (для M5StickC PLUS 2)
+        // 4.2V - 100%, 3.0V - 0%
+        let batteryPercent = Math.min(100, Math.max(0, (data.battery - 3.0) / 1.2 * 100));
+        document.getElementById('battery-progress').style.width = batteryPercent.toFixed(0) + '%';
+        
+        // Меняем цвет индикатора в зависимости от заряда
+        if (batteryPercent < 20) {
+            document.getElementById('battery-progress').style.backgroundColor = 'var(--error-color)';
+        } else if (batteryPercent < 50) {
+            document.getElementById('battery-progress').style.backgroundColor = 'var(--warning-color)';
+        } else {
+            document.getElementById('battery-progress').style.backgroundColor = 'var(--success-color)';
+        }
+    }
+}
+
+// Функция для сканирования сетей с улучшенным отслеживанием статуса
+function scanNetworks() {
+    // Показываем индикатор сканирования
+    const scanButton = document.getElementById('scan-wifi-btn');
+    const scanStatus = document.getElementById('scan-status');
+    const scanStatusText = document.getElementById('scan-status-text');
+    
+    scanButton.disabled = true;
+    scanStatus.style.display = 'block';
+    scanStatusText.textContent = 'Сканирование...';
+    
+    // Очищаем текущий список
+    const networksList = document.getElementById('networks-list');
+    networksList.innerHTML = '<tr><td colspan="5" class="text-center">Запуск сканирования...</td></tr>';
+    
+    // Сначала запускаем сканирование
+    fetch('/scan-start')
+        .then(response => {
+            if (!response.ok) {
+                throw new Error('Ошибка сети');
+            }
+            return response.json();
+        })
+        .then(data => {
+            networksList.innerHTML = '<tr><td colspan="5" class="text-center">Сканирование выполняется...</td></tr>';
+            scanStatusText.textContent = 'Сканирование выполняется...';
+            
+            // Функция для проверки статуса сканирования
+            function checkScanStatus() {
+                fetch('/scan-status')
+                    .then(response => {
+                        if (!response.ok) {
+                            throw new Error('Ошибка сети');
+                        }
+                        return response.json();
+                    })
+                    .then(statusData => {
+                        if (statusData.status === 'scanning') {
+                            // Если сканирование всё еще идет, проверяем снова через 1 секунду
+                            scanStatusText.textContent = 'Сканирование выполняется...';
+                            setTimeout(checkScanStatus, 1000);
+                        } else if (statusData.status === 'ready') {
+                            // Если сканирование завершено, запрашиваем результаты
+                            scanStatusText.textContent = 'Загрузка результатов...';
+                            getNetworkResults();
+                        } else {
+                            // Неожиданный статус
+                            networksList.innerHTML = '<tr><td colspan="5" class="text-center">Ошибка: Неожиданный статус сканирования</td></tr>';
+                            scanButton.disabled = false;
+                            scanStatus.style.display = 'none';
+                            showNotification('Ошибка: Неожиданный статус сканирования', 'error');
+                        }
+                    })
+                    .catch(error => {
+                        console.error('Ошибка при проверке статуса сканирования:', error);
+                        networksList.innerHTML = '<tr><td colspan="5" class="text-center">Ошибка при проверке статуса сканирования</td></tr>';
+                        scanButton.disabled = false;
+                        scanStatus.style.display = 'none';
+                        showNotification('Ошибка при проверке статуса сканирования: ' + error.message, 'error');
+                    });
+            }
+            
+            // Начинаем проверять статус
+            if (data.status === 'started' || data.status === 'scanning') {
+                setTimeout(checkScanStatus, 1000);
+            } else if (data.status === 'ready') {
+                // Если результаты уже готовы, запрашиваем их сразу
+                getNetworkResults();
+            }
+        })
+        .catch(error => {
+            console.error('Ошибка при запуске сканирования:', error);
+            networksList.innerHTML = '<tr><td colspan="5" class="text-center">Ошибка при запуске сканирования</td></tr>';
+            scanButton.disabled = false;
+            scanStatus.style.display = 'none';
+            showNotification('Ошибка при запуске сканирования: ' + error.message, 'error');
+        });
+    
+    // Функция для получения результатов сканирования
+    function getNetworkResults() {
+        fetch('/scan-results')
+            .then(response => {
+            if (!response.ok) {
+                throw new Error('Ошибка сети');
+            }
+            return response.json();
+            })
+            .then(data => {
+            // Обновляем список сетей
+            networksList.innerHTML = '';
+            
+            if (data.networks && data.networks.length > 0) {
+                data.networks.forEach(network => {
+                const row = document.createElement('tr');
+                
+                // SSID
+                const ssidCell = document.createElement('td');
+                ssidCell.textContent = network.ssid || '(Скрытая сеть)';
+                row.appendChild(ssidCell);
+                
+                // Сигнал с визуальным индикатором
+                const rssiCell = document.createElement('td');
+                const signalDiv = document.createElement('div');
+                signalDiv.className = 'align-center';
+                
+                const signalText = document.createElement('span');
+                signalText.textContent = `${network.rssi} dBm`;
+                
+                const signalIndicator = document.createElement('span');
+                signalIndicator.className = 'signal-strength';
+                
+                for (let i = 1; i <= 4; i++) {
+                    const bar = document.createElement('span');
+                    bar.className = `signal-bar bar${i}`;
+                    signalIndicator.appendChild(bar);
+                }
+                
+                if (network.rssi > -50) {
+                    signalIndicator.classList.add('signal-excellent');
+                } else if (network.rssi > -70) {
+                    signalIndicator.classList.add('signal-good');
+                } else if (network.rssi > -80) {
+                    signalIndicator.classList.add('signal-fair');
+                } else {
+                    signalIndicator.classList.add('signal-weak');
+                }
+                
+                signalDiv.appendChild(signalText);
+                signalDiv.appendChild(signalIndicator);
+                rssiCell.appendChild(signalDiv);
+                row.appendChild(rssiCell);
+                
+                // Безопасность
+                const securityCell = document.createElement('td');
+                const securitySpan = document.createElement('span');
+                securitySpan.textContent = network.encryption;
+                
+                if (network.encryption === 'Open') {
+                    securitySpan.className = 'badge warning';
+                } else {
+                    securitySpan.className = 'badge success';
+                }
+                
+                securityCell.appendChild(securitySpan);
+                row.appendChild(securityCell);
+                
+                // Канал
+                const channelCell = document.createElement('td');
+                channelCell.textContent = network.channel;
+                row.appendChild(channelCell);
+                
+                // Кнопка подключения
+                const actionCell = document.createElement('td');
+                const connectBtn = document.createElement('button');
+                connectBtn.textContent = 'Подключиться';
+                connectBtn.className = 'primary';
+                connectBtn.addEventListener('click', function() {
+                    // Заполняем форму подключения данными выбранной сети
+                    document.getElementById('ssid').value = network.ssid;
+                    document.getElementById('password').focus();
+                    
+                    // Прокручиваем до формы подключения
+                    document.getElementById('connect-form').scrollIntoView({
+                    behavior: 'smooth'
+                    });
+                });
+                actionCell.appendChild(connectBtn);
+                row.appendChild(actionCell);
+                
+                networksList.appendChild(row);
+                });
+            } else {
+                networksList.innerHTML = '<tr><td colspan="5" class="text-center">Сети не найдены</td></tr>';
+            }
+            
+            // Обновляем статус
+            scanButton.disabled = false;
+            scanStatus.style.display = 'none';
+            showNotification('Сканирование WiFi сетей завершено', 'success');
+            })
+            .catch(error => {
+            // Отображаем ошибку
+            networksList.innerHTML = '<tr><td colspan="5" class="text-center">Ошибка при получении результатов сканирования</td></tr>';
+            console.error('Ошибка при получении результатов сканирования:', error);
+            scanButton.disabled = false;
+            scanStatus.style.display = 'none';
+            showNotification('Ошибка при получении результатов сканирования: ' + error.message, 'error');
+            });
+    }            
+    
+    // Функция для загрузки конкретной страницы результатов
+    function loadNetworkPage(page) {
+        scanButton.disabled = true;
+        scanStatus.style.display = 'block';
+        scanStatusText.textContent = 'Загрузка страницы ' + (page + 1) + '...';
+        
+        networksList.innerHTML = '<tr><td colspan="5" class="text-center">Загрузка страницы ' + (page + 1) + '...</td></tr>';
+        
+        fetch(`/scan-results?page=${page}&size=10`)
+            .then(response => {
+                if (!response.ok) {
+                    throw new Error('Ошибка сети');
+                }
+                return response.json();
+            })
+            .then(data => {
+                getNetworkResults();
+            })
+            .catch(error => {
+                networksList.innerHTML = '<tr><td colspan="5" class="text-center">Ошибка при загрузке страницы</td></tr>';
+                console.error('Ошибка при загрузке страницы:', error);
+                scanButton.disabled = false;
+                scanStatus.style.display = 'none';
+                showNotification('Ошибка при загрузке страницы: ' + error.message, 'error');
+            });
+    }
+}
+
+// Функция для подключения к сети
+function connectToNetwork() {
+    const ssid = document.getElementById('ssid').value;
+    const password = document.getElementById('password').value;
+    
+    if (!ssid) {
+        showNotification('Введите SSID сети', 'warning');
+        return;
+    }
+    
+    showNotification(`Подключение к сети ${ssid}...`, 'info');
+    
+    const formData = new FormData();
+    formData.append('ssid', ssid);
+    formData.append('password', password);
+    
+    fetch('/connect', {
+        method: 'POST',
+        body: formData
+    })
+    .then(response => {
+        if (!response.ok) {
+            throw new Error('Ошибка сети');
+        }
+        return response.text();
+    })
+    .then(result => {
+        showNotification(`Подключение к сети ${ssid} инициировано`, 'success');
+        
+        // Очищаем форму
+        document.getElementById('password').value = '';
+        
+        // Перезагружаем список сохраненных сетей
+        setTimeout(() => {
+            loadSavedNetworks();
+            refreshStatus();
+        }, 5000);
+    })
+    .catch(error => {
+        console.error('Ошибка при подключении к сети:', error);
+        showNotification('Ошибка при подключении к сети: ' + error.message, 'error');
+    });
+}
+
+// Функция для загрузки настроек точки доступа
+function loadAPSettings() {
+    fetch('/ap')
+        .then(response => {
+            if (!response.ok) {
+                throw new Error('Ошибка сети');
+            }
+            return response.json();
+        })
+        .then(data => {
+            // Заполняем форму настроек AP
+            document.getElementById('ap-mode').value = data.mode;
+            document.getElementById('ap-ssid').value = data.ssid;
+            document.getElementById('ap-password').value = ''; // Пароль не загружаем по соображениям безопасности
+            document.getElementById('ap-channel').value = data.channel;
+            
+            // Отображаем раздел honeypot если выбран соответствующий режим
+            const honeypotSection = document.getElementById('honeypot-section');
+            if (data.mode === 4) {
+                honeypotSection.style.display = 'block';
+                getHoneypotLogs();
+            } else {
+                honeypotSection.style.display = 'none';
+            }
+        })
+        .catch(error => {
+            console.error('Ошибка при загрузке настроек AP:', error);
+            showNotification('Ошибка при загрузке настроек точки доступа: ' + error.message, 'error');
+        });
+}
+
+// Функция для обновления настроек точки доступа
+function updateAPSettings() {
+    const formData = new FormData();
+    formData.append('mode', document.getElementById('ap-mode').value);
+    formData.append('ssid', document.getElementById('ap-ssid').value);
+    formData.append('password', document.getElementById('ap-password').value);
+    formData.append('channel', document.getElementById('ap-channel').value);
+    
+    // Показываем уведомление
+    showNotification('Обновление настроек точки доступа...', 'info');
+    
+    fetch('/ap/config', {
+        method: 'POST',
+        body: formData
+    })
+    .then(response => {
+        if (!response.ok) {
+            throw new Error('Ошибка сети');
+        }
+        return response.text();
+    })
+    .then(result => {
+        showNotification(result, 'success');
+        // Обновляем статус
+        refreshStatus();
+        loadAPSettings();
+    })
+    .catch(error => {
+        console.error('Ошибка при обновлении настроек AP:', error);
+        showNotification('Ошибка при обновлении настроек точки доступа: ' + error.message, 'error');
+    });
+}
+
+// Функция для получения логов honeypot
+function getHoneypotLogs() {
+    fetch('/ap/honeypot/logs')
+        .then(response => {
+            if (!response.ok) {
+                throw new Error('Ошибка сети');
+            }
+            return response.json();
+        })
+        .then(data => {
+            const logsDiv = document.getElementById('honeypot-logs');
+            
+            if (data.logs && data.logs.length > 0) {
+                let logsHTML = '<table><tr><th>IP</th><th>Порт</th><th>Время</th><th>Данные</th></tr>';
+                
+                data.logs.forEach(log => {
+                    const date = new Date(log.timestamp);
+                    logsHTML += `<tr>
+                        <td>${log.ip}</td>
+                        <td>${log.port}</td>
+                        <td>${date.toLocaleString()}</td>
+                        <td>${log.data}</td>
+                    </tr>`;
+                });
+                
+                logsHTML += '</table>';
+                logsDiv.innerHTML = logsHTML;
+            } else {
+                logsDiv.innerHTML = '<p>Нет записей</p>';
+            }
+        })
+        .catch(error => {
+            console.error('Ошибка при получении логов honeypot:', error);
+            document.getElementById('honeypot-logs').innerHTML = '<p>Ошибка при загрузке логов</p>';
+            showNotification('Ошибка при получении логов Honeypot: ' + error.message, 'error');
+        });
+}
+
+// Функция для загрузки KVM пинов
+function loadKVMPins() {
+    const pinsList = document.getElementById('pins-list');
+    pinsList.innerHTML = '<p class="text-center">Загрузка пинов...</p>';
+    
+    fetch('/kvm')
+        .then(response => {
+            if (!response.ok) {
+                throw new Error('Ошибка сети');
+            }
+            return response.json();
+        })
+        .then(data => {
+            // Заполняем настройки интервала проверки соединения
+            document.getElementById('connection-check').value = data.connectionCheck;
+            
+            pinsList.innerHTML = '';
+            
+            if (data.pins && data.pins.length > 0) {
+                data.pins.forEach((pin, index) => {
+                    const pinCard = document.createElement('div');
+                    pinCard.className = 'pin-card';
+                    
+                    // Информация о пине
+                    const pinInfo = document.createElement('div');
+                    pinInfo.className = 'pin-info';
+                    pinInfo.innerHTML = `<strong>${pin.name}</strong><br>Пин #${pin.pin}`;
+                    pinCard.appendChild(pinInfo);
+                    
+                    // Режим мониторинга
+                    const monitorDiv = document.createElement('div');
+                    monitorDiv.innerHTML = `
+                        <label>Мониторинг:
+                            <select class="monitor-select" data-index="${index}">
+                                <option value="0" ${pin.monitorMode == 0 ? 'selected' : ''}>Выкл</option>
+                                <option value="1" ${pin.monitorMode == 1 ? 'selected' : ''}>Вкл</option>
+                                <option value="2" ${pin.monitorMode == 2 ? 'selected' : ''}>Звук</option>
+                            </select>
+                        </label>
+                    `;
+                    pinCard.appendChild(monitorDiv);
+                    
+                    // Состояние пина
+                    const pinState = document.createElement('div');
+                    pinState.className = `pin-state ${pin.state ? 'on' : 'off'}`;
+                    
+                    // Если режим инвертирован, отображаем обратное состояние
+                    if (isPinInverted) {
+                        pinState.textContent = pin.state ? 'ВЫКЛ' : 'ВКЛ';
+                        pinState.className = `pin-state ${pin.state ? 'off' : 'on'}`;
+                    } else {
+                        pinState.textContent = pin.state ? 'ВКЛ' : 'ВЫКЛ';
+                    }
+                    
+                    pinCard.appendChild(pinState);
+                    
+                    // Элементы управления пином
+                    const pinControls = document.createElement('div');
+                    pinControls.className = 'pin-controls';
+                    
+                    // Переключатель состояния
+                    const toggleContainer = document.createElement('div');
+                    toggleContainer.innerHTML = `
+                        <label class="toggle-btn">
+                            <input type="checkbox" class="pin-toggle" data-index="${index}" ${pin.state ? 'checked' : ''}>
+                            <span class="slider"></span>
+                        </label>
+                    `;
+                    pinControls.appendChild(toggleContainer);
+                    
+                    // Управление импульсом
+                    const pulseControl = document.createElement('div');
+                    pulseControl.className = 'pulse-control';
+                    pulseControl.innerHTML = `
+                        <input type="number" id="pin-pulse-duration-${index}" 
+                               class="pulse-duration" 
+                               value="500" 
+                               min="50" 
+                               max="10000" 
+                               placeholder="мс">
+                        <button class="pulse-button" 
+                                onclick="sendPulseToPin(${index})"
+                                title="Отправить импульс">
+                            ⚡ Импульс
+                        </button>
+                    `;
+                    pinControls.appendChild(pulseControl);
+                    
+                    pinCard.appendChild(pinControls);
+                    pinsList.appendChild(pinCard);
+                });
+                
+                // Добавляем обработчики событий для переключателей и выпадающих списков
+                document.querySelectorAll('.pin-toggle').forEach(toggle => {
+                    toggle.addEventListener('change', function() {
+                        const pinIndex = this.getAttribute('data-index');
+                        togglePin(pinIndex);
+                    });
+                });
+                
+                document.querySelectorAll('.monitor-select').forEach(select => {
+                    select.addEventListener('change', function() {
+                        const pinIndex = this.getAttribute('data-index');
+                        changeMonitorMode(pinIndex, this.value);
+                    });
+                });
+            } else {
+                pinsList.innerHTML = '<p class="text-center">Нет настроенных пинов. Добавьте новый пин ниже.</p>';
+            }
+        })
+        .catch(error => {
+            pinsList.innerHTML = '<p class="text-center">Ошибка при загрузке пинов</p>';
+            console.error('Ошибка при загрузке KVM пинов:', error);
+            showNotification('Ошибка при загрузке KVM пинов: ' + error.message, 'error');
+        });
+}
+
+// Функция для изменения режима мониторинга пина
+function changeMonitorMode(pinIndex, mode) {
+    const formData = new FormData();
+    formData.append('index', pinIndex);
+    formData.append('monitor', mode);
+    
+    fetch('/kvm/pin', {
+        method: 'POST',
+        body: formData
+    })
+    .then(response => {
+        if (!response.ok) {
+            throw new Error('Ошибка сети');
+        }
+        return response.text();
+    })
+    .then(result => {
+        // Успешно обновлено
+        showNotification(`Режим мониторинга пина ${parseInt(pinIndex) + 1} изменен`, 'success');
+    })
+    .catch(error => {
+        console.error('Ошибка при изменении режима мониторинга:', error);
+        showNotification('Ошибка при изменении режима мониторинга: ' + error.message, 'error');
+        loadKVMPins(); // Перезагружаем пины для восстановления правильного состояния
+    });
+}
+
+// Функция для переключения состояния пина
+function togglePin(pinIndex) {
+    // Формируем данные для отправки
+    const formData = new FormData();
+    formData.append('index', pinIndex);
+    
+    // Отправляем запрос
+    fetch('/kvm/pin', {
+        method: 'POST',
+        body: formData
+    })
+    .then(response => {
+        if (!response.ok) {
+            throw new Error('Ошибка сети');
+        }
+        return response.text();
+    })
+    .then(result => {
+        // Обновляем список пинов
+        showNotification(`Состояние пина ${parseInt(pinIndex) + 1} изменено`, 'success');
+        loadKVMPins();
+    })
+    .catch(error => {
+        console.error('Ошибка при переключении пина:', error);
+        showNotification('Ошибка при переключении пина: ' + error.message, 'error');
+        // Обновляем список пинов для отображения текущего состояния
+        loadKVMPins();
+    });
+}
+
+// Функция для обновления интервала проверки соединения
+function updateConnectionCheck() {
+    const interval = document.getElementById('connection-check').value;
+    
+    fetch('/kvm/connectioncheck', {
+        method: 'POST',
+        body: new URLSearchParams({
+            'interval': interval
+        })
+    })
+    .then(response => {
+        if (!response.ok) {
+            throw new Error('Ошибка сети');
+        }
+        return response.text();
+    })
+    .then(result => {
+        showNotification(result, 'success');
+    })
+    .catch(error => {
+        console.error('Ошибка при обновлении интервала проверки:', error);
+        showNotification('Ошибка при обновлении интервала проверки: ' + error.message, 'error');
+    });
+}
+
+// Функция для добавления нового пина
+function addNewPin() {
+    const pinNumber = document.getElementById('pin-select').value;
+    const pinName = document.getElementById('pin-name').value;
+    
+    // Проверки
+    if (!pinNumber) {
+        showNotification('Выберите пин из списка', 'warning');
+        return;
+    }
+    
+    if (!pinName) {
+        showNotification('Введите название пина', 'warning');
+        return;
+    }
+    
+    // Формируем данные для отправки
+    const formData = new FormData();
+    formData.append('pin', pinNumber);
+    formData.append('name', pinName);
+    
+    // Отправляем запрос
+    fetch('/kvm/add', {
+        method: 'POST',
+        body: formData
+    })
+    .then(response => {
+        if (!response.ok) {
+            return response.text().then(text => { throw new Error(text) });
+        }
+        return response.text();
+    })
+    .then(result => {
+        showNotification(result, 'success');
+        
+        // Очищаем форму
+        document.getElementById('pin-select').value = '';
+        document.getElementById('pin-name').value = '';
+        
+        // Обновляем список пинов
+        loadKVMPins();
+        loadAvailablePins();
+    })
+    .catch(error => {
+        console.error('Ошибка при добавлении пина:', error);
+        showNotification('Ошибка: ' + error.message, 'error');
+    });
+}
+
+// Функция для загрузки информации об устройстве
+function loadDeviceInfo() {
+    const deviceDetails = document.getElementById('device-details');
+    deviceDetails.innerHTML = '<p class="text-center">Загрузка информации...</p>';
+    
+    fetch('/diagnostic')
+        .then(response => {
+            if (!response.ok) {
+                throw new Error('Ошибка сети');
+            }
+            return response.json();
+        })
+        .then(data => {
+            let html = '<table>';
+            
+            // Информация о железе и программном обеспечении
+            html += '<tr><th colspan="2">Железо</th></tr>';
+            html += `<tr><td>Модель</td><td>M5StickC PLUS2</td></tr>`;
+            html += `<tr><td>Батарея</td><td>${data.battery ? data.battery.toFixed(2) + 'V' : 'N/A'}</td></tr>`;
+            
+            // Информация о WiFi
+            html += '<tr><th colspan="2">WiFi</th></tr>';
+            if (data.connected) {
+                html += `<tr><td>SSID</td><td>${data.ssid}</td></tr>`;
+                html += `<tr><td>Сигнал</td><td>${data.rssi} dBm</td></tr>`;
+                html += `<tr><td>IP-адрес</td><td>${data.ip}</td></tr>`;
+                html += `<tr><td>Маска подсети</td><td>${data.subnet}</td></tr>`;
+                html += `<tr><td>Шлюз</td><td>${data.gateway}</td></tr>`;
+                html += `<tr><td>DNS</td><td>${data.dns}</td></tr>`;
+            } else {
+                html += `<tr><td colspan="2">Не подключено к WiFi</td></tr>`;
+            }
+            
+            // Информация о точке доступа
+            html += '<tr><th colspan="2">Точка доступа</th></tr>';
+            if (data.ap_mode !== undefined && data.ap_mode > 0) {
+                let apModeName = 'Неизвестно';
+                switch(data.ap_mode) {
+                    case 1: apModeName = 'Обычный'; break;
+                    case 2: apModeName = 'Ретранслятор'; break;
+                    case 3: apModeName = 'Скрытый'; break;
+                    case 4: apModeName = 'Honeypot'; break;
+                }
+                
+                html += `<tr><td>Режим</td><td>${apModeName}</td></tr>`;
+                html += `<tr><td>SSID</td><td>${data.ap_ssid}</td></tr>`;
+                html += `<tr><td>IP-адрес</td><td>${data.ap_ip}</td></tr>`;
+                html += `<tr><td>Подключено клиентов</td><td>${data.ap_stations}</td></tr>`;
+            } else {
+                html += `<tr><td colspan="2">Точка доступа выключена</td></tr>`;
+            }
+            
+            html += '</table>';
+            deviceDetails.innerHTML = html;
+        })
+        .catch(error => {
+            console.error('Ошибка при загрузке информации об устройстве:', error);
+            deviceDetails.innerHTML = '<p class="text-center">Ошибка при загрузке информации</p>';
+            showNotification('Ошибка при загрузке информации об устройстве: ' + error.message, 'error');
+        });
+}
+
+// Функция для загрузки настроек устройства
+function loadDeviceSettings() {
+    fetch('/device')
+        .then(response => {
+            if (!response.ok) {
+                throw new Error('Ошибка сети');
+            }
+            return response.json();
+        })
+        .then(data => {
+            document.getElementById('brightness').value = data.brightness;
+            document.getElementById('brightness-value').textContent = data.brightness + '%';
+            
+            document.getElementById('sleep-timeout').value = data.sleepTimeout;
+            document.getElementById('device-id').value = data.deviceId;
+            document.getElementById('rotate-display').checked = data.rotateDisplay;
+            
+            document.getElementById('volume').value = data.volume;
+            document.getElementById('volume-value').textContent = data.volume + '%';
+        })
+        .catch(error => {
+            console.error('Ошибка при загрузке настроек устройства:', error);
+            showNotification('Ошибка при загрузке настроек устройства: ' + error.message, 'error');
+        });
+}
+
+// Функция для сохранения настроек устройства
+function saveDeviceSettings() {
+    const formData = new FormData();
+    formData.append('brightness', document.getElementById('brightness').value);
+    formData.append('sleepTimeout', document.getElementById('sleep-timeout').value);
+    formData.append('deviceId', document.getElementById('device-id').value);
+    formData.append('rotateDisplay', document.getElementById('rotate-display').checked ? 1 : 0);
+    formData.append('volume', document.getElementById('volume').value);
+    
+    fetch('/device/settings', {
+        method: 'POST',
+        body: formData
+    })
+    .then(response => {
+        if (!response.ok) {
+            throw new Error('Ошибка сети');
+        }
+        return response.text();
+    })
+    .then(result => {
+        showNotification('Настройки устройства сохранены', 'success');
+    })
+    .catch(error => {
+        console.error('Ошибка при сохранении настроек устройства:', error);
+        showNotification('Ошибка при сохранении настроек устройства: ' + error.message, 'error');
+    });
+}
+
+// Функция активации звукового сигнала "Найти меня"
+function findMe() {
+    fetch('/device/findme', {
+        method: 'POST'
+    })
+    .then(response => {
+        if (!response.ok) {
+            throw new Error('Ошибка сети');
+        }
+        return response.text();
+    })
+    .then(result => {
+        showNotification('Звуковой сигнал активирован', 'success');
+    })
+    .catch(error => {
+        console.error('Ошибка при активации сигнала:', error);
+        showNotification('Ошибка при активации сигнала: ' + error.message, 'error');
+    });
+}
+
+// Функция перезагрузки устройства
+function resetDevice() {
+    if (confirm('Вы уверены, что хотите перезагрузить устройство?')) {
+        fetch('/device/reset', {
+            method: 'POST'
+        })
+        .then(response => {
+            if (!response.ok) {
+                throw new Error('Ошибка сети');
+            }
+            return response.text();
+        })
+        .then(result => {
+            showNotification('Устройство перезагружается...', 'info');
+            // Таймер для обновления страницы после перезагрузки устройства
+            setTimeout(() => {
+                window.location.reload();
+            }, 10000);
+        })
+        .catch(error => {
+            console.error('Ошибка при перезагрузке устройства:', error);
+            showNotification('Ошибка при перезагрузке устройства: ' + error.message, 'error');
+        });
+    }
+}
+
+// Проверка доступности сетевых инструментов
+function checkNetworkTools() {
+    if (!isAPModeActive) {
+        document.getElementById('ip-block-section').style.display = 'none';
+    } else {
+        document.getElementById('ip-block-section').style.display = 'block';
+        loadBlockedIPs();
+    }
+}
+
+// Загрузка списка заблокированных IP
+function loadBlockedIPs() {
+    fetch('/network/blocked')
+        .then(response => {
+            if (!response.ok) {
+                throw new Error('Ошибка сети');
+            }
+            return response.json();
+        })
+        .then(data => {
+            const blockedIPsDiv = document.getElementById('blocked-ips');
+            
+            if (data.blocked && data.blocked.length > 0) {
+                let html = '<ul>';
+                data.blocked.forEach(ip => {
+                    html += `<li>${ip} <button class="danger" onclick="unblockIP('${ip}')">Разблокировать</button></li>`;
+                });
+                html += '</ul>';
+                blockedIPsDiv.innerHTML = html;
+            } else {
+                blockedIPsDiv.innerHTML = '<p>Нет заблокированных IP-адресов</p>';
+            }
+        })
+        .catch(error => {
+            console.error('Ошибка при загрузке списка заблокированных IP:', error);
+            document.getElementById('blocked-ips').innerHTML = '<p>Ошибка при загрузке списка заблокированных IP</p>';
+        });
+}
+
+// Ожидание завершения задания на устройстве (/jobs/{id}).
+// Возвращает Promise с результатом задания
+function waitForJob(jobId, onProgress) {
+    return new Promise((resolve, reject) => {
+        const poll = () => {
+            fetch(`/jobs/${jobId}`)
+            .then(response => {
+                if (!response.ok) {
+                    throw new Error('Задание не найдено');
+                }
+                return response.json();
+            })
+            .then(job => {
+                if (onProgress) {
+                    onProgress(job);
+                }
+                
+                if (job.status === 'queued' || job.status === 'running') {
+                    setTimeout(poll, 300);
+                } else if (job.status === 'done') {
+                    resolve(job.result || {});
+                } else {
+                    reject(new Error(job.error || (job.status === 'cancelled' ? 'Задание отменено' : 'Ошибка задания')));
+                }
+            })
+            .catch(reject);
+        };
+        poll();
+    });
+}
+
+// Постановка задания: POST-запрос, ответ 202 с идентификатором задания
+function submitJob(url, body) {
+    return fetch(url, {
+        method: 'POST',
+        headers: {
+            'Content-Type': 'application/x-www-form-urlencoded',
+        },
+        body: body
+    })
+    .then(response => response.json().then(data => {
+        if (response.status === 503) {
+            throw new Error('Очередь заданий заполнена, повторите позже');
+        }
+        if (!response.ok) {
+            throw new Error(data.error || data.message || 'Ошибка сети');
+        }
+        return data;
+    }));
+}
+
+// Функция для выполнения Ping
+function pingHost() {
+    const host = document.getElementById('ping-host').value;
+    
+    if (!host) {
+        showNotification('Введите хост для Ping', 'warning');
+        return;
+    }
+    
+    const resultDiv = document.getElementById('ping-result');
+    resultDiv.innerHTML = '<div class="loader" style="display: block;"></div>';
+    
+    submitJob('/network/ping', `host=${encodeURIComponent(host)}`)
+    .then(job => waitForJob(job.jobId))
+    .then(data => {
+        let resultHTML = '<div class="status info">';
+        
+        if (data.success) {
+            resultHTML += `<p>Ping к ${host} успешен</p>`;
+            resultHTML += `<p>IP: ${data.ip}</p>`;
+            resultHTML += `<p>Среднее время: ${data.time} мс</p>`;
+            resultHTML += `<p>Потеря пакетов: ${data.loss}%</p>`;
+        } else {
+            resultHTML += `<p>Ошибка при выполнении ping к ${host}</p>`;
+            if (data.error) {
+                resultHTML += `<p>Ошибка: ${data.error}</p>`;
+            }
+        }
+        
+        resultHTML += '</div>';
+        resultDiv.innerHTML = resultHTML;
+    })
+    .catch(error => {
+        console.error('Ошибка при выполнении ping:', error);
+        resultDiv.innerHTML = `
+            <div class="status error">
+                <p>Ошибка при выполнении ping: ${error.message}</p>
+            </div>
+        `;
+    });
+}
+
+// Функция для сканирования диапазона IP
+function scanIPRange() {
+    const prefix = document.getElementById('ip-prefix').value;
+    
+    if (!prefix) {
+        showNotification('Введите префикс сети для сканирования', 'warning');
+        return;
+    }
+    
+    const progressDiv = document.getElementById('ip-scan-progress');
+    const progressBar = document.getElementById('ip-scan-progress-bar');
+    const progressStatus = document.getElementById('ip-scan-status');
+    const resultDiv = document.getElementById('ip-scan-result');
+    
+    progressDiv.style.display = 'block';
+    resultDiv.innerHTML = 'Сканирование...';
+    
+    fetch('/network/sweep-start', {
+        method: 'POST',
+        headers: {
+            'Content-Type': 'application/x-www-form-urlencoded',
+        },
+        body: `range=${encodeURIComponent(prefix)}`
+    })
+    .then(response => {
+        if (response.status === 429) {
+            throw new Error('Сканирование уже выполняется');
+        }
+        if (!response.ok) {
+            throw new Error('Некорректный префикс сети');
+        }
+        return response.json();
+    })
+    .then(() => {
+        // Опрашиваем статус, пока сканирование идет в фоне на устройстве
+        const pollStatus = () => {
+            fetch('/network/sweep-status')
+            .then(response => response.json())
+            .then(status => {
+                const progress = status.total ? (status.completed / status.total) * 100 : 0;
+                progressBar.style.width = `${progress}%`;
+                progressStatus.textContent = `Сканирование: ${status.completed}/${status.total}, найдено: ${status.found}`;
+                
+                if (status.status === 'scanning') {
+                    setTimeout(pollStatus, 500);
+                    return;
+                }
+                
+                fetch('/network/sweep-results')
+                .then(response => response.json())
+                .then(data => {
+                    progressDiv.style.display = 'none';
+                    displayScanResults(data.hosts || []);
+                });
+            })
+            .catch(error => {
+                console.error('Ошибка при получении статуса сканирования:', error);
+                setTimeout(pollStatus, 1000);
+            });
+        };
+        pollStatus();
+    })
+    .catch(error => {
+        progressDiv.style.display = 'none';
+        resultDiv.innerHTML = `<div class="status error"><p>${error.message}</p></div>`;
+    });
+}
+
+function displayScanResults(results) {
+    const resultDiv = document.getElementById('ip-scan-result');
+    let resultHTML = '';
+    
+    if (results.length > 0) {
+        resultHTML = '<table><tr><th>IP-адрес</th><th>Статус</th><th>Время отклика</th></tr>';
+        
+        results.forEach(host => {
+            resultHTML += `<tr>
+                <td>${host.ip}</td>
+                <td><span class="badge success">Активен</span></td>
+                <td>${host.time ? host.time + ' мс' : '-'}</td>
+            </tr>`;
+        });
+        
+        resultHTML += '</table>';
+    } else {
+        resultHTML = '<div class="status warning"><p>Активные хосты не найдены</p></div>';
+    }
+    
+    resultDiv.innerHTML = resultHTML;
+}
+
+// Функция для сканирования портов
+function scanPorts() {
+    const ip = document.getElementById('port-scan-ip').value;
+    const startPort = document.getElementById('port-scan-start').value;
+    const endPort = document.getElementById('port-scan-end').value;
+    
+    if (!ip) {
+        showNotification('Введите IP-адрес для сканирования портов', 'warning');
+        return;
+    }
+    
+    const resultDiv = document.getElementById('port-scan-result');
+    resultDiv.innerHTML = `
+        <div id="port-scan-progress" class="status info"><p>Подготовка сканирования...</p></div>
+        <table id="port-scan-table" style="display: none;"><tr><th>Порт</th><th>Статус</th><th>Сервис</th></tr></table>
+    `;
+    
+    const progressEl = document.getElementById('port-scan-progress');
+    const tableEl = document.getElementById('port-scan-table');
+    let openCount = 0;
+    
+    // Открытые порты приходят по мере обнаружения через SSE
+    const events = new EventSource('/network/portscan/events');
+    
+    events.addEventListener('port', event => {
+        const port = JSON.parse(event.data);
+        const row = tableEl.insertRow(-1);
+        row.innerHTML = `
+            <td>${port.port}</td>
+            <td><span class="badge success">Открыт</span></td>
+            <td>${port.service || 'Неизвестно'}</td>
+        `;
+        tableEl.style.display = '';
+        openCount++;
+    });
+    
+    events.addEventListener('progress', event => {
+        const progress = JSON.parse(event.data);
+        progressEl.innerHTML = `<p>Сканирование ${ip}: ${progress.scanned}/${progress.total}, открыто: ${progress.open}</p>`;
+    });
+    
+    events.addEventListener('done', event => {
+        const result = JSON.parse(event.data);
+        events.close();
+        
+        if (result.status === 'error') {
+            progressEl.className = 'status error';
+            progressEl.innerHTML = '<p>Ошибка при сканировании портов</p>';
+        } else if (openCount > 0) {
+            progressEl.className = 'status success';
+            progressEl.innerHTML = `<p>Сканирование портов для ${ip} завершено за ${(result.elapsed / 1000).toFixed(1)} с. Найдено открытых портов: ${openCount}</p>`;
+        } else {
+            progressEl.className = 'status warning';
+            progressEl.innerHTML = `<p>Открытые порты не найдены для ${ip}</p>`;
+        }
+    });
+    
+    // Запускаем сканирование после подключения к потоку, чтобы не пропустить результаты
+    events.addEventListener('open', () => {
+        submitJob('/network/portscan', `ip=${encodeURIComponent(ip)}&startPort=${startPort}&endPort=${endPort}`)
+        .then(job => waitForJob(job.jobId))
+        .catch(error => {
+            console.error('Ошибка при сканировании портов:', error);
+            events.close();
+            progressEl.className = 'status error';
+            progressEl.innerHTML = `<p>Ошибка при сканировании портов: ${error.message}</p>`;
+        });
+    }, { once: true });
+}
+
+// Функция для блокировки IP
+function blockIP() {
+    const ip = document.getElementById('block-ip').value;
+    
+    if (!ip) {
+        showNotification('Введите IP-адрес для блокировки', 'warning');
+        return;
+    }
+    
+    if (!isAPModeActive) {
+        showNotification('Блокировка IP доступна только в режиме точки доступа', 'warning');
+        return;
+    }
+    
+    fetch('/network/block', {
+        method: 'POST',
+        body: new URLSearchParams({
+            'ip': ip
+        })
+    })
+    .then(response => {
+        if (!response.ok) {
+            throw new Error('Ошибка сети');
+        }
+        return response.text();
+    })
+    .then(result => {
+        showNotification(`IP-адрес ${ip} заблокирован`, 'success');
+        loadBlockedIPs();
+    })
+    .catch(error => {
+        console.error('Ошибка при блокировке IP:', error);
+        showNotification('Ошибка при блокировке IP: ' + error.message, 'error');
+    });
+}
+
+// Функция для разблокировки IP
+function unblockIP(ip) {
+    if (!isAPModeActive) {
+        showNotification('Разблокировка IP доступна только в режиме точки доступа', 'warning');
+        return;
+    }
+    
+    fetch('/network/unblock', {
+        method: 'POST',
+        body: new URLSearchParams({
+            'ip': ip
+        })
+    })
+    .then(response => {
+        if (!response.ok) {
+            throw new Error('Ошибка сети');
+        }
+        return response.text();
+    })
+    .then(result => {
+        showNotification(`IP-адрес ${ip} разблокирован`, 'success');
+        loadBlockedIPs();
+    })
+    .catch(error => {
+        console.error('Ошибка при разблокировке IP:', error);
+        showNotification('Ошибка при разблокировке IP: ' + error.message, 'error');
+    });
+}
+
+// Функция для загрузки списка пользователей AP
+function loadAPUsers() {
+    const usersList = document.getElementById('ap-users-list');
+    
+    if (!isAPModeActive) {
+        usersList.innerHTML = '<p class="text-center">Точка доступа не активна</p>';
+        return;
+    }
+    
+    usersList.innerHTML = '<p class="text-center">Загрузка списка пользователей...</p>';
+    
+    fetch('/ap/users')
+        .then(response => {
+            if (!response.ok) {
+                throw new Error('Ошибка сети');
+            }
+            return response.json();
+        })
+        .then(data => {
+            if (data.users && data.users.length > 0) {
+                let html = '';
+                
+                data.users.forEach(user => {
+                    html += `
+                        <div class="ap-user-card" id="user-${user.ip.replace(/\./g, '-')}">
+                            <div class="ap-user-info">
+                                <h4>${user.ip}</h4>
+                                <div>MAC: ${user.mac}</div>
+                                <div>Общий трафик: ${user.totalBytes} байт</div>
+                                <div>Последняя активность: ${new Date(user.lastSeen).toLocaleString()}</div>
+                            </div>
+                            <div class="ap-user-controls">
+                                <button class="primary" onclick="showUserDetails('${user.ip}')">Подробнее</button>
+                                <button class="${user.blocked ? 'success' : 'danger'}" 
+                                        onclick="toggleUserBlock('${user.ip}', ${!user.blocked})">
+                                    ${user.blocked ? 'Разблокировать' : 'Заблокировать'}
+                                </button>
+                            </div>
+                        </div>
+                        <div id="user-details-${user.ip.replace(/\./g, '-')}" class="user-details-section hidden">
+                            <div>
+                                <h5>Информация о пользователе</h5>
+                                <table>
+                                    <tr><td>IP:</td><td>${user.ip}</td></tr>
+                                    <tr><td>MAC:</td><td>${user.mac}</td></tr>
+                                    <tr><td>Общий трафик:</td><td>${user.totalBytes} байт</td></tr>
+                                    <tr><td>Последняя активность:</td><td>${new Date(user.lastSeen).toLocaleString()}</td></tr>
+                                    <tr><td>Статус:</td><td>${user.blocked ? 'Заблокирован' : 'Активен'}</td></tr>
+                                </table>
+                            </div>
+                            <div>
+                                <h5>Трафик</h5>
+                                <button class="primary" onclick="startSniffing('${user.ip}')">Начать сниффинг</button>
+                                <button class="danger" onclick="stopSniffing()">Остановить сниффинг</button>
+                                <div id="traffic-display-${user.ip.replace(/\./g, '-')}" class="traffic-display"></div>
+                            </div>
+                        </div>
+                    `;
+                });
+                
+                usersList.innerHTML = html;
+            } else {
+                usersList.innerHTML = '<p class="text-center">Нет подключенных пользователей</p>';
+            }
+        })
+        .catch(error => {
+            console.error('Ошибка при загрузке списка пользователей:', error);
+            usersList.innerHTML = '<p class="text-center">Ошибка при загрузке списка пользователей</p>';
+            showNotification('Ошибка при загрузке списка пользователей: ' + error.message, 'error');
+        });
+}
+
+// Функция для показа деталей пользователя
+function showUserDetails(ip) {
+    const detailsDiv = document.getElementById(`user-details-${ip.replace(/\./g, '-')}`);
+    if (detailsDiv) {
+        detailsDiv.classList.toggle('hidden');
+    }
+}
+
+// Функция для переключения блокировки пользователя
+function toggleUserBlock(ip, block) {
+    fetch('/ap/users/block', {
+        method: 'POST',
+        headers: {
+            'Content-Type': 'application/x-www-form-urlencoded',
+        },
+        body: `ip=${encodeURIComponent(ip)}&blocked=${block ? 1 : 0}`
+    })
+    .then(response => {
+        if (!response.ok) {
+            throw new Error('Ошибка сети');
+        }
+        return response.json();
+    })
+    .then(data => {
+        if (data.success) {
+            showNotification(`Пользователь ${ip} ${block ? 'заблокирован' : 'разблокирован'}`, 'success');
+            loadAPUsers();
+        } else {
+            showNotification(`Ошибка: ${data.error}`, 'error');
+        }
+    })
+    .catch(error => {
+        console.error('Ошибка при изменении блокировки пользователя:', error);
+        showNotification('Ошибка при изменении блокировки пользователя: ' + error.message, 'error');
+    });
+}
+
+// Подписка на трафик и пакеты клиента, которого прослушиваем
+function watchSniffTraffic(ip, trafficDisplay) {
+    unwatchSniffTraffic();
+
+    const state = { totalBytes: 0, sniffedPackets: 0, lastPacketInfo: '' };
+    const render = () => {
+        if (!trafficDisplay) {
+            return;
+        }
+        trafficDisplay.innerHTML = `
+            <div><strong>Общий трафик:</strong> ${state.totalBytes} байт</div>
+            <div><strong>Обновлено:</strong> ${new Date().toLocaleTimeString()}</div>
+            <div class="divider"></div>
+            <div><strong>Сниффинг активен</strong></div>
+            <div><strong>Перехвачено пакетов:</strong> ${state.sniffedPackets}</div>
+            <div><strong>Информация о пакете:</strong> ${state.lastPacketInfo || 'Нет данных'}</div>
+            <div><a href="/ap/users/sniff/pcap" download="capture.pcap">Скачать PCAP</a>
+                | <a href="/ap/users/sniff/pcap?live=1" download="live.pcap">Поток PCAP</a></div>
+        `;
+    };
+
+    const onTraffic = (message) => {
+        const client = message.clients.find(c => c.ip === ip);
+        if (client) {
+            state.totalBytes = client.bytes;
+            render();
+        }
+    };
+    const onSniff = (message) => {
+        state.sniffedPackets = message.total;
+        const last = message.packets[message.packets.length - 1];
+        if (last) {
+            state.lastPacketInfo = `To:${last.dst} Type:${last.type} Size:${last.size}`;
+        }
+        render();
+    };
+
+    telemetry.subscribe('traffic', onTraffic);
+    telemetry.subscribe('sniff', onSniff);
+    sniffWatch = { onTraffic, onSniff };
+}
+
+function unwatchSniffTraffic() {
+    if (sniffWatch) {
+        telemetry.unsubscribe('traffic', sniffWatch.onTraffic);
+        telemetry.unsubscribe('sniff', sniffWatch.onSniff);
+        sniffWatch = null;
+    }
+}
+
+// Функция для начала сниффинга трафика
+function startSniffing(ip) {
+    currentUserIP = ip;
+    const trafficDisplay = document.getElementById(`traffic-display-${ip.replace(/\./g, '-')}`);
+    
+    if (trafficDisplay) {
+        trafficDisplay.innerHTML = '<p>Запуск сниффинга...</p>';
+    }
+    
+    // Отправляем запрос на запуск сниффинга
+    fetch('/ap/users/sniff', {
+        method: 'POST',
+        headers: {
+            'Content-Type': 'application/x-www-form-urlencoded',
+        },
+        body: `ip=${encodeURIComponent(ip)}&action=start`
+    })
+    .then(response => response.json())
+    .then(data => {
+        if (data.success) {
+            showNotification('Сниффинг запущен', 'success');
+            // Счетчики и новые пакеты приходят через телеметрию
+            watchSniffTraffic(ip, trafficDisplay);
+        } else {
+            showNotification(`Ошибка запуска сниффинга: ${data.error}`, 'error');
+        }
+    })
+    .catch(error => {
+        console.error('Ошибка при запуске сниффинга:', error);
+        showNotification('Ошибка при запуске сниффинга: ' + error.message, 'error');
+    });
+}
+
+// Функция для остановки сниффинга трафика
+function stopSniffing() {
+    unwatchSniffTraffic();
+    
+    if (currentUserIP) {
+        // Отправляем запрос на остановку сниффинга
+        fetch('/ap/users/sniff', {
+            method: 'POST',
+            headers: {
+                'Content-Type': 'application/x-www-form-urlencoded',
+            },
+            body: `ip=${encodeURIComponent(currentUserIP)}&action=stop`
+        })
+        .then(response => response.json())
+        .then(data => {
+            if (data.success) {
+                showNotification('Сниффинг остановлен', 'success');
+                const trafficDisplay = document.getElementById(`traffic-display-${currentUserIP.replace(/\./g, '-')}`);
+                if (trafficDisplay) {
+                    trafficDisplay.innerHTML = '<p>Сниффинг остановлен</p>';
+                }
+            } else {
+                showNotification(`Ошибка остановки сниффинга: ${data.error}`, 'error');
+            }
+        })
+        .catch(error => {
+            console.error('Ошибка при остановке сниффинга:', error);
+            showNotification('Ошибка при остановке сниффинга: ' + error.message, 'error');
+        });
+        
+        currentUserIP = null;
+    }
+}